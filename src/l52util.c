@@ -180,3 +180,15 @@ void lutil_pushnvalues(lua_State *L, int n){
   int i = -n;
   for(;n;--n) lua_pushvalue(L, i);
 }
+
+int lutil_resume(lua_State *L, lua_State *from, int narg){
+#if LUA_VERSION_NUM >= 504
+  int nres;
+  return lua_resume(L, from, narg, &nres);
+#elif LUA_VERSION_NUM >= 502
+  return lua_resume(L, from, narg);
+#else
+  (void)from;
+  return lua_resume(L, narg);
+#endif
+}
@@ -83,5 +83,7 @@ int64_t lutil_optint64(lua_State *L, int idx, int64_t v);
 
 void lutil_pushnvalues(lua_State *L, int n);
 
+int lutil_resume(lua_State *L, lua_State *from, int narg);
+
 #endif
 
@@ -16,6 +16,9 @@
 #include "lluv_loop.h"
 #include "lluv_fs.h"
 #include "lluv_fbuf.h"
+#include "lluv_bqueue.h"
+#include "lluv_rbuf.h"
+#include "lluv_addr.h"
 #include "lluv_handle.h"
 #include "lluv_stream.h"
 #include "lluv_tcp.h"
@@ -28,9 +31,12 @@
 #include "lluv_signal.h"
 #include "lluv_fs_event.h"
 #include "lluv_fs_poll.h"
+#include "lluv_fs_walk.h"
+#include "lluv_fs_notify.h"
 #include "lluv_process.h"
 #include "lluv_misc.h"
 #include "lluv_dns.h"
+#include "lluv_pool.h"
 
 #define LLUV_VERSION_MAJOR 0
 #define LLUV_VERSION_MINOR 1
@@ -63,9 +69,33 @@ static int lluv_debug_registry(lua_State *L){
   return 2;
 }
 
+/* Services written in Lua (src/lua/lluv) loaded on first call.
+** They use only public API so there no reason to make them C code.
+*/
+static int lluv_call_module(lua_State *L, const char *name){
+  int n = lua_gettop(L);
+  lua_getglobal(L, "require");
+  lua_pushstring(L, name);
+  lua_call(L, 1, 1);
+  lua_insert(L, 1);
+  lua_call(L, n, LUA_MULTRET);
+  return lua_gettop(L);
+}
+
+static int lluv_watch_tree(lua_State *L){
+  return lluv_call_module(L, "lluv.watch_tree");
+}
+
+static int lluv_fs_tail(lua_State *L){
+  return lluv_call_module(L, "lluv.tail");
+}
+
 static const struct luaL_Reg lluv_functions[] = {
   {"__registry", lluv_debug_registry},
 
+  {"watch_tree", lluv_watch_tree    },
+  {"fs_tail",    lluv_fs_tail       },
+
   {NULL,NULL}
 };
 
@@ -91,6 +121,9 @@ static int luaopen_lluv_impl(lua_State *L, int safe){
   LLUV_PUSH_UPVALUES(L); lluv_stream_initlib   (L, NUPVALUES, safe);
   LLUV_PUSH_UPVALUES(L); lluv_timer_initlib    (L, NUPVALUES, safe);
   LLUV_PUSH_UPVALUES(L); lluv_fbuf_initlib     (L, NUPVALUES, safe);
+  LLUV_PUSH_UPVALUES(L); lluv_bqueue_initlib   (L, NUPVALUES, safe);
+  LLUV_PUSH_UPVALUES(L); lluv_rbuf_initlib     (L, NUPVALUES, safe);
+  LLUV_PUSH_UPVALUES(L); lluv_addr_initlib     (L, NUPVALUES, safe);
   LLUV_PUSH_UPVALUES(L); lluv_idle_initlib     (L, NUPVALUES, safe);
   LLUV_PUSH_UPVALUES(L); lluv_tcp_initlib      (L, NUPVALUES, safe);
   LLUV_PUSH_UPVALUES(L); lluv_pipe_initlib     (L, NUPVALUES, safe);
@@ -102,9 +135,12 @@ static int luaopen_lluv_impl(lua_State *L, int safe){
   LLUV_PUSH_UPVALUES(L); lluv_signal_initlib   (L, NUPVALUES, safe);
   LLUV_PUSH_UPVALUES(L); lluv_fs_event_initlib (L, NUPVALUES, safe);
   LLUV_PUSH_UPVALUES(L); lluv_fs_poll_initlib  (L, NUPVALUES, safe);
+  LLUV_PUSH_UPVALUES(L); lluv_fs_walk_initlib  (L, NUPVALUES, safe);
+  LLUV_PUSH_UPVALUES(L); lluv_fs_notify_initlib(L, NUPVALUES, safe);
   LLUV_PUSH_UPVALUES(L); lluv_process_initlib  (L, NUPVALUES, safe);
   LLUV_PUSH_UPVALUES(L); lluv_misc_initlib     (L, NUPVALUES, safe);
   LLUV_PUSH_UPVALUES(L); lluv_dns_initlib      (L, NUPVALUES, safe);
+  LLUV_PUSH_UPVALUES(L); lluv_pool_initlib     (L, NUPVALUES, safe);
 
   lua_remove(L, -2); /* registry */
   lua_remove(L, -2); /* handles  */
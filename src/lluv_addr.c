@@ -0,0 +1,201 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#include "lluv_addr.h"
+#include "lluv_utils.h"
+#include "lluv_error.h"
+#include "lluv_handle.h"
+#include <memory.h>
+#include <string.h>
+
+/* Address object holds binary socket address and formats it to text
+** only on demand. Objects are interned in weak table keyed by packed
+** address so repeated peer does not allocate new object and object
+** could be used as table key.
+*/
+
+//{ Address
+
+#define LLUV_ADDRESS_NAME LLUV_PREFIX" Address"
+static const char *LLUV_ADDRESS = LLUV_ADDRESS_NAME;
+
+/* key of cache table in library registry */
+static const char *LLUV_ADDRESS_CACHE = LLUV_ADDRESS_NAME" cache";
+
+LLUV_INTERNAL lluv_address_t *lluv_test_address(lua_State *L, int i){
+  if(!lutil_isudatap(L, i, LLUV_ADDRESS)) return NULL;
+  return (lluv_address_t *)lua_touserdata(L, i);
+}
+
+static lluv_address_t *lluv_check_address(lua_State *L, int i){
+  lluv_address_t *addr = (lluv_address_t *)lutil_checkudatap (L, i, LLUV_ADDRESS);
+  luaL_argcheck (L, addr != NULL, i, LLUV_ADDRESS_NAME" expected");
+  return addr;
+}
+
+/* family, port, address and scope only. Padding and flowinfo ignored */
+static size_t lluv_address_key(const struct sockaddr_storage *addr, char *key){
+  size_t n = 0;
+
+  memcpy(&key[n], &addr->ss_family, sizeof(addr->ss_family)); n += sizeof(addr->ss_family);
+
+  if(addr->ss_family == AF_INET){
+    const struct sockaddr_in *sa = (const struct sockaddr_in*)addr;
+    memcpy(&key[n], &sa->sin_port, sizeof(sa->sin_port)); n += sizeof(sa->sin_port);
+    memcpy(&key[n], &sa->sin_addr, sizeof(sa->sin_addr)); n += sizeof(sa->sin_addr);
+  }
+  else if(addr->ss_family == AF_INET6){
+    const struct sockaddr_in6 *sa = (const struct sockaddr_in6*)addr;
+    memcpy(&key[n], &sa->sin6_port,     sizeof(sa->sin6_port));     n += sizeof(sa->sin6_port);
+    memcpy(&key[n], &sa->sin6_addr,     sizeof(sa->sin6_addr));     n += sizeof(sa->sin6_addr);
+    memcpy(&key[n], &sa->sin6_scope_id, sizeof(sa->sin6_scope_id)); n += sizeof(sa->sin6_scope_id);
+  }
+
+  return n;
+}
+
+LLUV_INTERNAL int lluv_push_address(lua_State *L, const struct sockaddr_storage *addr){
+  char key[sizeof(struct sockaddr_storage)];
+  size_t len = lluv_address_key(addr, key);
+  lluv_address_t *obj;
+
+  lua_rawgetp(L, LLUV_LUA_REGISTRY, LLUV_ADDRESS_CACHE);
+  if(lua_isnil(L, -1)){
+    lua_pop(L, 1);
+    lua_newtable(L);
+    lua_newtable(L);
+    lua_pushliteral(L, "v");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, LLUV_LUA_REGISTRY, LLUV_ADDRESS_CACHE);
+  }
+
+  lua_pushlstring(L, key, len);
+  lua_pushvalue(L, -1);
+  lua_rawget(L, -3);
+  if(!lua_isnil(L, -1)){
+    lua_replace(L, -3);
+    lua_pop(L, 1);
+    return 1;
+  }
+  lua_pop(L, 1);
+
+  obj = (lluv_address_t *)lutil_newudatap(L, lluv_address_t, LLUV_ADDRESS);
+  memcpy(&obj->addr, addr, sizeof(obj->addr));
+
+  /* cache, key, obj */
+  lua_insert(L, -2);
+  lua_pushvalue(L, -2);
+  lua_rawset(L, -4);
+  lua_replace(L, -2);
+
+  return 1;
+}
+
+LLUV_INTERNAL int lluv_push_handle_addr(lua_State *L, lluv_flags_t flags, const struct sockaddr_storage *addr){
+  if(flags & LLUV_FLAG_COMPACT_ADDR) return lluv_push_address(L, addr);
+  return lluv_push_addr(L, addr);
+}
+
+LLUV_INTERNAL int lluv_handle_compact_address(lua_State *L){
+  lluv_handle_t *handle = lluv_check_handle(L, 1, 0);
+
+  if(lua_isnoneornil(L, 2) || lua_toboolean(L, 2)) SET_(handle, COMPACT_ADDR);
+  else UNSET_(handle, COMPACT_ADDR);
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+static int lluv_address_new(lua_State *L){
+  struct sockaddr_storage sa;
+  int err = lluv_check_addr(L, 1, &sa);
+
+  if(err < 0){
+    lua_settop(L, 2);
+    lua_pushliteral(L, ":");lua_insert(L, -2);lua_concat(L, 3);
+    return lluv_fail(L, 0, LLUV_ERR_UV, err, lua_tostring(L, -1));
+  }
+
+  return lluv_push_address(L, &sa);
+}
+
+static int lluv_address_host(lua_State *L){
+  lluv_address_t *addr = lluv_check_address(L, 1);
+  lluv_push_addr(L, &addr->addr);
+  lua_settop(L, 2);
+  return 1;
+}
+
+static int lluv_address_port(lua_State *L){
+  lluv_address_t *addr = lluv_check_address(L, 1);
+  lluv_push_addr(L, &addr->addr);
+  lua_settop(L, 3);
+  return 1;
+}
+
+static int lluv_address_unpack(lua_State *L){
+  lluv_address_t *addr = lluv_check_address(L, 1);
+  return lluv_push_addr(L, &addr->addr);
+}
+
+static int lluv_address_family(lua_State *L){
+  lluv_address_t *addr = lluv_check_address(L, 1);
+  if(addr->addr.ss_family == AF_INET6) lua_pushliteral(L, "inet6");
+  else lua_pushliteral(L, "inet");
+  return 1;
+}
+
+static int lluv_address_to_s(lua_State *L){
+  lluv_address_t *addr = lluv_check_address(L, 1);
+  lua_settop(L, 1);
+  lluv_push_addr(L, &addr->addr);
+  lua_settop(L, 3);
+
+  if(addr->addr.ss_family == AF_INET6){
+    lua_pushliteral(L, "[");  lua_pushvalue(L, 2);
+    lua_pushliteral(L, "]:"); lua_pushvalue(L, 3);
+    lua_concat(L, 4);
+  }
+  else{
+    lua_pushvalue(L, 2); lua_pushliteral(L, ":"); lua_pushvalue(L, 3);
+    lua_concat(L, 3);
+  }
+
+  return 1;
+}
+
+static const struct luaL_Reg lluv_address_methods[] = {
+  { "__tostring",  lluv_address_to_s    },
+  { "host",        lluv_address_host    },
+  { "port",        lluv_address_port    },
+  { "unpack",      lluv_address_unpack  },
+  { "family",      lluv_address_family  },
+
+  {NULL,NULL}
+};
+
+//}
+
+static const struct luaL_Reg lluv_addr_functions[] = {
+  { "address",      lluv_address_new    },
+
+  {NULL,NULL}
+};
+
+LLUV_INTERNAL void lluv_addr_initlib(lua_State *L, int nup, int safe){
+  lutil_pushnvalues(L, nup);
+  if(!lutil_createmetap(L, LLUV_ADDRESS, lluv_address_methods, nup))
+    lua_pop(L, nup);
+  lua_pop(L, 1);
+
+  luaL_setfuncs(L, lluv_addr_functions, nup);
+}
@@ -0,0 +1,39 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#ifndef _LLUV_ADDR_H_
+#define _LLUV_ADDR_H_
+
+#include "lluv.h"
+#include "lluv_utils.h"
+
+/* handle pushes peer addresses as `uv_address` objects */
+#define LLUV_FLAG_COMPACT_ADDR LLUV_FLAG_6
+
+typedef struct lluv_address_tag{
+  struct sockaddr_storage addr;
+}lluv_address_t;
+
+LLUV_INTERNAL void lluv_addr_initlib(lua_State *L, int nup, int safe);
+
+LLUV_INTERNAL lluv_address_t *lluv_test_address(lua_State *L, int i);
+
+/* push interned address object. Same address always returns same object
+** while it is alive so it could be used as table key
+*/
+LLUV_INTERNAL int lluv_push_address(lua_State *L, const struct sockaddr_storage *addr);
+
+/* push address as object or as host, port, ... depend on handle flag */
+LLUV_INTERNAL int lluv_push_handle_addr(lua_State *L, lluv_flags_t flags, const struct sockaddr_storage *addr);
+
+/* compact_address([enable]) method for handles */
+LLUV_INTERNAL int lluv_handle_compact_address(lua_State *L);
+
+#endif
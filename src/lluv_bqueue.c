@@ -0,0 +1,479 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#include "lluv_bqueue.h"
+#include "lluv_utils.h"
+#include "lluv_error.h"
+#include <memory.h>
+#include <string.h>
+
+/* Byte queue is contiguous growable buffer with read position.
+** It implements same interface as lluv.utils.Buffer but does not
+** allocate Lua strings for each chunk and uses memchr to find EOL.
+**
+** EOL could be any plain string. Also supported patterns like `\r*\n`
+** (some char repeated before plain string) as used by LuaSocket.
+**/
+
+//{ Byte queue
+
+#define LLUV_BQUEUE_NAME LLUV_PREFIX" Byte queue"
+static const char *LLUV_BQUEUE = LLUV_BQUEUE_NAME;
+
+#define LLUV_BQUEUE_MIN_SIZE 512
+
+#define LLUV_BQUEUE_SIZE(q) ((q)->tail - (q)->head)
+
+static int lluv_is_pattern(const char *s, size_t len){
+  static const char *specials = "^$*+?.([%-";
+  size_t i;
+  for(i = 0; i < len; ++i){
+    if(strchr(specials, s[i])) return 1;
+  }
+  return 0;
+}
+
+/* parse EOL string. String should be valid while eol is used */
+static void lluv_bqueue_check_eol(lua_State *L, int idx, int rex, const char **eol, size_t *eol_len, int *eol_rep){
+  size_t len; const char *str = luaL_checklstring(L, idx, &len);
+
+  luaL_argcheck(L, len > 0, idx, "empty EOL");
+
+  *eol = str; *eol_len = len; *eol_rep = -1;
+
+  if(!rex || !lluv_is_pattern(str, len)) return;
+
+  /* only `c*eol` patterns */
+  luaL_argcheck(L, (len > 2) && (str[1] == '*') && (!lluv_is_pattern(&str[0], 1))
+    && (!lluv_is_pattern(&str[2], len - 2)), idx, "unsupported EOL pattern"
+  );
+
+  *eol = &str[2]; *eol_len = len - 2; *eol_rep = (unsigned char)str[0];
+}
+
+static void lluv_bqueue_set_eol_impl(lua_State *L, lluv_bqueue_t *q, int idx, int rex){
+  const char *eol; size_t eol_len; int eol_rep;
+
+  idx = lua_absindex(L, idx);
+
+  lluv_bqueue_check_eol(L, idx, rex, &eol, &eol_len, &eol_rep);
+
+  lua_pushvalue(L, idx);
+  luaL_unref(L, LLUV_LUA_REGISTRY, q->eol_ref);
+  q->eol_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
+  q->eol     = eol;
+  q->eol_len = eol_len;
+  q->eol_rep = eol_rep;
+  q->scan    = q->head;
+}
+
+static void lluv_bqueue_compact(lluv_bqueue_t *q){
+  size_t size = LLUV_BQUEUE_SIZE(q);
+  if(q->head == 0) return;
+
+  if(size) memmove(q->data, q->data + q->head, size);
+  q->scan = (q->scan > q->head) ? (q->scan - q->head) : 0;
+  q->head = 0; q->tail = size;
+}
+
+/* ensure there at least `len` free bytes after tail */
+static int lluv_bqueue_reserve(lua_State *L, lluv_bqueue_t *q, size_t len){
+  size_t size = LLUV_BQUEUE_SIZE(q);
+  size_t capacity; char *data;
+
+  if((q->capacity - q->tail) >= len) return 0;
+
+  /* there enough space. Avoid move data too often */
+  if(((q->capacity - size) >= len) && (q->head >= size)){
+    lluv_bqueue_compact(q);
+    return 0;
+  }
+
+  capacity = q->capacity ? q->capacity : LLUV_BQUEUE_MIN_SIZE;
+  while((capacity - size) < len){
+    if(capacity > (((size_t)-1) / 2)) return UV_ENOMEM;
+    capacity *= 2;
+  }
+
+  data = (char*)lluv_alloc(L, capacity);
+  if(!data) return UV_ENOMEM;
+
+  if(size) memcpy(data, q->data + q->head, size);
+  if(q->data) lluv_free(L, q->data);
+
+  q->data     = data;
+  q->capacity = capacity;
+  q->scan     = (q->scan > q->head) ? (q->scan - q->head) : 0;
+  q->head     = 0;
+  q->tail     = size;
+
+  return 0;
+}
+
+static void lluv_bqueue_consume(lluv_bqueue_t *q, size_t n){
+  q->head += n;
+  if(q->head == q->tail) q->head = q->tail = q->scan = 0;
+}
+
+static int lluv_bqueue_push_n(lua_State *L, lluv_bqueue_t *q, size_t n){
+  lua_pushlstring(L, q->data + q->head, n);
+  lluv_bqueue_consume(q, n);
+  return 1;
+}
+
+LLUV_INTERNAL lluv_bqueue_t *lluv_check_bqueue(lua_State *L, int i){
+  lluv_bqueue_t *q = (lluv_bqueue_t *)lutil_checkudatap (L, i, LLUV_BQUEUE);
+  luaL_argcheck (L, q != NULL, i, LLUV_BQUEUE_NAME" expected");
+  return q;
+}
+
+LLUV_INTERNAL int lluv_bqueue_append(lua_State *L, lluv_bqueue_t *q, const char *data, size_t len){
+  int err;
+  if(!len) return 0;
+
+  err = lluv_bqueue_reserve(L, q, len);
+  if(err < 0) return err;
+
+  memcpy(q->data + q->tail, data, len);
+  q->tail += len;
+  return 0;
+}
+
+static int lluv_bqueue_new(lua_State *L){
+  lluv_bqueue_t *q;
+
+  lua_settop(L, 2);
+
+  q = lutil_newudatap(L, lluv_bqueue_t, LLUV_BQUEUE);
+  q->eol_ref = LUA_NOREF;
+
+  if(lua_isnil(L, 1)){
+    lua_pushliteral(L, "\n");
+    lua_replace(L, 1);
+  }
+  lluv_bqueue_set_eol_impl(L, q, 1, lua_toboolean(L, 2));
+
+  return 1;
+}
+
+static int lluv_bqueue_free(lua_State *L){
+  lluv_bqueue_t *q = lluv_check_bqueue(L, 1);
+  if(q->data){
+    lluv_free(L, q->data);
+    q->data = NULL;
+  }
+  q->capacity = q->head = q->tail = q->scan = 0;
+  return 0;
+}
+
+static int lluv_bqueue_gc(lua_State *L){
+  lluv_bqueue_t *q = lluv_check_bqueue(L, 1);
+  lluv_bqueue_free(L);
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, q->eol_ref);
+  q->eol_ref = LUA_NOREF;
+  q->eol = NULL;
+  return 0;
+}
+
+static int lluv_bqueue_to_s(lua_State *L){
+  lluv_bqueue_t *q = lluv_check_bqueue(L, 1);
+  lua_pushfstring(L, LLUV_BQUEUE_NAME" (%p)", q);
+  return 1;
+}
+
+static int lluv_bqueue_reset(lua_State *L){
+  lluv_bqueue_t *q = lluv_check_bqueue(L, 1);
+  q->head = q->tail = q->scan = 0;
+  lua_settop(L, 1);
+  return 1;
+}
+
+static int lluv_bqueue_eol(lua_State *L){
+  lluv_bqueue_t *q = lluv_check_bqueue(L, 1);
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, q->eol_ref);
+  lua_pushboolean(L, q->eol_rep < 0);
+  return 2;
+}
+
+static int lluv_bqueue_set_eol(lua_State *L){
+  lluv_bqueue_t *q = lluv_check_bqueue(L, 1);
+  luaL_checkstring(L, 2);
+  lluv_bqueue_set_eol_impl(L, q, 2, lua_toboolean(L, 3));
+  lua_settop(L, 1);
+  return 1;
+}
+
+static int lluv_bqueue_size(lua_State *L){
+  lluv_bqueue_t *q = lluv_check_bqueue(L, 1);
+  lutil_pushint64(L, LLUV_BQUEUE_SIZE(q));
+  return 1;
+}
+
+static int lluv_bqueue_empty(lua_State *L){
+  lluv_bqueue_t *q = lluv_check_bqueue(L, 1);
+  lua_pushboolean(L, q->head == q->tail);
+  return 1;
+}
+
+static int lluv_bqueue_append_(lua_State *L){
+  lluv_bqueue_t *q = lluv_check_bqueue(L, 1);
+  size_t len; const char *data = luaL_checklstring(L, 2, &len);
+  int err = lluv_bqueue_append(L, q, data, len);
+  if(err < 0) return lluv_fail(L, LLUV_FLAG_RAISE_ERROR, LLUV_ERR_UV, err, NULL);
+  lua_settop(L, 1);
+  return 1;
+}
+
+static int lluv_bqueue_prepend(lua_State *L){
+  lluv_bqueue_t *q = lluv_check_bqueue(L, 1);
+  size_t len; const char *data = luaL_checklstring(L, 2, &len);
+
+  if(len > q->head){
+    size_t size = LLUV_BQUEUE_SIZE(q);
+    int err = lluv_bqueue_reserve(L, q, len);
+    if(err < 0) return lluv_fail(L, LLUV_FLAG_RAISE_ERROR, LLUV_ERR_UV, err, NULL);
+
+    lluv_bqueue_compact(q);
+    if(size) memmove(q->data + len, q->data, size);
+    q->head = len; q->tail = len + size;
+  }
+
+  q->head -= len;
+  memcpy(q->data + q->head, data, len);
+  q->scan = q->head;
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+static int lluv_bqueue_read_line_impl(lua_State *L, lluv_bqueue_t *q, const char *eol, size_t eol_len, int eol_rep, size_t from, int cache){
+  const char *e = lluv_memfind(q->data + from, q->tail - from, eol, eol_len);
+  size_t end, next;
+
+  if(!e){
+    if(cache){
+      from = q->tail - from < eol_len ? from : q->tail - eol_len + 1;
+      q->scan = from;
+    }
+    return 0;
+  }
+
+  end  = e - q->data;
+  next = end + eol_len;
+
+  if(eol_rep >= 0){
+    while((end > q->head) && ((unsigned char)q->data[end - 1] == eol_rep)) --end;
+  }
+
+  lua_pushlstring(L, q->data + q->head, end - q->head);
+  lluv_bqueue_consume(q, next - q->head);
+  return 1;
+}
+
+static int lluv_bqueue_read_line(lua_State *L){
+  lluv_bqueue_t *q = lluv_check_bqueue(L, 1);
+  const char *eol; size_t eol_len; int eol_rep;
+
+  if(lua_isnoneornil(L, 2)){
+    size_t from = (q->scan > q->head) ? q->scan : q->head;
+    return lluv_bqueue_read_line_impl(L, q, q->eol, q->eol_len, q->eol_rep, from, 1);
+  }
+
+  lluv_bqueue_check_eol(L, 2, lua_toboolean(L, 3), &eol, &eol_len, &eol_rep);
+  return lluv_bqueue_read_line_impl(L, q, eol, eol_len, eol_rep, q->head, 0);
+}
+
+static int lluv_bqueue_read_until(lua_State *L){
+  lluv_bqueue_t *q = lluv_check_bqueue(L, 1);
+  size_t len; const char *delim = luaL_checklstring(L, 2, &len);
+  int inclusive = lua_toboolean(L, 3);
+  const char *e;
+  size_t end;
+
+  luaL_argcheck(L, len > 0, 2, "empty delimiter");
+
+  e = lluv_memfind(q->data + q->head, LLUV_BQUEUE_SIZE(q), delim, len);
+  if(!e) return 0;
+
+  end = e - q->data;
+  lua_pushlstring(L, q->data + q->head, end - q->head + (inclusive ? len : 0));
+  lluv_bqueue_consume(q, end + len - q->head);
+  return 1;
+}
+
+static int lluv_bqueue_find(lua_State *L){
+  lluv_bqueue_t *q = lluv_check_bqueue(L, 1);
+  size_t len; const char *delim = luaL_checklstring(L, 2, &len);
+  size_t size = LLUV_BQUEUE_SIZE(q);
+  int64_t init = lutil_optint64(L, 3, 1);
+  const char *e;
+
+  luaL_argcheck(L, init > 0, 3, "positive number expected");
+  if((size_t)(init - 1) > size) return 0;
+
+  e = lluv_memfind(q->data + q->head + init - 1, size - (size_t)(init - 1), delim, len);
+  if(!e) return 0;
+
+  lutil_pushint64(L, e - (q->data + q->head) + 1);
+  return 1;
+}
+
+static int lluv_bqueue_read_n(lua_State *L){
+  lluv_bqueue_t *q = lluv_check_bqueue(L, 1);
+  int64_t n = (int64_t)luaL_checknumber(L, 2);
+
+  luaL_argcheck(L, n >= 0, 2, "non negative number expected");
+
+  if(q->head == q->tail) return 0;
+
+  if(LLUV_BQUEUE_SIZE(q) < (size_t)n) return 0;
+
+  return lluv_bqueue_push_n(L, q, (size_t)n);
+}
+
+static int lluv_bqueue_read_all(lua_State *L){
+  lluv_bqueue_t *q = lluv_check_bqueue(L, 1);
+  return lluv_bqueue_push_n(L, q, LLUV_BQUEUE_SIZE(q));
+}
+
+static int lluv_bqueue_read_some(lua_State *L){
+  lluv_bqueue_t *q = lluv_check_bqueue(L, 1);
+  if(q->head == q->tail) return 0;
+  return lluv_bqueue_push_n(L, q, LLUV_BQUEUE_SIZE(q));
+}
+
+static int lluv_bqueue_read(lua_State *L){
+  lluv_check_bqueue(L, 1);
+
+  if(lua_isnoneornil(L, 2)){
+    lua_settop(L, 1);
+    return lluv_bqueue_read_some(L);
+  }
+
+  if(lua_type(L, 2) == LUA_TSTRING){
+    const char *pat = lua_tostring(L, 2);
+
+    if(0 == strcmp(pat, "*l")){
+      lua_remove(L, 2);
+      return lluv_bqueue_read_line(L);
+    }
+
+    if(0 == strcmp(pat, "*a")){
+      lua_settop(L, 1);
+      return lluv_bqueue_read_all(L);
+    }
+  }
+
+  return lluv_bqueue_read_n(L);
+}
+
+static int lluv_bqueue_peek(lua_State *L){
+  lluv_bqueue_t *q = lluv_check_bqueue(L, 1);
+  size_t size = LLUV_BQUEUE_SIZE(q);
+  int64_t n;
+
+  if(lua_isnoneornil(L, 2)){
+    lua_pushlstring(L, q->data + q->head, size);
+    return 1;
+  }
+
+  n = lutil_checkint64(L, 2);
+  luaL_argcheck(L, n >= 0, 2, "non negative number expected");
+  if(size < (size_t)n) return 0;
+
+  lua_pushlstring(L, q->data + q->head, (size_t)n);
+  return 1;
+}
+
+static int lluv_bqueue_skip(lua_State *L){
+  lluv_bqueue_t *q = lluv_check_bqueue(L, 1);
+  size_t size = LLUV_BQUEUE_SIZE(q);
+  int64_t n = lutil_checkint64(L, 2);
+
+  luaL_argcheck(L, n >= 0, 2, "non negative number expected");
+  if((size_t)n > size) n = size;
+
+  lluv_bqueue_consume(q, (size_t)n);
+  lutil_pushint64(L, n);
+  return 1;
+}
+
+static int lluv_bqueue_next_line(lua_State *L){
+  lluv_bqueue_t *q = lluv_check_bqueue(L, 1);
+  lua_settop(L, 3);
+
+  if(!lua_isnil(L, 2)){
+    size_t len; const char *data = luaL_checklstring(L, 2, &len);
+    int err = lluv_bqueue_append(L, q, data, len);
+    if(err < 0) return lluv_fail(L, LLUV_FLAG_RAISE_ERROR, LLUV_ERR_UV, err, NULL);
+  }
+
+  lua_remove(L, 2);
+  return lluv_bqueue_read_line(L);
+}
+
+static int lluv_bqueue_next_n(lua_State *L){
+  lluv_bqueue_t *q = lluv_check_bqueue(L, 1);
+  lua_settop(L, 3);
+
+  if(!lua_isnil(L, 2)){
+    size_t len; const char *data = luaL_checklstring(L, 2, &len);
+    int err = lluv_bqueue_append(L, q, data, len);
+    if(err < 0) return lluv_fail(L, LLUV_FLAG_RAISE_ERROR, LLUV_ERR_UV, err, NULL);
+  }
+
+  lua_remove(L, 2);
+  return lluv_bqueue_read_n(L);
+}
+
+static const struct luaL_Reg lluv_bqueue_methods[] = {
+  { "__gc",        lluv_bqueue_gc            },
+  { "__tostring",  lluv_bqueue_to_s          },
+  { "__len",       lluv_bqueue_size          },
+  { "free",        lluv_bqueue_free          },
+  { "reset",       lluv_bqueue_reset         },
+  { "eol",         lluv_bqueue_eol           },
+  { "set_eol",     lluv_bqueue_set_eol       },
+  { "size",        lluv_bqueue_size          },
+  { "empty",       lluv_bqueue_empty         },
+  { "append",      lluv_bqueue_append_       },
+  { "prepend",     lluv_bqueue_prepend       },
+  { "read_line",   lluv_bqueue_read_line     },
+  { "read_until",  lluv_bqueue_read_until    },
+  { "read_n",      lluv_bqueue_read_n        },
+  { "read_all",    lluv_bqueue_read_all      },
+  { "read_some",   lluv_bqueue_read_some     },
+  { "read",        lluv_bqueue_read          },
+  { "find",        lluv_bqueue_find          },
+  { "peek",        lluv_bqueue_peek          },
+  { "skip",        lluv_bqueue_skip          },
+  { "next_line",   lluv_bqueue_next_line     },
+  { "next_n",      lluv_bqueue_next_n        },
+
+  {NULL,NULL}
+};
+
+//}
+
+static const struct luaL_Reg lluv_bqueue_functions[] = {
+  { "bqueue",      lluv_bqueue_new    },
+
+  {NULL,NULL}
+};
+
+LLUV_INTERNAL void lluv_bqueue_initlib(lua_State *L, int nup, int safe){
+  lutil_pushnvalues(L, nup);
+  if(!lutil_createmetap(L, LLUV_BQUEUE, lluv_bqueue_methods, nup))
+    lua_pop(L, nup);
+  lua_pop(L, 1);
+
+  luaL_setfuncs(L, lluv_bqueue_functions, nup);
+}
@@ -0,0 +1,34 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#ifndef _LLUV_BQUEUE_H_
+#define _LLUV_BQUEUE_H_
+
+#include "lluv.h"
+
+typedef struct lluv_bqueue_tag{
+  char       *data;
+  size_t      capacity;
+  size_t      head;      /* first unread byte       */
+  size_t      tail;      /* end of data             */
+  size_t      scan;      /* no default EOL before   */
+  int         eol_ref;
+  const char *eol;
+  size_t      eol_len;
+  int         eol_rep;   /* char which may repeat before EOL (`\r*\n`) or -1 */
+}lluv_bqueue_t;
+
+LLUV_INTERNAL void lluv_bqueue_initlib(lua_State *L, int nup, int safe);
+
+LLUV_INTERNAL lluv_bqueue_t *lluv_check_bqueue(lua_State *L, int i);
+
+LLUV_INTERNAL int lluv_bqueue_append(lua_State *L, lluv_bqueue_t *q, const char *data, size_t len);
+
+#endif
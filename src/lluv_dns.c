@@ -13,6 +13,7 @@
 #include "lluv_loop.h"
 #include "lluv_error.h"
 #include "lluv_req.h"
+#include "lluv_pool.h"
 #include <memory.h>
 #include <assert.h>
 
@@ -101,6 +102,8 @@ static void lluv_on_getnameinfo(uv_getnameinfo_t* arg, int status, const char* h
 
   LLUV_CHECK_LOOP_CB_INVARIANT(L);
 
+  lluv_pool_done(loop, LLUV_POOL_DNS, req->start);
+
   if(!IS_(loop, OPEN)){
     lluv_req_free(L, req);
     return;
@@ -120,30 +123,10 @@ static void lluv_on_getnameinfo(uv_getnameinfo_t* arg, int status, const char* h
   LLUV_CHECK_LOOP_CB_INVARIANT(L);
 }
 
-static void lluv_on_getaddrinfo(uv_getaddrinfo_t* arg, int status, struct addrinfo* res){
-  lluv_req_t  *req   = lluv_req_byptr((uv_req_t*)arg);
-  lluv_loop_t *loop  = lluv_loop_byptr(arg->loop);
-  lua_State   *L     = loop->L;
-  struct addrinfo* a = res;
+static void lluv_push_addrinfo(lua_State *L, struct addrinfo* res){
+  struct addrinfo* a;
   int i = 0;
 
-  LLUV_CHECK_LOOP_CB_INVARIANT(L);
-
-  lua_rawgeti(L, LLUV_LUA_REGISTRY, req->cb);
-  lluv_req_free(L, req);
-  assert(!lua_isnil(L, -1));
-
-  lluv_loop_pushself(L, loop);
-
-  if(status < 0){
-    uv_freeaddrinfo(res);
-    lluv_error_create(L, LLUV_ERR_UV, (uv_errno_t)status, NULL);
-    LLUV_LOOP_CALL_CB(L, loop, 2);
-    LLUV_CHECK_LOOP_CB_INVARIANT(L);
-    return;
-  }
-
-  lua_pushnil(L);
   lua_newtable(L);
   for(a = res; a; a = a->ai_next){
     char buf[INET6_ADDRSTRLEN + 1];
@@ -192,13 +175,304 @@ static void lluv_on_getaddrinfo(uv_getaddrinfo_t* arg, int status, struct addrin
 
     lua_rawseti(L, -2, ++i);
   }
+}
+
+/*
+** Resolver cache.
+**
+** Each loop has table `entries` (key => {expire, err, addresses}) and
+** table `pending` (key => {callbacks}). Only one request per key is in flight.
+** Callbacks for same key which come while request in flight are queued
+** in `pending` and called after first one. Each callback gets its own copy
+** of addresses table so callers can modify it.
+*/
+
+#define LLUV_DNS_CACHE_TTL          60000
+#define LLUV_DNS_CACHE_NEGATIVE_TTL 5000
+#define LLUV_DNS_CACHE_MAX_ENTRIES  1024
+
+LLUV_INTERNAL void lluv_dns_cache_init(lua_State *L, lluv_dns_cache_t *cache){
+  memset(cache, 0, sizeof(lluv_dns_cache_t));
+  cache->enabled      = 1;
+  cache->max_entries  = LLUV_DNS_CACHE_MAX_ENTRIES;
+  cache->ttl          = LLUV_DNS_CACHE_TTL;
+  cache->negative_ttl = LLUV_DNS_CACHE_NEGATIVE_TTL;
+
+  lua_newtable(L);
+  cache->entries = luaL_ref(L, LLUV_LUA_REGISTRY);
+  lua_newtable(L);
+  cache->pending = luaL_ref(L, LLUV_LUA_REGISTRY);
+}
+
+LLUV_INTERNAL void lluv_dns_cache_close(lua_State *L, lluv_dns_cache_t *cache){
+  luaL_unref(L, LLUV_LUA_REGISTRY, cache->entries);
+  luaL_unref(L, LLUV_LUA_REGISTRY, cache->pending);
+  cache->entries = cache->pending = LUA_NOREF;
+  cache->size = 0;
+}
+
+static void lluv_dns_cache_flush(lua_State *L, lluv_dns_cache_t *cache){
+  if(cache->entries == LUA_NOREF) return;
+  luaL_unref(L, LLUV_LUA_REGISTRY, cache->entries);
+  lua_newtable(L);
+  cache->entries = luaL_ref(L, LLUV_LUA_REGISTRY);
+  cache->size = 0;
+}
+
+/* push copy of addresses array at index idx */
+static void lluv_dns_cache_push_copy(lua_State *L, int idx){
+  int i, n;
+
+  idx = lua_absindex(L, idx);
+  n = (int)lua_rawlen(L, idx);
+
+  lua_createtable(L, n, 0);
+  for(i = 1; i <= n; ++i){
+    lua_createtable(L, 0, 6);
+    lua_rawgeti(L, idx, i);
+    lua_pushnil(L);
+    while(lua_next(L, -2)){
+      lua_pushvalue(L, -2); lua_insert(L, -2);
+      lua_rawset(L, -5);
+    }
+    lua_pop(L, 1);
+    lua_rawseti(L, -2, i);
+  }
+}
+
+/* remove expired entries and if there still no room then some arbitrary one */
+static void lluv_dns_cache_reserve(lua_State *L, lluv_loop_t *loop){
+  lluv_dns_cache_t *cache = &loop->dns;
+  lua_Number now = (lua_Number)uv_now(loop->handle);
+  int top = lua_gettop(L);
+
+  if(cache->size < cache->max_entries) return;
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, cache->entries);
+  lua_pushnil(L);
+  while(lua_next(L, -2)){
+    lua_rawgeti(L, -1, 1);
+    if(lua_tonumber(L, -1) <= now){
+      /* clear existing field is allowed during traversal */
+      lua_pushvalue(L, -3); lua_pushnil(L); lua_rawset(L, -6);
+      cache->size -= 1;
+    }
+    lua_pop(L, 2);
+  }
 
-  uv_freeaddrinfo(res);
-  LLUV_LOOP_CALL_CB(L, loop, 3);
+  while(cache->size >= cache->max_entries){
+    lua_pushnil(L);
+    if(!lua_next(L, -2)) break;
+    lua_pop(L, 1);
+    lua_pushnil(L); lua_rawset(L, -3);
+    cache->size -= 1;
+  }
+
+  lua_settop(L, top);
+}
+
+/* stack: key, loop, err, addresses */
+static void lluv_dns_cache_done(lua_State *L, lluv_loop_t *loop, int status){
+  lluv_dns_cache_t *cache = &loop->dns;
+  int top = lua_gettop(L), key = top - 3;
+  uint64_t ttl = cache->ttl;
+  size_t i, n;
+
+  /* loop closed */
+  if(cache->pending == LUA_NOREF) return;
+
+  if(status < 0){
+    /* do not cache transient errors */
+    ttl = ((status == UV_EAI_NONAME) || (status == UV_EAI_NODATA)) ? cache->negative_ttl : 0;
+  }
+
+  if(cache->enabled && ttl > 0 && cache->max_entries > 0){
+    lluv_dns_cache_reserve(L, loop);
+
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, cache->entries);
+    lua_pushvalue(L, key);
+    lua_rawget(L, -2);
+    if(lua_isnil(L, -1)) cache->size += 1;
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, key);
+    lua_createtable(L, 3, 0);
+    lua_pushnumber(L, (lua_Number)(uv_now(loop->handle) + ttl));
+    lua_rawseti(L, -2, 1);
+    lua_pushvalue(L, top - 1);
+    lua_rawseti(L, -2, 2);
+    if(status >= 0){
+      lluv_dns_cache_push_copy(L, top);
+      lua_rawseti(L, -2, 3);
+    }
+    lua_rawset(L, -3);
+    lua_pop(L, 1);
+  }
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, cache->pending);
+  lua_pushvalue(L, key);
+  lua_rawget(L, -2);
+  lua_pushvalue(L, key); lua_pushnil(L); lua_rawset(L, -4);
+
+  if(lua_istable(L, -1)){
+    n = lua_rawlen(L, -1);
+    for(i = 1; i <= n; ++i){
+      lua_rawgeti(L, -1, (int)i);
+      lua_pushvalue(L, top - 2);
+      lua_pushvalue(L, top - 1);
+      if(status < 0) lluv_loop_defer_call(L, loop, 2);
+      else{
+        lluv_dns_cache_push_copy(L, top);
+        lluv_loop_defer_call(L, loop, 3);
+      }
+    }
+  }
+
+  lua_settop(L, top);
+}
+
+static void lluv_on_getaddrinfo(uv_getaddrinfo_t* arg, int status, struct addrinfo* res){
+  lluv_req_t  *req   = lluv_req_byptr((uv_req_t*)arg);
+  lluv_loop_t *loop  = lluv_loop_byptr(arg->loop);
+  lua_State   *L     = loop->L;
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+  lluv_pool_done(loop, LLUV_POOL_DNS, req->start);
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, req->cb);
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, req->arg);
+  lluv_req_free(L, req);
+  assert(!lua_isnil(L, -2));
+
+  lluv_loop_pushself(L, loop);
+
+  if(status < 0){
+    uv_freeaddrinfo(res);
+    lluv_error_create(L, LLUV_ERR_UV, (uv_errno_t)status, NULL);
+    lua_pushnil(L);
+  }
+  else{
+    lua_pushnil(L);
+    lluv_push_addrinfo(L, res);
+    uv_freeaddrinfo(res);
+  }
+
+  if(!lua_isnil(L, -4)) lluv_dns_cache_done(L, loop, status);
+  lua_remove(L, -4);
+
+  if(status < 0){
+    lua_pop(L, 1);
+    LLUV_LOOP_CALL_CB(L, loop, 2);
+  }
+  else{
+    LLUV_LOOP_CALL_CB(L, loop, 3);
+  }
 
   LLUV_CHECK_LOOP_CB_INVARIANT(L);
 }
 
+LLUV_INTERNAL int lluv_dns_getaddrinfo(lua_State *L, lluv_loop_t *loop, const char *node,
+  const char *service, const struct addrinfo *hints)
+{
+  lluv_dns_cache_t *cache = &loop->dns;
+  int cb = lua_gettop(L), key = cb + 1;
+  lluv_req_t *req; int err;
+
+  if(!cache->enabled || cache->pending == LUA_NOREF){
+    req = lluv_req_new(L, UV_GETADDRINFO, NULL);
+    err = uv_getaddrinfo(loop->handle, LLUV_R(req, getaddrinfo), lluv_on_getaddrinfo, node, service, hints);
+    if(err >= 0){
+      req->start = lluv_pool_submit(loop, LLUV_POOL_DNS);
+      return err;
+    }
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, req->cb);
+    lluv_req_free(L, req);
+    lluv_loop_pushself(L, loop);
+    lluv_error_create(L, LLUV_ERR_UV, err, NULL);
+    lluv_loop_defer_call(L, loop, 2);
+    return err;
+  }
+
+  lua_pushfstring(L, "%c%s\n%c%s\n%d %d %d %d",
+    node    ? '=' : '-', node    ? node    : "",
+    service ? '=' : '-', service ? service : "",
+    hints->ai_family, hints->ai_socktype, hints->ai_protocol, hints->ai_flags
+  );
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, cache->entries);
+  lua_pushvalue(L, key);
+  lua_rawget(L, -2);
+  if(lua_istable(L, -1)){
+    lua_rawgeti(L, -1, 1);
+    if(lua_tonumber(L, -1) > (lua_Number)uv_now(loop->handle)){
+      cache->hits += 1;
+      lua_pushvalue(L, cb);
+      lluv_loop_pushself(L, loop);
+      lua_rawgeti(L, -4, 2);
+      if(lua_isnil(L, -1)){
+        lua_rawgeti(L, -5, 3);
+        lluv_dns_cache_push_copy(L, -1);
+        lua_remove(L, -2);
+        lluv_loop_defer_call(L, loop, 3);
+      }
+      else lluv_loop_defer_call(L, loop, 2);
+      lua_settop(L, cb - 1);
+      return 0;
+    }
+
+    /* expired */
+    lua_pushvalue(L, key); lua_pushnil(L); lua_rawset(L, key + 1);
+    cache->size -= 1;
+  }
+  lua_settop(L, key);
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, cache->pending);
+  lua_pushvalue(L, key);
+  lua_rawget(L, -2);
+  if(lua_istable(L, -1)){
+    cache->coalesced += 1;
+    lua_pushvalue(L, cb);
+    lua_rawseti(L, -2, (int)lua_rawlen(L, -2) + 1);
+    lua_settop(L, cb - 1);
+    return 0;
+  }
+  lua_pop(L, 1);
+
+  cache->misses += 1;
+
+  lua_pushvalue(L, key);
+  lua_newtable(L);
+  lua_rawset(L, -3);
+  lua_pop(L, 1);
+
+  lua_pushvalue(L, cb);
+  req = lluv_req_new(L, UV_GETADDRINFO, NULL);
+  lua_pushvalue(L, key);
+  lluv_req_ref(L, req);
+
+  err = uv_getaddrinfo(loop->handle, LLUV_R(req, getaddrinfo), lluv_on_getaddrinfo, node, service, hints);
+  if(err >= 0){
+    req->start = lluv_pool_submit(loop, LLUV_POOL_DNS);
+    lua_settop(L, cb - 1);
+    return err;
+  }
+
+  lluv_req_free(L, req);
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, cache->pending);
+  lua_pushvalue(L, key); lua_pushnil(L); lua_rawset(L, -3);
+  lua_pop(L, 1);
+
+  lua_pushvalue(L, cb);
+  lluv_loop_pushself(L, loop);
+  lluv_error_create(L, LLUV_ERR_UV, err, NULL);
+  lluv_loop_defer_call(L, loop, 2);
+
+  lua_settop(L, cb - 1);
+  return err;
+}
+
 LLUV_IMPL_SAFE(lluv_getaddrinfo){
 #define XX(C, L, N) {C, N},
 
@@ -235,14 +509,14 @@ LLUV_IMPL_SAFE(lluv_getaddrinfo){
   {
     const char *node;
     const char *service = NULL;
-    lluv_req_t *req; int err;
     struct addrinfo hints;
+    int co;
 
     memset(&hints, 0, sizeof(hints));
 
     node = luaL_optstring(L, argc + 1, NULL);
 
-    if(!lua_isfunction(L, argc + 2)){
+    if(!lua_isfunction(L, argc + 2) && !lua_isthread(L, argc + 2)){
       if(lua_istable(L, argc + 2)) hi = argc + 2;
       else service = luaL_optstring(L, argc + 2, NULL);
     }
@@ -270,14 +544,16 @@ LLUV_IMPL_SAFE(lluv_getaddrinfo){
     }
 
     lluv_check_args_with_cb(L, argc + 4);
-    req = lluv_req_new(L, UV_GETADDRINFO, NULL);
+    co = lluv_is_yield_cb(L, -1);
+
+    lluv_dns_getaddrinfo(L, loop, node, service, &hints);
+
+    /* coroutine waits result of request. It will be resumed from callback */
+    if(co) return lua_yield(L, 0);
 
-    err = uv_getaddrinfo(loop->handle, LLUV_R(req, getaddrinfo), lluv_on_getaddrinfo, node, service, &hints);
-    
     lua_settop(L, 0);
     lluv_loop_pushself(L, loop);
-
-    return lluv_return_loop_req(L, loop, req, err);
+    return 1;
   }
 }
 
@@ -325,6 +601,7 @@ LLUV_IMPL_SAFE(lluv_getnameinfo){
     req = lluv_req_new(L, UV_GETNAMEINFO, NULL);
 
     err = uv_getnameinfo(loop->handle, LLUV_R(req, getnameinfo), lluv_on_getnameinfo, (struct sockaddr*)&sa, flags);
+    if(err >= 0) req->start = lluv_pool_submit(loop, LLUV_POOL_DNS);
 
     lua_settop(L, 0);
     lluv_loop_pushself(L, loop);
@@ -332,6 +609,54 @@ LLUV_IMPL_SAFE(lluv_getnameinfo){
   }
 }
 
+/* dns_cache([loop,] [false | true | {ttl=, negative_ttl=, max_entries=, flush=}]) */
+static int lluv_dns_cache(lua_State *L){
+  lluv_loop_t *loop = lluv_opt_loop(L, 1, LLUV_FLAG_OPEN);
+  int argc = loop ? 1 : 0;
+  lluv_dns_cache_t *cache;
+  if(!loop)loop = lluv_default_loop(L);
+  cache = &loop->dns;
+
+  if(lua_isboolean(L, argc + 1)){
+    cache->enabled = lua_toboolean(L, argc + 1);
+    if(!cache->enabled) lluv_dns_cache_flush(L, cache);
+  }
+  else if(lua_istable(L, argc + 1)){
+    int opt = argc + 1;
+
+    lua_getfield(L, opt, "ttl");
+    if(!lua_isnil(L, -1)) cache->ttl = (uint64_t)luaL_checkinteger(L, -1);
+    lua_pop(L, 1);
+
+    lua_getfield(L, opt, "negative_ttl");
+    if(!lua_isnil(L, -1)) cache->negative_ttl = (uint64_t)luaL_checkinteger(L, -1);
+    lua_pop(L, 1);
+
+    lua_getfield(L, opt, "max_entries");
+    if(!lua_isnil(L, -1)) cache->max_entries = (size_t)luaL_checkinteger(L, -1);
+    lua_pop(L, 1);
+
+    lua_getfield(L, opt, "flush");
+    if(lua_toboolean(L, -1) || cache->size > cache->max_entries) lluv_dns_cache_flush(L, cache);
+    lua_pop(L, 1);
+  }
+  else if(!lua_isnoneornil(L, argc + 1)){
+    luaL_argerror(L, argc + 1, "boolean or table expected");
+  }
+
+  lua_newtable(L);
+  lua_pushboolean(L, cache->enabled);                 lua_setfield(L, -2, "enabled");
+  lua_pushnumber(L, (lua_Number)cache->ttl);          lua_setfield(L, -2, "ttl");
+  lua_pushnumber(L, (lua_Number)cache->negative_ttl); lua_setfield(L, -2, "negative_ttl");
+  lua_pushnumber(L, (lua_Number)cache->max_entries);  lua_setfield(L, -2, "max_entries");
+  lua_pushnumber(L, (lua_Number)cache->size);         lua_setfield(L, -2, "size");
+  lua_pushnumber(L, (lua_Number)cache->hits);         lua_setfield(L, -2, "hits");
+  lua_pushnumber(L, (lua_Number)cache->misses);       lua_setfield(L, -2, "misses");
+  lua_pushnumber(L, (lua_Number)cache->coalesced);    lua_setfield(L, -2, "coalesced");
+
+  return 1;
+}
+
 static const lluv_uv_const_t lluv_dns_constants[] = {
 #define XX(C, L, N) {C, L},
     LLUV_AI_FAMILY_MAP(XX)
@@ -346,8 +671,9 @@ static const lluv_uv_const_t lluv_dns_constants[] = {
 #define LLUV_FUNCTIONS(F)                \
   {"getaddrinfo", lluv_getaddrinfo_##F}, \
   {"getnameinfo", lluv_getnameinfo_##F}, \
+  {"dns_cache",   lluv_dns_cache},         \
 
-static const struct luaL_Reg lluv_functions[][3] = {
+static const struct luaL_Reg lluv_functions[][4] = {
   {
     LLUV_FUNCTIONS(unsafe)
 
@@ -11,6 +11,20 @@
 #ifndef _LLUV_DNS_H_
 #define _LLUV_DNS_H_
 
+#include "lluv.h"
+#include "lluv_loop.h"
+
 LLUV_INTERNAL void lluv_dns_initlib(lua_State *L, int nup, int safe);
 
+LLUV_INTERNAL void lluv_dns_cache_init(lua_State *L, lluv_dns_cache_t *cache);
+
+LLUV_INTERNAL void lluv_dns_cache_close(lua_State *L, lluv_dns_cache_t *cache);
+
+/* resolve with loop cache. Callback `cb(loop, err, addresses)` should be on top
+** of stack and it is popped. Returns error code if request can not be started
+** (callback is called with error on next loop iteration).
+*/
+LLUV_INTERNAL int lluv_dns_getaddrinfo(lua_State *L, lluv_loop_t *loop, const char *node,
+  const char *service, const struct addrinfo *hints);
+
 #endif
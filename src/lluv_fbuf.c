@@ -10,8 +10,17 @@
 
 #include "lluv_fbuf.h"
 #include "lluv_utils.h"
+#include "lluv_error.h"
+#include <memory.h>
+#include <string.h>
 
-//! @todo implement pack/unpack functions
+#ifdef _WIN32
+#  include <io.h>
+#else
+#  include <sys/mman.h>
+#  include <unistd.h>
+#  include <errno.h>
+#endif
 
 //{ Fixed buffer
 
@@ -19,8 +28,13 @@
 static const char *LLUV_FIXEDBUFFER = LLUV_FIXEDBUFFER_NAME;
 
 LLUV_INTERNAL lluv_fixed_buffer_t *lluv_fbuf_alloc(lua_State *L, size_t n){
-  lluv_fixed_buffer_t *buffer = (lluv_fixed_buffer_t*)lutil_newudatap_impl(L, sizeof(lluv_fixed_buffer_t) + n - 1, LLUV_FIXEDBUFFER);
+  lluv_fixed_buffer_t *buffer = (lluv_fixed_buffer_t*)lutil_newudatap_impl(L, sizeof(lluv_fixed_buffer_t) + n, LLUV_FIXEDBUFFER);
   buffer->capacity = n;
+  buffer->data     = (char*)&buffer[1];
+  buffer->parent   = LUA_NOREF;
+  buffer->release  = NULL;
+  buffer->length   = 0;
+  buffer->pins     = 0;
   
   // this prevent GC so user shoul do this explicitly
   // but we remove ref in close method
@@ -30,12 +44,103 @@ LLUV_INTERNAL lluv_fixed_buffer_t *lluv_fbuf_alloc(lua_State *L, size_t n){
   return buffer;
 }
 
+LLUV_INTERNAL lluv_fixed_buffer_t *lluv_fbuf_wrap(lua_State *L, char *data, size_t n, lluv_fbuf_release_t release){
+  lluv_fixed_buffer_t *buffer = (lluv_fixed_buffer_t*)lutil_newudatap_impl(L, sizeof(lluv_fixed_buffer_t), LLUV_FIXEDBUFFER);
+  buffer->capacity = n;
+  buffer->data     = data;
+  buffer->parent   = LUA_NOREF;
+  buffer->release  = release;
+  buffer->length   = n;
+  buffer->pins     = 0;
+  return buffer;
+}
+
 LLUV_INTERNAL lluv_fixed_buffer_t *lluv_check_fbuf(lua_State *L, int i){
   lluv_fixed_buffer_t *buffer = (lluv_fixed_buffer_t *)lutil_checkudatap (L, i, LLUV_FIXEDBUFFER);
   luaL_argcheck (L, buffer != NULL, i, LLUV_FIXEDBUFFER_NAME" expected");
   return buffer;
 }
 
+LLUV_INTERNAL lluv_fixed_buffer_t *lluv_test_fbuf(lua_State *L, int i){
+  if(!lutil_isudatap(L, i, LLUV_FIXEDBUFFER)) return NULL;
+  return (lluv_fixed_buffer_t *)lua_touserdata(L, i);
+}
+
+LLUV_INTERNAL const char *lluv_to_bufdata(lua_State *L, int i, size_t *len){
+  lluv_fixed_buffer_t *buffer;
+
+  if(lua_type(L, i) == LUA_TSTRING) return lua_tolstring(L, i, len);
+
+  buffer = lluv_test_fbuf(L, i);
+  if(!buffer) return NULL;
+
+  *len = buffer->capacity;
+  return buffer->data;
+}
+
+LLUV_INTERNAL const char *lluv_check_bufdata(lua_State *L, int i, size_t *len){
+  const char *data = lluv_to_bufdata(L, i, len);
+  if(!data) luaL_typerror(L, i, "string or "LLUV_FIXEDBUFFER_NAME);
+  return data;
+}
+
+/* buffer which owns memory of buffer or slice */
+static lluv_fixed_buffer_t *lluv_fbuf_owner(lua_State *L, lluv_fixed_buffer_t *buffer){
+  lluv_fixed_buffer_t *owner;
+
+  if(buffer->parent == LUA_NOREF) return buffer;
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, buffer->parent);
+  owner = lluv_test_fbuf(L, -1);
+  lua_pop(L, 1);
+  return owner;
+}
+
+static void lluv_fbuf_release(lluv_fixed_buffer_t *buffer){
+  buffer->release(buffer->data, buffer->length);
+  buffer->release  = NULL;
+  buffer->capacity = 0;
+  buffer->data     = (char*)&buffer[1];
+}
+
+static void lluv_fbuf_pin_one(lua_State *L, int i, int delta){
+  lluv_fixed_buffer_t *buffer = lluv_test_fbuf(L, i);
+  if(buffer) buffer = lluv_fbuf_owner(L, buffer);
+  if(!buffer) return;
+
+  buffer->pins += delta;
+
+  /* `free` called while buffer was pinned.
+  ** Owner of external memory is empty only after `free`.
+  */
+  if((buffer->pins == 0) && buffer->release && (buffer->capacity == 0))
+    lluv_fbuf_release(buffer);
+}
+
+static void lluv_fbuf_pin_value(lua_State *L, int i, int delta){
+  if(lua_istable(L, i)){
+    size_t k, n = lua_rawlen(L, i);
+    for(k = 1; k <= n; ++k){
+      lua_rawgeti(L, i, (int)k);
+      lluv_fbuf_pin_one(L, -1, delta);
+      lua_pop(L, 1);
+    }
+    return;
+  }
+
+  lluv_fbuf_pin_one(L, i, delta);
+}
+
+LLUV_INTERNAL void lluv_fbuf_pin(lua_State *L, int i){
+  if(i < 0) i = lua_gettop(L) + i + 1;
+  lluv_fbuf_pin_value(L, i, 1);
+}
+
+LLUV_INTERNAL void lluv_fbuf_unpin(lua_State *L, int i){
+  if(i < 0) i = lua_gettop(L) + i + 1;
+  lluv_fbuf_pin_value(L, i, -1);
+}
+
 static int lluv_fbuf_new(lua_State *L){
   int64_t len = lutil_checkint64(L, 1);
   /*lluv_fixed_buffer_t *buffer = */lluv_fbuf_alloc(L, (size_t)len);
@@ -44,11 +149,76 @@ static int lluv_fbuf_new(lua_State *L){
 
 static int lluv_fbuf_close(lua_State *L){
   lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+
+  if(buffer->parent != LUA_NOREF){
+    lluv_fbuf_unpin(L, 1);
+    luaL_unref(L, LLUV_LUA_REGISTRY, buffer->parent);
+    buffer->parent   = LUA_NOREF;
+    buffer->capacity = 0;
+    return 0;
+  }
+
+  if(buffer->release){
+    /* slices and pending requests may still use memory
+    ** so it released when last of them done
+    */
+    buffer->capacity = 0;
+    if(buffer->pins == 0) lluv_fbuf_release(buffer);
+    return 0;
+  }
+
   lua_pushnil(L);
   lua_rawsetp(L, LLUV_LUA_REGISTRY, &buffer->data[0]);
   return 0;
 }
 
+static int lluv_fbuf_gc(lua_State *L){
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+
+  if(buffer->release){
+    lluv_fbuf_release(buffer);
+    return 0;
+  }
+
+  return lluv_fbuf_close(L);
+}
+
+static int lluv_fbuf_slice(lua_State *L){
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+  int64_t off = lutil_optint64(L, 2, 0);
+  int64_t len;
+  lluv_fixed_buffer_t *slice;
+
+  luaL_argcheck (L, (off >= 0) && (buffer->capacity >= (size_t)off), 2, LLUV_PREFIX" out of index");
+  len = lutil_optint64(L, 3, buffer->capacity - off);
+  luaL_argcheck (L, (len >= 0) && ((buffer->capacity - off) >= (size_t)len), 3, LLUV_PREFIX" out of index");
+
+  slice = (lluv_fixed_buffer_t*)lutil_newudatap_impl(L, sizeof(lluv_fixed_buffer_t), LLUV_FIXEDBUFFER);
+  slice->capacity = (size_t)len;
+  slice->data     = buffer->data + off;
+  slice->release  = NULL;
+  slice->length   = 0;
+  slice->pins     = 0;
+
+  /* reference buffer which owns memory */
+  if(buffer->parent != LUA_NOREF)
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, buffer->parent);
+  else
+    lua_pushvalue(L, 1);
+  lluv_fbuf_pin(L, -1);
+  slice->parent   = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+  return 1;
+}
+
+static int lluv_fbuf_parent(lua_State *L){
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+  if(buffer->parent == LUA_NOREF) return 0;
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, buffer->parent);
+  return 1;
+}
+
 static int lluv_fbuf_to_s(lua_State *L){
   lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
   int64_t len = buffer->capacity;
@@ -90,13 +260,622 @@ static int lluv_fbuf_size(lua_State *L){
   return 1;
 }
 
+//{ Pack/unpack
+
+#define LLUV_VARINT_MAX_SIZE 10
+
+static int lluv_native_little(void){
+  static const int one = 1;
+  return *(const char*)&one;
+}
+
+static void lluv_put_uint(char *p, uint64_t v, size_t n, int little){
+  size_t i;
+  if(little) for(i = 0; i < n; ++i){ p[i]     = (char)(v & 0xFF); v >>= 8; }
+  else       for(i = n; i > 0; --i){ p[i - 1] = (char)(v & 0xFF); v >>= 8; }
+}
+
+static uint64_t lluv_get_uint(const char *p, size_t n, int little){
+  uint64_t v = 0; size_t i;
+  if(little) for(i = n; i > 0; --i) v = (v << 8) | (unsigned char)p[i - 1];
+  else       for(i = 0; i < n; ++i) v = (v << 8) | (unsigned char)p[i];
+  return v;
+}
+
+static int64_t lluv_get_int(const char *p, size_t n, int little){
+  uint64_t v = lluv_get_uint(p, n, little);
+  if((n < 8) && (v >> (n * 8 - 1))) v |= (~(uint64_t)0) << (n * 8);
+  return (int64_t)v;
+}
+
+static void lluv_put_float(char *p, double d, size_t n, int little){
+  char tmp[8]; size_t i;
+  if(n == 4){ float f = (float)d; memcpy(tmp, &f, 4); }
+  else memcpy(tmp, &d, 8);
+
+  if(little == lluv_native_little()) memcpy(p, tmp, n);
+  else for(i = 0; i < n; ++i) p[i] = tmp[n - i - 1];
+}
+
+static double lluv_get_float(const char *p, size_t n, int little){
+  char tmp[8]; size_t i;
+
+  if(little == lluv_native_little()) memcpy(tmp, p, n);
+  else for(i = 0; i < n; ++i) tmp[i] = p[n - i - 1];
+
+  if(n == 4){ float f; memcpy(&f, tmp, 4); return f; }
+  { double d; memcpy(&d, tmp, 8); return d; }
+}
+
+static size_t lluv_put_varint(char *p, uint64_t v){
+  size_t n = 0;
+  while(v >= 0x80){
+    p[n++] = (char)((v & 0x7F) | 0x80);
+    v >>= 7;
+  }
+  p[n++] = (char)v;
+  return n;
+}
+
+static size_t lluv_put_svarint(char *p, int64_t v){
+  size_t n = 0;
+  while(1){
+    unsigned char b = (unsigned char)(v & 0x7F);
+    v >>= 7; /* arithmetic shift */
+    if(((v == 0) && !(b & 0x40)) || ((v == -1) && (b & 0x40))){
+      p[n++] = (char)b;
+      return n;
+    }
+    p[n++] = (char)(b | 0x80);
+  }
+}
+
+/* return number of bytes or 0 if buffer too small, or -1 if varint too long */
+static int lluv_get_varint(const char *p, size_t len, uint64_t *v, int sign){
+  size_t i; int shift = 0; uint64_t r = 0;
+  for(i = 0; i < len; ++i){
+    unsigned char b = (unsigned char)p[i];
+    if(i == LLUV_VARINT_MAX_SIZE) return -1;
+    r |= ((uint64_t)(b & 0x7F)) << shift;
+    shift += 7;
+    if(!(b & 0x80)){
+      if(sign && (shift < 64) && (b & 0x40)) r |= (~(uint64_t)0) << shift;
+      *v = r;
+      return (int)(i + 1);
+    }
+  }
+  return 0;
+}
+
+static size_t lluv_fbuf_check_offset(lua_State *L, lluv_fixed_buffer_t *buffer, int idx, size_t n){
+  int64_t off = lutil_checkint64(L, idx);
+  luaL_argcheck(L, (off >= 0) && ((size_t)off <= buffer->capacity) && ((buffer->capacity - (size_t)off) >= n),
+    idx, LLUV_PREFIX" out of index");
+  return (size_t)off;
+}
+
+static int lluv_fbuf_get_int_impl(lua_State *L, size_t n, int sign, int little){
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+  size_t off = lluv_fbuf_check_offset(L, buffer, 2, n);
+  if(sign) lutil_pushint64(L, lluv_get_int(&buffer->data[off], n, little));
+  else if(n < 8) lutil_pushint64(L, (int64_t)lluv_get_uint(&buffer->data[off], n, little));
+  else if(sizeof(lua_Integer) >= 8) lua_pushinteger(L, (lua_Integer)lluv_get_uint(&buffer->data[off], n, little));
+  else lua_pushnumber(L, (lua_Number)lluv_get_uint(&buffer->data[off], n, little));
+  return 1;
+}
+
+static uint64_t lluv_check_uint64(lua_State *L, int idx){
+  if((sizeof(lua_Integer) < 8) && (lua_tonumber(L, idx) >= 9223372036854775808.0))
+    return (uint64_t)lua_tonumber(L, idx);
+  return (uint64_t)lutil_checkint64(L, idx);
+}
+
+static int lluv_fbuf_set_int_impl(lua_State *L, size_t n, int little){
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+  size_t off = lluv_fbuf_check_offset(L, buffer, 2, n);
+  lluv_put_uint(&buffer->data[off], lluv_check_uint64(L, 3), n, little);
+  lutil_pushint64(L, off + n);
+  return 1;
+}
+
+static int lluv_fbuf_get_float_impl(lua_State *L, size_t n, int little){
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+  size_t off = lluv_fbuf_check_offset(L, buffer, 2, n);
+  lua_pushnumber(L, lluv_get_float(&buffer->data[off], n, little));
+  return 1;
+}
+
+static int lluv_fbuf_set_float_impl(lua_State *L, size_t n, int little){
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+  size_t off = lluv_fbuf_check_offset(L, buffer, 2, n);
+  lluv_put_float(&buffer->data[off], luaL_checknumber(L, 3), n, little);
+  lutil_pushint64(L, off + n);
+  return 1;
+}
+
+#define LLUV_FBUF_INT_ACCESSORS(NAME, N, SIGN, LITTLE)                                    \
+static int lluv_fbuf_get_##NAME(lua_State *L){                                            \
+  return lluv_fbuf_get_int_impl(L, N, SIGN, LITTLE);                                      \
+}                                                                                         \
+static int lluv_fbuf_set_##NAME(lua_State *L){                                            \
+  return lluv_fbuf_set_int_impl(L, N, LITTLE);                                            \
+}                                                                                         \
+
+#define LLUV_FBUF_FLOAT_ACCESSORS(NAME, N, LITTLE)                                        \
+static int lluv_fbuf_get_##NAME(lua_State *L){                                            \
+  return lluv_fbuf_get_float_impl(L, N, LITTLE);                                          \
+}                                                                                         \
+static int lluv_fbuf_set_##NAME(lua_State *L){                                            \
+  return lluv_fbuf_set_float_impl(L, N, LITTLE);                                          \
+}                                                                                         \
+
+LLUV_FBUF_INT_ACCESSORS(i8,    1, 1, 1)
+LLUV_FBUF_INT_ACCESSORS(u8,    1, 0, 1)
+LLUV_FBUF_INT_ACCESSORS(i16le, 2, 1, 1)
+LLUV_FBUF_INT_ACCESSORS(i16be, 2, 1, 0)
+LLUV_FBUF_INT_ACCESSORS(u16le, 2, 0, 1)
+LLUV_FBUF_INT_ACCESSORS(u16be, 2, 0, 0)
+LLUV_FBUF_INT_ACCESSORS(i32le, 4, 1, 1)
+LLUV_FBUF_INT_ACCESSORS(i32be, 4, 1, 0)
+LLUV_FBUF_INT_ACCESSORS(u32le, 4, 0, 1)
+LLUV_FBUF_INT_ACCESSORS(u32be, 4, 0, 0)
+LLUV_FBUF_INT_ACCESSORS(i64le, 8, 1, 1)
+LLUV_FBUF_INT_ACCESSORS(i64be, 8, 1, 0)
+LLUV_FBUF_INT_ACCESSORS(u64le, 8, 0, 1)
+LLUV_FBUF_INT_ACCESSORS(u64be, 8, 0, 0)
+
+LLUV_FBUF_FLOAT_ACCESSORS(f32le, 4, 1)
+LLUV_FBUF_FLOAT_ACCESSORS(f32be, 4, 0)
+LLUV_FBUF_FLOAT_ACCESSORS(f64le, 8, 1)
+LLUV_FBUF_FLOAT_ACCESSORS(f64be, 8, 0)
+
+static int lluv_fbuf_get_varint_impl(lua_State *L, int sign){
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+  size_t off = lluv_fbuf_check_offset(L, buffer, 2, 0);
+  uint64_t v; int n = lluv_get_varint(&buffer->data[off], buffer->capacity - off, &v, sign);
+
+  if(n < 0) return luaL_error(L, "malformed varint at offset %d", (int)off);
+
+  if(n == 0) return 0; /* need more data */
+
+  if(sign || (sizeof(lua_Integer) >= 8)) lutil_pushint64(L, (int64_t)v);
+  else lua_pushnumber(L, (lua_Number)v);
+  lutil_pushint64(L, off + n);
+  return 2;
+}
+
+static int lluv_fbuf_set_varint_impl(lua_State *L, int sign){
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+  size_t off = lluv_fbuf_check_offset(L, buffer, 2, 0);
+  char tmp[LLUV_VARINT_MAX_SIZE];
+  size_t n = sign ? lluv_put_svarint(tmp, lutil_checkint64(L, 3)) : lluv_put_varint(tmp, lluv_check_uint64(L, 3));
+
+  luaL_argcheck(L, (buffer->capacity - off) >= n, 2, LLUV_PREFIX" out of index");
+  memcpy(&buffer->data[off], tmp, n);
+
+  lutil_pushint64(L, off + n);
+  return 1;
+}
+
+static int lluv_fbuf_get_varint(lua_State *L){
+  return lluv_fbuf_get_varint_impl(L, 0);
+}
+
+static int lluv_fbuf_set_varint(lua_State *L){
+  return lluv_fbuf_set_varint_impl(L, 0);
+}
+
+static int lluv_fbuf_get_svarint(lua_State *L){
+  return lluv_fbuf_get_varint_impl(L, 1);
+}
+
+static int lluv_fbuf_set_svarint(lua_State *L){
+  return lluv_fbuf_set_varint_impl(L, 1);
+}
+
+/* Format options (similar to string.pack)
+**  < > =     little/big/native endian
+**  b B       signed/unsigned char
+**  h H       signed/unsigned 16 bit integer
+**  i[n] I[n] signed/unsigned integer with n bytes (default 4)
+**  l L j J   signed/unsigned 64 bit integer
+**  f d       float/double
+**  v V       unsigned/signed LEB128 varint
+**  s[n]      string preceded by its length coded as unsigned integer with n bytes (default 4)
+**  z         zero-terminated string
+**  c[n]      fixed-sized string with n bytes
+**  x         one byte of padding
+**  ' '       ignored
+**/
+
+typedef struct lluv_pack_state_tag{
+  lua_State  *L;
+  const char *fmt;
+  int         little;
+}lluv_pack_state_t;
+
+static size_t lluv_pack_optsize(lluv_pack_state_t *h, size_t d){
+  size_t n = 0;
+  if((*h->fmt < '0') || (*h->fmt > '9')) return d;
+  while((*h->fmt >= '0') && (*h->fmt <= '9')){
+    n = n * 10 + (*h->fmt++ - '0');
+    if(n > 0xFFFFFF) luaL_error(h->L, "format size too large");
+  }
+  return n;
+}
+
+static size_t lluv_pack_intsize(lluv_pack_state_t *h, size_t d){
+  size_t n = lluv_pack_optsize(h, d);
+  if((n < 1) || (n > 8)) luaL_error(h->L, "integral size (%d) out of limits [1,8]", (int)n);
+  return n;
+}
+
+/* return option char and set size of fixed sized value */
+static int lluv_pack_next(lluv_pack_state_t *h, size_t *size){
+  while(1){
+    int opt = *h->fmt++;
+    *size = 0;
+    switch(opt){
+      case '\0': --h->fmt; return 0;
+      case ' ' : break;
+      case '<' : h->little = 1; break;
+      case '>' : h->little = 0; break;
+      case '=' : h->little = lluv_native_little(); break;
+      case 'b' : case 'B': case 'x': *size = 1; return opt;
+      case 'h' : case 'H': *size = 2; return opt;
+      case 'i' : case 'I': *size = lluv_pack_intsize(h, 4); return opt;
+      case 'l' : case 'L': case 'j': case 'J': *size = 8; return opt;
+      case 'f' : *size = 4; return opt;
+      case 'd' : *size = 8; return opt;
+      case 's' : *size = lluv_pack_intsize(h, 4); return opt;
+      case 'c' :
+        *size = lluv_pack_optsize(h, (size_t)-1);
+        if(*size == (size_t)-1) luaL_error(h->L, "missing size for format option 'c'");
+        return opt;
+      case 'v' : case 'V': case 'z': return opt;
+      default: return luaL_error(h->L, "invalid format option '%c'", opt);
+    }
+  }
+}
+
+#define LLUV_PACK_CHECK(n) if((buffer->capacity - off) < (n)) \
+  return luaL_error(L, LLUV_PREFIX" out of index (offset %d)", (int)off)
+
+static int lluv_fbuf_pack(lua_State *L){
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+  size_t off = lluv_fbuf_check_offset(L, buffer, 2, 0);
+  lluv_pack_state_t h; int arg = 3, opt; size_t size;
+
+  h.L = L; h.fmt = luaL_checkstring(L, 3); h.little = lluv_native_little();
+
+  while(0 != (opt = lluv_pack_next(&h, &size))){
+    switch(opt){
+      case 'b': case 'h': case 'i': case 'l': case 'j':
+      case 'B': case 'H': case 'I': case 'L': case 'J':
+        LLUV_PACK_CHECK(size);
+        lluv_put_uint(&buffer->data[off], lluv_check_uint64(L, ++arg), size, h.little);
+        break;
+      case 'f': case 'd':
+        LLUV_PACK_CHECK(size);
+        lluv_put_float(&buffer->data[off], luaL_checknumber(L, ++arg), size, h.little);
+        break;
+      case 'x':
+        LLUV_PACK_CHECK(size);
+        buffer->data[off] = 0;
+        break;
+      case 'v': case 'V':{
+        char tmp[LLUV_VARINT_MAX_SIZE];
+        size = (opt == 'v') ? lluv_put_varint(tmp, lluv_check_uint64(L, ++arg)) : lluv_put_svarint(tmp, lutil_checkint64(L, ++arg));
+        LLUV_PACK_CHECK(size);
+        memcpy(&buffer->data[off], tmp, size);
+        break;
+      }
+      case 's':{
+        size_t len; const char *str = luaL_checklstring(L, ++arg, &len);
+        luaL_argcheck(L, (size >= 8) || (len < ((uint64_t)1 << (size * 8))), arg, "string length does not fit in given size");
+        LLUV_PACK_CHECK(size);
+        lluv_put_uint(&buffer->data[off], len, size, h.little);
+        off += size;
+        LLUV_PACK_CHECK(len);
+        memcpy(&buffer->data[off], str, len);
+        size = len;
+        break;
+      }
+      case 'z':{
+        size_t len; const char *str = luaL_checklstring(L, ++arg, &len);
+        luaL_argcheck(L, strlen(str) == len, arg, "string contains zeros");
+        LLUV_PACK_CHECK(len + 1);
+        memcpy(&buffer->data[off], str, len + 1);
+        size = len + 1;
+        break;
+      }
+      case 'c':{
+        size_t len; const char *str = luaL_checklstring(L, ++arg, &len);
+        luaL_argcheck(L, len <= size, arg, "string longer than given size");
+        LLUV_PACK_CHECK(size);
+        memcpy(&buffer->data[off], str, len);
+        if(len < size) memset(&buffer->data[off + len], 0, size - len);
+        break;
+      }
+    }
+    off += size;
+  }
+
+  lutil_pushint64(L, off);
+  return 1;
+}
+
+static int lluv_fbuf_unpack(lua_State *L){
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+  size_t off = lluv_fbuf_check_offset(L, buffer, 2, 0);
+  lluv_pack_state_t h; int n = 0, opt; size_t size;
+
+  h.L = L; h.fmt = luaL_checkstring(L, 3); h.little = lluv_native_little();
+
+  while(0 != (opt = lluv_pack_next(&h, &size))){
+    luaL_checkstack(L, 2, "too many results");
+    switch(opt){
+      case 'b': case 'h': case 'i': case 'l': case 'j':
+        LLUV_PACK_CHECK(size);
+        lutil_pushint64(L, lluv_get_int(&buffer->data[off], size, h.little));
+        ++n;
+        break;
+      case 'B': case 'H': case 'I': case 'L': case 'J':{
+        uint64_t v;
+        LLUV_PACK_CHECK(size);
+        v = lluv_get_uint(&buffer->data[off], size, h.little);
+        if((size < 8) || (sizeof(lua_Integer) >= 8)) lutil_pushint64(L, (int64_t)v);
+        else lua_pushnumber(L, (lua_Number)v);
+        ++n;
+        break;
+      }
+      case 'f': case 'd':
+        LLUV_PACK_CHECK(size);
+        lua_pushnumber(L, lluv_get_float(&buffer->data[off], size, h.little));
+        ++n;
+        break;
+      case 'x':
+        LLUV_PACK_CHECK(size);
+        break;
+      case 'v': case 'V':{
+        uint64_t v; int ret = lluv_get_varint(&buffer->data[off], buffer->capacity - off, &v, opt == 'V');
+        if(ret < 0) return luaL_error(L, "malformed varint at offset %d", (int)off);
+        LLUV_PACK_CHECK((size_t)(ret ? ret : LLUV_VARINT_MAX_SIZE + 1));
+        if((opt == 'V') || (sizeof(lua_Integer) >= 8)) lutil_pushint64(L, (int64_t)v);
+        else lua_pushnumber(L, (lua_Number)v);
+        size = ret;
+        ++n;
+        break;
+      }
+      case 's':{
+        uint64_t len;
+        LLUV_PACK_CHECK(size);
+        len = lluv_get_uint(&buffer->data[off], size, h.little);
+        off += size;
+        LLUV_PACK_CHECK(len);
+        lua_pushlstring(L, &buffer->data[off], (size_t)len);
+        size = (size_t)len;
+        ++n;
+        break;
+      }
+      case 'z':{
+        const char *e = memchr(&buffer->data[off], 0, buffer->capacity - off);
+        if(!e) return luaL_error(L, "unfinished string for format 'z'");
+        size = e - &buffer->data[off];
+        lua_pushlstring(L, &buffer->data[off], size);
+        size += 1;
+        ++n;
+        break;
+      }
+      case 'c':
+        LLUV_PACK_CHECK(size);
+        lua_pushlstring(L, &buffer->data[off], size);
+        ++n;
+        break;
+    }
+    off += size;
+  }
+
+  lutil_pushint64(L, off);
+  return n + 1;
+}
+
+#undef LLUV_PACK_CHECK
+
+//}
+
+//{ Memory mapping
+
+/* Mapping has to start at page (allocation granularity on Windows)
+** boundary so buffer data points inside mapping and base address
+** is restored from data pointer on unmap.
+*/
+
+static size_t lluv_map_granularity(void){
+  static size_t granularity = 0;
+  if(!granularity){
+#ifdef _WIN32
+    SYSTEM_INFO si; GetSystemInfo(&si);
+    granularity = (size_t)si.dwAllocationGranularity;
+#else
+    granularity = (size_t)sysconf(_SC_PAGESIZE);
+#endif
+  }
+  return granularity;
+}
+
+static int lluv_map_error(void){
+#ifdef _WIN32
+  /* libuv does not export system error translation */
+  return (GetLastError() == ERROR_NOT_ENOUGH_MEMORY) ? UV_ENOMEM : UV_EIO;
+#else
+  return -errno;
+#endif
+}
+
+static void lluv_fbuf_munmap(char *data, size_t capacity){
+  size_t delta = (size_t)((uintptr_t)data % lluv_map_granularity());
+#ifdef _WIN32
+  UnmapViewOfFile(data - delta);
+#else
+  munmap(data - delta, capacity + delta);
+#endif
+}
+
+LLUV_INTERNAL int lluv_fbuf_mmap(lua_State *L, uv_file fd, int mode, int64_t offset, size_t len){
+  size_t delta = (size_t)(offset % lluv_map_granularity());
+  int64_t base_offset = offset - delta;
+  char *base;
+
+  if(len == 0){
+    lluv_fbuf_alloc(L, 0);
+    return 0;
+  }
+
+#ifdef _WIN32
+  {
+    HANDLE hfile = (HANDLE)_get_osfhandle(fd), hmap;
+    DWORD protect = (mode == LLUV_FBUF_MAP_WRITE)   ? PAGE_READWRITE :
+                    (mode == LLUV_FBUF_MAP_PRIVATE) ? PAGE_WRITECOPY : PAGE_READONLY;
+    DWORD access  = (mode == LLUV_FBUF_MAP_WRITE)   ? FILE_MAP_WRITE :
+                    (mode == LLUV_FBUF_MAP_PRIVATE) ? FILE_MAP_COPY  : FILE_MAP_READ;
+
+    if(hfile == INVALID_HANDLE_VALUE) return UV_EBADF;
+
+    hmap = CreateFileMappingA(hfile, NULL, protect, 0, 0, NULL);
+    if(!hmap) return lluv_map_error();
+
+    base = (char*)MapViewOfFile(hmap, access,
+      (DWORD)((uint64_t)base_offset >> 32), (DWORD)(base_offset & 0xFFFFFFFF),
+      len + delta
+    );
+    if(!base){
+      int err = lluv_map_error();
+      CloseHandle(hmap);
+      return err;
+    }
+
+    /* view keeps mapping object alive */
+    CloseHandle(hmap);
+  }
+#else
+  {
+    int prot  = (mode == LLUV_FBUF_MAP_READ) ? PROT_READ : (PROT_READ | PROT_WRITE);
+    int flags = (mode == LLUV_FBUF_MAP_PRIVATE) ? MAP_PRIVATE : MAP_SHARED;
+
+    base = (char*)mmap(NULL, len + delta, prot, flags, fd, (off_t)base_offset);
+    if(base == (char*)MAP_FAILED) return lluv_map_error();
+  }
+#endif
+
+  lluv_fbuf_wrap(L, base + delta, len, lluv_fbuf_munmap);
+  return 0;
+}
+
+/* push buffer which owns memory of (possibly sliced) buffer at index i */
+static lluv_fixed_buffer_t *lluv_fbuf_check_mapped(lua_State *L, int i){
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, i), *owner = buffer;
+
+  if(buffer->parent != LUA_NOREF){
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, buffer->parent);
+    owner = lluv_test_fbuf(L, -1);
+    lua_pop(L, 1);
+  }
+
+  luaL_argcheck (L, owner && (owner->release == lluv_fbuf_munmap), i, LLUV_PREFIX" mapped buffer expected");
+  return buffer;
+}
+
+static int lluv_fbuf_msync(lua_State *L){
+  lluv_fixed_buffer_t *buffer = lluv_fbuf_check_mapped(L, 1);
+  int async = lua_toboolean(L, 2);
+  size_t delta = (size_t)((uintptr_t)buffer->data % lluv_map_granularity());
+  int err = 0;
+
+  if(buffer->capacity == 0){
+    lua_settop(L, 1);
+    return 1;
+  }
+
+#ifdef _WIN32
+  if(!FlushViewOfFile(buffer->data - delta, buffer->capacity + delta))
+    err = lluv_map_error();
+#else
+  if(msync(buffer->data - delta, buffer->capacity + delta, async ? MS_ASYNC : MS_SYNC))
+    err = lluv_map_error();
+#endif
+  (void)async;
+
+  if(err < 0) return lluv_fail(L, 0, LLUV_ERR_UV, err, NULL);
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+static int lluv_fbuf_madvise(lua_State *L){
+  static const char *advices[] = {"normal", "random", "sequential", "willneed", "dontneed", NULL};
+  lluv_fixed_buffer_t *buffer = lluv_fbuf_check_mapped(L, 1);
+  int advice = luaL_checkoption(L, 2, NULL, advices);
+
+#ifndef _WIN32
+  static const int values[] = {MADV_NORMAL, MADV_RANDOM, MADV_SEQUENTIAL, MADV_WILLNEED, MADV_DONTNEED};
+  size_t delta = (size_t)((uintptr_t)buffer->data % lluv_map_granularity());
+
+  if(buffer->capacity && madvise(buffer->data - delta, buffer->capacity + delta, values[advice]))
+    return lluv_fail(L, 0, LLUV_ERR_UV, lluv_map_error(), NULL);
+#else
+  /* hints only, there no direct equivalent */
+  (void)buffer; (void)advice;
+#endif
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+//}
+
 static const struct luaL_Reg lluv_fbuf_methods[] = {
-  { "__gc",        lluv_fbuf_close          },
+  { "__gc",        lluv_fbuf_gc             },
   { "__tostring",  lluv_fbuf_to_s           },
   { "free",        lluv_fbuf_close          },
   { "to_s",        lluv_fbuf_to_s           },
   { "to_p",        lluv_fbuf_topointer      },
   { "size",        lluv_fbuf_size           },
+  { "slice",       lluv_fbuf_slice          },
+  { "parent",      lluv_fbuf_parent         },
+  { "msync",       lluv_fbuf_msync          },
+  { "madvise",     lluv_fbuf_madvise        },
+  { "pack",        lluv_fbuf_pack           },
+  { "unpack",      lluv_fbuf_unpack         },
+  { "get_varint",  lluv_fbuf_get_varint     },
+  { "set_varint",  lluv_fbuf_set_varint     },
+  { "get_svarint", lluv_fbuf_get_svarint    },
+  { "set_svarint", lluv_fbuf_set_svarint    },
+
+#define LLUV_FBUF_ACCESSORS_REG(NAME) \
+  { "get_"#NAME,   lluv_fbuf_get_##NAME     }, \
+  { "set_"#NAME,   lluv_fbuf_set_##NAME     },
+
+  LLUV_FBUF_ACCESSORS_REG(i8   )
+  LLUV_FBUF_ACCESSORS_REG(u8   )
+  LLUV_FBUF_ACCESSORS_REG(i16le)
+  LLUV_FBUF_ACCESSORS_REG(i16be)
+  LLUV_FBUF_ACCESSORS_REG(u16le)
+  LLUV_FBUF_ACCESSORS_REG(u16be)
+  LLUV_FBUF_ACCESSORS_REG(i32le)
+  LLUV_FBUF_ACCESSORS_REG(i32be)
+  LLUV_FBUF_ACCESSORS_REG(u32le)
+  LLUV_FBUF_ACCESSORS_REG(u32be)
+  LLUV_FBUF_ACCESSORS_REG(i64le)
+  LLUV_FBUF_ACCESSORS_REG(i64be)
+  LLUV_FBUF_ACCESSORS_REG(u64le)
+  LLUV_FBUF_ACCESSORS_REG(u64be)
+  LLUV_FBUF_ACCESSORS_REG(f32le)
+  LLUV_FBUF_ACCESSORS_REG(f32be)
+  LLUV_FBUF_ACCESSORS_REG(f64le)
+  LLUV_FBUF_ACCESSORS_REG(f64be)
+
+#undef LLUV_FBUF_ACCESSORS_REG
 
   {NULL,NULL}
 };
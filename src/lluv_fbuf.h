@@ -13,15 +13,48 @@
 
 #include "lluv.h"
 
+/* release memory which not owned by buffer object (e.g. malloc or mmap) */
+typedef void (*lluv_fbuf_release_t)(char *data, size_t capacity);
+
 typedef struct lluv_fixed_buffer_tag{
   size_t  capacity;
-  char    data[1];
+  char   *data;
+  int     parent;   /* slice holds reference to buffer which owns memory */
+  lluv_fbuf_release_t release;
+  size_t  length;   /* size of external memory passed to `release` */
+  int     pins;     /* slices and pending requests which use memory */
 }lluv_fixed_buffer_t;
 
 LLUV_INTERNAL void lluv_fbuf_initlib(lua_State *L, int nup, int safe);
 
 LLUV_INTERNAL lluv_fixed_buffer_t *lluv_fbuf_alloc(lua_State *L, size_t n);
 
+/* buffer takes ownership of external memory and calls `release`
+** on `free` (when buffer is not pinned) or on gc
+*/
+LLUV_INTERNAL lluv_fixed_buffer_t *lluv_fbuf_wrap(lua_State *L, char *data, size_t n, lluv_fbuf_release_t release);
+
+#define LLUV_FBUF_MAP_READ    0
+#define LLUV_FBUF_MAP_WRITE   1 /* shared, changes go to file   */
+#define LLUV_FBUF_MAP_PRIVATE 2 /* copy on write, file untouched */
+
+/* push buffer mapped to file region. returns 0 or UV error code */
+LLUV_INTERNAL int lluv_fbuf_mmap(lua_State *L, uv_file fd, int mode, int64_t offset, size_t len);
+
 LLUV_INTERNAL lluv_fixed_buffer_t *lluv_check_fbuf(lua_State *L, int i);
 
+LLUV_INTERNAL lluv_fixed_buffer_t *lluv_test_fbuf(lua_State *L, int i);
+
+/* return pointer to string or buffer (slice) data or NULL */
+LLUV_INTERNAL const char *lluv_to_bufdata(lua_State *L, int i, size_t *len);
+
+LLUV_INTERNAL const char *lluv_check_bufdata(lua_State *L, int i, size_t *len);
+
+/* pin memory of buffer at index i while request uses it.
+** Value could also be string (ignored) or array of strings and buffers.
+*/
+LLUV_INTERNAL void lluv_fbuf_pin(lua_State *L, int i);
+
+LLUV_INTERNAL void lluv_fbuf_unpin(lua_State *L, int i);
+
 #endif
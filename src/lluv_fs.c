@@ -17,8 +17,11 @@
 #include "lluv_stream.h"
 #include "lluv_pipe.h"
 #include "lluv_fbuf.h"
+#include "lluv_pool.h"
 #include <assert.h>
 #include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
 
 #ifndef _WIN32
 
@@ -36,6 +39,7 @@ typedef struct lluv_fs_request_tag{
   lua_State *L;
   int cb;
   int file_ref;
+  uint64_t start; /* threadpool submit time */
 }lluv_fs_request_t;
 
 #define LLUV_FCALLBACK_L(H) (lluv_loop_byptr(H->req.loop)->L)
@@ -49,6 +53,14 @@ static lluv_fs_request_t *lluv_fs_request_new(lua_State *L){
 }
 
 static void lluv_fs_request_free(lua_State *L, lluv_fs_request_t *req){
+  /* read/write buffer if result not pushed */
+  lua_rawgetp(L, LLUV_LUA_REGISTRY, &req->req);
+  if(!lua_isnil(L, -1)){
+    lluv_fbuf_unpin(L, -1);
+    lua_pushnil(L); lua_rawsetp(L, LLUV_LUA_REGISTRY, &req->req);
+  }
+  lua_pop(L, 1);
+
   if(req->cb != LUA_NOREF)
     luaL_unref(L, LLUV_LUA_REGISTRY, req->cb);
   if(req->file_ref != LUA_NOREF)
@@ -113,16 +125,6 @@ static int lluv_push_fs_result_object(lua_State* L, lluv_fs_request_t* lreq) {
   }
 }
 
-#define LLUV_DIRENT_MAP(XX)        \
-  XX("unknown", UV_DIRENT_UNKNOWN) \
-  XX("file",    UV_DIRENT_FILE)    \
-  XX("dir",     UV_DIRENT_DIR)     \
-  XX("link",    UV_DIRENT_LINK)    \
-  XX("fifo",    UV_DIRENT_FIFO)    \
-  XX("socket",  UV_DIRENT_SOCKET)  \
-  XX("char",    UV_DIRENT_CHAR)    \
-  XX("block",   UV_DIRENT_BLOCK)   \
-
 static int lluv_push_fs_result(lua_State* L, lluv_fs_request_t* lreq) {
   uv_fs_t *req = &lreq->req;
   /*lluv_loop_t *loop = req->loop->data;*/
@@ -174,6 +176,7 @@ static int lluv_push_fs_result(lua_State* L, lluv_fs_request_t* lreq) {
     case UV_FS_WRITE:
     case UV_FS_READ:
       lua_rawgetp(L, LLUV_LUA_REGISTRY, req);
+      lluv_fbuf_unpin(L, -1);
       lua_pushnil(L); lua_rawsetp(L, LLUV_LUA_REGISTRY, req);
       lutil_pushint64(L, req->result);
       return 2;
@@ -217,6 +220,8 @@ static void lluv_on_fs(uv_fs_t *arg){
 
   LLUV_CHECK_LOOP_CB_INVARIANT(L);
 
+  lluv_pool_done(loop, LLUV_POOL_FS, req->start);
+
   lua_rawgeti(L, LLUV_LUA_REGISTRY, req->cb);
 
   argc = lluv_push_fs_result_object(L, req);
@@ -237,21 +242,91 @@ static void lluv_on_fs(uv_fs_t *arg){
   LLUV_CHECK_LOOP_CB_INVARIANT(L);
 }
 
+//{ Calls queued by threadpool limit
+
+/* fs class reached its limit (see lluv_pool.c) so call saved with
+** all arguments and repeated when fs request of this loop done.
+*/
+typedef struct lluv_fs_call_tag{
+  lluv_pool_job_t pool;   /* must be first */
+  int             args;   /* {function, arguments...} */
+  int             n;      /* number of arguments      */
+}lluv_fs_call_t;
+
+static void lluv_fs_call_queued(lluv_loop_t *loop, lluv_pool_job_t *job){
+  lluv_fs_call_t *c = (lluv_fs_call_t*)job;
+  lua_State *L = loop->L;
+  int i, t, n = c->n;
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, c->args);
+  t = lua_gettop(L);
+  luaL_unref(L, LLUV_LUA_REGISTRY, c->args);
+  lluv_free_t(L, lluv_fs_call_t, c);
+
+  lua_checkstack(L, n + 1);
+  for(i = 1; i <= n + 1; ++i) lua_rawgeti(L, t, i);
+
+  loop->pool.starting = 1;
+  lluv_lua_call(L, n, 0);
+  loop->pool.starting = 0;
+
+  /* buffers pinned by request itself now */
+  for(i = 2; i <= n + 1; ++i){
+    lua_rawgeti(L, t, i);
+    lluv_fbuf_unpin(L, -1);
+    lua_pop(L, 1);
+  }
+  lua_settop(L, t - 1);
+}
+
+static void lluv_fs_call_enqueue(lua_State *L, lluv_loop_t *loop, lua_CFunction fn){
+  lluv_fs_call_t *c = lluv_alloc_t(L, lluv_fs_call_t);
+  int i, n = lua_gettop(L);
+
+  lua_createtable(L, n + 1, 0);
+  lua_pushvalue(L, LLUV_LUA_REGISTRY);
+  lua_pushvalue(L, LLUV_LUA_HANDLES);
+  lua_pushcclosure(L, fn, 2);
+  lua_rawseti(L, -2, 1);
+  for(i = 1; i <= n; ++i){
+    lua_pushvalue(L, i);
+    lluv_fbuf_pin(L, -1);
+    lua_rawseti(L, -2, i + 1);
+  }
+
+  c->n    = n;
+  c->args = luaL_ref(L, LLUV_LUA_REGISTRY);
+  lluv_pool_enqueue(loop, LLUV_POOL_FS, &c->pool, lluv_fs_call_queued);
+}
+
+//}
+
 //{ Macro
 #define LLUV_CHECK_LOOP_FS()                                              \
   lluv_loop_t *loop  = lluv_opt_loop(L, 1, LLUV_FLAG_OPEN);               \
   int argc = loop? 1 : 0;                                                 \
 
-#define LLUV_PRE_FS(){                                                    \
-  lluv_fs_request_t *req = lluv_fs_request_new(L);                        \
-  int err;  uv_fs_cb cb = NULL;                                           \
+/* F - function to repeat call if it queued by threadpool limit */
+#define LLUV_PRE_FS_(F){                                                  \
+  lluv_fs_request_t *req;                                                 \
+  int err;  uv_fs_cb cb = NULL; int co = 0;                               \
                                                                           \
   if(!loop)loop = lluv_default_loop(L);                                   \
                                                                           \
   if(lua_gettop(L) > argc){                                               \
     lua_settop(L, argc + 1);                                              \
+    lluv_check_callable(L, -1);                                           \
+    co = lluv_is_yield_cb(L, -1);                                         \
     cb = lluv_on_fs;                                                      \
+    if(lluv_pool_full(loop, LLUV_POOL_FS)){                               \
+      lluv_fs_call_enqueue(L, loop, (F));                                 \
+      if(co) return lua_yield(L, 0);                                      \
+      lua_pushboolean(L, 1);                                              \
+      return 1;                                                           \
+    }                                                                     \
   }                                                                       \
+                                                                          \
+  req = lluv_fs_request_new(L);                                           \
 
 #define LLUV_POST_FS_FILE()                                               \
   if(err < 0){                                                            \
@@ -262,6 +337,7 @@ static void lluv_on_fs(uv_fs_t *arg){
     lua_pushvalue(L, 1);                                                  \
     lluv_error_create(L, LLUV_ERR_UV, err, path);                         \
     lluv_loop_defer_call(L, loop, 2);                                     \
+    if(co) return lua_yield(L, 0);                                        \
     lua_pushboolean(L, 1);                                                \
     return 1;                                                             \
   }                                                                       \
@@ -275,6 +351,7 @@ static void lluv_on_fs(uv_fs_t *arg){
     lluv_loop_pushself(L, loop);                                          \
     lluv_error_create(L, LLUV_ERR_UV, err, path);                         \
     lluv_loop_defer_call(L, loop, 2);                                     \
+    if(co) return lua_yield(L, 0);                                        \
     lua_pushboolean(L, 1);                                                \
     return 1;                                                             \
   }                                                                       \
@@ -282,7 +359,9 @@ static void lluv_on_fs(uv_fs_t *arg){
 #define LLUV_POST_FS_COMMON()                                             \
                                                                           \
   if(cb){                                                                 \
+    req->start = lluv_pool_submit(loop, LLUV_POOL_FS);                    \
     req->cb = luaL_ref(L, LLUV_LUA_REGISTRY);                             \
+    if(co) return lua_yield(L, 0);                                        \
     lua_pushboolean(L, 1);                                                \
     return 1;                                                             \
   }                                                                       \
@@ -315,9 +394,11 @@ static void lluv_on_fs(uv_fs_t *arg){
   LLUV_POST_FS_FILE()                                                     \
   LLUV_POST_FS_COMMON()                                                   \
 
-#define LLUV_PRE_FILE() LLUV_PRE_FS()
+#define LLUV_PRE_FS(N) LLUV_PRE_FS_((safe_flag & LLUV_FLAG_RAISE_ERROR) ? N##_unsafe : N##_safe)
+
+#define LLUV_PRE_FILE(F) LLUV_PRE_FS_(F)
 
-#define lluv_arg_exists(L, idx) ((!lua_isnone(L, idx)) && (lua_type(L, idx) != LUA_TFUNCTION))
+#define lluv_arg_exists(L, idx) ((!lua_isnone(L, idx)) && (lua_type(L, idx) != LUA_TFUNCTION) && (lua_type(L, idx) != LUA_TTHREAD))
 
 //}
 
@@ -328,7 +409,7 @@ LLUV_IMPL_SAFE(lluv_fs_unlink){
 
   const char *path = luaL_checkstring(L, ++argc);
 
-  LLUV_PRE_FS();
+  LLUV_PRE_FS(lluv_fs_unlink);
   err = uv_fs_unlink(loop->handle, &req->req, path, cb);
   LLUV_POST_FS();
 }
@@ -341,7 +422,7 @@ LLUV_IMPL_SAFE(lluv_fs_mkdtemp) {
     path = luaL_checkstring(L, ++argc);
   }
 
-  LLUV_PRE_FS();
+  LLUV_PRE_FS(lluv_fs_mkdtemp);
   err = uv_fs_mkdtemp(loop->handle, &req->req, path, cb);
   LLUV_POST_FS();
 }
@@ -355,7 +436,7 @@ LLUV_IMPL_SAFE(lluv_fs_mkdir) {
     mode = (int)luaL_checkinteger(L, ++argc);
   }
 
-  LLUV_PRE_FS();
+  LLUV_PRE_FS(lluv_fs_mkdir);
   err = uv_fs_mkdir(loop->handle, &req->req, path, mode, cb);
   LLUV_POST_FS();
 }
@@ -365,7 +446,7 @@ LLUV_IMPL_SAFE(lluv_fs_rmdir) {
 
   const char *path = luaL_checkstring(L, ++argc);
 
-  LLUV_PRE_FS();
+  LLUV_PRE_FS(lluv_fs_rmdir);
   err = uv_fs_rmdir(loop->handle, &req->req, path, cb);
   LLUV_POST_FS();
 }
@@ -379,7 +460,7 @@ LLUV_IMPL_SAFE(lluv_fs_scandir) {
     flags = (int)luaL_checkinteger(L, ++argc);
   }
 
-  LLUV_PRE_FS();
+  LLUV_PRE_FS(lluv_fs_scandir);
   err = uv_fs_scandir(loop->handle, &req->req, path, flags, cb);
   LLUV_POST_FS();
 }
@@ -389,7 +470,7 @@ LLUV_IMPL_SAFE(lluv_fs_stat) {
 
   const char *path = luaL_checkstring(L, ++argc);
 
-  LLUV_PRE_FS();
+  LLUV_PRE_FS(lluv_fs_stat);
   err = uv_fs_stat(loop->handle, &req->req, path, cb);
   LLUV_POST_FS();
 }
@@ -399,7 +480,7 @@ LLUV_IMPL_SAFE(lluv_fs_lstat) {
 
   const char *path = luaL_checkstring(L, ++argc);
 
-  LLUV_PRE_FS();
+  LLUV_PRE_FS(lluv_fs_lstat);
   err = uv_fs_lstat(loop->handle, &req->req, path, cb);
   LLUV_POST_FS();
 }
@@ -410,7 +491,7 @@ LLUV_IMPL_SAFE(lluv_fs_rename) {
   const char *path     = luaL_checkstring(L, ++argc);
   const char *new_path = luaL_checkstring(L, ++argc);
 
-  LLUV_PRE_FS();
+  LLUV_PRE_FS(lluv_fs_rename);
   err = uv_fs_rename(loop->handle, &req->req, path, new_path, cb);
   LLUV_POST_FS();
 }
@@ -421,7 +502,7 @@ LLUV_IMPL_SAFE(lluv_fs_chmod) {
   const char *path = luaL_checkstring (L, ++argc);
   int         mode = (int)luaL_checkinteger(L, ++argc);
 
-  LLUV_PRE_FS();
+  LLUV_PRE_FS(lluv_fs_chmod);
   err = uv_fs_chmod(loop->handle, &req->req, path, mode, cb);
   LLUV_POST_FS();
 }
@@ -433,7 +514,7 @@ LLUV_IMPL_SAFE(lluv_fs_utime) {
   double     atime = luaL_checknumber(L, ++argc);
   double     mtime = luaL_checknumber(L, ++argc);
 
-  LLUV_PRE_FS();
+  LLUV_PRE_FS(lluv_fs_utime);
   err = uv_fs_utime(loop->handle, &req->req, path, atime, mtime, cb);
   LLUV_POST_FS();
 }
@@ -448,7 +529,7 @@ LLUV_IMPL_SAFE(lluv_fs_symlink) {
     flags = (int)luaL_checkinteger(L, ++argc);
   }
 
-  LLUV_PRE_FS();
+  LLUV_PRE_FS(lluv_fs_symlink);
   err = uv_fs_symlink(loop->handle, &req->req, path, new_path, flags, cb);
   LLUV_POST_FS();
 }
@@ -458,7 +539,7 @@ LLUV_IMPL_SAFE(lluv_fs_readlink) {
 
   const char *path = luaL_checkstring(L, ++argc);
 
-  LLUV_PRE_FS();
+  LLUV_PRE_FS(lluv_fs_readlink);
   err = uv_fs_readlink(loop->handle, &req->req, path, cb);
   LLUV_POST_FS();
 }
@@ -470,7 +551,7 @@ LLUV_IMPL_SAFE(lluv_fs_chown) {
   uv_uid_t     uid = (uv_uid_t)lutil_checkint64(L, ++argc);
   uv_gid_t     gid = (uv_gid_t)lutil_checkint64(L, ++argc);
 
-  LLUV_PRE_FS();
+  LLUV_PRE_FS(lluv_fs_chown);
   err = uv_fs_chown(loop->handle, &req->req, path, uid, gid, cb);
   LLUV_POST_FS();
 }
@@ -493,7 +574,7 @@ LLUV_IMPL_SAFE(lluv_fs_access) {
     flags = lluv_opt_flags_ui(L, ++argc, flags, FLAGS);
   }
 
-  LLUV_PRE_FS();
+  LLUV_PRE_FS(lluv_fs_access);
   err = uv_fs_access(loop->handle, &req->req, path, flags, cb);
   LLUV_POST_FS();
 }
@@ -560,7 +641,7 @@ LLUV_IMPL_SAFE(lluv_fs_open) {
     mode = (int)luaL_checkinteger(L, ++argc);
   }
 
-  LLUV_PRE_FS();
+  LLUV_PRE_FS(lluv_fs_open);
   err = uv_fs_open(loop->handle, &req->req, path, flags, mode, cb);
   LLUV_POST_FS();
 }
@@ -577,6 +658,519 @@ LLUV_IMPL_SAFE(lluv_fs_open_fd) {
 
 //}
 
+//{ Whole file operations
+
+/* Open, stat, read/write and close file in one threadpool job
+** so Lua gets single callback.
+** Work functions run in threadpool so they use only sync uv_fs_* calls
+** and malloc (Lua allocator is not thread safe).
+*/
+
+typedef struct lluv_fs_work_tag{
+  lluv_pool_job_t pool;   /* must be first */
+  uv_work_t   req;
+  int         cb;
+  int         path_ref;   /* keep path string alive       */
+  int         data_ref;   /* keep data to write alive     */
+  const char *path;
+  char       *data;       /* read content (malloc) or data to write */
+  size_t      size;
+  int         flags;      /* open flags                   */
+  int         as_buffer;  /* return read content as fbuf  */
+  int         result;
+  uv_work_cb  work;       /* job function                 */
+  uint64_t    start;      /* threadpool submit time       */
+}lluv_fs_work_t;
+
+static lluv_fs_work_t *lluv_fs_work_new(lua_State *L, int path_idx){
+  lluv_fs_work_t *w = lluv_alloc_t(L, lluv_fs_work_t);
+  memset(w, 0, sizeof(*w));
+  w->req.data = w;
+  w->cb = w->data_ref = LUA_NOREF;
+  w->path = lua_tostring(L, path_idx);
+  lua_pushvalue(L, path_idx);
+  w->path_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
+  return w;
+}
+
+static void lluv_fs_work_free(lua_State *L, lluv_fs_work_t *w){
+  luaL_unref(L, LLUV_LUA_REGISTRY, w->cb);
+  luaL_unref(L, LLUV_LUA_REGISTRY, w->path_ref);
+  if(w->data_ref != LUA_NOREF){
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, w->data_ref);
+    lluv_fbuf_unpin(L, -1);
+    lua_pop(L, 1);
+    luaL_unref(L, LLUV_LUA_REGISTRY, w->data_ref);
+  }
+  else
+    free(w->data);
+  lluv_free_t(L, lluv_fs_work_t, w);
+}
+
+static void lluv_fs_release_malloc(char *data, size_t capacity){
+  UNUSED_ARG(capacity);
+  free(data);
+}
+
+static void lluv_fs_readfile_work(uv_work_t *arg){
+  lluv_fs_work_t *w = (lluv_fs_work_t*)arg->data;
+  size_t cap = 0, len = 0;
+  uv_file fd; uv_fs_t req;
+  char *data; int err;
+
+  err = uv_fs_open(NULL, &req, w->path, O_RDONLY, 0, NULL);
+  uv_fs_req_cleanup(&req);
+  if(err < 0){
+    w->result = err;
+    return;
+  }
+  fd = (uv_file)err;
+
+  if(uv_fs_fstat(NULL, &req, fd, NULL) >= 0)
+    cap = (size_t)req.statbuf.st_size;
+  uv_fs_req_cleanup(&req);
+
+  /* one more byte to detect EOF without realloc. Some files report zero size */
+  cap = (cap == 0) ? 4096 : cap + 1;
+
+  data = (char*)malloc(cap);
+  if(!data) err = UV_ENOMEM;
+
+  while(data){
+    uv_buf_t buf;
+
+    if(len == cap){
+      char *tmp = (char*)realloc(data, cap * 2);
+      if(!tmp){
+        err = UV_ENOMEM;
+        break;
+      }
+      data = tmp;
+      cap *= 2;
+    }
+
+    buf = uv_buf_init(data + len, (unsigned int)(cap - len));
+    err = uv_fs_read(NULL, &req, fd, &buf, 1, -1, NULL);
+    uv_fs_req_cleanup(&req);
+    if(err <= 0) break;
+    len += (size_t)err;
+  }
+
+  uv_fs_close(NULL, &req, fd, NULL);
+  uv_fs_req_cleanup(&req);
+
+  if(err < 0){
+    free(data);
+    w->result = err;
+    return;
+  }
+
+  w->data = data;
+  w->size = len;
+}
+
+static void lluv_fs_writefile_work(uv_work_t *arg){
+  lluv_fs_work_t *w = (lluv_fs_work_t*)arg->data;
+  size_t off = 0;
+  uv_file fd; uv_fs_t req;
+  int err;
+
+  err = uv_fs_open(NULL, &req, w->path, w->flags, 0666, NULL);
+  uv_fs_req_cleanup(&req);
+  if(err < 0){
+    w->result = err;
+    return;
+  }
+  fd = (uv_file)err;
+
+  while(off < w->size){
+    uv_buf_t buf = uv_buf_init(w->data + off, (unsigned int)(w->size - off));
+    err = uv_fs_write(NULL, &req, fd, &buf, 1, -1, NULL);
+    uv_fs_req_cleanup(&req);
+    if(err < 0) break;
+    off += (size_t)err;
+  }
+
+  if(err >= 0){
+    err = uv_fs_close(NULL, &req, fd, NULL);
+  }
+  else{
+    uv_fs_close(NULL, &req, fd, NULL);
+  }
+  uv_fs_req_cleanup(&req);
+
+  w->result = (err < 0) ? err : 0;
+}
+
+/* stat_many keeps its state in `data` block so it freed with work */
+
+#define LLUV_STAT_FIELDS_MAP(XX) \
+  XX(size  ) XX(mtime ) XX(atime ) XX(ctime ) \
+  XX(mode  ) XX(ino   ) XX(dev   ) XX(nlink ) \
+  XX(uid   ) XX(gid   ) XX(type  ) XX(error ) \
+
+enum{
+#define XX(N) LLUV_STAT_FIELD_##N,
+  LLUV_STAT_FIELDS_MAP(XX)
+#undef XX
+  LLUV_STAT_FIELD_MAX
+};
+
+static const char *lluv_stat_fields[] = {
+#define XX(N) #N,
+  LLUV_STAT_FIELDS_MAP(XX)
+#undef XX
+  NULL
+};
+
+typedef struct lluv_fs_stat_item_tag{
+  const char *path;
+  int         result;
+  uv_stat_t   stat;
+}lluv_fs_stat_item_t;
+
+typedef struct lluv_fs_stat_many_tag{
+  size_t              count;
+  int                 lstat;
+  int                 nfields;   /* 0 - push full stat tables */
+  int                 fields[LLUV_STAT_FIELD_MAX];
+  lluv_fs_stat_item_t items[1];
+}lluv_fs_stat_many_t;
+
+static void lluv_fs_stat_many_work(uv_work_t *arg){
+  lluv_fs_work_t *w = (lluv_fs_work_t*)arg->data;
+  lluv_fs_stat_many_t *m = (lluv_fs_stat_many_t*)w->data;
+  size_t i;
+
+  for(i = 0; i < m->count; ++i){
+    lluv_fs_stat_item_t *item = &m->items[i];
+    uv_fs_t req;
+
+    item->result = m->lstat ?
+      uv_fs_lstat(NULL, &req, item->path, NULL):
+      uv_fs_stat (NULL, &req, item->path, NULL);
+    if(item->result >= 0) item->stat = req.statbuf;
+    uv_fs_req_cleanup(&req);
+  }
+}
+
+static void lluv_push_stat_time(lua_State *L, const uv_timespec_t *ts){
+  lua_pushnumber(L, (lua_Number)ts->tv_sec + (lua_Number)ts->tv_nsec / 1e9);
+}
+
+static void lluv_push_stat_field(lua_State *L, lluv_fs_stat_item_t *item, int field){
+  const uv_stat_t *s = &item->stat;
+
+  if(field == LLUV_STAT_FIELD_error){
+    if(item->result < 0) lluv_error_create(L, LLUV_ERR_UV, item->result, item->path);
+    else lua_pushboolean(L, 0);
+    return;
+  }
+
+  if(item->result < 0){
+    lua_pushboolean(L, 0);
+    return;
+  }
+
+  switch(field){
+    case LLUV_STAT_FIELD_size:  lutil_pushint64(L, s->st_size);  break;
+    case LLUV_STAT_FIELD_mtime: lluv_push_stat_time(L, &s->st_mtim); break;
+    case LLUV_STAT_FIELD_atime: lluv_push_stat_time(L, &s->st_atim); break;
+    case LLUV_STAT_FIELD_ctime: lluv_push_stat_time(L, &s->st_ctim); break;
+    case LLUV_STAT_FIELD_mode:  lutil_pushint64(L, s->st_mode);  break;
+    case LLUV_STAT_FIELD_ino:   lutil_pushint64(L, s->st_ino);   break;
+    case LLUV_STAT_FIELD_dev:   lutil_pushint64(L, s->st_dev);   break;
+    case LLUV_STAT_FIELD_nlink: lutil_pushint64(L, s->st_nlink); break;
+    case LLUV_STAT_FIELD_uid:   lutil_pushint64(L, s->st_uid);   break;
+    case LLUV_STAT_FIELD_gid:   lutil_pushint64(L, s->st_gid);   break;
+    case LLUV_STAT_FIELD_type:
+      switch(s->st_mode & S_IFMT){
+        case S_IFREG: lua_pushliteral(L, "file");  break;
+        case S_IFDIR: lua_pushliteral(L, "dir");   break;
+#ifdef S_IFLNK
+        case S_IFLNK: lua_pushliteral(L, "link");  break;
+#endif
+        default:      lua_pushliteral(L, "other"); break;
+      }
+      break;
+    default: lua_pushnil(L);
+  }
+}
+
+/* one array per selected field or arrays of stat tables and errors */
+static int lluv_fs_stat_many_push(lua_State *L, lluv_fs_stat_many_t *m){
+  size_t i; int f;
+
+  if(m->nfields == 0){
+    lua_createtable(L, (int)m->count, 0);
+    for(i = 0; i < m->count; ++i){
+      if(m->items[i].result < 0) lua_pushboolean(L, 0);
+      else lluv_push_stat(L, &m->items[i].stat);
+      lua_rawseti(L, -2, (int)i + 1);
+    }
+
+    lua_createtable(L, (int)m->count, 0);
+    for(i = 0; i < m->count; ++i){
+      lluv_push_stat_field(L, &m->items[i], LLUV_STAT_FIELD_error);
+      lua_rawseti(L, -2, (int)i + 1);
+    }
+    return 2;
+  }
+
+  for(f = 0; f < m->nfields; ++f){
+    lua_createtable(L, (int)m->count, 0);
+    for(i = 0; i < m->count; ++i){
+      lluv_push_stat_field(L, &m->items[i], m->fields[f]);
+      lua_rawseti(L, -2, (int)i + 1);
+    }
+  }
+  return m->nfields;
+}
+
+/* push result values without error (content, path) */
+static int lluv_fs_work_push_result(lua_State *L, lluv_fs_work_t *w){
+  if(w->work == lluv_fs_readfile_work){
+    if(w->as_buffer){
+      lluv_fbuf_wrap(L, w->data, w->size, lluv_fs_release_malloc);
+      w->data = NULL;
+    }
+    else{
+      lua_pushlstring(L, w->data ? w->data : "", w->size);
+    }
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, w->path_ref);
+    return 2;
+  }
+
+  if(w->work == lluv_fs_stat_many_work){
+    return lluv_fs_stat_many_push(L, (lluv_fs_stat_many_t*)w->data);
+  }
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, w->path_ref);
+  return 1;
+}
+
+static void lluv_fs_work_start(uv_work_t *arg){
+  lluv_fs_work_t *w = (lluv_fs_work_t*)arg->data;
+  lluv_pool_started(LLUV_POOL_FS, w->start);
+  w->work(arg);
+}
+
+static void lluv_on_fs_work(uv_work_t *arg, int status){
+  lluv_fs_work_t *w = (lluv_fs_work_t*)arg->data;
+  lluv_loop_t *loop = lluv_loop_byptr(arg->loop);
+  lua_State *L = loop->L;
+  int argc = 2;
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+  lluv_pool_done(loop, LLUV_POOL_FS, w->start);
+
+  if(status < 0) w->result = status;
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, w->cb);
+  lua_pushvalue(L, LLUV_LOOP_INDEX);
+
+  if(w->result < 0){
+    lluv_error_create(L, LLUV_ERR_UV, w->result, w->path);
+  }
+  else{
+    lua_pushnil(L);
+    argc += lluv_fs_work_push_result(L, w);
+  }
+
+  lluv_fs_work_free(L, w);
+
+  LLUV_LOOP_CALL_CB(L, loop, argc);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+}
+
+/* callback in w->cb */
+static void lluv_fs_work_submit(lua_State *L, lluv_loop_t *loop, lluv_fs_work_t *w){
+  int err;
+
+  w->start = lluv_pool_submit(loop, LLUV_POOL_FS);
+  err = uv_queue_work(loop->handle, &w->req, lluv_fs_work_start, lluv_on_fs_work);
+  if(err < 0){
+    lluv_pool_cancel(loop, LLUV_POOL_FS);
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, w->cb);
+    lluv_loop_pushself(L, loop);
+    lluv_error_create(L, LLUV_ERR_UV, err, w->path);
+    lluv_fs_work_free(L, w);
+    lluv_loop_defer_call(L, loop, 2);
+  }
+}
+
+static void lluv_fs_work_queued(lluv_loop_t *loop, lluv_pool_job_t *job){
+  lluv_fs_work_submit(loop->L, loop, (lluv_fs_work_t*)job);
+}
+
+/* should be called before work allocated so error does not leak it */
+static void lluv_fs_work_check_cb(lua_State *L, int argc){
+  if(lua_gettop(L) > argc){
+    lua_settop(L, argc + 1);
+    lluv_check_callable(L, -1);
+  }
+}
+
+/* run work in threadpool or synchronously if there no callback */
+static int lluv_fs_work_run(lua_State *L, lluv_loop_t *loop, lluv_flags_t safe_flag, int argc, lluv_fs_work_t *w){
+  int err, co = 0;
+
+  if(lua_gettop(L) > argc){
+    co = lluv_is_yield_cb(L, -1);
+  }
+  else{
+    int n;
+    w->work(&w->req);
+    if(w->result < 0){
+      err = w->result;
+      lua_rawgeti(L, LLUV_LUA_REGISTRY, w->path_ref);
+      lluv_fs_work_free(L, w);
+      return lluv_fail(L, safe_flag | loop->flags, LLUV_ERR_UV, err, lua_tostring(L, -1));
+    }
+    n = lluv_fs_work_push_result(L, w);
+    lluv_fs_work_free(L, w);
+    return n;
+  }
+
+  w->cb = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+  if(lluv_pool_full(loop, LLUV_POOL_FS))
+    lluv_pool_enqueue(loop, LLUV_POOL_FS, &w->pool, lluv_fs_work_queued);
+  else
+    lluv_fs_work_submit(L, loop, w);
+
+  if(co) return lua_yield(L, 0);
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+LLUV_IMPL_SAFE(lluv_fs_readfile) {
+  LLUV_CHECK_LOOP_FS()
+  lluv_fs_work_t *w;
+  int path_idx, as_buffer = 0;
+
+  luaL_checkstring(L, ++argc);
+  path_idx = argc;
+
+  if(lua_istable(L, argc + 1)){
+    lua_getfield(L, ++argc, "buffer");
+    as_buffer = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+  }
+
+  lluv_fs_work_check_cb(L, argc);
+
+  if(!loop) loop = lluv_default_loop(L);
+
+  w = lluv_fs_work_new(L, path_idx);
+  w->as_buffer = as_buffer;
+  w->work = lluv_fs_readfile_work;
+
+  return lluv_fs_work_run(L, loop, safe_flag, argc, w);
+}
+
+LLUV_IMPL_SAFE(lluv_fs_writefile) {
+  LLUV_CHECK_LOOP_FS()
+  lluv_fs_work_t *w;
+  int path_idx, data_idx, flags;
+  const char *data; size_t len;
+
+  luaL_checkstring(L, ++argc);
+  path_idx = argc;
+  data = lluv_check_bufdata(L, ++argc, &len);
+  data_idx = argc;
+
+  if(lua_type(L, argc + 1) == LUA_TSTRING)
+    flags = luv_check_open_flags(L, ++argc, NULL);
+  else
+    flags = O_TRUNC | O_CREAT | O_WRONLY;
+
+  lluv_fs_work_check_cb(L, argc);
+
+  if(!loop) loop = lluv_default_loop(L);
+
+  w = lluv_fs_work_new(L, path_idx);
+  w->data  = (char*)data;
+  w->size  = len;
+  w->flags = flags;
+  w->work = lluv_fs_writefile_work;
+  lua_pushvalue(L, data_idx);
+  lluv_fbuf_pin(L, -1);
+  w->data_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+  return lluv_fs_work_run(L, loop, safe_flag, argc, w);
+}
+
+LLUV_IMPL_SAFE(lluv_fs_stat_many) {
+  LLUV_CHECK_LOOP_FS()
+  lluv_fs_work_t *w;
+  lluv_fs_stat_many_t *m;
+  int i, n, paths_idx, nfields = 0, lstat = 0;
+  int fields[LLUV_STAT_FIELD_MAX];
+
+  luaL_checktype(L, ++argc, LUA_TTABLE);
+  paths_idx = argc;
+  n = (int)lua_rawlen(L, paths_idx);
+
+  if(lua_istable(L, argc + 1)){
+    ++argc;
+    lua_getfield(L, argc, "lstat");
+    lstat = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+
+    lua_getfield(L, argc, "fields");
+    if(!lua_isnil(L, -1)){
+      luaL_argcheck(L, lua_istable(L, -1), argc, LLUV_PREFIX" fields must be array");
+      nfields = (int)lua_rawlen(L, -1);
+      luaL_argcheck(L, nfields <= LLUV_STAT_FIELD_MAX, argc, LLUV_PREFIX" too many fields");
+      for(i = 0; i < nfields; ++i){
+        lua_rawgeti(L, -1, i + 1);
+        fields[i] = luaL_checkoption(L, -1, NULL, lluv_stat_fields);
+        lua_pop(L, 1);
+      }
+    }
+    lua_pop(L, 1);
+  }
+
+  lluv_fs_work_check_cb(L, argc);
+
+  if(!loop) loop = lluv_default_loop(L);
+
+  /* clone paths to save strings from gc */
+  lua_createtable(L, n, 0);
+  for(i = 0; i < n; ++i){
+    lua_rawgeti(L, paths_idx, i + 1);
+    luaL_argcheck(L, lua_type(L, -1) == LUA_TSTRING, paths_idx, LLUV_PREFIX" array of strings expected");
+    lua_rawseti(L, -2, i + 1);
+  }
+  lua_replace(L, paths_idx);
+
+  m = (lluv_fs_stat_many_t*)malloc(sizeof(lluv_fs_stat_many_t) + sizeof(lluv_fs_stat_item_t) * n);
+  if(!m){
+    return lluv_fail(L, safe_flag | loop->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+  }
+
+  m->count   = (size_t)n;
+  m->lstat   = lstat;
+  m->nfields = nfields;
+  memcpy(m->fields, fields, sizeof(int) * nfields);
+  for(i = 0; i < n; ++i){
+    lua_rawgeti(L, paths_idx, i + 1);
+    m->items[i].path = lua_tostring(L, -1);
+    lua_pop(L, 1);
+  }
+
+  w = lluv_fs_work_new(L, paths_idx);
+  w->data = (char*)m;
+  w->work = lluv_fs_stat_many_work;
+
+  return lluv_fs_work_run(L, loop, safe_flag, argc, w);
+}
+
+//}
+
 //{ File object
 
 #define LLUV_FILE_NAME LLUV_PREFIX" File"
@@ -627,12 +1221,14 @@ static int lluv_file_close(lua_State *L){
   if(IS_(f, OPEN)){
     const char  *path = NULL;
     int          argc = 1;
-    UNSET_(f, OPEN);
     if(!IS_(f, NOCLOSE)){
-      LLUV_PRE_FILE();
+      /* close can be queued after other requests so file still open */
+      LLUV_PRE_FILE(lluv_file_close);
+      UNSET_(f, OPEN);
       err = uv_fs_close(loop->handle, &req->req, f->handle, cb);
       LLUV_POST_FILE();
     }
+    UNSET_(f, OPEN);
   }
 
   return 0;
@@ -650,7 +1246,7 @@ static int lluv_file_stat(lua_State *L){
   lluv_loop_t *loop = f->loop;
   int          argc = 1;
 
-  LLUV_PRE_FILE();
+  LLUV_PRE_FILE(lluv_file_stat);
   lua_pushvalue(L, 1);
   req->file_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
   err = uv_fs_fstat(loop->handle, &req->req, f->handle, cb);
@@ -663,7 +1259,7 @@ static int lluv_file_sync(lua_State *L){
   lluv_loop_t *loop = f->loop;
   int          argc = 1;
 
-  LLUV_PRE_FILE();
+  LLUV_PRE_FILE(lluv_file_sync);
   lua_pushvalue(L, 1);
   req->file_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
   err = uv_fs_fsync(loop->handle, &req->req, f->handle, cb);
@@ -676,7 +1272,7 @@ static int lluv_file_datasync(lua_State *L){
   lluv_loop_t *loop = f->loop;
   int          argc = 1;
 
-  LLUV_PRE_FILE();
+  LLUV_PRE_FILE(lluv_file_datasync);
   lua_pushvalue(L, 1);
   req->file_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
   err = uv_fs_fdatasync(loop->handle, &req->req, f->handle, cb);
@@ -690,7 +1286,7 @@ static int lluv_file_truncate(lua_State *L){
   int64_t      len  = lutil_checkint64(L, 2);
   int         argc  = 2;
 
-  LLUV_PRE_FILE();
+  LLUV_PRE_FILE(lluv_file_truncate);
   lua_pushvalue(L, 1);
   req->file_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
   err = uv_fs_ftruncate(loop->handle, &req->req, f->handle, len, cb);
@@ -705,7 +1301,7 @@ static int lluv_file_chown(lua_State* L) {
   uv_gid_t     gid  = (uv_gid_t)lutil_checkint64(L, 3);
   int         argc  = 3;
 
-  LLUV_PRE_FILE();
+  LLUV_PRE_FILE(lluv_file_chown);
   lua_pushvalue(L, 1);
   req->file_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
   err = uv_fs_fchown(loop->handle, &req->req, f->handle, uid, gid, cb);
@@ -719,7 +1315,7 @@ static int lluv_file_chmod(lua_State* L) {
   int         mode  = (int)luaL_checkinteger(L, 2);
   int         argc  = 2;
 
-  LLUV_PRE_FILE();
+  LLUV_PRE_FILE(lluv_file_chmod);
   lua_pushvalue(L, 1);
   req->file_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
   err = uv_fs_fchmod(loop->handle, &req->req, f->handle, mode, cb);
@@ -734,7 +1330,7 @@ static int lluv_file_utime(lua_State* L) {
   double     mtime  = luaL_checknumber(L, 3);
   int         argc  = 3;
 
-  LLUV_PRE_FILE();
+  LLUV_PRE_FILE(lluv_file_utime);
   lua_pushvalue(L, 1);
   req->file_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
   err = uv_fs_futime(loop->handle, &req->req, f->handle, atime, mtime, cb);
@@ -783,11 +1379,12 @@ static int lluv_file_readb(lua_State* L) {
   luaL_argcheck (L, capacity > (size_t)offset, 4, LLUV_PREFIX" offset out of index"); 
   luaL_argcheck (L, capacity >= ((size_t)offset + length), 5, LLUV_PREFIX" length out of index");
 
-  LLUV_PRE_FILE();
+  LLUV_PRE_FILE(lluv_file_readb);
   {
     uv_buf_t ubuf = uv_buf_init(&base[offset], length);
 
     lua_pushvalue(L, 2);
+    lluv_fbuf_pin(L, -1);
     lua_rawsetp(L, LLUV_LUA_REGISTRY, &req->req);
     lua_pushvalue(L, 1);
     req->file_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
@@ -809,10 +1406,59 @@ static int lluv_file_read(lua_State* L) {
   return lluv_file_readb(L);
 }
 
+static int lluv_file_writev(lua_State* L) {
+  // writev({buffer | string, ...}, [position,] [callback])
+
+  const char  *path = NULL;
+  lluv_file_t *f    = lluv_check_file(L, 1, LLUV_FLAG_OPEN);
+  lluv_loop_t *loop = f->loop;
+  int64_t   position = 0; /* position in file default: 0*/ 
+  int       i, n, argc = 2;
+  uv_buf_t *bufs;
+
+  luaL_checktype(L, 2, LUA_TTABLE);
+  n = lua_rawlen(L, 2);
+  luaL_argcheck(L, n > 0, 2, "Empty array not supported");
+
+  if(lluv_arg_exists(L, 3)){      /* position        */
+    position = lutil_checkint64(L, ++argc);
+  }
+
+  bufs = (uv_buf_t*)lluv_alloca(sizeof(uv_buf_t) * n);
+  if(!bufs){
+    return lluv_fail(L, f->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+  }
+
+  /* clone array to save strings and buffers from gc */
+  lua_createtable(L, n, 0);
+  for(i = 0; i < n; ++i){
+    size_t len; const char *str;
+    lua_rawgeti(L, 2, i + 1);
+    str = lluv_check_bufdata(L, -1, &len);
+    lua_rawseti(L, -2, i + 1);
+    bufs[i] = uv_buf_init((char*)str, len);
+  }
+  lua_replace(L, 2);
+
+  LLUV_PRE_FILE(lluv_file_writev);
+  {
+    lua_pushvalue(L, 2); /*array of strings or buffers*/
+    lluv_fbuf_pin(L, -1);
+    lua_rawsetp(L, LLUV_LUA_REGISTRY, &req->req);
+    lua_pushvalue(L, 1);
+    req->file_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
+    /* uv_fs_write copies buffer descriptors */
+    err = uv_fs_write(loop->handle, &req->req, f->handle, bufs, n, position, cb);
+  }
+  LLUV_POST_FILE();
+}
+
 static int lluv_file_write(lua_State* L) {
   // if you provide string then function does not copy this string
   // write(buffer | string, [position, [ [offset,] [length,] ] ] [callback])
 
+  if(lua_type(L, 2) == LUA_TTABLE) return lluv_file_writev(L); else{
+
   const char  *path           = NULL;
   lluv_file_t *f              = lluv_check_file(L, 1, LLUV_FLAG_OPEN);
   lluv_loop_t *loop           = f->loop;
@@ -849,18 +1495,19 @@ static int lluv_file_write(lua_State* L) {
   luaL_argcheck (L, capacity > (size_t)offset, 4, LLUV_PREFIX" offset out of index"); 
   luaL_argcheck (L, capacity >= ((size_t)offset + length), 5, LLUV_PREFIX" length out of index");
 
-  LLUV_PRE_FILE();
+  LLUV_PRE_FILE(lluv_file_write);
   {
     uv_buf_t ubuf = uv_buf_init((char*)&str[offset], length);
     
     lua_pushvalue(L, 2); /*string or buffer*/
+    lluv_fbuf_pin(L, -1);
     lua_rawsetp(L, LLUV_LUA_REGISTRY, &req->req);
     lua_pushvalue(L, 1);
     req->file_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
     err = uv_fs_write(loop->handle, &req->req, f->handle, &ubuf, 1, position, cb);
   }
   LLUV_POST_FILE();
-}
+}}
 
 static int lluv_file_fileno(lua_State *L){
   lluv_file_t *f = lluv_check_file(L, 1, LLUV_FLAG_OPEN);
@@ -908,6 +1555,344 @@ static int lluv_file_pipe(lua_State *L){
   return 1;
 }
 
+//{ Read-ahead stream reader
+
+/* Keeps `depth` reads in flight and delivers chunks in file order.
+** Chunk slot for sequence number N is chunks[N % depth] so slot
+** can be reused only after its chunk delivered (or written to stream).
+*/
+
+#define LLUV_FS_READER_CHUNK 65536
+#define LLUV_FS_READER_DEPTH 4
+#define LLUV_FS_READER_MAX_DEPTH 64
+
+typedef struct lluv_fs_reader_tag lluv_fs_reader_t;
+
+typedef struct lluv_fs_chunk_tag{
+  lluv_pool_job_t   pool;   /* must be first */
+  uv_fs_t           req;
+  uv_write_t        wreq;
+  lluv_fs_reader_t *reader;
+  char             *data;
+  int64_t           position;
+  size_t            length;  /* requested size */
+  ssize_t           result;
+  int               done;   /* read completed, waiting for delivery */
+  uint64_t          start;  /* threadpool submit time */
+}lluv_fs_chunk_t;
+
+struct lluv_fs_reader_tag{
+  lluv_loop_t     *loop;
+  uv_file          fd;
+  int              file_ref;
+  int              cb;
+  int              stream_ref;
+  uv_stream_t     *stream;     /* write chunks to stream instead of callback */
+  size_t           chunk_size;
+  int              depth;
+  int              active;     /* requests in flight       */
+  int              stopped;    /* EOF or error reached     */
+  int              canceled;   /* callback raised error    */
+  int              error;
+  int64_t          position;   /* next position to read    */
+  int64_t          end;        /* -1 read up to EOF        */
+  int64_t          total;      /* bytes delivered          */
+  unsigned int     next_seq;   /* sequence for next read   */
+  unsigned int     deliver_seq;/* sequence to deliver next */
+  lluv_fs_chunk_t *chunks;
+};
+
+static void lluv_fs_reader_on_read(uv_fs_t *arg);
+
+static void lluv_fs_reader_stop(lluv_fs_reader_t *r, int err){
+  if(r->stopped) return;
+  r->stopped = 1;
+  r->error   = err;
+}
+
+static void lluv_fs_reader_deliver(lluv_fs_reader_t *r);
+
+static int lluv_fs_reader_read(lluv_fs_reader_t *r, lluv_fs_chunk_t *chunk){
+  uv_buf_t buf = uv_buf_init(chunk->data, (unsigned int)chunk->length);
+  int err = uv_fs_read(r->loop->handle, &chunk->req, r->fd, &buf, 1, chunk->position, lluv_fs_reader_on_read);
+  if(err >= 0) chunk->start = lluv_pool_submit(r->loop, LLUV_POOL_FS);
+  return err;
+}
+
+/* called from lluv_pool_done when fs class has free slot */
+static void lluv_fs_reader_queued(lluv_loop_t *loop, lluv_pool_job_t *job){
+  lluv_fs_chunk_t  *chunk = (lluv_fs_chunk_t*)job;
+  lluv_fs_reader_t *r     = chunk->reader;
+  int err = r->stopped ? UV_ECANCELED : lluv_fs_reader_read(r, chunk);
+
+  UNUSED_ARG(loop);
+
+  if(err >= 0) return;
+
+  /* deliver as failed read to keep chunks order */
+  chunk->result = err;
+  chunk->done   = 1;
+  --r->active;
+  lluv_fs_reader_deliver(r);
+}
+
+static void lluv_fs_reader_issue(lluv_fs_reader_t *r, lluv_fs_chunk_t *chunk){
+  size_t len = r->chunk_size;
+  int err;
+
+  if(r->stopped) return;
+
+  if(r->end >= 0){
+    /* region issued, EOF reported when all chunks delivered */
+    if(r->position >= r->end) return;
+    if((int64_t)len > (r->end - r->position)) len = (size_t)(r->end - r->position);
+  }
+
+  ++r->next_seq;
+  chunk->position = r->position;
+  chunk->length   = len;
+  r->position    += len;
+
+  if(lluv_pool_full(r->loop, LLUV_POOL_FS)){
+    lluv_pool_enqueue(r->loop, LLUV_POOL_FS, &chunk->pool, lluv_fs_reader_queued);
+    ++r->active;
+    return;
+  }
+
+  err = lluv_fs_reader_read(r, chunk);
+  if(err < 0){
+    lluv_fs_reader_stop(r, err);
+    return;
+  }
+  ++r->active;
+}
+
+static void lluv_fs_reader_free(lua_State *L, lluv_fs_reader_t *r){
+  int i;
+  for(i = 0; i < r->depth; ++i) free(r->chunks[i].data);
+  luaL_unref(L, LLUV_LUA_REGISTRY, r->file_ref);
+  luaL_unref(L, LLUV_LUA_REGISTRY, r->cb);
+  luaL_unref(L, LLUV_LUA_REGISTRY, r->stream_ref);
+  lluv_free(L, r->chunks);
+  lluv_free_t(L, lluv_fs_reader_t, r);
+}
+
+static void lluv_fs_reader_finish(lluv_fs_reader_t *r){
+  lluv_loop_t *loop = r->loop;
+  lua_State *L = loop->L;
+  int argc = 2;
+
+  if(r->active) return;
+
+  /* all requested region delivered */
+  lluv_fs_reader_stop(r, UV_EOF);
+
+  if(r->canceled){
+    /* loop stopped by callback error, do not call it again */
+    lluv_fs_reader_free(L, r);
+    return;
+  }
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, r->cb);
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, r->file_ref);
+  if(r->stream){
+    if(r->error == UV_EOF){
+      lua_pushnil(L);
+      lutil_pushint64(L, r->total);
+      ++argc;
+    }
+    else lluv_error_create(L, LLUV_ERR_UV, r->error, NULL);
+  }
+  else lluv_error_create(L, LLUV_ERR_UV, r->error, NULL);
+
+  lluv_fs_reader_free(L, r);
+
+  LLUV_LOOP_CALL_CB(L, loop, argc);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+}
+
+static void lluv_fs_reader_on_write(uv_write_t *arg, int status){
+  lluv_fs_chunk_t  *chunk = (lluv_fs_chunk_t*)arg->data;
+  lluv_fs_reader_t *r     = chunk->reader;
+
+  --r->active;
+  if(status < 0) lluv_fs_reader_stop(r, status);
+  else lluv_fs_reader_issue(r, chunk);
+
+  lluv_fs_reader_finish(r);
+}
+
+/* deliver completed chunks in order. Chunks after EOF/error only drained.
+** Short read is EOF so data appended to file later does not make gaps.
+*/
+static void lluv_fs_reader_deliver(lluv_fs_reader_t *r){
+  lua_State *L = r->loop->L;
+
+  while(1){
+    lluv_fs_chunk_t *chunk = &r->chunks[r->deliver_seq % r->depth];
+    if(!chunk->done) break;
+
+    chunk->done = 0;
+    ++r->deliver_seq;
+
+    if(r->stopped) continue;
+
+    if(chunk->result <= 0){
+      lluv_fs_reader_stop(r, chunk->result ? (int)chunk->result : UV_EOF);
+      continue;
+    }
+
+    r->total += chunk->result;
+
+    if((size_t)chunk->result < chunk->length) lluv_fs_reader_stop(r, UV_EOF);
+
+    if(r->stream){
+      uv_buf_t buf = uv_buf_init(chunk->data, (unsigned int)chunk->result);
+      int err = uv_write(&chunk->wreq, r->stream, &buf, 1, lluv_fs_reader_on_write);
+      if(err < 0) lluv_fs_reader_stop(r, err);
+      else ++r->active;
+      continue;
+    }
+
+    LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, r->cb);
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, r->file_ref);
+    lua_pushnil(L);
+    lua_pushlstring(L, chunk->data, (size_t)chunk->result);
+    lutil_pushint64(L, chunk->position);
+
+    /* data already copied so next read can be started before callback */
+    lluv_fs_reader_issue(r, chunk);
+
+    if(lluv_lua_call(L, 4, 0)){
+      /* loop stopped, do not deliver any more */
+      lluv_fs_reader_stop(r, UV_ECANCELED);
+      r->canceled = 1;
+
+      LLUV_CHECK_LOOP_CB_INVARIANT(L);
+      continue;
+    }
+    lluv_loop_defer_proceed(L, r->loop);
+
+    LLUV_CHECK_LOOP_CB_INVARIANT(L);
+  }
+
+  lluv_fs_reader_finish(r);
+}
+
+static void lluv_fs_reader_on_read(uv_fs_t *arg){
+  lluv_fs_chunk_t  *chunk = (lluv_fs_chunk_t*)arg->data;
+  lluv_fs_reader_t *r     = chunk->reader;
+
+  lluv_pool_done(r->loop, LLUV_POOL_FS, chunk->start);
+
+  chunk->result = arg->result;
+  chunk->done   = 1;
+  uv_fs_req_cleanup(arg);
+  --r->active;
+
+  lluv_fs_reader_deliver(r);
+}
+
+static int lluv_file_stream_read(lua_State *L){
+  // stream_read([{chunk = N, depth = K, position = P, length = L, stream = S},] callback)
+
+  lluv_file_t *f = lluv_check_file(L, 1, LLUV_FLAG_OPEN);
+  lluv_handle_t *stream = NULL;
+  int64_t chunk_size = LLUV_FS_READER_CHUNK, position = 0, length = -1;
+  int depth = LLUV_FS_READER_DEPTH, i;
+  lluv_fs_reader_t *r;
+
+  if(lua_istable(L, 2)){
+    lua_getfield(L, 2, "chunk");
+    chunk_size = lutil_optint64(L, -1, chunk_size);
+    lua_pop(L, 1);
+    lua_getfield(L, 2, "depth");
+    depth = (int)luaL_optinteger(L, -1, depth);
+    lua_pop(L, 1);
+    lua_getfield(L, 2, "position");
+    position = lutil_optint64(L, -1, position);
+    lua_pop(L, 1);
+    lua_getfield(L, 2, "length");
+    length = lutil_optint64(L, -1, length);
+    lua_pop(L, 1);
+
+    /* replace options with stream (or nil) */
+    lua_getfield(L, 2, "stream");
+    if(!lua_isnil(L, -1)) stream = lluv_check_stream(L, -1, LLUV_FLAG_OPEN);
+    lua_replace(L, 2);
+  }
+  else{
+    lua_pushnil(L);
+    lua_insert(L, 2);
+  }
+
+  luaL_argcheck(L, (chunk_size > 0) && (chunk_size <= 0x7FFFFFFF), 2, LLUV_PREFIX" invalid chunk size");
+  luaL_argcheck(L, (depth > 0) && (depth <= LLUV_FS_READER_MAX_DEPTH), 2, LLUV_PREFIX" invalid depth");
+  luaL_argcheck(L, position >= 0, 2, LLUV_PREFIX" invalid position");
+
+  lua_settop(L, 3);
+  lluv_check_callable(L, 3);
+
+  r = lluv_alloc_t(L, lluv_fs_reader_t);
+  memset(r, 0, sizeof(*r));
+  r->loop       = f->loop;
+  r->fd         = f->handle;
+  r->chunk_size = (size_t)chunk_size;
+  r->depth      = depth;
+  r->position   = position;
+  r->end        = (length < 0) ? -1 : position + length;
+  r->stream     = stream ? LLUV_H(stream, uv_stream_t) : NULL;
+  r->chunks     = (lluv_fs_chunk_t*)lluv_alloc(L, sizeof(lluv_fs_chunk_t) * depth);
+  memset(r->chunks, 0, sizeof(lluv_fs_chunk_t) * depth);
+
+  r->cb         = luaL_ref(L, LLUV_LUA_REGISTRY);
+  r->stream_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
+  lua_pushvalue(L, 1);
+  r->file_ref   = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+  for(i = 0; i < depth; ++i){
+    lluv_fs_chunk_t *chunk = &r->chunks[i];
+    chunk->reader    = r;
+    chunk->req.data  = chunk;
+    chunk->wreq.data = chunk;
+    chunk->data      = (char*)malloc(r->chunk_size);
+    if(!chunk->data) lluv_fs_reader_stop(r, UV_ENOMEM);
+  }
+
+  for(i = 0; i < depth; ++i)
+    lluv_fs_reader_issue(r, &r->chunks[i]);
+
+  if(r->active == 0){
+    int err = r->stopped ? r->error : UV_EOF;
+    /* nothing to read, e.g. zero length */
+    if(err == UV_EOF){
+      lua_rawgeti(L, LLUV_LUA_REGISTRY, r->cb);
+      lua_pushvalue(L, 1);
+      lluv_fs_reader_free(L, r);
+      if(stream){
+        lua_pushnil(L);
+        lutil_pushint64(L, 0);
+      }
+      else lluv_error_create(L, LLUV_ERR_UV, UV_EOF, NULL);
+      lluv_loop_defer_call(L, f->loop, stream ? 3 : 2);
+      lua_pushboolean(L, 1);
+      return 1;
+    }
+    lluv_fs_reader_free(L, r);
+    return lluv_fail(L, f->flags, LLUV_ERR_UV, err, NULL);
+  }
+
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+//}
+
 static const struct luaL_Reg lluv_file_methods[] = {
   {"loop",         lluv_file_loop      },
   {"stat",         lluv_file_stat      },
@@ -923,6 +1908,8 @@ static const struct luaL_Reg lluv_file_methods[] = {
 
   {"read",         lluv_file_read      },
   {"write",        lluv_file_write     },
+  {"writev",       lluv_file_writev    },
+  {"stream_read",  lluv_file_stream_read},
   {"__gc",         lluv_file_close     },
   {"__tostring",   lluv_file_to_s      },
   
@@ -931,6 +1918,79 @@ static const struct luaL_Reg lluv_file_methods[] = {
 
 //}
 
+//{ Memory mapped files
+
+/* Mapping is sync operation. File opened by path closed right after
+** mapping, memory stays valid until buffer freed or collected.
+*/
+
+static int lluv_fs_check_map_mode(lua_State *L, int idx){
+  static const char *modes[] = {"r", "w", "p", NULL};
+  static const int values[]  = {LLUV_FBUF_MAP_READ, LLUV_FBUF_MAP_WRITE, LLUV_FBUF_MAP_PRIVATE};
+  return values[luaL_checkoption(L, idx, "r", modes)];
+}
+
+LLUV_IMPL_SAFE(lluv_fs_mmap) {
+  LLUV_CHECK_LOOP_FS()
+  lluv_fs_request_t *req;
+  const char *path = NULL;
+  lluv_file_t *f = NULL;
+  uv_file fd;
+  int mode, err;
+  int64_t offset, length, size;
+  size_t len = 0;
+
+  if(lutil_isudatap(L, argc + 1, LLUV_FILE)) f = lluv_check_file(L, ++argc, LLUV_FLAG_OPEN);
+  else path = luaL_checkstring(L, ++argc);
+
+  mode   = lluv_fs_check_map_mode(L, ++argc);
+  offset = lutil_optint64(L, ++argc, 0);
+  luaL_argcheck (L, offset >= 0, argc, LLUV_PREFIX" offset out of index");
+  length = lutil_optint64(L, ++argc, -1); /* default: up to end of file */
+
+  if(!loop) loop = lluv_default_loop(L);
+
+  req = lluv_fs_request_new(L);
+
+  if(f) fd = f->handle;
+  else{
+    int flags = (mode == LLUV_FBUF_MAP_WRITE) ? O_RDWR : O_RDONLY;
+    err = uv_fs_open(NULL, &req->req, path, flags, 0, NULL);
+    uv_fs_req_cleanup(&req->req);
+    if(err < 0){
+      lluv_fs_request_free(L, req);
+      return lluv_fail(L, safe_flag | loop->flags, LLUV_ERR_UV, err, path);
+    }
+    fd = (uv_file)err;
+  }
+
+  err = uv_fs_fstat(NULL, &req->req, fd, NULL);
+  size = (int64_t)req->req.statbuf.st_size;
+  uv_fs_req_cleanup(&req->req);
+
+  if(err >= 0){
+    /* access past end of file raises SIGBUS so do not allow such mapping */
+    if(offset > size) err = UV_EINVAL;
+    else if(length < 0) len = (size_t)(size - offset);
+    else if(length > size - offset) err = UV_EINVAL;
+    else len = (size_t)length;
+  }
+
+  if(err >= 0) err = lluv_fbuf_mmap(L, fd, mode, offset, len);
+
+  if(!f){
+    uv_fs_close(NULL, &req->req, fd, NULL);
+    uv_fs_req_cleanup(&req->req);
+  }
+  lluv_fs_request_free(L, req);
+
+  if(err < 0) return lluv_fail(L, safe_flag | loop->flags, LLUV_ERR_UV, err, path);
+
+  return 1;
+}
+
+//}
+
 #define LLUV_FS_FUNCTIONS(F)                \
   { "fs_unlink",   lluv_fs_unlink_##F   },  \
   { "fs_mkdtemp",  lluv_fs_mkdtemp_##F  },  \
@@ -949,8 +2009,12 @@ static const struct luaL_Reg lluv_file_methods[] = {
                                             \
   { "fs_open",     lluv_fs_open_##F     },  \
   { "fs_open_fd",  lluv_fs_open_fd_##F  },  \
+  { "fs_readfile", lluv_fs_readfile_##F },  \
+  { "fs_writefile",lluv_fs_writefile_##F},  \
+  { "fs_mmap",     lluv_fs_mmap_##F     },  \
+  { "fs_stat_many",lluv_fs_stat_many_##F},  \
 
-static const struct luaL_Reg lluv_fs_functions[][17] = {
+static const struct luaL_Reg lluv_fs_functions[][21] = {
   {
     LLUV_FS_FUNCTIONS(unsafe)
     {NULL,NULL}
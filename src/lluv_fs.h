@@ -13,6 +13,16 @@
 
 #include "lluv.h"
 
+#define LLUV_DIRENT_MAP(XX)        \
+  XX("unknown", UV_DIRENT_UNKNOWN) \
+  XX("file",    UV_DIRENT_FILE)    \
+  XX("dir",     UV_DIRENT_DIR)     \
+  XX("link",    UV_DIRENT_LINK)    \
+  XX("fifo",    UV_DIRENT_FIFO)    \
+  XX("socket",  UV_DIRENT_SOCKET)  \
+  XX("char",    UV_DIRENT_CHAR)    \
+  XX("block",   UV_DIRENT_BLOCK)   \
+
 LLUV_INTERNAL void lluv_fs_initlib(lua_State *L, int nup, int safe);
 
 #endif
@@ -0,0 +1,259 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+/* Thin wrapper around single inotify descriptor.
+** One descriptor can watch any number of directories so watching
+** whole tree does not require handle per directory.
+** Descriptor is nonblocking and should be polled with `uv.poll`.
+** Used by `lluv.watch_tree` module.
+*/
+
+#include "lluv.h"
+#include "lluv_fs_notify.h"
+#include "lluv_error.h"
+#include <assert.h>
+
+#if defined(__linux__)
+#  define LLUV_FS_NOTIFY_SUPPORTED
+#  include <sys/inotify.h>
+#  include <unistd.h>
+#  include <errno.h>
+#endif
+
+#define LLUV_FS_NOTIFY_NAME LLUV_PREFIX" fs_notify"
+static const char *LLUV_FS_NOTIFY = LLUV_FS_NOTIFY_NAME;
+
+typedef struct lluv_fs_notify_tag{
+  int          fd;
+  lluv_flags_t flags;
+}lluv_fs_notify_t;
+
+static lluv_fs_notify_t *lluv_check_fs_notify(lua_State *L, int i, int open){
+  lluv_fs_notify_t *n = (lluv_fs_notify_t *)lutil_checkudatap (L, i, LLUV_FS_NOTIFY);
+  luaL_argcheck (L, n != NULL, i, LLUV_FS_NOTIFY_NAME" expected");
+  luaL_argcheck (L, !open || (n->fd >= 0), i, LLUV_FS_NOTIFY_NAME" closed");
+  return n;
+}
+
+#ifdef LLUV_FS_NOTIFY_SUPPORTED
+
+/* all events which can change content of watched directory */
+#define LLUV_FS_NOTIFY_MASK (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | \
+  IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |               \
+  IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_EXCL_UNLINK)
+
+/* order matters. One inotify event can have several bits set */
+#define LLUV_FS_NOTIFY_EVENTS_MAP(XX) \
+  XX("overflow",    IN_Q_OVERFLOW )   \
+  XX("ignored",     IN_IGNORED    )   \
+  XX("create",      IN_CREATE     )   \
+  XX("delete",      IN_DELETE     )   \
+  XX("moved_from",  IN_MOVED_FROM )   \
+  XX("moved_to",    IN_MOVED_TO   )   \
+  XX("delete_self", IN_DELETE_SELF)   \
+  XX("move_self",   IN_MOVE_SELF  )   \
+  XX("modify",      IN_MODIFY     )   \
+  XX("modify",      IN_CLOSE_WRITE)   \
+  XX("attrib",      IN_ATTRIB     )   \
+
+static int lluv_fs_notify_error(void){
+  switch(errno){
+    case ENOENT:  return UV_ENOENT;
+    case ENOTDIR: return UV_ENOTDIR;
+    case EACCES:  return UV_EACCES;
+    case ENOSPC:  return UV_ENOSPC;
+    case EMFILE:  return UV_EMFILE;
+    case ENFILE:  return UV_ENFILE;
+    case ENOMEM:  return UV_ENOMEM;
+    case EINVAL:  return UV_EINVAL;
+    case EBADF:   return UV_EBADF;
+  }
+  return UV_EIO;
+}
+
+static void lluv_push_fs_notify_event(lua_State *L, uint32_t mask){
+#define XX(S, M) if(mask & M){ lua_pushliteral(L, S); return; }
+  LLUV_FS_NOTIFY_EVENTS_MAP(XX)
+#undef XX
+  lua_pushliteral(L, "unknown");
+}
+
+#endif
+
+LLUV_IMPL_SAFE(lluv_fs_notify_create){
+#ifdef LLUV_FS_NOTIFY_SUPPORTED
+  lluv_fs_notify_t *n;
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if(fd < 0){
+    return lluv_fail(L, safe_flag, LLUV_ERR_UV, lluv_fs_notify_error(), NULL);
+  }
+
+  n = lutil_newudatap(L, lluv_fs_notify_t, LLUV_FS_NOTIFY);
+  n->fd    = fd;
+  n->flags = safe_flag;
+  return 1;
+#else
+  return lluv_fail(L, safe_flag, LLUV_ERR_UV, UV_ENOSYS, NULL);
+#endif
+}
+
+static int lluv_fs_notify_fileno(lua_State *L){
+  lluv_fs_notify_t *n = lluv_check_fs_notify(L, 1, 1);
+  lua_pushinteger(L, n->fd);
+  return 1;
+}
+
+/* add directory to watch list. Returns watch descriptor.
+** Adding same directory again returns same descriptor.
+*/
+static int lluv_fs_notify_add(lua_State *L){
+  lluv_fs_notify_t *n = lluv_check_fs_notify(L, 1, 1);
+  const char *path = luaL_checkstring(L, 2);
+#ifdef LLUV_FS_NOTIFY_SUPPORTED
+  int wd = inotify_add_watch(n->fd, path, LLUV_FS_NOTIFY_MASK);
+  if(wd < 0){
+    return lluv_fail(L, n->flags, LLUV_ERR_UV, lluv_fs_notify_error(), path);
+  }
+  lua_pushinteger(L, wd);
+  return 1;
+#else
+  return lluv_fail(L, n->flags, LLUV_ERR_UV, UV_ENOSYS, path);
+#endif
+}
+
+static int lluv_fs_notify_remove(lua_State *L){
+  lluv_fs_notify_t *n = lluv_check_fs_notify(L, 1, 1);
+  int wd = (int)luaL_checkinteger(L, 2);
+#ifdef LLUV_FS_NOTIFY_SUPPORTED
+  if(inotify_rm_watch(n->fd, wd) < 0){
+    return lluv_fail(L, n->flags, LLUV_ERR_UV, lluv_fs_notify_error(), NULL);
+  }
+  lua_settop(L, 1);
+  return 1;
+#else
+  return lluv_fail(L, n->flags, LLUV_ERR_UV, UV_ENOSYS, NULL);
+#endif
+}
+
+/* read all pending events without blocking.
+** Returns 4 arrays: watch descriptors, names (false if event
+** is about watched directory itself), events and is_dir flags.
+*/
+static int lluv_fs_notify_read(lua_State *L){
+  lluv_fs_notify_t *n = lluv_check_fs_notify(L, 1, 1);
+#ifdef LLUV_FS_NOTIFY_SUPPORTED
+  char buf[16 * 1024]
+#if defined(__GNUC__)
+    __attribute__ ((aligned(__alignof__(struct inotify_event))))
+#endif
+  ;
+  int i = 0;
+
+  lua_settop(L, 1);
+  lua_newtable(L); lua_newtable(L); lua_newtable(L); lua_newtable(L);
+
+  while(1){
+    ssize_t len = read(n->fd, buf, sizeof(buf));
+    char *ptr;
+
+    if(len < 0){
+      if(errno == EINTR) continue;
+      if((errno == EAGAIN) || (errno == EWOULDBLOCK)) break;
+      return lluv_fail(L, n->flags, LLUV_ERR_UV, lluv_fs_notify_error(), NULL);
+    }
+
+    if(len == 0) break;
+
+    for(ptr = buf; ptr < buf + len;){
+      const struct inotify_event *e = (const struct inotify_event*)ptr;
+      ptr += sizeof(struct inotify_event) + e->len;
+      ++i;
+
+      lua_pushinteger(L, e->wd);
+      lua_rawseti(L, 2, i);
+
+      if(e->len && e->name[0]) lua_pushstring(L, e->name);
+      else lua_pushboolean(L, 0);
+      lua_rawseti(L, 3, i);
+
+      lluv_push_fs_notify_event(L, e->mask);
+      lua_rawseti(L, 4, i);
+
+      lua_pushboolean(L, (e->mask & IN_ISDIR) ? 1 : 0);
+      lua_rawseti(L, 5, i);
+    }
+  }
+
+  return 4;
+#else
+  return lluv_fail(L, n->flags, LLUV_ERR_UV, UV_ENOSYS, NULL);
+#endif
+}
+
+static int lluv_fs_notify_close(lua_State *L){
+  lluv_fs_notify_t *n = lluv_check_fs_notify(L, 1, 0);
+#ifdef LLUV_FS_NOTIFY_SUPPORTED
+  if(n->fd >= 0) close(n->fd);
+#endif
+  n->fd = -1;
+  return 0;
+}
+
+static int lluv_fs_notify_closed(lua_State *L){
+  lluv_fs_notify_t *n = lluv_check_fs_notify(L, 1, 0);
+  lua_pushboolean(L, n->fd < 0);
+  return 1;
+}
+
+static int lluv_fs_notify_to_s(lua_State *L){
+  lluv_fs_notify_t *n = lluv_check_fs_notify(L, 1, 0);
+  lua_pushfstring(L, LLUV_FS_NOTIFY_NAME" (%p)", n);
+  return 1;
+}
+
+static const struct luaL_Reg lluv_fs_notify_methods[] = {
+  { "fileno",      lluv_fs_notify_fileno      },
+  { "add",         lluv_fs_notify_add         },
+  { "remove",      lluv_fs_notify_remove      },
+  { "read",        lluv_fs_notify_read        },
+  { "close",       lluv_fs_notify_close       },
+  { "closed",      lluv_fs_notify_closed      },
+  { "__gc",        lluv_fs_notify_close       },
+  { "__tostring",  lluv_fs_notify_to_s        },
+
+  {NULL,NULL}
+};
+
+#define LLUV_FUNCTIONS(F)                      \
+  {"fs_notify",   lluv_fs_notify_create_##F},  \
+
+static const struct luaL_Reg lluv_functions[][2] = {
+  {
+    LLUV_FUNCTIONS(unsafe)
+
+    {NULL,NULL}
+  },
+  {
+    LLUV_FUNCTIONS(safe)
+
+    {NULL,NULL}
+  },
+};
+
+LLUV_INTERNAL void lluv_fs_notify_initlib(lua_State *L, int nup, int safe){
+  assert((safe == 0) || (safe == 1));
+
+  lutil_pushnvalues(L, nup);
+  if(!lutil_createmetap(L, LLUV_FS_NOTIFY, lluv_fs_notify_methods, nup))
+    lua_pop(L, nup);
+  lua_pop(L, 1);
+
+  luaL_setfuncs(L, lluv_functions[safe], nup);
+}
@@ -0,0 +1,18 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#ifndef _LLUV_FS_NOTIFY_H_
+#define _LLUV_FS_NOTIFY_H_
+
+#include "lluv.h"
+
+LLUV_INTERNAL void lluv_fs_notify_initlib(lua_State *L, int nup, int safe);
+
+#endif
@@ -0,0 +1,672 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#include "lluv.h"
+#include "lluv_fs_walk.h"
+#include "lluv_fs.h"
+#include "lluv_loop.h"
+#include "lluv_error.h"
+#include "lluv_pool.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+//{ Glob
+
+static int lluv_glob_class(const char **pp, char c){
+  const char *p = *pp + 1;
+  int neg = 0, match = 0;
+
+  if((*p == '!') || (*p == '^')){ neg = 1; ++p; }
+
+  do{
+    if((p[1] == '-') && p[2] && (p[2] != ']')){
+      if((c >= p[0]) && (c <= p[2])) match = 1;
+      p += 3;
+    }
+    else{
+      if(c == *p) match = 1;
+      ++p;
+    }
+  }while(*p && (*p != ']'));
+
+  if(*p != ']') return -1; /* invalid class, compare `[` literally */
+
+  *pp = p + 1;
+  return match != neg;
+}
+
+LLUV_INTERNAL int lluv_glob_match(const char *p, const char *s){
+  while(*p){
+    switch(*p){
+      case '*':
+        if(p[1] == '*'){
+          /* `**` matches any sequence including `/`, `**` + `/` also matches nothing */
+          p += 2;
+          if(*p == '/'){
+            if(lluv_glob_match(p + 1, s)) return 1;
+          }
+          for(; *s; ++s){
+            if(lluv_glob_match(p, s)) return 1;
+          }
+          return lluv_glob_match(p, s);
+        }
+
+        ++p;
+        for(; *s && (*s != '/'); ++s){
+          if(lluv_glob_match(p, s)) return 1;
+        }
+        return lluv_glob_match(p, s);
+
+      case '?':
+        if(!*s || (*s == '/')) return 0;
+        ++p; ++s;
+        break;
+
+      case '[':{
+        int r;
+        if(!*s || (*s == '/')) return 0;
+        r = lluv_glob_class(&p, *s);
+        if(r == 0) return 0;
+        if(r < 0){
+          if(*s != '[') return 0;
+          ++p;
+        }
+        ++s;
+        break;
+      }
+
+      default:
+        if(*p != *s) return 0;
+        ++p; ++s;
+    }
+  }
+
+  return *s == '\0';
+}
+
+/* patterns without `/` match only base name */
+static int lluv_glob_match_any(char **patterns, int n, const char *rel, const char *name){
+  int i;
+  for(i = 0; i < n; ++i){
+    const char *p = patterns[i];
+    if(lluv_glob_match(p, strchr(p, '/') ? rel : name)) return 1;
+  }
+  return 0;
+}
+
+//}
+
+//{ Walker
+
+/* Each directory scanned by separate threadpool job with sync
+** scandir/lstat calls. Job results processed on loop thread so queue
+** of directories and entries for delivery do not need locking.
+*/
+
+#define LLUV_FS_WALK_BATCH 256
+#define LLUV_FS_WALK_JOBS  4
+
+typedef struct lluv_fs_walk_entry_tag{
+  char         *path;
+  int           type;
+  int           recurse;
+  int           deliver;
+  int64_t       size;
+  uv_timespec_t mtime;
+}lluv_fs_walk_entry_t;
+
+typedef struct lluv_fs_walker_tag lluv_fs_walker_t;
+
+typedef struct lluv_fs_walk_job_tag{
+  lluv_pool_job_t              pool;   /* must be first */
+  uv_work_t                    req;
+  lluv_fs_walker_t            *walker;
+  struct lluv_fs_walk_job_tag *next;
+  char                        *dir;
+  int                          depth;  /* depth of entries in this directory */
+  int                          result;
+  uint64_t                     start;  /* threadpool submit time */
+  lluv_fs_walk_entry_t        *entries;
+  size_t                       n, cap;
+}lluv_fs_walk_job_t;
+
+struct lluv_fs_walker_tag{
+  lluv_loop_t          *loop;
+  int                   batch_cb;
+  int                   done_cb;
+  char                **include;
+  char                **exclude;
+  int                   n_include;
+  int                   n_exclude;
+  int                   max_depth;  /* -1 no limit */
+  int                   with_stat;
+  size_t                batch;
+  int                   jobs;
+  size_t                prefix_len; /* length of root path with separator */
+  int                   active;
+  int                   error;
+  int                   canceled;   /* batch callback raised error */
+  int64_t               total;
+  lluv_fs_walk_job_t   *head, *tail;
+  lluv_fs_walk_entry_t *pending;
+  size_t                npending, cap;
+};
+
+static int lluv_fs_walk_push_entry(lluv_fs_walk_entry_t **arr, size_t *n, size_t *cap, const lluv_fs_walk_entry_t *e){
+  if(*n == *cap){
+    size_t new_cap = *cap ? *cap * 2 : 64;
+    lluv_fs_walk_entry_t *tmp = (lluv_fs_walk_entry_t*)realloc(*arr, new_cap * sizeof(lluv_fs_walk_entry_t));
+    if(!tmp) return UV_ENOMEM;
+    *arr = tmp; *cap = new_cap;
+  }
+  (*arr)[(*n)++] = *e;
+  return 0;
+}
+
+static char *lluv_fs_walk_join(const char *dir, const char *name){
+  size_t dlen = strlen(dir), nlen = strlen(name);
+  int sep = (dlen > 0) && (dir[dlen - 1] != '/') && (dir[dlen - 1] != '\\');
+  char *path = (char*)malloc(dlen + sep + nlen + 1);
+  if(!path) return NULL;
+  memcpy(path, dir, dlen);
+  if(sep) path[dlen] = '/';
+  memcpy(path + dlen + sep, name, nlen + 1);
+  return path;
+}
+
+static int lluv_fs_walk_type(uint64_t mode){
+#ifdef S_IFLNK
+  if((mode & S_IFMT) == S_IFLNK)  return UV_DIRENT_LINK;
+#endif
+#ifdef S_IFIFO
+  if((mode & S_IFMT) == S_IFIFO)  return UV_DIRENT_FIFO;
+#endif
+#ifdef S_IFSOCK
+  if((mode & S_IFMT) == S_IFSOCK) return UV_DIRENT_SOCKET;
+#endif
+#ifdef S_IFBLK
+  if((mode & S_IFMT) == S_IFBLK)  return UV_DIRENT_BLOCK;
+#endif
+  if((mode & S_IFMT) == S_IFCHR)  return UV_DIRENT_CHAR;
+  if((mode & S_IFMT) == S_IFDIR)  return UV_DIRENT_DIR;
+  if((mode & S_IFMT) == S_IFREG)  return UV_DIRENT_FILE;
+  return UV_DIRENT_UNKNOWN;
+}
+
+static void lluv_fs_walk_work(uv_work_t *arg){
+  lluv_fs_walk_job_t *job = (lluv_fs_walk_job_t*)arg->data;
+  lluv_fs_walker_t   *w   = job->walker;
+  uv_fs_t req; uv_dirent_t ent;
+  int err;
+
+  lluv_pool_started(LLUV_POOL_FS, job->start);
+
+  err = uv_fs_scandir(NULL, &req, job->dir, 0, NULL);
+  if(err < 0){
+    uv_fs_req_cleanup(&req);
+    job->result = err;
+    return;
+  }
+
+  while(uv_fs_scandir_next(&req, &ent) != UV_EOF){
+    lluv_fs_walk_entry_t e;
+    const char *rel;
+
+    memset(&e, 0, sizeof(e));
+    e.type = ent.type;
+    e.path = lluv_fs_walk_join(job->dir, ent.name);
+    if(!e.path){
+      job->result = UV_ENOMEM;
+      break;
+    }
+
+    rel = e.path + w->prefix_len;
+    if(lluv_glob_match_any(w->exclude, w->n_exclude, rel, ent.name)){
+      free(e.path);
+      continue;
+    }
+
+    e.deliver = (w->n_include == 0) || lluv_glob_match_any(w->include, w->n_include, rel, ent.name);
+
+    /* d_type is not supported by some file systems */
+    if(w->with_stat || (e.type == UV_DIRENT_UNKNOWN)){
+      uv_fs_t sreq;
+      if(uv_fs_lstat(NULL, &sreq, e.path, NULL) >= 0){
+        e.type  = lluv_fs_walk_type(sreq.statbuf.st_mode);
+        e.size  = (int64_t)sreq.statbuf.st_size;
+        e.mtime = sreq.statbuf.st_mtim;
+      }
+      uv_fs_req_cleanup(&sreq);
+    }
+
+    e.recurse = (e.type == UV_DIRENT_DIR) && ((w->max_depth < 0) || (job->depth < w->max_depth));
+
+    if(!(e.deliver || e.recurse)){
+      free(e.path);
+      continue;
+    }
+
+    if(lluv_fs_walk_push_entry(&job->entries, &job->n, &job->cap, &e) < 0){
+      free(e.path);
+      job->result = UV_ENOMEM;
+      break;
+    }
+  }
+
+  uv_fs_req_cleanup(&req);
+}
+
+static void lluv_fs_walk_job_free(lluv_fs_walk_job_t *job){
+  size_t i;
+  for(i = 0; i < job->n; ++i) free(job->entries[i].path);
+  free(job->entries);
+  free(job->dir);
+  free(job);
+}
+
+static lluv_fs_walk_job_t *lluv_fs_walk_enqueue(lluv_fs_walker_t *w, char *dir, int depth){
+  lluv_fs_walk_job_t *job = (lluv_fs_walk_job_t*)malloc(sizeof(lluv_fs_walk_job_t));
+  if(!job) return NULL;
+
+  memset(job, 0, sizeof(*job));
+  job->req.data = job;
+  job->walker   = w;
+  job->dir      = dir;
+  job->depth    = depth;
+
+  if(w->tail) w->tail->next = job; else w->head = job;
+  w->tail = job;
+
+  return job;
+}
+
+static void lluv_fs_walk_free(lua_State *L, lluv_fs_walker_t *w){
+  int i;
+  size_t j;
+
+  while(w->head){
+    lluv_fs_walk_job_t *job = w->head;
+    w->head = job->next;
+    lluv_fs_walk_job_free(job);
+  }
+
+  for(j = 0; j < w->npending; ++j) free(w->pending[j].path);
+  free(w->pending);
+
+  for(i = 0; i < w->n_include; ++i) free(w->include[i]);
+  for(i = 0; i < w->n_exclude; ++i) free(w->exclude[i]);
+  free(w->include);
+  free(w->exclude);
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, w->batch_cb);
+  luaL_unref(L, LLUV_LUA_REGISTRY, w->done_cb);
+  lluv_free_t(L, lluv_fs_walker_t, w);
+}
+
+static void lluv_push_fs_walk_type(lua_State *L, int type){
+  switch(type){
+#define XX(C,S) case S: lua_pushliteral(L, C); break;
+    LLUV_DIRENT_MAP(XX)
+#undef XX
+    default: lua_pushliteral(L, "unknown");
+  }
+}
+
+/* callback(loop, paths, types[, sizes, mtimes]) */
+static void lluv_fs_walk_deliver(lluv_fs_walker_t *w, int all){
+  lua_State *L = w->loop->L;
+  size_t off = 0;
+
+  while((w->npending - off) >= (all ? 1 : w->batch)){
+    size_t i, n = w->npending - off;
+    int argc = 3;
+    if(n > w->batch) n = w->batch;
+
+    LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, w->batch_cb);
+    lua_pushvalue(L, LLUV_LOOP_INDEX);
+    lua_createtable(L, (int)n, 0);
+    lua_createtable(L, (int)n, 0);
+    if(w->with_stat){
+      lua_createtable(L, (int)n, 0);
+      lua_createtable(L, (int)n, 0);
+      argc += 2;
+    }
+
+    for(i = 0; i < n; ++i){
+      lluv_fs_walk_entry_t *e = &w->pending[off + i];
+      int t = w->with_stat ? -4 : -2;
+
+      lua_pushstring(L, e->path);            lua_rawseti(L, t - 1, (int)i + 1);
+      lluv_push_fs_walk_type(L, e->type);    lua_rawseti(L, t,     (int)i + 1);
+      if(w->with_stat){
+        lutil_pushint64(L, e->size);         lua_rawseti(L, -3, (int)i + 1);
+        lua_pushnumber(L, (lua_Number)e->mtime.tv_sec + (lua_Number)e->mtime.tv_nsec / 1e9);
+        lua_rawseti(L, -2, (int)i + 1);
+      }
+      free(e->path);
+      e->path = NULL;
+    }
+
+    off      += n;
+    w->total += n;
+
+    if(lluv_lua_call(L, argc, 0)){
+      /* loop stopped, do not walk and deliver any more */
+      if(!w->error) w->error = UV_ECANCELED;
+      w->canceled = 1;
+
+      LLUV_CHECK_LOOP_CB_INVARIANT(L);
+      break;
+    }
+    lluv_loop_defer_proceed(L, w->loop);
+
+    LLUV_CHECK_LOOP_CB_INVARIANT(L);
+  }
+
+  if(off){
+    memmove(w->pending, w->pending + off, (w->npending - off) * sizeof(lluv_fs_walk_entry_t));
+    w->npending -= off;
+  }
+}
+
+static void lluv_on_fs_walk_work(uv_work_t *arg, int status);
+
+static void lluv_fs_walk_queued(lluv_loop_t *loop, lluv_pool_job_t *pool);
+
+static void lluv_fs_walk_finish(lluv_fs_walker_t *w);
+
+static int lluv_fs_walk_submit(lluv_fs_walker_t *w, lluv_fs_walk_job_t *job){
+  int err;
+
+  job->start = lluv_pool_submit(w->loop, LLUV_POOL_FS);
+  err = uv_queue_work(w->loop->handle, &job->req, lluv_fs_walk_work, lluv_on_fs_walk_work);
+  if(err < 0) lluv_pool_cancel(w->loop, LLUV_POOL_FS);
+  return err;
+}
+
+static void lluv_fs_walk_pump(lluv_fs_walker_t *w){
+  if(w->canceled){
+    while(w->head){
+      lluv_fs_walk_job_t *job = w->head;
+      w->head = job->next;
+      lluv_fs_walk_job_free(job);
+    }
+    w->tail = NULL;
+    return;
+  }
+
+  while((w->active < w->jobs) && w->head){
+    lluv_fs_walk_job_t *job = w->head;
+    int err;
+
+    w->head = job->next;
+    if(!w->head) w->tail = NULL;
+    job->next = NULL;
+
+    if(lluv_pool_full(w->loop, LLUV_POOL_FS)){
+      lluv_pool_enqueue(w->loop, LLUV_POOL_FS, &job->pool, lluv_fs_walk_queued);
+      ++w->active;
+      continue;
+    }
+
+    err = lluv_fs_walk_submit(w, job);
+    if(err < 0){
+      if(!w->error) w->error = err;
+      lluv_fs_walk_job_free(job);
+      continue;
+    }
+    ++w->active;
+  }
+}
+
+/* called from lluv_pool_done when fs class has free slot */
+static void lluv_fs_walk_queued(lluv_loop_t *loop, lluv_pool_job_t *pool){
+  lluv_fs_walk_job_t *job = (lluv_fs_walk_job_t*)pool;
+  lluv_fs_walker_t   *w   = job->walker;
+  int err = w->canceled ? UV_ECANCELED : lluv_fs_walk_submit(w, job);
+
+  UNUSED_ARG(loop);
+
+  if(err >= 0) return;
+
+  --w->active;
+  if(!w->canceled && !w->error) w->error = err;
+  lluv_fs_walk_job_free(job);
+
+  lluv_fs_walk_pump(w);
+  lluv_fs_walk_finish(w);
+}
+
+static void lluv_fs_walk_finish(lluv_fs_walker_t *w){
+  lluv_loop_t *loop = w->loop;
+  lua_State *L = loop->L;
+
+  if(w->active || w->head) return;
+
+  if(!w->canceled) lluv_fs_walk_deliver(w, 1);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, w->done_cb);
+  lua_pushvalue(L, LLUV_LOOP_INDEX);
+  lluv_push_status(L, w->error);
+  lutil_pushint64(L, w->total);
+
+  lluv_fs_walk_free(L, w);
+
+  LLUV_LOOP_CALL_CB(L, loop, 3);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+}
+
+static void lluv_on_fs_walk_work(uv_work_t *arg, int status){
+  lluv_fs_walk_job_t *job = (lluv_fs_walk_job_t*)arg->data;
+  lluv_fs_walker_t   *w   = job->walker;
+  size_t i;
+
+  lluv_pool_done(w->loop, LLUV_POOL_FS, job->start);
+  --w->active;
+
+  if(status < 0) job->result = status;
+
+  /* unreadable subdirectories skipped, only root error reported */
+  if((job->result < 0) && ((job->depth == 1) || (job->result == UV_ENOMEM))){
+    if(!w->error) w->error = job->result;
+  }
+
+  for(i = 0; i < job->n; ++i){
+    lluv_fs_walk_entry_t *e = &job->entries[i];
+
+    if(e->recurse && !w->error){
+      char *dir = e->deliver ? strdup(e->path) : e->path;
+      if(dir && lluv_fs_walk_enqueue(w, dir, job->depth + 1)){
+        if(!e->deliver) e->path = NULL;
+      }
+      else{
+        if(dir != e->path) free(dir);
+        w->error = UV_ENOMEM;
+      }
+    }
+
+    if(e->deliver && e->path){
+      if(lluv_fs_walk_push_entry(&w->pending, &w->npending, &w->cap, e) == 0)
+        e->path = NULL;
+    }
+  }
+
+  lluv_fs_walk_job_free(job);
+
+  if(!w->error) lluv_fs_walk_deliver(w, 0);
+
+  lluv_fs_walk_pump(w);
+
+  lluv_fs_walk_finish(w);
+}
+
+/* push array of patterns or nil. raises error for invalid option */
+static int lluv_fs_walk_check_patterns(lua_State *L, int opt, const char *name){
+  int i, n;
+
+  lua_getfield(L, opt, name);
+  if(lua_isnil(L, -1)) return lua_gettop(L);
+
+  if(lua_type(L, -1) == LUA_TSTRING){
+    lua_createtable(L, 1, 0);
+    lua_insert(L, -2);
+    lua_rawseti(L, -2, 1);
+  }
+
+  luaL_argcheck(L, lua_istable(L, -1), opt, LLUV_PREFIX" pattern must be string or array of strings");
+
+  n = (int)lua_rawlen(L, -1);
+  for(i = 1; i <= n; ++i){
+    lua_rawgeti(L, -1, i);
+    luaL_argcheck(L, lua_type(L, -1) == LUA_TSTRING, opt, LLUV_PREFIX" pattern must be string or array of strings");
+    lua_pop(L, 1);
+  }
+
+  return lua_gettop(L);
+}
+
+/* copy patterns validated by lluv_fs_walk_check_patterns */
+static int lluv_fs_walk_patterns(lua_State *L, int idx, char ***arr, int *count){
+  int i, n;
+
+  if(lua_isnil(L, idx)) return 0;
+
+  n = (int)lua_rawlen(L, idx);
+  if(!n) return 0;
+
+  *arr = (char**)malloc(sizeof(char*) * n);
+  if(!*arr) return UV_ENOMEM;
+
+  for(i = 0; i < n; ++i){
+    lua_rawgeti(L, idx, i + 1);
+    (*arr)[i] = strdup(lua_tostring(L, -1));
+    lua_pop(L, 1);
+    if(!(*arr)[i]) return UV_ENOMEM;
+    *count = i + 1;
+  }
+
+  return 0;
+}
+
+LLUV_IMPL_SAFE(lluv_fs_walk){
+  lluv_loop_t *loop = lluv_opt_loop(L, 1, LLUV_FLAG_OPEN);
+  int argc = loop ? 1 : 0, opt = 0, include = 0, exclude = 0;
+  int max_depth = -1, jobs = LLUV_FS_WALK_JOBS, with_stat = 0, err;
+  lua_Integer batch = LLUV_FS_WALK_BATCH;
+  lluv_fs_walker_t *w;
+  const char *root;
+  size_t root_len;
+
+  root = luaL_checklstring(L, ++argc, &root_len);
+  if(lua_istable(L, argc + 1)) opt = ++argc;
+
+  lluv_check_callable(L, argc + 1);
+  lluv_check_callable(L, argc + 2);
+  lua_settop(L, argc + 2);
+
+  if(!loop) loop = lluv_default_loop(L);
+
+  /* all options checked before walker allocated */
+  if(opt){
+    lua_getfield(L, opt, "depth");
+    max_depth = (int)luaL_optinteger(L, -1, max_depth);
+    lua_getfield(L, opt, "batch");
+    batch = luaL_optinteger(L, -1, batch);
+    lua_getfield(L, opt, "jobs");
+    jobs = (int)luaL_optinteger(L, -1, jobs);
+    lua_getfield(L, opt, "stat");
+    with_stat = lua_toboolean(L, -1);
+    lua_pop(L, 4);
+
+    include = lluv_fs_walk_check_patterns(L, opt, "include");
+    exclude = lluv_fs_walk_check_patterns(L, opt, "exclude");
+  }
+
+  w = lluv_alloc_t(L, lluv_fs_walker_t);
+  memset(w, 0, sizeof(*w));
+  w->loop      = loop;
+  w->max_depth = max_depth;
+  w->batch     = (batch > 0) ? (size_t)batch : 1;
+  w->jobs      = (jobs > 0) ? jobs : 1;
+  w->with_stat = with_stat;
+  w->batch_cb  = w->done_cb = LUA_NOREF;
+
+  err = include ? lluv_fs_walk_patterns(L, include, &w->include, &w->n_include) : 0;
+  if((err >= 0) && exclude) err = lluv_fs_walk_patterns(L, exclude, &w->exclude, &w->n_exclude);
+  if(err < 0){
+    lluv_fs_walk_free(L, w);
+    return lluv_fail(L, safe_flag | loop->flags, LLUV_ERR_UV, err, NULL);
+  }
+
+  /* relative path of entry starts after root and separator */
+  w->prefix_len = root_len;
+  if((root_len > 0) && (root[root_len - 1] != '/') && (root[root_len - 1] != '\\'))
+    w->prefix_len += 1;
+
+  lua_pushvalue(L, argc + 2);
+  w->done_cb  = luaL_ref(L, LLUV_LUA_REGISTRY);
+  lua_pushvalue(L, argc + 1);
+  w->batch_cb = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+  if(w->max_depth != 0){
+    char *dir = strdup(root);
+    if(!dir || !lluv_fs_walk_enqueue(w, dir, 1)){
+      free(dir);
+      lluv_fs_walk_free(L, w);
+      return lluv_fail(L, safe_flag | loop->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+    }
+  }
+
+  lluv_fs_walk_pump(w);
+
+  if(!w->active){
+    int err = w->error;
+    /* nothing to do */
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, w->done_cb);
+    lluv_loop_pushself(L, loop);
+    lluv_push_status(L, err);
+    lua_pushinteger(L, 0);
+    lluv_fs_walk_free(L, w);
+    lluv_loop_defer_call(L, loop, 3);
+  }
+
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+//}
+
+#define LLUV_FUNCTIONS(F)                \
+  {"fs_walk",     lluv_fs_walk_##F},     \
+
+static const struct luaL_Reg lluv_functions[][2] = {
+  {
+    LLUV_FUNCTIONS(unsafe)
+
+    {NULL,NULL}
+  },
+  {
+    LLUV_FUNCTIONS(safe)
+
+    {NULL,NULL}
+  },
+};
+
+LLUV_INTERNAL void lluv_fs_walk_initlib(lua_State *L, int nup, int safe){
+  luaL_setfuncs(L, lluv_functions[safe], nup);
+}
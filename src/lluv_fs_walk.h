@@ -0,0 +1,21 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#ifndef _LLUV_FS_WALK_H_
+#define _LLUV_FS_WALK_H_
+
+#include "lluv.h"
+
+LLUV_INTERNAL void lluv_fs_walk_initlib(lua_State *L, int nup, int safe);
+
+/* match path against glob pattern. `*` and `?` do not match `/`, `**` does */
+LLUV_INTERNAL int lluv_glob_match(const char *pattern, const char *str);
+
+#endif
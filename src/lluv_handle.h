@@ -16,7 +16,9 @@
 #define LLUV_READ_CB(H)       H->callbacks[1]
 #define LLUV_EXIT_CB(H)       H->callbacks[1]
 #define LLUV_CONNECTION_CB(H) H->callbacks[2]
-#define LLUV_MAX_HANDLE_CB    3
+#define LLUV_SEND_QUEUE(H)    H->callbacks[2] /* udp datagrams to send */
+#define LLUV_READ_BUF(H)      H->callbacks[3] /* buffer to read data into */
+#define LLUV_MAX_HANDLE_CB    4
 
 
 #include "lluv.h"
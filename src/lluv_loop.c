@@ -13,6 +13,7 @@
 #include "lluv_utils.h"
 #include "lluv_handle.h"
 #include "lluv_list.h"
+#include "lluv_dns.h"
 #include <assert.h>
 
 #ifndef LLUV_DEFER_DEPTH
@@ -72,6 +73,10 @@ LLUV_INTERNAL int lluv_loop_create(lua_State *L, uv_loop_t *h, lluv_flags_t flag
   loop->level        = 0;
   loop->buffer_size  = LLUV_BUFFER_SIZE;
   lluv_list_init(L, &loop->defer);
+  lluv_dns_cache_init(L, &loop->dns);
+  loop->pool.head = loop->pool.tail = NULL;
+  loop->pool.active = 0;
+  loop->pool.starting = 0;
 
   lua_pushvalue(L, -1);
   lua_rawsetp(L, LLUV_LUA_REGISTRY, h);
@@ -116,17 +121,22 @@ static int lluv_defer_call(lua_State *L){
   int i, n = lua_tointeger(L, lua_upvalueindex(1));
   luaL_checkstack(L, n, "too many arguments");
 
-  assert(lua_isfunction(L, lua_upvalueindex(2)));
+  assert(lua_isfunction(L, lua_upvalueindex(2)) || lua_isthread(L, lua_upvalueindex(2)));
   assert(!lua_isnone(L, lua_upvalueindex(n + 1)));
 
   for(i = 2; i <= n+1; ++i)lua_pushvalue(L, lua_upvalueindex(i));
 
+  if(lua_isthread(L, lua_upvalueindex(2))){
+    if(lluv_lua_resume(L, n - 1)) return lua_error(L);
+    return 0;
+  }
+
   lua_call(L, n - 1, 0);
   return 0;
 }
 
 LLUV_INTERNAL void lluv_loop_defer_call(lua_State *L, lluv_loop_t *loop, int nargs){
-  assert(lua_isfunction(L, -1-nargs));
+  assert(lua_isfunction(L, -1-nargs) || lua_isthread(L, -1-nargs));
 
   luaL_checkstack(L, 1, "too many arguments");
   lua_pushinteger(L, nargs+1);
@@ -302,6 +312,7 @@ static int lluv_loop_close_impl(lua_State *L, int ignore_error, int close_handle
 
   loop->handle = NULL;
   lluv_list_close(L, &loop->defer);
+  lluv_dns_cache_close(L, &loop->dns);
   return 0;
 }
 
@@ -435,6 +446,43 @@ static int lluv_loop_poll_timeout(lua_State *L){
   return 1;
 }
 
+/* value of `UV_LOOP_USE_IO_URING_SQPOLL`. Option is passed as is so it
+** works with newer runtime library. Older one returns `ENOSYS`.
+*/
+#define LLUV_LOOP_USE_IO_URING_SQPOLL 2
+
+static int lluv_loop_configure(lua_State *L){
+  static const lluv_uv_const_t OPTIONS[] = {
+    { UV_LOOP_BLOCK_SIGNAL,          "block_signal"       },
+#if LLUV_UV_VER_GE(1,39,0)
+    { UV_METRICS_IDLE_TIME,          "metrics_idle_time"  },
+#endif
+    { LLUV_LOOP_USE_IO_URING_SQPOLL, "io_uring_sqpoll"    },
+
+    { 0, NULL }
+  };
+
+  lluv_loop_t* loop = lluv_check_loop(L, 1, LLUV_FLAG_OPEN);
+  int option, err;
+
+  luaL_checkany(L, 2);
+  option = (int)lluv_opt_named_const(L, 2, 0, OPTIONS);
+
+  if(option == UV_LOOP_BLOCK_SIGNAL){
+    err = uv_loop_configure(loop->handle, UV_LOOP_BLOCK_SIGNAL, (int)luaL_checkinteger(L, 3));
+  }
+  else{
+    err = uv_loop_configure(loop->handle, (uv_loop_option)option);
+  }
+
+  if(err < 0){
+    return lluv_fail(L, loop->flags, LLUV_ERR_UV, err, NULL);
+  }
+
+  lua_settop(L, 1);
+  return 1;
+}
+
 static int lluv_loop_stop(lua_State *L){
   lluv_loop_t* loop = lluv_opt_loop_ex(L, 1, LLUV_FLAG_OPEN);
   uv_stop(loop->handle);
@@ -524,6 +572,7 @@ static const struct luaL_Reg lluv_loop_methods[] = {
   { "fileno",       lluv_loop_fileno       },
   { "poll_timeout", lluv_loop_poll_timeout },
   { "update_time",  lluv_loop_update_time  },
+  { "configure",    lluv_loop_configure    },
   
   { "close_all_handles", lluv_loop_close_all_handles },
 
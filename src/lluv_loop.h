@@ -20,12 +20,36 @@
 
 #define LLUV_BUFFER_SIZE 65536
 
+/* getaddrinfo results cache (see lluv_dns.c) */
+typedef struct lluv_dns_cache_tag{
+  int          enabled;
+  int          entries;      /* ref to table key => {expire, result | err} */
+  int          pending;      /* ref to table key => {callbacks} waiting for request in flight */
+  size_t       size;
+  size_t       max_entries;
+  uint64_t     ttl;          /* ms */
+  uint64_t     negative_ttl; /* ms */
+  uint64_t     hits;
+  uint64_t     misses;
+  uint64_t     coalesced;
+}lluv_dns_cache_t;
+
+/* fs jobs waiting for threadpool slot (see lluv_pool.c) */
+typedef struct lluv_pool_queue_tag{
+  struct lluv_pool_job_tag *head;
+  struct lluv_pool_job_tag *tail;
+  size_t       active;       /* fs jobs of this loop in threadpool */
+  int          starting;     /* queued call repeated so it should not be queued again */
+}lluv_pool_queue_t;
+
 typedef struct lluv_loop_tag{
   uv_loop_t   *handle;/* read only */
   lluv_flags_t flags; /* read only */
   lua_State   *L;
   lluv_list_t  defer;
   int8_t       level;
+  lluv_dns_cache_t dns;
+  lluv_pool_queue_t pool;
   size_t       buffer_size;
   char         buffer[LLUV_BUFFER_SIZE];
 }lluv_loop_t;
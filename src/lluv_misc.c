@@ -259,6 +259,32 @@ static int lluv_hrtime(lua_State *L){
   return 1;
 }
 
+#if LLUV_UV_VER_GE(1,33,0)
+
+static int lluv_random(lua_State *L){
+  size_t len = (size_t)luaL_checkinteger(L, 1);
+  char *buf; int err;
+
+  luaL_argcheck(L, len <= 65536, 1, "too many bytes");
+  if(len == 0){
+    lua_pushliteral(L, "");
+    return 1;
+  }
+
+  buf = lluv_alloc(L, len);
+  err = uv_random(NULL, NULL, buf, len, 0, NULL);
+  if(err < 0){
+    lluv_free(L, buf);
+    return lluv_fail(L, 0, LLUV_ERR_UV, err, NULL);
+  }
+
+  lua_pushlstring(L, buf, len);
+  lluv_free(L, buf);
+  return 1;
+}
+
+#endif
+
 static const lluv_uv_const_t lluv_misc_constants[] = {
   { 0, NULL }
 };
@@ -278,6 +304,9 @@ static const struct luaL_Reg lluv_misc_functions[] = {
   { "get_total_memory",    lluv_get_total_memory    },
   { "get_free_memory",     lluv_get_free_memory     },
   { "hrtime",              lluv_hrtime              },
+#if LLUV_UV_VER_GE(1,33,0)
+  { "random",              lluv_random              },
+#endif
 
   {NULL,NULL}
 };
@@ -0,0 +1,354 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+/* Accounting for libuv threadpool.
+**
+** libuv has one global threadpool shared by fs requests, getaddrinfo,
+** getnameinfo and `uv_queue_work`. Its size read from `UV_THREADPOOL_SIZE`
+** only once when first request submitted. Here we count requests per
+** class to see which one saturates the pool, and allow to set pool size
+** from Lua before first use.
+**
+** Slow fs requests (e.g. stat on hung NFS) can occupy all threads and
+** then getaddrinfo waits behind them. So number of fs requests in pool
+** limited (by default size - 1) and other fs jobs wait in loop queue.
+** Request in queue started when fs request of same loop completed.
+*/
+
+#include "lluv.h"
+#include "lluv_pool.h"
+#include "lluv_error.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* same as in libuv */
+#define LLUV_POOL_DEFAULT_SIZE 4
+#define LLUV_POOL_MAX_SIZE     1024
+
+typedef struct lluv_pool_stat_tag{
+  uint64_t submitted;
+  uint64_t completed;
+  uint64_t active;      /* submitted and not completed yet */
+  uint64_t max_active;
+  uint64_t started;     /* jobs with known wait time       */
+  uint64_t wait_total;  /* ns from submit to work start    */
+  uint64_t wait_max;
+  uint64_t time_total;  /* ns from submit to completion    */
+  uint64_t time_max;
+  uint64_t queued;      /* waiting in loop queues          */
+  uint64_t max_queued;
+  uint64_t dequeued;
+  uint64_t queue_wait_total;
+  uint64_t queue_wait_max;
+}lluv_pool_stat_t;
+
+static lluv_pool_stat_t lluv_pool_stats[LLUV_POOL_CLASSES];
+static int              lluv_pool_limits[LLUV_POOL_CLASSES]; /* 0 - default */
+static int              lluv_pool_used;
+static uv_mutex_t       lluv_pool_mutex;
+static uv_once_t        lluv_pool_once = UV_ONCE_INIT;
+
+static const char *lluv_pool_names[LLUV_POOL_CLASSES] = { "fs", "dns" };
+
+static void lluv_pool_init_once(void){
+  int err = uv_mutex_init(&lluv_pool_mutex);
+  assert(err == 0);
+}
+
+static void lluv_pool_lock(void){
+  uv_once(&lluv_pool_once, lluv_pool_init_once);
+  uv_mutex_lock(&lluv_pool_mutex);
+}
+
+static void lluv_pool_unlock(void){
+  uv_mutex_unlock(&lluv_pool_mutex);
+}
+
+static int lluv_pool_current_size(void){
+  const char *val = getenv("UV_THREADPOOL_SIZE");
+  int n = val ? atoi(val) : LLUV_POOL_DEFAULT_SIZE;
+  if(n <= 0) n = 1;
+  if(n > LLUV_POOL_MAX_SIZE) n = LLUV_POOL_MAX_SIZE;
+  return n;
+}
+
+/* must be called with lock */
+static int lluv_pool_limit(lluv_pool_class_t cls){
+  int n;
+
+  /* only fs requests can be queued */
+  if(cls != LLUV_POOL_FS) return 0;
+
+  if(lluv_pool_limits[cls]) return lluv_pool_limits[cls];
+
+  n = lluv_pool_current_size() - 1;
+  return n > 0 ? n : 1;
+}
+
+/* class reached limit and loop has own job to start queued one when it done */
+static int lluv_pool_limited(lluv_loop_t *loop, lluv_pool_class_t cls){
+  int limit; uint64_t active;
+
+  if(!loop->pool.active) return 0;
+
+  lluv_pool_lock();
+  limit  = lluv_pool_limit(cls);
+  active = lluv_pool_stats[cls].active;
+  lluv_pool_unlock();
+
+  return (limit > 0) && (active >= (uint64_t)limit);
+}
+
+LLUV_INTERNAL int lluv_pool_full(lluv_loop_t *loop, lluv_pool_class_t cls){
+  if(cls != LLUV_POOL_FS) return 0;
+
+  if(loop->pool.starting) return 0;
+
+  /* keep order of requests */
+  if(loop->pool.head) return 1;
+
+  return lluv_pool_limited(loop, cls);
+}
+
+LLUV_INTERNAL void lluv_pool_enqueue(lluv_loop_t *loop, lluv_pool_class_t cls, lluv_pool_job_t *job, lluv_pool_start_cb start){
+  lluv_pool_stat_t *s = &lluv_pool_stats[cls];
+
+  assert(cls == LLUV_POOL_FS);
+
+  job->next   = NULL;
+  job->start  = start;
+  job->queued = uv_hrtime();
+
+  if(loop->pool.tail) loop->pool.tail->next = job;
+  else loop->pool.head = job;
+  loop->pool.tail = job;
+
+  lluv_pool_lock();
+  s->queued += 1;
+  if(s->queued > s->max_queued) s->max_queued = s->queued;
+  lluv_pool_unlock();
+}
+
+LLUV_INTERNAL uint64_t lluv_pool_submit(lluv_loop_t *loop, lluv_pool_class_t cls){
+  lluv_pool_stat_t *s = &lluv_pool_stats[cls];
+  uint64_t now = uv_hrtime();
+
+  if(cls == LLUV_POOL_FS) loop->pool.active += 1;
+
+  lluv_pool_lock();
+  lluv_pool_used = 1;
+  s->submitted += 1;
+  s->active    += 1;
+  if(s->active > s->max_active) s->max_active = s->active;
+  lluv_pool_unlock();
+
+  return now;
+}
+
+LLUV_INTERNAL void lluv_pool_cancel(lluv_loop_t *loop, lluv_pool_class_t cls){
+  lluv_pool_stat_t *s = &lluv_pool_stats[cls];
+
+  if(cls == LLUV_POOL_FS) loop->pool.active -= 1;
+
+  lluv_pool_lock();
+  s->submitted -= 1;
+  s->active    -= 1;
+  lluv_pool_unlock();
+}
+
+LLUV_INTERNAL void lluv_pool_started(lluv_pool_class_t cls, uint64_t submitted){
+  lluv_pool_stat_t *s = &lluv_pool_stats[cls];
+  uint64_t wait = uv_hrtime() - submitted;
+
+  lluv_pool_lock();
+  s->started    += 1;
+  s->wait_total += wait;
+  if(wait > s->wait_max) s->wait_max = wait;
+  lluv_pool_unlock();
+}
+
+LLUV_INTERNAL void lluv_pool_done(lluv_loop_t *loop, lluv_pool_class_t cls, uint64_t submitted){
+  lluv_pool_stat_t *s = &lluv_pool_stats[cls];
+  uint64_t time = uv_hrtime() - submitted;
+
+  if(cls == LLUV_POOL_FS) loop->pool.active -= 1;
+
+  lluv_pool_lock();
+  s->completed  += 1;
+  s->active     -= 1;
+  s->time_total += time;
+  if(time > s->time_max) s->time_max = time;
+  lluv_pool_unlock();
+
+  if(cls != LLUV_POOL_FS) return;
+
+  while(loop->pool.head && !lluv_pool_limited(loop, cls)){
+    lluv_pool_job_t *job = loop->pool.head;
+    uint64_t wait = uv_hrtime() - job->queued;
+
+    loop->pool.head = job->next;
+    if(!loop->pool.head) loop->pool.tail = NULL;
+    job->next = NULL;
+
+    lluv_pool_lock();
+    s->queued           -= 1;
+    s->dequeued         += 1;
+    s->queue_wait_total += wait;
+    if(wait > s->queue_wait_max) s->queue_wait_max = wait;
+    lluv_pool_unlock();
+
+    job->start(loop, job);
+  }
+}
+
+/* threadpool_size([size]) */
+LLUV_IMPL_SAFE(lluv_threadpool_size){
+  int n, used, err;
+  char buf[32];
+
+  if(lua_isnoneornil(L, 1)){
+    lua_pushinteger(L, lluv_pool_current_size());
+    return 1;
+  }
+
+  n = (int)luaL_checkinteger(L, 1);
+  luaL_argcheck(L, (n > 0) && (n <= LLUV_POOL_MAX_SIZE), 1, "invalid threadpool size");
+
+  lluv_pool_lock();
+  used = lluv_pool_used;
+  lluv_pool_unlock();
+
+  /* libuv reads size only once */
+  if(used){
+    return lluv_fail(L, safe_flag, LLUV_ERR_UV, UV_EBUSY, NULL);
+  }
+
+  sprintf(buf, "%d", n);
+
+#ifdef _WIN32
+  err = _putenv_s("UV_THREADPOOL_SIZE", buf);
+#else
+  err = setenv("UV_THREADPOOL_SIZE", buf, 1);
+#endif
+
+  if(err != 0){
+    return lluv_fail(L, safe_flag, LLUV_ERR_UV, UV_ENOMEM, NULL);
+  }
+
+  lua_pushinteger(L, n);
+  return 1;
+}
+
+/* threadpool_limit(class, [limit]) */
+static int lluv_threadpool_limit(lua_State *L){
+  static const char *classes[] = {"fs", NULL};
+  lluv_pool_class_t cls = (lluv_pool_class_t)luaL_checkoption(L, 1, NULL, classes);
+  int n;
+
+  if(!lua_isnoneornil(L, 2)){
+    n = (int)luaL_checkinteger(L, 2);
+    luaL_argcheck(L, (n >= 0) && (n <= LLUV_POOL_MAX_SIZE), 2, "invalid threadpool limit");
+    lluv_pool_lock();
+    lluv_pool_limits[cls] = n;
+    lluv_pool_unlock();
+  }
+
+  lluv_pool_lock();
+  n = lluv_pool_limit(cls);
+  lluv_pool_unlock();
+
+  lua_pushinteger(L, n);
+  return 1;
+}
+
+static void lluv_pool_push_ms(lua_State *L, uint64_t ns, const char *name){
+  lua_pushnumber(L, (lua_Number)ns / 1e6);
+  lua_setfield(L, -2, name);
+}
+
+static void lluv_pool_push_stat(lua_State *L, const lluv_pool_stat_t *s, int limit){
+  lua_newtable(L);
+  if(limit){ lua_pushinteger(L, limit); lua_setfield(L, -2, "limit"); }
+  lutil_pushint64(L, s->submitted);  lua_setfield(L, -2, "submitted");
+  lutil_pushint64(L, s->completed);  lua_setfield(L, -2, "completed");
+  lutil_pushint64(L, s->active);     lua_setfield(L, -2, "active");
+  lutil_pushint64(L, s->max_active); lua_setfield(L, -2, "max_active");
+
+  lluv_pool_push_ms(L, s->started   ? s->wait_total / s->started   : 0, "wait_avg");
+  lluv_pool_push_ms(L, s->wait_max,                                      "wait_max");
+  lluv_pool_push_ms(L, s->completed ? s->time_total / s->completed : 0, "time_avg");
+  lluv_pool_push_ms(L, s->time_max,                                      "time_max");
+
+  lutil_pushint64(L, s->queued);     lua_setfield(L, -2, "queued");
+  lutil_pushint64(L, s->max_queued); lua_setfield(L, -2, "max_queued");
+  lluv_pool_push_ms(L, s->dequeued ? s->queue_wait_total / s->dequeued : 0, "queue_wait_avg");
+  lluv_pool_push_ms(L, s->queue_wait_max,                                     "queue_wait_max");
+}
+
+/* threadpool_stats([reset]) */
+static int lluv_threadpool_stats(lua_State *L){
+  lluv_pool_stat_t stats[LLUV_POOL_CLASSES];
+  int limits[LLUV_POOL_CLASSES];
+  int reset = lua_toboolean(L, 1);
+  int i;
+
+  lluv_pool_lock();
+  memcpy(stats, lluv_pool_stats, sizeof(stats));
+  for(i = 0; i < LLUV_POOL_CLASSES; ++i){
+    limits[i] = lluv_pool_limit((lluv_pool_class_t)i);
+  }
+  if(reset){
+    for(i = 0; i < LLUV_POOL_CLASSES; ++i){
+      uint64_t active = lluv_pool_stats[i].active;
+      uint64_t queued = lluv_pool_stats[i].queued;
+      memset(&lluv_pool_stats[i], 0, sizeof(lluv_pool_stat_t));
+      lluv_pool_stats[i].active = lluv_pool_stats[i].max_active = active;
+      lluv_pool_stats[i].queued = lluv_pool_stats[i].max_queued = queued;
+    }
+  }
+  lluv_pool_unlock();
+
+  lua_newtable(L);
+  for(i = 0; i < LLUV_POOL_CLASSES; ++i){
+    lluv_pool_push_stat(L, &stats[i], limits[i]);
+    lua_setfield(L, -2, lluv_pool_names[i]);
+  }
+
+  lua_pushinteger(L, lluv_pool_current_size());
+  lua_setfield(L, -2, "size");
+
+  return 1;
+}
+
+#define LLUV_FUNCTIONS(F)                              \
+  {"threadpool_size",  lluv_threadpool_size_##F},      \
+  {"threadpool_stats", lluv_threadpool_stats},         \
+  {"threadpool_limit", lluv_threadpool_limit},         \
+
+static const struct luaL_Reg lluv_functions[][4] = {
+  {
+    LLUV_FUNCTIONS(unsafe)
+
+    {NULL,NULL}
+  },
+  {
+    LLUV_FUNCTIONS(safe)
+
+    {NULL,NULL}
+  },
+};
+
+LLUV_INTERNAL void lluv_pool_initlib(lua_State *L, int nup, int safe){
+  assert((safe == 0) || (safe == 1));
+
+  luaL_setfuncs(L, lluv_functions[safe], nup);
+}
@@ -0,0 +1,58 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#ifndef _LLUV_POOL_H_
+#define _LLUV_POOL_H_
+
+#include "lluv.h"
+#include "lluv_loop.h"
+
+/* classes of work submitted to libuv threadpool */
+typedef enum{
+  LLUV_POOL_FS,
+  LLUV_POOL_DNS,
+
+  LLUV_POOL_CLASSES
+}lluv_pool_class_t;
+
+typedef struct lluv_pool_job_tag lluv_pool_job_t;
+
+typedef void (*lluv_pool_start_cb)(lluv_loop_t *loop, lluv_pool_job_t *job);
+
+/* job waiting in loop queue until class has free slot */
+struct lluv_pool_job_tag{
+  lluv_pool_job_t    *next;
+  lluv_pool_start_cb  start;
+  uint64_t            queued;
+};
+
+LLUV_INTERNAL void lluv_pool_initlib(lua_State *L, int nup, int safe);
+
+/* class reached its limit so new job have to be queued */
+LLUV_INTERNAL int lluv_pool_full(lluv_loop_t *loop, lluv_pool_class_t cls);
+
+/* queue job. `start` called from `lluv_pool_done` on loop thread and
+** it should submit request or report error via callback.
+*/
+LLUV_INTERNAL void lluv_pool_enqueue(lluv_loop_t *loop, lluv_pool_class_t cls, lluv_pool_job_t *job, lluv_pool_start_cb start);
+
+/* request submitted. Returns timestamp which should be passed to other functions */
+LLUV_INTERNAL uint64_t lluv_pool_submit(lluv_loop_t *loop, lluv_pool_class_t cls);
+
+/* request was not submitted after `lluv_pool_submit` (libuv returned error) */
+LLUV_INTERNAL void lluv_pool_cancel(lluv_loop_t *loop, lluv_pool_class_t cls);
+
+/* work started on worker thread (only for `uv_queue_work` jobs) */
+LLUV_INTERNAL void lluv_pool_started(lluv_pool_class_t cls, uint64_t submitted);
+
+/* request completed (called on loop thread). Starts queued jobs */
+LLUV_INTERNAL void lluv_pool_done(lluv_loop_t *loop, lluv_pool_class_t cls, uint64_t submitted);
+
+#endif
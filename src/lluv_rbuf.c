@@ -0,0 +1,384 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#include "lluv_rbuf.h"
+#include "lluv_utils.h"
+#include "lluv_error.h"
+#include "lluv_fbuf.h"
+#include <memory.h>
+#include <string.h>
+#include <assert.h>
+
+/* Ring buffer has fixed capacity and provides contiguous view of free space
+** (to read data into) and contiguous view of readable data (to parse it).
+**
+** On Linux same memory is mapped twice one after another (memfd + mmap)
+** so data which wraps around the end of buffer is still contiguous.
+** On other systems data moved to the beginning of buffer when needed.
+**/
+
+#if defined(__linux__)
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#  if defined(SYS_memfd_create)
+#    define LLUV_RBUF_USE_MIRROR 1
+#  endif
+#endif
+
+#ifndef LLUV_RBUF_USE_MIRROR
+#  define LLUV_RBUF_USE_MIRROR 0
+#endif
+
+//{ Ring buffer
+
+#define LLUV_RBUF_NAME LLUV_PREFIX" Ring buffer"
+static const char *LLUV_RBUF = LLUV_RBUF_NAME;
+
+#if LLUV_RBUF_USE_MIRROR
+
+static int lluv_rbuf_map(lluv_ringbuf_t *rb, size_t capacity){
+  long page = sysconf(_SC_PAGESIZE);
+  size_t size; int fd; char *base;
+
+  if(page <= 0) return -1;
+  size = ((capacity + page - 1) / page) * page;
+
+  fd = (int)syscall(SYS_memfd_create, "lluv-ringbuf", 1 /*MFD_CLOEXEC*/);
+  if(fd < 0) return -1;
+
+  if(ftruncate(fd, (off_t)size) < 0){
+    close(fd);
+    return -1;
+  }
+
+  base = (char*)mmap(NULL, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(base == MAP_FAILED){
+    close(fd);
+    return -1;
+  }
+
+  if( (mmap(base,        size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) ||
+      (mmap(base + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+  ){
+    munmap(base, 2 * size);
+    close(fd);
+    return -1;
+  }
+
+  close(fd);
+
+  rb->data     = base;
+  rb->capacity = size;
+  rb->mirror   = 1;
+  return 0;
+}
+
+#endif
+
+static void lluv_rbuf_release(lua_State *L, lluv_ringbuf_t *rb){
+  if(!rb->data) return;
+
+#if LLUV_RBUF_USE_MIRROR
+  if(rb->mirror) munmap(rb->data, 2 * rb->capacity);
+  else
+#endif
+  lluv_free(L, rb->data);
+
+  rb->data = NULL;
+  rb->capacity = rb->head = rb->size = 0;
+}
+
+static void lluv_rbuf_compact(lluv_ringbuf_t *rb){
+  if(rb->head == 0) return;
+  if(rb->size) memmove(rb->data, rb->data + rb->head, rb->size);
+  rb->head = 0;
+}
+
+LLUV_INTERNAL char *lluv_rbuf_write_view(lluv_ringbuf_t *rb, size_t *len){
+  size_t space = rb->capacity - rb->size;
+
+  if(!rb->mirror){
+    /* avoid move data too often */
+    if((rb->capacity - rb->head - rb->size) < (space / 2)) lluv_rbuf_compact(rb);
+    space = rb->capacity - rb->head - rb->size;
+  }
+
+  *len = space;
+  return rb->data + rb->head + rb->size;
+}
+
+LLUV_INTERNAL void lluv_rbuf_commit(lluv_ringbuf_t *rb, size_t n){
+  assert(n <= (rb->capacity - rb->size));
+  rb->size += n;
+}
+
+static void lluv_rbuf_consume(lluv_ringbuf_t *rb, size_t n){
+  assert(n <= rb->size);
+  rb->head += n; rb->size -= n;
+  if(rb->size == 0) rb->head = 0;
+  else if(rb->head >= rb->capacity){
+    assert(rb->mirror);
+    rb->head -= rb->capacity;
+  }
+}
+
+LLUV_INTERNAL lluv_ringbuf_t *lluv_check_rbuf(lua_State *L, int i){
+  lluv_ringbuf_t *rb = (lluv_ringbuf_t *)lutil_checkudatap (L, i, LLUV_RBUF);
+  luaL_argcheck (L, rb != NULL, i, LLUV_RBUF_NAME" expected");
+  return rb;
+}
+
+LLUV_INTERNAL lluv_ringbuf_t *lluv_test_rbuf(lua_State *L, int i){
+  if(!lutil_isudatap(L, i, LLUV_RBUF)) return NULL;
+  return (lluv_ringbuf_t *)lua_touserdata(L, i);
+}
+
+static int lluv_rbuf_new(lua_State *L){
+  int64_t capacity = lutil_checkint64(L, 1);
+  int mirror = lua_isnoneornil(L, 2) || lua_toboolean(L, 2);
+  lluv_ringbuf_t *rb;
+
+  luaL_argcheck(L, capacity > 0, 1, "positive number expected");
+
+  rb = lutil_newudatap(L, lluv_ringbuf_t, LLUV_RBUF);
+
+#if LLUV_RBUF_USE_MIRROR
+  if(mirror && (0 == lluv_rbuf_map(rb, (size_t)capacity))) return 1;
+#else
+  (void)mirror;
+#endif
+
+  rb->data = (char*)lluv_alloc(L, (size_t)capacity);
+  if(!rb->data) return lluv_fail(L, LLUV_FLAG_RAISE_ERROR, LLUV_ERR_UV, UV_ENOMEM, NULL);
+  rb->capacity = (size_t)capacity;
+
+  return 1;
+}
+
+static int lluv_rbuf_free(lua_State *L){
+  lluv_ringbuf_t *rb = lluv_check_rbuf(L, 1);
+  lluv_rbuf_release(L, rb);
+  return 0;
+}
+
+static int lluv_rbuf_to_s(lua_State *L){
+  lluv_ringbuf_t *rb = lluv_check_rbuf(L, 1);
+  lua_pushfstring(L, LLUV_RBUF_NAME" (%p)", rb);
+  return 1;
+}
+
+static int lluv_rbuf_reset(lua_State *L){
+  lluv_ringbuf_t *rb = lluv_check_rbuf(L, 1);
+  rb->head = rb->size = 0;
+  lua_settop(L, 1);
+  return 1;
+}
+
+static int lluv_rbuf_capacity(lua_State *L){
+  lluv_ringbuf_t *rb = lluv_check_rbuf(L, 1);
+  lutil_pushint64(L, rb->capacity);
+  return 1;
+}
+
+static int lluv_rbuf_size(lua_State *L){
+  lluv_ringbuf_t *rb = lluv_check_rbuf(L, 1);
+  lutil_pushint64(L, rb->size);
+  return 1;
+}
+
+static int lluv_rbuf_space(lua_State *L){
+  lluv_ringbuf_t *rb = lluv_check_rbuf(L, 1);
+  lutil_pushint64(L, rb->capacity - rb->size);
+  return 1;
+}
+
+static int lluv_rbuf_empty(lua_State *L){
+  lluv_ringbuf_t *rb = lluv_check_rbuf(L, 1);
+  lua_pushboolean(L, rb->size == 0);
+  return 1;
+}
+
+static int lluv_rbuf_full(lua_State *L){
+  lluv_ringbuf_t *rb = lluv_check_rbuf(L, 1);
+  lua_pushboolean(L, rb->size == rb->capacity);
+  return 1;
+}
+
+static int lluv_rbuf_mirrored(lua_State *L){
+  lluv_ringbuf_t *rb = lluv_check_rbuf(L, 1);
+  lua_pushboolean(L, rb->mirror);
+  return 1;
+}
+
+static int lluv_rbuf_write(lua_State *L){
+  lluv_ringbuf_t *rb = lluv_check_rbuf(L, 1);
+  size_t len; const char *data = lluv_check_bufdata(L, 2, &len);
+  size_t space; char *dst;
+
+  if(len > (rb->capacity - rb->size)) len = rb->capacity - rb->size;
+
+  dst = lluv_rbuf_write_view(rb, &space);
+  if(space < len){
+    lluv_rbuf_compact(rb);
+    dst = lluv_rbuf_write_view(rb, &space);
+  }
+
+  memcpy(dst, data, len);
+  lluv_rbuf_commit(rb, len);
+
+  lutil_pushint64(L, len);
+  return 1;
+}
+
+static int lluv_rbuf_commit_(lua_State *L){
+  lluv_ringbuf_t *rb = lluv_check_rbuf(L, 1);
+  int64_t n = lutil_checkint64(L, 2);
+  size_t space = rb->mirror ? (rb->capacity - rb->size) : (rb->capacity - rb->head - rb->size);
+
+  luaL_argcheck(L, (n >= 0) && ((size_t)n <= space), 2, LLUV_PREFIX" out of index");
+
+  lluv_rbuf_commit(rb, (size_t)n);
+  lua_settop(L, 1);
+  return 1;
+}
+
+static int lluv_rbuf_consume_(lua_State *L){
+  lluv_ringbuf_t *rb = lluv_check_rbuf(L, 1);
+  int64_t n = lutil_checkint64(L, 2);
+
+  luaL_argcheck(L, n >= 0, 2, "non negative number expected");
+  if((size_t)n > rb->size) n = rb->size;
+
+  lluv_rbuf_consume(rb, (size_t)n);
+  lutil_pushint64(L, n);
+  return 1;
+}
+
+static int lluv_rbuf_peek(lua_State *L){
+  lluv_ringbuf_t *rb = lluv_check_rbuf(L, 1);
+  int64_t n = lutil_optint64(L, 2, rb->size);
+
+  luaL_argcheck(L, n >= 0, 2, "non negative number expected");
+  if(rb->size < (size_t)n) return 0;
+
+  lua_pushlstring(L, rb->data + rb->head, (size_t)n);
+  return 1;
+}
+
+static int lluv_rbuf_read(lua_State *L){
+  lluv_ringbuf_t *rb = lluv_check_rbuf(L, 1);
+  int64_t n;
+
+  if(lua_isnoneornil(L, 2)){
+    if(rb->size == 0) return 0;
+    n = rb->size;
+  }
+  else{
+    n = lutil_checkint64(L, 2);
+    luaL_argcheck(L, n >= 0, 2, "non negative number expected");
+    if(rb->size < (size_t)n) return 0;
+  }
+
+  lua_pushlstring(L, rb->data + rb->head, (size_t)n);
+  lluv_rbuf_consume(rb, (size_t)n);
+  return 1;
+}
+
+static int lluv_rbuf_find(lua_State *L){
+  lluv_ringbuf_t *rb = lluv_check_rbuf(L, 1);
+  size_t len; const char *str = luaL_checklstring(L, 2, &len);
+  int64_t init = lutil_optint64(L, 3, 1);
+  const char *base = rb->data + rb->head, *e;
+
+  luaL_argcheck(L, init > 0, 3, "positive number expected");
+  if((size_t)(init - 1) > rb->size) return 0;
+
+  e = lluv_memfind(base + init - 1, rb->size - (size_t)(init - 1), str, len);
+  if(!e) return 0;
+
+  lutil_pushint64(L, e - base + 1);
+  return 1;
+}
+
+static int lluv_rbuf_read_until(lua_State *L){
+  lluv_ringbuf_t *rb = lluv_check_rbuf(L, 1);
+  size_t len; const char *delim = luaL_checklstring(L, 2, &len);
+  int inclusive = lua_toboolean(L, 3);
+  const char *base = rb->data + rb->head, *e;
+  size_t end;
+
+  luaL_argcheck(L, len > 0, 2, "empty delimiter");
+
+  e = lluv_memfind(base, rb->size, delim, len);
+  if(!e) return 0;
+
+  end = e - base;
+  lua_pushlstring(L, base, end + (inclusive ? len : 0));
+  lluv_rbuf_consume(rb, end + len);
+  return 1;
+}
+
+static int lluv_rbuf_read_view(lua_State *L){
+  lluv_ringbuf_t *rb = lluv_check_rbuf(L, 1);
+  lua_pushlightuserdata(L, rb->data + rb->head);
+  lutil_pushint64(L, rb->size);
+  return 2;
+}
+
+static int lluv_rbuf_write_view_(lua_State *L){
+  lluv_ringbuf_t *rb = lluv_check_rbuf(L, 1);
+  size_t len; char *p = lluv_rbuf_write_view(rb, &len);
+  lua_pushlightuserdata(L, p);
+  lutil_pushint64(L, len);
+  return 2;
+}
+
+static const struct luaL_Reg lluv_rbuf_methods[] = {
+  { "__gc",        lluv_rbuf_free            },
+  { "__tostring",  lluv_rbuf_to_s            },
+  { "__len",       lluv_rbuf_size            },
+  { "free",        lluv_rbuf_free            },
+  { "reset",       lluv_rbuf_reset           },
+  { "capacity",    lluv_rbuf_capacity        },
+  { "size",        lluv_rbuf_size            },
+  { "space",       lluv_rbuf_space           },
+  { "empty",       lluv_rbuf_empty           },
+  { "full",        lluv_rbuf_full            },
+  { "mirrored",    lluv_rbuf_mirrored        },
+  { "write",       lluv_rbuf_write           },
+  { "commit",      lluv_rbuf_commit_         },
+  { "consume",     lluv_rbuf_consume_        },
+  { "peek",        lluv_rbuf_peek            },
+  { "read",        lluv_rbuf_read            },
+  { "read_until",  lluv_rbuf_read_until      },
+  { "find",        lluv_rbuf_find            },
+  { "read_view",   lluv_rbuf_read_view       },
+  { "write_view",  lluv_rbuf_write_view_     },
+
+  {NULL,NULL}
+};
+
+//}
+
+static const struct luaL_Reg lluv_rbuf_functions[] = {
+  { "ringbuf",     lluv_rbuf_new      },
+
+  {NULL,NULL}
+};
+
+LLUV_INTERNAL void lluv_rbuf_initlib(lua_State *L, int nup, int safe){
+  lutil_pushnvalues(L, nup);
+  if(!lutil_createmetap(L, LLUV_RBUF, lluv_rbuf_methods, nup))
+    lua_pop(L, nup);
+  lua_pop(L, 1);
+
+  luaL_setfuncs(L, lluv_rbuf_functions, nup);
+}
@@ -0,0 +1,35 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#ifndef _LLUV_RBUF_H_
+#define _LLUV_RBUF_H_
+
+#include "lluv.h"
+
+typedef struct lluv_ringbuf_tag{
+  char       *data;
+  size_t      capacity;
+  size_t      head;      /* first unread byte        */
+  size_t      size;      /* number of readable bytes */
+  int         mirror;    /* memory mapped twice so views never wrap */
+}lluv_ringbuf_t;
+
+LLUV_INTERNAL void lluv_rbuf_initlib(lua_State *L, int nup, int safe);
+
+LLUV_INTERNAL lluv_ringbuf_t *lluv_check_rbuf(lua_State *L, int i);
+
+LLUV_INTERNAL lluv_ringbuf_t *lluv_test_rbuf(lua_State *L, int i);
+
+/* contiguous free space to read data into. len is 0 if buffer is full */
+LLUV_INTERNAL char *lluv_rbuf_write_view(lluv_ringbuf_t *rb, size_t *len);
+
+LLUV_INTERNAL void lluv_rbuf_commit(lluv_ringbuf_t *rb, size_t n);
+
+#endif
@@ -10,6 +10,7 @@
 
 #include "lluv.h"
 #include "lluv_req.h"
+#include "lluv_fbuf.h"
 #include <assert.h>
 
 
@@ -27,9 +28,20 @@ LLUV_INTERNAL lluv_req_t* lluv_req_new(lua_State *L, uv_req_type type, lluv_hand
   return req;
 }
 
+static void lluv_req_unref_arg(lua_State *L, lluv_req_t *req){
+  if(req->arg == LUA_NOREF) return;
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, req->arg);
+  lluv_fbuf_unpin(L, -1);
+  lua_pop(L, 1);
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, req->arg);
+  req->arg = LUA_NOREF;
+}
+
 LLUV_INTERNAL void lluv_req_free(lua_State *L, lluv_req_t *req){
   luaL_unref(L, LLUV_LUA_REGISTRY, req->cb);
-  luaL_unref(L, LLUV_LUA_REGISTRY, req->arg);
+  lluv_req_unref_arg(L, req);
   if(req->handle){
     lluv_handle_unlock(L, req->handle, LLUV_LOCK_REQ);
   }
@@ -44,7 +56,9 @@ LLUV_INTERNAL lluv_req_t* lluv_req_byptr(uv_req_t *r){
 }
 
 LLUV_INTERNAL void lluv_req_ref(lua_State *L, lluv_req_t *req){
-  luaL_unref(L, LLUV_LUA_REGISTRY, req->arg);
+  lluv_req_unref_arg(L, req);
+  /* buffer memory can not be released while request uses it */
+  lluv_fbuf_pin(L, -1);
   req->arg = luaL_ref(L, LLUV_LUA_REGISTRY);
 }
 
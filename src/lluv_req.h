@@ -18,6 +18,7 @@ typedef struct lluv_req_tag{
   lluv_handle_t *handle;
   int           cb;
   int           arg;
+  uint64_t      start;  /* threadpool submit time */
   uv_req_t      req;
 } lluv_req_t;
 
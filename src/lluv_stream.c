@@ -16,6 +16,9 @@
 #include "lluv_loop.h"
 #include "lluv_error.h"
 #include "lluv_req.h"
+#include "lluv_fbuf.h"
+#include "lluv_rbuf.h"
+#include "lluv_addr.h"
 #include <assert.h>
 
 #define LLUV_STREAM_NAME LLUV_PREFIX" Stream"
@@ -235,6 +238,9 @@ static int lluv_stream_accept(lua_State *L){
     return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, NULL);
   }
 
+  /* accepted connection reports addresses same way as server */
+  if(is_new_dst && IS_(handle, COMPACT_ADDR)) SET_(dst, COMPACT_ADDR);
+
   return 1;
 }
 
@@ -286,18 +292,167 @@ static void lluv_on_stream_read_cb(uv_stream_t* arg, ssize_t nread, const uv_buf
   LLUV_CHECK_LOOP_CB_INVARIANT(L);
 }
 
+static void lluv_alloc_rbuf_cb(uv_handle_t* arg, size_t suggested_size, uv_buf_t *buf){
+  lluv_handle_t *handle = lluv_handle_byptr(arg);
+  lua_State *L = LLUV_HCALLBACK_L(handle);
+  lluv_ringbuf_t *rb;
+  size_t len = 0; char *base = NULL;
+
+  UNUSED_ARG(suggested_size);
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, LLUV_READ_BUF(handle));
+  rb = lluv_test_rbuf(L, -1);
+  lua_pop(L, 1);
+
+  /* full buffer produce UV_ENOBUFS */
+  if(rb && rb->data) base = lluv_rbuf_write_view(rb, &len);
+
+  *buf = uv_buf_init(base, len);
+}
+
+static void lluv_on_stream_read_rbuf_cb(uv_stream_t* arg, ssize_t nread, const uv_buf_t* buf){
+  lluv_handle_t *handle = lluv_handle_byptr((uv_handle_t*)arg);
+  lua_State *L = LLUV_HCALLBACK_L(handle);
+
+  UNUSED_ARG(buf);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+  /* EAGAIN */
+  if((nread == 0) || !IS_(handle, OPEN)) return;
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+  assert(!lua_isnil(L, -1));
+
+  lluv_handle_pushself(L, handle);
+
+  if(nread > 0){
+    lluv_ringbuf_t *rb;
+
+    lua_pushnil(L);
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, LLUV_READ_BUF(handle));
+    rb = lluv_test_rbuf(L, -1);
+    assert(rb && rb->data);
+    lluv_rbuf_commit(rb, (size_t)nread);
+    lutil_pushint64(L, nread);
+  }
+  else{
+    uv_read_stop(arg);
+
+    luaL_unref(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+    LLUV_READ_CB(handle) = LUA_NOREF;
+
+    lluv_error_create(L, LLUV_ERR_UV, (uv_errno_t)nread, NULL);
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, LLUV_READ_BUF(handle));
+    lua_pushinteger(L, 0);
+
+    luaL_unref(L, LLUV_LUA_REGISTRY, LLUV_READ_BUF(handle));
+    LLUV_READ_BUF(handle) = LUA_NOREF;
+
+    lluv_handle_unlock(L, handle, LLUV_LOCK_READ);
+  }
+
+  LLUV_HANDLE_CALL_CB(L, handle, 4);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+}
+
 static int lluv_stream_start_read(lua_State *L){
   lluv_handle_t *handle = lluv_check_stream(L, 1, LLUV_FLAG_OPEN);
+  lluv_ringbuf_t *rb = lluv_test_rbuf(L, 2);
   int err;
 
-  lluv_check_args_with_cb(L, 2);
+  lluv_check_args_with_cb(L, rb ? 3 : 2);
   LLUV_READ_CB(handle) = luaL_ref(L, LLUV_LUA_REGISTRY);
 
-  err = uv_read_start(LLUV_H(handle, uv_stream_t), lluv_alloc_buffer_cb, lluv_on_stream_read_cb);
+  luaL_unref(L, LLUV_LUA_REGISTRY, LLUV_READ_BUF(handle));
+  LLUV_READ_BUF(handle) = LUA_NOREF;
+
+  if(rb){
+    luaL_argcheck(L, rb->data != NULL, 2, LLUV_PREFIX" ring buffer closed");
+    LLUV_READ_BUF(handle) = luaL_ref(L, LLUV_LUA_REGISTRY);
+    err = uv_read_start(LLUV_H(handle, uv_stream_t), lluv_alloc_rbuf_cb, lluv_on_stream_read_rbuf_cb);
+  }
+  else{
+    err = uv_read_start(LLUV_H(handle, uv_stream_t), lluv_alloc_buffer_cb, lluv_on_stream_read_cb);
+  }
+
   if(err >= 0) lluv_handle_lock(L, handle, LLUV_LOCK_READ);
   return lluv_return(L, handle, LLUV_READ_CB(handle), err);
 }
 
+static void lluv_on_stream_read_once_cb(uv_stream_t* arg, ssize_t nread, const uv_buf_t* buf){
+  lluv_handle_t *handle = lluv_handle_byptr((uv_handle_t*)arg);
+  lua_State *L = LLUV_HCALLBACK_L(handle);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+  if(!IS_(handle, OPEN)){
+    lluv_free_buffer((uv_handle_t*)arg, buf);
+    return;
+  }
+
+  /* EAGAIN */
+  if(nread == 0){
+    lluv_free_buffer((uv_handle_t*)arg, buf);
+    return;
+  }
+
+  uv_read_stop(arg);
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+  assert(!lua_isnil(L, -1));
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+  LLUV_READ_CB(handle) = LUA_NOREF;
+
+  lluv_handle_pushself(L, handle);
+
+  if(nread > 0){
+    lua_pushnil(L);
+    lua_pushlstring(L, buf->base, nread);
+  }
+  else{
+    lluv_error_create(L, LLUV_ERR_UV, (uv_errno_t)nread, NULL);
+    lua_pushnil(L);
+  }
+  lluv_free_buffer((uv_handle_t*)arg, buf);
+
+  lluv_handle_unlock(L, handle, LLUV_LOCK_READ);
+
+  LLUV_HANDLE_CALL_CB(L, handle, 3);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+}
+
+static int lluv_stream_read(lua_State *L){
+  lluv_handle_t *handle = lluv_check_stream(L, 1, LLUV_FLAG_OPEN);
+  int err, co;
+
+  lluv_check_args_with_cb(L, 2);
+  luaL_argcheck(L, LLUV_READ_CB(handle) == LUA_NOREF, 1, "stream already reading");
+
+  co = lluv_is_yield_cb(L, 2);
+  LLUV_READ_CB(handle) = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+  err = uv_read_start(LLUV_H(handle, uv_stream_t), lluv_alloc_buffer_cb, lluv_on_stream_read_once_cb);
+  if(err < 0){
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+    luaL_unref(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+    LLUV_READ_CB(handle) = LUA_NOREF;
+
+    lua_pushvalue(L, 1);
+    lluv_error_create(L, LLUV_ERR_UV, err, NULL);
+    lluv_loop_defer_call(L, lluv_loop_by_handle(&handle->handle), 2);
+  }
+  else lluv_handle_lock(L, handle, LLUV_LOCK_READ);
+
+  if(co) return lua_yield(L, 0);
+
+  lua_settop(L, 1);
+  return 1;
+}
+
 static int lluv_stream_stop_read(lua_State *L){
   lluv_handle_t *handle = lluv_check_stream(L, 1, LLUV_FLAG_OPEN);
   int err;
@@ -315,6 +470,9 @@ static int lluv_stream_stop_read(lua_State *L){
     LLUV_READ_CB(handle) = LUA_NOREF;
   }
 
+  luaL_unref(L, LLUV_LUA_REGISTRY, LLUV_READ_BUF(handle));
+  LLUV_READ_BUF(handle) = LUA_NOREF;
+
   lua_settop(L, 1);
   return 1;
 }
@@ -325,7 +483,7 @@ static int lluv_stream_stop_read(lua_State *L){
 
 static int lluv_stream_try_write(lua_State *L){
   lluv_handle_t *handle = lluv_check_stream(L, 1, LLUV_FLAG_OPEN);
-  size_t len; const char *str = luaL_checklstring(L, 2, &len);
+  size_t len; const char *str = lluv_check_bufdata(L, 2, &len);
   int err; uv_buf_t buf = uv_buf_init((char*)str, len);
 
   lluv_check_none(L, 3);
@@ -400,7 +558,7 @@ static int lluv_stream_writet(lua_State *L){
   for(i = 0; i < n; ++i){
     size_t len; const char *str;
     lua_rawgeti(L, 2, i + 1);
-    str = luaL_checklstring(L, -1, &len);
+    str = lluv_check_bufdata(L, -1, &len);
     lua_rawseti(L, -2, i + 1);
     buf[i] = uv_buf_init((char*)str, len);
   }
@@ -418,7 +576,7 @@ static int lluv_stream_write(lua_State *L){
   if(lua_type(L, 2) == LUA_TTABLE) return lluv_stream_writet(L); else{
 
   lluv_handle_t  *handle = lluv_check_stream(L, 1, LLUV_FLAG_OPEN);
-  size_t len; const char *str = luaL_checklstring(L, 2, &len);
+  size_t len; const char *str = lluv_check_bufdata(L, 2, &len);
   int err; lluv_req_t *req;
   uv_buf_t buf = uv_buf_init((char*)str, len);
 
@@ -428,7 +586,7 @@ static int lluv_stream_write(lua_State *L){
     lluv_check_args_with_cb(L, 3);
 
   req = lluv_req_new(L, UV_WRITE, handle);
-  lluv_req_ref(L, req); /* string */
+  lluv_req_ref(L, req); /* string or buffer */
 
   err = uv_write(LLUV_R(req, write), LLUV_H(handle, uv_stream_t), &buf, 1, lluv_on_stream_write_cb);
 
@@ -446,7 +604,7 @@ static int lluv_stream_write2(lua_State *L){
     lua_pushliteral(L, ".");
     lua_insert(L, 3);
   }
-  str = luaL_checklstring(L, 3, &len);
+  str = lluv_check_bufdata(L, 3, &len);
   buf = uv_buf_init((char*)str, len);
 
   if(lua_gettop(L) == 3)
@@ -455,7 +613,7 @@ static int lluv_stream_write2(lua_State *L){
     lluv_check_args_with_cb(L, 4);
 
   req = lluv_req_new(L, UV_WRITE, handle);
-  lluv_req_ref(L, req); /* string */
+  lluv_req_ref(L, req); /* string or buffer */
 
   err = uv_write2(LLUV_R(req, write), LLUV_H(handle, uv_stream_t), &buf, 1, LLUV_H(src, uv_stream_t), lluv_on_stream_write_cb);
 
@@ -498,6 +656,7 @@ static const struct luaL_Reg lluv_stream_methods[] = {
   { "listen",       lluv_stream_listen        },
   { "accept",       lluv_stream_accept        },
   { "start_read",   lluv_stream_start_read    },
+  { "read",         lluv_stream_read          },
   { "stop_read",    lluv_stream_stop_read     },
   { "try_write",    lluv_stream_try_write     },
   { "write",        lluv_stream_write         },
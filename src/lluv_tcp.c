@@ -15,6 +15,11 @@
 #include "lluv_loop.h"
 #include "lluv_error.h"
 #include "lluv_req.h"
+#include "lluv_addr.h"
+#include "lluv_dns.h"
+#include "lluv_timer.h"
+#include <memory.h>
+#include <string.h>
 #include <assert.h>
 
 #define LLUV_TCP_NAME LLUV_PREFIX" tcp"
@@ -43,10 +48,101 @@ static lluv_handle_t* lluv_check_tcp(lua_State *L, int idx, lluv_flags_t flags){
   return handle;
 }
 
+/* defer cb(tcp, err) where err on top of the stack */
+static void lluv_tcp_connect_done(lua_State *L, lluv_handle_t *handle){
+  lua_pushvalue(L, lua_upvalueindex(5));
+  lua_pushvalue(L, lua_upvalueindex(3));
+  lua_pushvalue(L, -3);
+  lluv_loop_defer_call(L, lluv_loop_by_handle(&handle->handle), 2);
+  lua_pop(L, 1);
+}
+
+/* getaddrinfo callback for connect(host, port, cb).
+** Only first resolved address is used. Handle belongs to user and could be
+** bound or configured, so it is not reinitialized to try other addresses
+** (`tcp_connect_any` creates own handles for that).
+** upvalues: registry, handles, tcp, port, cb
+*/
+static int lluv_tcp_connect_resolved(lua_State *L){
+  lluv_handle_t *handle;
+  int err = UV_EAI_NODATA;
+
+  lua_settop(L, 3);
+  handle = lluv_check_handle(L, lua_upvalueindex(3), 0);
+
+  if(!IS_(handle, OPEN) || uv_is_closing(LLUV_H(handle, uv_handle_t))){
+    /* closed while resolving */
+    err = UV_ECANCELED;
+  }
+  else if(!lua_isnil(L, 2)){
+    lua_pushvalue(L, 2);
+    lluv_tcp_connect_done(L, handle);
+    return 0;
+  }
+  else{
+    lua_rawgeti(L, 3, 1);
+    if(lua_istable(L, -1)) lua_getfield(L, -1, "address");
+    if(lua_type(L, -1) == LUA_TSTRING){
+      struct sockaddr_storage sa; lluv_req_t *req;
+
+      lua_pushvalue(L, lua_upvalueindex(4));
+      err = lluv_check_addr(L, -2, &sa);
+      if(err >= 0){
+        lua_pushvalue(L, lua_upvalueindex(5));
+        req = lluv_req_new(L, UV_CONNECT, handle);
+
+        err = uv_tcp_connect(LLUV_R(req, connect), LLUV_H(handle, uv_tcp_t), (struct sockaddr *)&sa, lluv_on_stream_connect_cb);
+        if(err >= 0) return 0;
+        lluv_req_free(L, req);
+      }
+    }
+  }
+
+  lluv_error_create(L, LLUV_ERR_UV, err, NULL);
+  lluv_tcp_connect_done(L, handle);
+  return 0;
+}
+
 static int lluv_tcp_connect(lua_State *L){
   lluv_handle_t  *handle = lluv_check_tcp(L, 1, LLUV_FLAG_OPEN);
-  struct sockaddr_storage sa; lluv_req_t *req;
-  int err = lluv_check_addr(L, 2, &sa);
+  struct sockaddr_storage sa; lluv_req_t *req; int err;
+
+  /* connect(address, cb) */
+  if(lluv_test_address(L, 2)){
+    lua_pushboolean(L, 0);
+    lua_insert(L, 3);
+  }
+
+  err = lluv_check_addr(L, 2, &sa);
+
+  /* connect(host, port, cb) resolves host with loop dns cache */
+  if((err < 0) && (lua_type(L, 2) == LUA_TSTRING) && (lua_gettop(L) == 4) &&
+    (lua_isfunction(L, 4) || lua_isthread(L, 4))
+  ){
+    struct addrinfo hints; int co;
+
+    luaL_checkinteger(L, 3);
+    lluv_check_args_with_cb(L, 4);
+    co = lluv_is_yield_cb(L, 4);
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    lua_pushvalue(L, LLUV_LUA_REGISTRY);
+    lua_pushvalue(L, LLUV_LUA_HANDLES);
+    lua_pushvalue(L, 1);
+    lua_pushvalue(L, 3);
+    lua_pushvalue(L, 4);
+    lua_pushcclosure(L, lluv_tcp_connect_resolved, 5);
+
+    lluv_dns_getaddrinfo(L, lluv_loop_by_handle(&handle->handle), lua_tostring(L, 2), NULL, &hints);
+
+    if(co) return lua_yield(L, 0);
+
+    lua_settop(L, 1);
+    return 1;
+  }
 
   if(err < 0){
     lua_settop(L, 3);
@@ -71,9 +167,18 @@ static int lluv_tcp_bind(lua_State *L){
   };
 
   lluv_handle_t  *handle = lluv_check_tcp(L, 1, LLUV_FLAG_OPEN);
-  struct sockaddr_storage sa; int err = lluv_check_addr(L, 2, &sa);
+  struct sockaddr_storage sa; int err;
   unsigned int flags = 0;
-  int top = lua_gettop(L);
+  int top;
+
+  /* bind(address[, flags][, cb]) is same as bind(host, port[, flags][, cb]) */
+  if(lluv_test_address(L, 2)){
+    lua_pushboolean(L, 0);
+    lua_insert(L, 3);
+  }
+
+  err = lluv_check_addr(L, 2, &sa);
+  top = lua_gettop(L);
   if(top > 5)lua_settop(L, top = 5);
 
   if((top > 4) || (!lua_isfunction(L, 4))){
@@ -81,9 +186,7 @@ static int lluv_tcp_bind(lua_State *L){
   }
 
   if(err < 0){
-    lua_checkstack(L, 3);
-
-    lua_pushvalue(L, 2); lua_pushliteral(L, ":"); lua_pushvalue(L, 3); lua_concat(L, 3);
+    lluv_push_addr_text(L, 2);
 
     if(!lua_isfunction(L, top)){
       return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, lua_tostring(L, -1));
@@ -100,9 +203,7 @@ static int lluv_tcp_bind(lua_State *L){
 
   err = uv_tcp_bind(LLUV_H(handle, uv_tcp_t), (struct sockaddr *)&sa, flags);
   if(err < 0){
-    lua_checkstack(L, 3);
-
-    lua_pushvalue(L, 2); lua_pushliteral(L, ":"); lua_pushvalue(L, 3); lua_concat(L, 3);
+    lluv_push_addr_text(L, 2);
 
     if(!lua_isfunction(L, top)){
       return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, lua_tostring(L, -1));
@@ -193,7 +294,7 @@ static int lluv_tcp_getsockname(lua_State *L){
   if(err < 0){
     return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, NULL);
   }
-  return lluv_push_addr(L, &sa);
+  return lluv_push_handle_addr(L, handle->flags, &sa);
 }
 
 static int lluv_tcp_getpeername(lua_State *L){
@@ -204,7 +305,388 @@ static int lluv_tcp_getpeername(lua_State *L){
   if(err < 0){
     return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, NULL);
   }
-  return lluv_push_addr(L, &sa);
+  return lluv_push_handle_addr(L, handle->flags, &sa);
+}
+
+/*
+** tcp_connect_any - Happy Eyeballs (RFC 8305).
+**
+** Host resolved with loop dns cache. Addresses ordered by family interleaving
+** starting with family of first returned address. New attempt started every
+** `delay` ms or immediately when previous one fails. First connected handle
+** returned to callback and all other attempts closed.
+*/
+
+#define LLUV_CONNECT_ANY_DELAY     250
+#define LLUV_CONNECT_ANY_MIN_DELAY 10
+
+typedef struct lluv_connect_any_tag{
+  lluv_loop_t   *loop;
+  lluv_flags_t   flags;
+  int            ctx;           /* {cb=, timer=, err=, addresses={}, handles={}} */
+  int            port;
+  uint64_t       delay;
+  int            next;          /* index of next address to try */
+  int            count;         /* number of addresses */
+  int            active;        /* connect requests in flight */
+  int            timer_active;
+  int            done;
+}lluv_connect_any_t;
+
+/* push closure with upvalues registry, handles, state[, index] */
+static void lluv_connect_any_pushcb(lua_State *L, int st, lua_CFunction f, int i){
+  lua_pushvalue(L, LLUV_LUA_REGISTRY);
+  lua_pushvalue(L, LLUV_LUA_HANDLES);
+  lua_pushvalue(L, st);
+  if(i){
+    lua_pushinteger(L, i);
+    lua_pushcclosure(L, f, 4);
+  }
+  else lua_pushcclosure(L, f, 3);
+}
+
+/* call method of handle from ctx with args on top of stack */
+static void lluv_connect_any_call(lua_State *L, int ctx, const char *name, const char *method, int nargs){
+  lua_getfield(L, ctx, name);
+  lua_getfield(L, -1, method);
+  lua_insert(L, -2);
+  lua_insert(L, -2 - nargs);
+  lua_insert(L, -2 - nargs);
+  lua_call(L, nargs + 1, 0);
+}
+
+static void lluv_connect_any_close_handle(lua_State *L, int idx){
+  idx = lua_absindex(L, idx);
+  lua_getfield(L, idx, "close");
+  lua_pushvalue(L, idx);
+  lua_call(L, 1, 0);
+}
+
+/* winner - index of connected handle or 0 */
+static void lluv_connect_any_finish(lua_State *L, int st_idx, int winner){
+  lluv_connect_any_t *st = (lluv_connect_any_t *)lua_touserdata(L, st_idx);
+  int top = lua_gettop(L), ctx = top + 1, handles = top + 2;
+
+  st->done = 1;
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, st->ctx);
+  lua_getfield(L, ctx, "handles");
+
+  lluv_connect_any_call(L, ctx, "timer", "close", 0);
+
+  lua_getfield(L, ctx, "cb");
+  if(winner){
+    lua_rawgeti(L, handles, winner);
+    lua_pushnil(L);
+    lua_rawseti(L, handles, winner);
+    lua_pushnil(L);
+  }
+  else{
+    lua_pushnil(L);
+    lua_getfield(L, ctx, "err");
+    if(lua_isnil(L, -1)){
+      lua_pop(L, 1);
+      lluv_error_create(L, LLUV_ERR_UV, UV_EAI_NODATA, NULL);
+    }
+  }
+  lluv_loop_defer_call(L, st->loop, 2);
+
+  /* cancel other attempts */
+  lua_pushnil(L);
+  while(lua_next(L, handles)){
+    lluv_connect_any_close_handle(L, -1);
+    lua_pop(L, 1);
+  }
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, st->ctx);
+  st->ctx = LUA_NOREF;
+
+  lua_settop(L, top);
+}
+
+static int lluv_connect_any_on_connect(lua_State *L);
+
+static int lluv_connect_any_on_timer(lua_State *L);
+
+/* attempt(address, port, cb) => tcp */
+static int lluv_connect_any_attempt(lua_State *L){
+  lluv_connect_any_t *st = (lluv_connect_any_t *)lua_touserdata(L, lua_upvalueindex(3));
+
+  lua_settop(L, 3);
+  lluv_loop_pushself(L, st->loop);
+  lua_insert(L, 1);
+
+  if(FLAG_IS_SET(st->flags, LLUV_FLAG_RAISE_ERROR)) lluv_tcp_create_unsafe(L);
+  else if(lluv_tcp_create_safe(L) == 2) return 2;
+
+  lua_replace(L, 1);
+  return lluv_tcp_connect(L);
+}
+
+/* start next attempt. reset - restart delay timer */
+static void lluv_connect_any_next(lua_State *L, int st_idx, int reset){
+  lluv_connect_any_t *st = (lluv_connect_any_t *)lua_touserdata(L, st_idx);
+  int top = lua_gettop(L), ctx = top + 1;
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, st->ctx);
+
+  while(st->next <= st->count){
+    int i = st->next++;
+
+    lluv_connect_any_pushcb(L, st_idx, lluv_connect_any_attempt, 0);
+    lua_getfield(L, ctx, "addresses");
+    lua_rawgeti(L, -1, i);
+    lua_remove(L, -2);
+    lua_pushinteger(L, st->port);
+    lluv_connect_any_pushcb(L, st_idx, lluv_connect_any_on_connect, i);
+
+    if(lua_pcall(L, 3, 2, 0)){
+      lua_setfield(L, ctx, "err");
+      continue;
+    }
+
+    if(lua_isnil(L, -2)){
+      lua_setfield(L, ctx, "err");
+      lua_pop(L, 1);
+      continue;
+    }
+
+    lua_pop(L, 1);
+    lua_getfield(L, ctx, "handles");
+    lua_insert(L, -2);
+    lua_rawseti(L, -2, i);
+    lua_pop(L, 1);
+    st->active += 1;
+    break;
+  }
+
+  if(st->next > st->count){
+    if(st->timer_active){
+      st->timer_active = 0;
+      lluv_connect_any_call(L, ctx, "timer", "stop", 0);
+    }
+
+    if(st->active == 0){
+      lua_settop(L, top);
+      lluv_connect_any_finish(L, st_idx, 0);
+      return;
+    }
+  }
+  else if(!st->timer_active){
+    st->timer_active = 1;
+    lua_pushnumber(L, (lua_Number)st->delay);
+    lua_pushnumber(L, (lua_Number)st->delay);
+    lluv_connect_any_pushcb(L, st_idx, lluv_connect_any_on_timer, 0);
+    lluv_connect_any_call(L, ctx, "timer", "start", 3);
+  }
+  else if(reset){
+    lluv_connect_any_call(L, ctx, "timer", "again", 0);
+  }
+
+  lua_settop(L, top);
+}
+
+static int lluv_connect_any_on_timer(lua_State *L){
+  lluv_connect_any_t *st = (lluv_connect_any_t *)lua_touserdata(L, lua_upvalueindex(3));
+
+  if(st->done) return 0;
+
+  lua_settop(L, 0);
+  lua_pushvalue(L, lua_upvalueindex(3));
+  lluv_connect_any_next(L, 1, 0);
+  return 0;
+}
+
+static int lluv_connect_any_on_connect(lua_State *L){
+  lluv_connect_any_t *st = (lluv_connect_any_t *)lua_touserdata(L, lua_upvalueindex(3));
+  int i = (int)lua_tointeger(L, lua_upvalueindex(4));
+
+  /* losers closed by finish */
+  if(st->done) return 0;
+
+  lua_settop(L, 2);
+  lua_pushvalue(L, lua_upvalueindex(3));
+  st->active -= 1;
+
+  if(lua_isnil(L, 2)){
+    lluv_connect_any_finish(L, 3, i);
+    return 0;
+  }
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, st->ctx);
+  lua_getfield(L, -1, "handles");
+  lua_pushnil(L);
+  lua_rawseti(L, -2, i);
+  lua_pop(L, 1);
+  lua_pushvalue(L, 2);
+  lua_setfield(L, -2, "err");
+  lua_pop(L, 1);
+
+  lluv_connect_any_close_handle(L, 1);
+
+  /* do not wait delay if attempt failed */
+  lluv_connect_any_next(L, 3, 1);
+  return 0;
+}
+
+static int lluv_connect_any_on_resolved(lua_State *L){
+  lluv_connect_any_t *st = (lluv_connect_any_t *)lua_touserdata(L, lua_upvalueindex(3));
+  int i, n, ctx, addresses, first, family, pass;
+
+  if(st->done) return 0;
+
+  lua_settop(L, 3);
+  lua_pushvalue(L, lua_upvalueindex(3));           /* 4 state */
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, st->ctx);      /* 5 ctx   */
+  ctx = 5;
+
+  if(!lua_isnil(L, 2)){
+    lua_pushvalue(L, 2);
+    lua_setfield(L, ctx, "err");
+    lluv_connect_any_finish(L, 4, 0);
+    return 0;
+  }
+
+  /* interleave address families starting with first one */
+  lua_newtable(L);
+  addresses = lua_gettop(L);
+
+  n = (int)lua_rawlen(L, 3);
+  lua_createtable(L, n, 0); /* first family */
+  lua_createtable(L, n, 0); /* other families */
+  lua_pushnil(L);           /* family of first address */
+  first = addresses + 1; family = addresses + 3;
+
+  for(i = 1; i <= n; ++i){
+    lua_rawgeti(L, 3, i);
+    if(lua_istable(L, -1)){
+      lua_getfield(L, -1, "address");
+      lua_getfield(L, -2, "family");
+    }
+    else{
+      const char *address = lua_tostring(L, -1);
+      lua_pushvalue(L, -1);
+      if(address && strchr(address, ':')) lua_pushliteral(L, "inet6");
+      else lua_pushliteral(L, "inet");
+    }
+
+    if(i == 1){
+      lua_pushvalue(L, -1);
+      lua_replace(L, family);
+    }
+
+    pass = lua_rawequal(L, -1, family) ? first : first + 1;
+    lua_pop(L, 1);
+    lua_rawseti(L, pass, (int)lua_rawlen(L, pass) + 1);
+    lua_pop(L, 1);
+  }
+
+  for(i = 1; ; ++i){
+    int found = 0;
+    for(pass = first; pass <= first + 1; ++pass){
+      lua_rawgeti(L, pass, i);
+      if(lua_isnil(L, -1)) lua_pop(L, 1);
+      else{
+        lua_rawseti(L, addresses, ++st->count);
+        found = 1;
+      }
+    }
+    if(!found) break;
+  }
+
+  lua_pushvalue(L, addresses);
+  lua_setfield(L, ctx, "addresses");
+  lua_settop(L, 4);
+
+  st->next = 1;
+  lluv_connect_any_next(L, 4, 0);
+  return 0;
+}
+
+/* tcp_connect_any([loop,] host | {addresses}, port, [{delay=, family=}], cb(tcp, err)) */
+LLUV_IMPL_SAFE(lluv_tcp_connect_any){
+  static const lluv_uv_const_t families[] = {
+    { AF_UNSPEC,  "unspec" },
+    { AF_INET,    "inet"   },
+    { AF_INET6,   "inet6"  },
+
+    { 0, NULL }
+  };
+
+  lluv_loop_t *loop = lluv_opt_loop(L, 1, LLUV_FLAG_OPEN);
+  int argc = loop ? 1 : 0;
+  if(!loop)loop = lluv_default_loop(L);
+  {
+    const char *host = lua_istable(L, argc + 1) ? NULL : luaL_checkstring(L, argc + 1);
+    int port = luaL_checkint(L, argc + 2);
+    uint64_t delay = LLUV_CONNECT_ANY_DELAY;
+    struct addrinfo hints;
+    lluv_connect_any_t *st;
+    int co, cb, st_idx;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if(lua_istable(L, argc + 3)){
+      int opt = argc + 3;
+
+      lua_getfield(L, opt, "delay");
+      delay = (uint64_t)luaL_optinteger(L, -1, LLUV_CONNECT_ANY_DELAY);
+      if(delay < LLUV_CONNECT_ANY_MIN_DELAY) delay = LLUV_CONNECT_ANY_MIN_DELAY;
+      lua_pop(L, 1);
+
+      lua_getfield(L, opt, "family");
+      hints.ai_family = (int)lluv_opt_named_const(L, -1, AF_UNSPEC, families);
+      lua_pop(L, 1);
+
+      lluv_check_args_with_cb(L, argc + 4);
+    }
+    else lluv_check_args_with_cb(L, argc + 3);
+
+    cb = lua_gettop(L);
+    co = lluv_is_yield_cb(L, cb);
+
+    st = (lluv_connect_any_t *)lua_newuserdata(L, sizeof(lluv_connect_any_t));
+    memset(st, 0, sizeof(lluv_connect_any_t));
+    st->loop  = loop;
+    st->flags = safe_flag | loop->flags;
+    st->port  = port;
+    st->delay = delay;
+    st->ctx   = LUA_NOREF;
+    st_idx    = lua_gettop(L);
+
+    lua_newtable(L);
+    lua_pushvalue(L, cb);
+    lua_setfield(L, -2, "cb");
+    lua_newtable(L);
+    lua_setfield(L, -2, "handles");
+
+    lua_pushvalue(L, LLUV_LUA_REGISTRY);
+    lua_pushvalue(L, LLUV_LUA_HANDLES);
+    lua_pushcclosure(L, lluv_timer_create_unsafe, 2);
+    lluv_loop_pushself(L, loop);
+    lua_call(L, 1, 1);
+    lua_setfield(L, -2, "timer");
+
+    st->ctx = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+    lluv_connect_any_pushcb(L, st_idx, lluv_connect_any_on_resolved, 0);
+    if(host) lluv_dns_getaddrinfo(L, loop, host, NULL, &hints);
+    else{
+      /* already resolved addresses */
+      lluv_loop_pushself(L, loop);
+      lua_pushnil(L);
+      lua_pushvalue(L, argc + 1);
+      lluv_loop_defer_call(L, loop, 3);
+    }
+
+    if(co) return lua_yield(L, 0);
+
+    lua_settop(L, 0);
+    lluv_loop_pushself(L, loop);
+    return 1;
+  }
 }
 
 static const struct luaL_Reg lluv_tcp_methods[] = {
@@ -215,6 +697,7 @@ static const struct luaL_Reg lluv_tcp_methods[] = {
   { "keepalive",            lluv_tcp_keepalive            },
   { "simultaneous_accepts", lluv_tcp_simultaneous_accepts },
   { "getsockname",          lluv_tcp_getsockname          },
+  { "compact_address",      lluv_handle_compact_address   },
   { "getpeername",          lluv_tcp_getpeername          },
 
   {NULL,NULL}
@@ -226,10 +709,11 @@ static const lluv_uv_const_t lluv_tcp_constants[] = {
   { 0, NULL }
 };
 
-#define LLUV_FUNCTIONS(F)         \
-  {"tcp", lluv_tcp_create_##F},   \
+#define LLUV_FUNCTIONS(F)                         \
+  {"tcp",             lluv_tcp_create_##F},       \
+  {"tcp_connect_any", lluv_tcp_connect_any_##F},  \
 
-static const struct luaL_Reg lluv_functions[][2] = {
+static const struct luaL_Reg lluv_functions[][3] = {
   {
     LLUV_FUNCTIONS(unsafe)
 
@@ -22,7 +22,7 @@ LLUV_INTERNAL int lluv_timer_index(lua_State *L){
   return lluv__index(L, LLUV_TIMER, lluv_handle_index);
 }
 
-LLUV_IMPL_SAFE(lluv_timer_create){
+LLUV_IMPL_SAFE_(lluv_timer_create){
   lluv_loop_t   *loop   = lluv_opt_loop_ex(L, 1, LLUV_FLAG_OPEN);
   lluv_handle_t *handle = lluv_handle_create(L, UV_TIMER, safe_flag | INHERITE_FLAGS(loop));
   int err = uv_timer_init(loop->handle, LLUV_H(handle, uv_timer_t));
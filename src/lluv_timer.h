@@ -15,4 +15,8 @@ LLUV_INTERNAL void lluv_timer_initlib(lua_State *L, int nup, int safe);
 
 LLUV_INTERNAL int lluv_timer_index(lua_State *L);
 
+LLUV_INTERNAL int lluv_timer_create_safe(lua_State *L);
+
+LLUV_INTERNAL int lluv_timer_create_unsafe(lua_State *L);
+
 #endif
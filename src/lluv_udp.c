@@ -8,6 +8,11 @@
 * This file is part of lua-lluv library.
 ******************************************************************************/
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+/* sendmmsg */
+#  define _GNU_SOURCE
+#endif
+
 #include "lluv.h"
 #include "lluv_handle.h"
 #include "lluv_udp.h"
@@ -15,8 +20,35 @@
 #include "lluv_error.h"
 #include "lluv_req.h"
 #include "lluv_stream.h"
+#include "lluv_fbuf.h"
+#include "lluv_addr.h"
 #include <assert.h>
 
+#if !defined(LLUV_UDP_USE_SENDMMSG) && defined(__linux__)
+#  define LLUV_UDP_USE_SENDMMSG 1
+#endif
+
+#if LLUV_UDP_USE_SENDMMSG
+#  include <sys/socket.h>
+#  include <netinet/in.h>
+#  include <netinet/udp.h>
+#  include <errno.h>
+#  include <string.h>
+#endif
+
+/* UDP segmentation offload (Linux >= 4.18) */
+#if !defined(LLUV_UDP_USE_GSO) && LLUV_UDP_USE_SENDMMSG && defined(UDP_SEGMENT)
+#  define LLUV_UDP_USE_GSO 1
+#endif
+
+/* UDP receive offload (Linux >= 5.0) */
+#if !defined(LLUV_UDP_USE_GRO) && LLUV_UDP_USE_SENDMMSG && defined(UDP_GRO)
+#  define LLUV_UDP_USE_GRO 1
+#endif
+
+/* kernel does not support UDP_SEGMENT for this socket */
+#define LLUV_FLAG_UDP_NO_GSO LLUV_FLAG_5
+
 #define LLUV_UDP_NAME LLUV_PREFIX" udp"
 static const char *LLUV_UDP = LLUV_UDP_NAME;
 
@@ -24,10 +56,55 @@ LLUV_INTERNAL int lluv_udp_index(lua_State *L){
   return lluv__index(L, LLUV_UDP, lluv_handle_index);
 }
 
+#if LLUV_UV_VER_GE(1,40,0)
+/* recvmmsg could be used only if handle created with this flag */
+#  define LLUV_UDP_USE_MMSG 1
+#else
+#  define LLUV_UDP_USE_MMSG 0
+#endif
+
+#if LLUV_UV_VER_GE(1,27,0)
+#  define LLUV_UDP_USE_CONNECT 1
+#else
+#  define LLUV_UDP_USE_CONNECT 0
+#endif
+
+#if LLUV_UV_VER_GE(1,19,0)
+#  define LLUV_UDP_SEND_QUEUE_COUNT(H) uv_udp_get_send_queue_count(LLUV_H((H), uv_udp_t))
+#else
+#  define LLUV_UDP_SEND_QUEUE_COUNT(H) (LLUV_H((H), uv_udp_t)->send_queue_count)
+#endif
+
+/* libuv reads each datagram into its own 64KB chunk of buffer
+** and uses not more than 20 chunks per recvmmsg call
+*/
+#define LLUV_UDP_DGRAM_MAXSIZE  (64 * 1024)
+#define LLUV_UDP_MMSG_MAXWIDTH  20
+
 LLUV_IMPL_SAFE(lluv_udp_create){
-  lluv_loop_t   *loop   = lluv_opt_loop_ex(L, 1, LLUV_FLAG_OPEN);
-  lluv_handle_t *handle = lluv_handle_create(L, UV_UDP, safe_flag | INHERITE_FLAGS(loop));
-  int err = uv_udp_init(loop->handle, LLUV_H(handle, uv_udp_t));
+  static const lluv_uv_const_t FLAGS[] = {
+#if LLUV_UDP_USE_MMSG
+    { UV_UDP_RECVMMSG,    "recvmmsg"   },
+#endif
+
+    { 0, NULL }
+  };
+
+  lluv_loop_t   *loop   = lluv_opt_loop(L, 1, LLUV_FLAG_OPEN);
+  unsigned int   flags  = lluv_opt_flags_ui(L, loop ? 2 : 1, 0, FLAGS);
+  lluv_handle_t *handle;
+  int err;
+
+  if(!loop) loop = lluv_default_loop(L);
+
+  handle = lluv_handle_create(L, UV_UDP, safe_flag | INHERITE_FLAGS(loop));
+
+#if LLUV_UV_VER_GE(1,7,0)
+  if(flags) err = uv_udp_init_ex(loop->handle, LLUV_H(handle, uv_udp_t), flags);
+  else
+#endif
+  err = uv_udp_init(loop->handle, LLUV_H(handle, uv_udp_t));
+
   if(err < 0){
     lluv_handle_cleanup(L, handle, -1);
     return lluv_fail(L, safe_flag | loop->flags, LLUV_ERR_UV, (uv_errno_t)err, NULL);
@@ -54,6 +131,16 @@ static int lluv_udp_open(lua_State *L){
   return 1;
 }
 
+/* send(address, data) is same as send(host, port, data) (also bind and connect).
+** Port is false so it could be stored in flat arrays without holes.
+*/
+static void lluv_udp_norm_addr(lua_State *L){
+  if(lluv_test_address(L, 2)){
+    lua_pushboolean(L, 0);
+    lua_insert(L, 3);
+  }
+}
+
 static int lluv_udp_bind(lua_State *L){
   static const lluv_uv_const_t FLAGS[] = {
     { UV_UDP_IPV6ONLY ,   "ipv6only"   },
@@ -63,9 +150,14 @@ static int lluv_udp_bind(lua_State *L){
   };
 
   lluv_handle_t  *handle = lluv_check_udp(L, 1, LLUV_FLAG_OPEN);
-  struct sockaddr_storage sa; int err = lluv_check_addr(L, 2, &sa);
+  struct sockaddr_storage sa; int err;
   unsigned int flags = 0;
-  int top = lua_gettop(L);
+  int top;
+
+  lluv_udp_norm_addr(L);
+
+  err = lluv_check_addr(L, 2, &sa);
+  top = lua_gettop(L);
   if(top > 5)lua_settop(L, top = 5);
 
   if((top > 4) || (!lua_isfunction(L, 4))){
@@ -73,9 +165,7 @@ static int lluv_udp_bind(lua_State *L){
   }
 
   if(err < 0){
-    lua_checkstack(L, 3);
-
-    lua_pushvalue(L, 2); lua_pushliteral(L, ":"); lua_pushvalue(L, 3); lua_concat(L, 3);
+    lluv_push_addr_text(L, 2);
 
     if(!lua_isfunction(L, top)){
       return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, lua_tostring(L, -1));
@@ -92,9 +182,7 @@ static int lluv_udp_bind(lua_State *L){
 
   err = uv_udp_bind(LLUV_H(handle, uv_udp_t), (struct sockaddr *)&sa, flags);
   if(err < 0){
-    lua_checkstack(L, 3);
-
-    lua_pushvalue(L, 2); lua_pushliteral(L, ":"); lua_pushvalue(L, 3); lua_concat(L, 3);
+    lluv_push_addr_text(L, 2);
 
     if(!lua_isfunction(L, top)){
       return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, lua_tostring(L, -1));
@@ -122,13 +210,96 @@ static int lluv_udp_bind(lua_State *L){
   return 1;
 }
 
+//{ Connect
+
+#if LLUV_UDP_USE_CONNECT
+
+static int lluv_udp_connect(lua_State *L){
+  lluv_handle_t  *handle = lluv_check_udp(L, 1, LLUV_FLAG_OPEN);
+  struct sockaddr_storage sa; int err;
+
+  if(lua_isnoneornil(L, 2)){ /* disconnect */
+    lluv_check_none(L, 3);
+    err = uv_udp_connect(LLUV_H(handle, uv_udp_t), NULL);
+    if(err < 0){
+      return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, NULL);
+    }
+    lua_settop(L, 1);
+    return 1;
+  }
+
+  lluv_udp_norm_addr(L);
+
+  err = lluv_check_addr(L, 2, &sa);
+  lluv_check_none(L, 4);
+
+  if(err >= 0){
+    err = uv_udp_connect(LLUV_H(handle, uv_udp_t), (struct sockaddr*)&sa);
+  }
+
+  if(err < 0){
+    lua_settop(L, 3);
+    return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, lluv_push_addr_text(L, 2));
+  }
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+static int lluv_udp_getpeername(lua_State *L){
+  lluv_handle_t *handle = lluv_check_udp(L, 1, LLUV_FLAG_OPEN);
+  struct sockaddr_storage sa; int sa_len = sizeof(sa);
+  int err = uv_udp_getpeername(LLUV_H(handle, uv_udp_t), (struct sockaddr*)&sa, &sa_len);
+
+  lua_settop(L, 1);
+  if(err < 0){
+    return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, NULL);
+  }
+  return lluv_push_handle_addr(L, handle->flags, &sa);
+}
+
+#endif
+
+//}
+
 //{ Send
 
+#if LLUV_UDP_USE_CONNECT
+
+static int lluv_udp_try_send_connected(lua_State *L, lluv_handle_t *handle){
+  size_t len; const char *str = lluv_check_bufdata(L, 2, &len);
+  uv_buf_t buf = uv_buf_init((char*)str, len);
+  int err;
+
+  lluv_check_none(L, 3);
+
+  err = uv_udp_try_send(LLUV_H(handle, uv_udp_t), &buf, 1, NULL);
+  if(err < 0){
+    return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, NULL);
+  }
+
+  lua_pushinteger(L, err);
+  return 1;
+}
+
+#endif
+
 static int lluv_udp_try_send(lua_State *L){
   lluv_handle_t *handle = lluv_check_udp(L, 1, LLUV_FLAG_OPEN);
-  struct sockaddr_storage sa; int err = lluv_check_addr(L, 2, &sa);
-  size_t len; const char *str = luaL_checklstring(L, 4, &len);
-  uv_buf_t buf = uv_buf_init((char*)str, len);
+  struct sockaddr_storage sa; int err;
+  size_t len; const char *str;
+  uv_buf_t buf;
+
+  lluv_udp_norm_addr(L);
+
+#if LLUV_UDP_USE_CONNECT
+  /* try_send(data) on connected socket */
+  if(lua_gettop(L) < 4) return lluv_udp_try_send_connected(L, handle);
+#endif
+
+  err = lluv_check_addr(L, 2, &sa);
+  str = lluv_check_bufdata(L, 4, &len);
+  buf = uv_buf_init((char*)str, len);
 
   if(err < 0){
     lua_settop(L, 3);
@@ -136,7 +307,7 @@ static int lluv_udp_try_send(lua_State *L){
     return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, lua_tostring(L, -1));
   }
 
-  lluv_check_none(L, 3);
+  lluv_check_none(L, 5);
 
   err = uv_udp_try_send(LLUV_H(handle, uv_udp_t), &buf, 1, (struct sockaddr*)&sa);
   if(err < 0){
@@ -151,13 +322,47 @@ static void lluv_on_udp_send_cb(uv_udp_send_t* arg, int status){
   lluv_on_stream_req_cb((uv_req_t*)arg, status);
 }
 
+#if LLUV_UDP_USE_CONNECT
+
+static int lluv_udp_send_connected(lua_State *L, lluv_handle_t *handle){
+  size_t len; const char *str = lluv_check_bufdata(L, 2, &len);
+  uv_buf_t buf = uv_buf_init((char*)str, len);
+  lluv_req_t *req; int err;
+
+  if(lua_gettop(L) == 2)
+    lua_settop(L, 3);
+  else
+    lluv_check_args_with_cb(L, 3);
+
+  req = lluv_req_new(L, UV_UDP_SEND, handle);
+
+  lluv_req_ref(L, req); /* string or buffer */
+
+  err = uv_udp_send(LLUV_R(req, udp_send), LLUV_H(handle, uv_udp_t), &buf, 1, NULL, lluv_on_udp_send_cb);
+
+  return lluv_return_req(L, handle, req, err);
+}
+
+#endif
+
 static int lluv_udp_send(lua_State *L){
   lluv_handle_t  *handle = lluv_check_udp(L, 1, LLUV_FLAG_OPEN);
-  struct sockaddr_storage sa; int err = lluv_check_addr(L, 2, &sa);
-  size_t len; const char *str = luaL_checklstring(L, 4, &len);
-  uv_buf_t buf = uv_buf_init((char*)str, len);
+  struct sockaddr_storage sa; int err;
+  size_t len; const char *str;
+  uv_buf_t buf;
   lluv_req_t *req;
 
+  lluv_udp_norm_addr(L);
+
+#if LLUV_UDP_USE_CONNECT
+  /* send(data[, cb]) on connected socket */
+  if(lua_gettop(L) < 4) return lluv_udp_send_connected(L, handle);
+#endif
+
+  err = lluv_check_addr(L, 2, &sa);
+  str = lluv_check_bufdata(L, 4, &len);
+  buf = uv_buf_init((char*)str, len);
+
   if(err < 0){
     int top = lua_gettop(L);
     if(top > 4) lua_settop(L, top = 5);
@@ -185,7 +390,7 @@ static int lluv_udp_send(lua_State *L){
 
   req = lluv_req_new(L, UV_UDP_SEND, handle);
 
-  lluv_req_ref(L, req); /* string */
+  lluv_req_ref(L, req); /* string or buffer */
 
   err = uv_udp_send(LLUV_R(req, udp_send), LLUV_H(handle, uv_udp_t), &buf, 1, (struct sockaddr*)&sa, lluv_on_udp_send_cb);
 
@@ -194,6 +399,466 @@ static int lluv_udp_send(lua_State *L){
 
 //}
 
+//{ Batch send
+
+/* max number of datagrams passed to one sendmmsg call */
+#define LLUV_UDP_SENDMMSG_WIDTH 64
+
+typedef struct lluv_udp_dgram_tag{
+  uv_buf_t                buf;
+  int                     has_addr; /* send to connected peer if 0 */
+  struct sockaddr_storage addr;
+}lluv_udp_dgram_t;
+
+#define LLUV_UDP_DGRAM_ADDR(d) ((d)->has_addr ? (struct sockaddr*)&(d)->addr : NULL)
+
+/* Push host, port and data of i-th datagram.
+** Items could be array of {host, port, data} or {address, data} tables (`flat == 0`)
+** or flat array {host, port, data, host, port, data, ...}.
+** Datagram without address (data only or host is false) sends to connected peer.
+*/
+static void lluv_udp_push_dgram(lua_State *L, int t, lua_Integer i, int flat){
+  if(flat){
+    lua_rawgeti(L, t, 3 * i + 1);
+    lua_rawgeti(L, t, 3 * i + 2);
+    lua_rawgeti(L, t, 3 * i + 3);
+    return;
+  }
+
+  lua_rawgeti(L, t, i + 1);
+  if(!lua_istable(L, -1)){
+    lua_pushboolean(L, 0); lua_insert(L, -2);
+    lua_pushboolean(L, 0); lua_insert(L, -2);
+    return;
+  }
+  lua_rawgeti(L, -1, 1);
+  if(lluv_test_address(L, -1)){ /* {address, data} */
+    lua_pushnil(L);
+    lua_rawgeti(L, -3, 2);
+  }
+  else{
+    lua_rawgeti(L, -2, 2);
+    lua_rawgeti(L, -3, 3);
+  }
+  lua_remove(L, -4);
+}
+
+/* send as many datagrams as possible without blocking */
+static int lluv_udp_send_now(lluv_handle_t *handle, lluv_udp_dgram_t *d, size_t n, size_t *sent){
+  uv_udp_t *udp = LLUV_H(handle, uv_udp_t);
+  int err;
+
+#if LLUV_UDP_USE_SENDMMSG
+  uv_os_fd_t fd;
+
+  /* socket could be created and bound by first send */
+  if((*sent < n) && (uv_fileno((uv_handle_t*)udp, &fd) < 0)){
+    err = uv_udp_try_send(udp, &d[*sent].buf, 1, LLUV_UDP_DGRAM_ADDR(&d[*sent]));
+    if(err < 0) return err;
+    *sent += 1;
+  }
+
+  if((*sent < n) && (uv_fileno((uv_handle_t*)udp, &fd) == 0)){
+    struct mmsghdr msgs[LLUV_UDP_SENDMMSG_WIDTH];
+
+    while(*sent < n){
+      size_t i, k = n - *sent;
+      int ret;
+
+      if(k > LLUV_UDP_SENDMMSG_WIDTH) k = LLUV_UDP_SENDMMSG_WIDTH;
+
+      memset(msgs, 0, sizeof(msgs[0]) * k);
+      for(i = 0; i < k; ++i){
+        lluv_udp_dgram_t *dg = &d[*sent + i];
+        if(dg->has_addr){
+          msgs[i].msg_hdr.msg_name    = &dg->addr;
+          msgs[i].msg_hdr.msg_namelen = (dg->addr.ss_family == AF_INET6) ?
+            sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+        }
+        /* uv_buf_t is compatible with struct iovec */
+        msgs[i].msg_hdr.msg_iov     = (struct iovec*)&dg->buf;
+        msgs[i].msg_hdr.msg_iovlen  = 1;
+      }
+
+      do ret = sendmmsg(fd, msgs, (unsigned int)k, 0);
+      while((ret == -1) && (errno == EINTR));
+
+      if(ret < 0){
+        if((errno == EAGAIN) || (errno == EWOULDBLOCK)) return UV_EAGAIN;
+        return -errno;
+      }
+
+      *sent += (size_t)ret;
+    }
+  }
+#endif
+
+  while(*sent < n){
+    err = uv_udp_try_send(udp, &d[*sent].buf, 1, LLUV_UDP_DGRAM_ADDR(&d[*sent]));
+    if(err < 0) return err;
+    *sent += 1;
+  }
+
+  return 0;
+}
+
+/* Stack: self, items, callback or nil */
+static int lluv_udp_send_batch_impl(lua_State *L, lluv_handle_t *handle, int flat){
+  lluv_udp_dgram_t *d;
+  size_t i, n, sent = 0;
+  int err = 0, co;
+
+  assert(lua_gettop(L) == 3);
+
+  n = lua_rawlen(L, 2);
+  if(flat) n /= 3;
+
+  co = lluv_is_yield_cb(L, 3);
+
+  d = (lluv_udp_dgram_t *)lua_newuserdata(L, sizeof(lluv_udp_dgram_t) * (n ? n : 1));
+
+  for(i = 0; i < n; ++i){
+    size_t len; const char *data;
+
+    lluv_udp_push_dgram(L, 2, i, flat);
+
+    d[i].has_addr = lua_toboolean(L, -3);
+    if(d[i].has_addr){
+      err = lluv_check_addr(L, -3, &d[i].addr);
+    }
+#if !LLUV_UDP_USE_CONNECT
+    else err = UV_EINVAL;
+#endif
+
+    if(err < 0){
+      lua_pop(L, 1);
+      lua_pushliteral(L, ":"); lua_insert(L, -2); lua_concat(L, 3);
+      break;
+    }
+
+    data = lluv_to_bufdata(L, -1, &len);
+    if(!data){
+      lua_pop(L, 3);
+      lua_pushfstring(L, "invalid datagram #%d: string or buffer expected", (int)(i + 1));
+      err = UV_EINVAL;
+      break;
+    }
+
+    d[i].buf = uv_buf_init((char*)data, len);
+    lua_pop(L, 3);
+  }
+
+  if((err >= 0) && (LLUV_UDP_SEND_QUEUE_COUNT(handle) == 0)){
+    err = lluv_udp_send_now(handle, d, n, &sent);
+    if(err == UV_EAGAIN) err = 0;
+  }
+
+  /* queue the rest. Callback called when last datagram sent */
+  for(i = sent; (err >= 0) && (i < n); ++i){
+    lluv_req_t *req;
+
+    if(i == (n - 1)) lua_pushvalue(L, 3); else lua_pushnil(L);
+    req = lluv_req_new(L, UV_UDP_SEND, handle);
+
+    lluv_udp_push_dgram(L, 2, i, flat);
+    lua_replace(L, -3); lua_pop(L, 1);
+    lluv_req_ref(L, req); /* string or buffer */
+
+    err = uv_udp_send(LLUV_R(req, udp_send), LLUV_H(handle, uv_udp_t),
+      &d[i].buf, 1, LLUV_UDP_DGRAM_ADDR(&d[i]), lluv_on_udp_send_cb
+    );
+
+    if(err < 0){
+      lluv_req_free(L, req);
+      break;
+    }
+
+    if(i == (n - 1)){
+      if(co) return lua_yield(L, 0);
+      lua_settop(L, 1);
+      return 1;
+    }
+  }
+
+  if(err < 0){
+    const char *msg = lua_isstring(L, -1) ? lua_tostring(L, -1) : NULL;
+
+    if(lua_isnil(L, 3)){
+      return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, msg);
+    }
+
+    lua_pushvalue(L, 3);
+    lua_pushvalue(L, 1);
+    lluv_error_create(L, LLUV_ERR_UV, err, msg);
+    lluv_loop_defer_call(L, lluv_loop_by_handle(&handle->handle), 2);
+  }
+  else if(!lua_isnil(L, 3)){
+    lua_pushvalue(L, 3);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    lluv_loop_defer_call(L, lluv_loop_by_handle(&handle->handle), 2);
+  }
+
+  if(co) return lua_yield(L, 0);
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+static int lluv_udp_send_batch(lua_State *L){
+  lluv_handle_t *handle = lluv_check_udp(L, 1, LLUV_FLAG_OPEN);
+  luaL_checktype(L, 2, LUA_TTABLE);
+
+  if(lua_gettop(L) == 2)
+    lua_settop(L, 3);
+  else
+    lluv_check_args_with_cb(L, 3);
+
+  return lluv_udp_send_batch_impl(L, handle, 0);
+}
+
+static int lluv_udp_flush_send_impl(lua_State *L, lluv_handle_t *handle){
+  lua_settop(L, 2);
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, LLUV_SEND_QUEUE(handle));
+  luaL_unref(L, LLUV_LUA_REGISTRY, LLUV_SEND_QUEUE(handle));
+  LLUV_SEND_QUEUE(handle) = LUA_NOREF;
+
+  if(lua_isnil(L, -1)){
+    lua_pop(L, 1);
+    lua_newtable(L);
+  }
+  lua_insert(L, 2);
+
+  return lluv_udp_send_batch_impl(L, handle, 1);
+}
+
+static int lluv_udp_flush_send_deferred(lua_State *L){
+  lluv_handle_t *handle = lluv_check_handle(L, 1, 0);
+
+  /* handle closed or queue already flushed */
+  if(!IS_(handle, OPEN) || (LLUV_SEND_QUEUE(handle) == LUA_NOREF)) return 0;
+
+  lua_settop(L, 1);
+  if(lluv_udp_flush_send_impl(L, handle) == 2){
+    /* nil, err. There no caller to return error so raise it from loop */
+    return lua_error(L);
+  }
+  return 0;
+}
+
+static int lluv_udp_flush_send(lua_State *L){
+  lluv_handle_t *handle = lluv_check_udp(L, 1, LLUV_FLAG_OPEN);
+
+  if(lua_gettop(L) > 1) lluv_check_args_with_cb(L, 2);
+
+  return lluv_udp_flush_send_impl(L, handle);
+}
+
+static int lluv_udp_queue_send(lua_State *L){
+  lluv_handle_t *handle = lluv_check_udp(L, 1, LLUV_FLAG_OPEN);
+  lua_Integer i; size_t len;
+
+  lluv_udp_norm_addr(L);
+
+  if(lua_gettop(L) == 2){ /* connected socket */
+    lua_pushboolean(L, 0); lua_insert(L, 2);
+    lua_pushboolean(L, 0); lua_insert(L, 2);
+  }
+  else if(!lluv_test_address(L, 2)){
+    luaL_checkstring(L, 2);
+    luaL_checknumber(L, 3);
+  }
+
+  lluv_check_bufdata(L, 4, &len);
+  lluv_check_none(L, 5);
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, LLUV_SEND_QUEUE(handle));
+  if(lua_isnil(L, -1)){
+    lua_pop(L, 1);
+    lua_newtable(L);
+    lua_pushvalue(L, -1);
+    LLUV_SEND_QUEUE(handle) = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+    /* flush queue when current callback done */
+    lua_pushvalue(L, LLUV_LUA_REGISTRY);
+    lua_pushvalue(L, LLUV_LUA_HANDLES);
+    lua_pushcclosure(L, lluv_udp_flush_send_deferred, 2);
+    lua_pushvalue(L, 1);
+    lluv_loop_defer_call(L, lluv_loop_by_handle(&handle->handle), 1);
+  }
+
+  i = lua_rawlen(L, -1);
+  lua_pushvalue(L, 2); lua_rawseti(L, -2, i + 1);
+  lua_pushvalue(L, 3); lua_rawseti(L, -2, i + 2);
+  lua_pushvalue(L, 4); lua_rawseti(L, -2, i + 3);
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+//}
+
+//{ Segmentation offload
+
+/* kernel limit for number of segments in one send call */
+#define LLUV_UDP_GSO_MAX_SEGMENTS 64
+#define LLUV_UDP_GSO_MAX_SIZE     65000
+
+#if LLUV_UDP_USE_GSO
+
+static int lluv_udp_gso_unsupported(int err){
+  return (err == EINVAL) || (err == ENOPROTOOPT) || (err == EOPNOTSUPP) || (err == EIO);
+}
+
+/* Send as many segments as possible with UDP_SEGMENT.
+** Returns number of bytes sent or negative error.
+** Marks handle if kernel or device can not do segmentation.
+*/
+static ssize_t lluv_udp_gso_send(lluv_handle_t *handle, const struct sockaddr *sa,
+  const char *data, size_t len, size_t seg_size)
+{
+  size_t off = 0, chunk = LLUV_UDP_GSO_MAX_SIZE / seg_size;
+  uv_os_fd_t fd;
+
+  if(chunk > LLUV_UDP_GSO_MAX_SEGMENTS) chunk = LLUV_UDP_GSO_MAX_SEGMENTS;
+  chunk *= seg_size;
+
+  /* socket could be created and bound by first send */
+  if(uv_fileno((uv_handle_t*)LLUV_H(handle, uv_udp_t), &fd) < 0){
+    uv_buf_t buf = uv_buf_init((char*)data, seg_size);
+    int err = uv_udp_try_send(LLUV_H(handle, uv_udp_t), &buf, 1, sa);
+    if(err < 0) return (err == UV_EAGAIN) ? 0 : err;
+    off = seg_size;
+    if(uv_fileno((uv_handle_t*)LLUV_H(handle, uv_udp_t), &fd) < 0) return (ssize_t)off;
+  }
+
+  while(off < len){
+    char control[CMSG_SPACE(sizeof(uint16_t))];
+    struct msghdr msg; struct cmsghdr *cm; struct iovec iov;
+    uint16_t gso = (uint16_t)seg_size;
+    ssize_t ret;
+
+    iov.iov_base = (char*)data + off;
+    iov.iov_len  = (len - off > chunk) ? chunk : (len - off);
+
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    if(sa){
+      msg.msg_name    = (void*)sa;
+      msg.msg_namelen = (sa->sa_family == AF_INET6) ?
+        sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+    }
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = IPPROTO_UDP;
+    cm->cmsg_type  = UDP_SEGMENT;
+    cm->cmsg_len   = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(cm), &gso, sizeof(gso));
+
+    do ret = sendmsg(fd, &msg, 0);
+    while((ret == -1) && (errno == EINTR));
+
+    if(ret < 0){
+      if((errno == EAGAIN) || (errno == EWOULDBLOCK)) break;
+      if(lluv_udp_gso_unsupported(errno)){
+        SET_(handle, UDP_NO_GSO);
+        break;
+      }
+      return -errno;
+    }
+
+    off += iov.iov_len;
+  }
+
+  return (ssize_t)off;
+}
+
+#endif
+
+/* send_segments(host, port, data, segment_size[, cb])
+** send_segments(data, segment_size[, cb]) -- connected socket
+**
+** Splits data into datagrams of segment_size bytes (last one could be shorter).
+** Uses one UDP_SEGMENT send call per up to 64 segments if supported
+** and sendmmsg/queued sends (see `send_batch`) otherwise.
+*/
+static int lluv_udp_send_segments(lua_State *L){
+  lluv_handle_t *handle = lluv_check_udp(L, 1, LLUV_FLAG_OPEN);
+  struct sockaddr_storage sa; int err = 0, has_addr;
+  size_t len, seg_size, off = 0;
+  lua_Integer i = 0;
+  const char *data;
+  lua_Number n;
+
+  lluv_udp_norm_addr(L);
+
+  has_addr = (lua_type(L, 5) == LUA_TNUMBER);
+  if(!has_addr){ /* connected socket */
+    lua_pushboolean(L, 0); lua_insert(L, 2);
+    lua_pushboolean(L, 0); lua_insert(L, 2);
+  }
+  else if(!lluv_test_address(L, 2)){
+    luaL_checkstring(L, 2);
+  }
+
+  data = lluv_check_bufdata(L, 4, &len);
+  n    = luaL_checknumber(L, 5);
+  luaL_argcheck(L, (n >= 1) && (n <= LLUV_UDP_DGRAM_MAXSIZE), has_addr ? 4 : 2, "invalid segment size");
+  seg_size = (size_t)n;
+
+  if(lua_gettop(L) == 5)
+    lua_settop(L, 6);
+  else
+    lluv_check_args_with_cb(L, 6);
+
+  /* invalid address reported by `send_batch` */
+  if(has_addr) err = lluv_check_addr(L, 2, &sa);
+
+#if LLUV_UDP_USE_GSO
+  if((err >= 0) && (len > seg_size) && !IS_(handle, UDP_NO_GSO) &&
+     (LLUV_UDP_SEND_QUEUE_COUNT(handle) == 0)
+  ){
+    ssize_t ret = lluv_udp_gso_send(handle, has_addr ? (struct sockaddr*)&sa : NULL, data, len, seg_size);
+    if(ret < 0){
+      lua_settop(L, 6);
+      if(lua_isnil(L, 6)){
+        return lluv_fail(L, handle->flags, LLUV_ERR_UV, (int)ret, NULL);
+      }
+      lua_pushvalue(L, 1);
+      lluv_error_create(L, LLUV_ERR_UV, (int)ret, NULL);
+      lluv_loop_defer_call(L, lluv_loop_by_handle(&handle->handle), 2);
+      lua_settop(L, 1);
+      return 1;
+    }
+    off = (size_t)ret;
+  }
+#endif
+
+  /* rest of data goes as regular datagrams */
+  lua_createtable(L, 3 * (int)((len - off + seg_size - 1) / seg_size), 0);
+  while((off < len) || ((len == 0) && (i == 0))){
+    size_t k = (len - off > seg_size) ? seg_size : (len - off);
+    lua_pushvalue(L, 2);                  lua_rawseti(L, -2, ++i);
+    lua_pushvalue(L, 3);                  lua_rawseti(L, -2, ++i);
+    lua_pushlstring(L, data + off, k);    lua_rawseti(L, -2, ++i);
+    off += k;
+  }
+
+  /* self, items, cb */
+  lua_replace(L, 2);
+  lua_replace(L, 3);
+  lua_settop(L, 3);
+
+  return lluv_udp_send_batch_impl(L, handle, 1);
+}
+
+//}
+
 //{ Recv
 
 static void lluv_on_udp_recv_cb(uv_udp_t *arg, ssize_t nread, const uv_buf_t* buf, const struct sockaddr* addr, unsigned flags){
@@ -221,6 +886,10 @@ static void lluv_on_udp_recv_cb(uv_udp_t *arg, ssize_t nread, const uv_buf_t* bu
     assert(addr);
     lua_pushnil(L);
     lua_pushlstring(L, buf->base, nread);
+#if LLUV_UDP_USE_MMSG
+    /* buffer released by last call with UV_UDP_MMSG_FREE */
+    if(!(flags & UV_UDP_MMSG_CHUNK))
+#endif
     lluv_free_buffer((uv_handle_t*)arg, buf);
   }
   else{
@@ -242,18 +911,407 @@ static void lluv_on_udp_recv_cb(uv_udp_t *arg, ssize_t nread, const uv_buf_t* bu
   }
   lua_pushinteger(L, flags);
 
-  LLUV_HANDLE_CALL_CB(L, handle, 4 + lluv_push_addr(L, (const struct sockaddr_storage*)addr));
+  LLUV_HANDLE_CALL_CB(L, handle, 4 + (addr ? lluv_push_handle_addr(L, handle->flags, (const struct sockaddr_storage*)addr) : 0));
 
   LLUV_CHECK_LOOP_CB_INVARIANT(L);
 }
 
+/* Batch mode collects datagrams received by one recvmmsg call
+** and pass them to Lua as flat array {data, host, port, data, host, port, ...}
+*/
+typedef struct lluv_udp_batch_tag{
+  size_t size;      /* max number of datagrams    */
+  size_t count;     /* number of pending datagrams */
+  int    items;     /* reference to pending array  */
+  int    gro;       /* socket receives coalesced datagrams */
+  size_t buffer_size;
+  char   buffer[1];
+}lluv_udp_batch_t;
+
+static lluv_udp_batch_t *lluv_udp_get_batch(lua_State *L, lluv_handle_t *handle){
+  lluv_udp_batch_t *batch;
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, LLUV_READ_BUF(handle));
+  /* read buffer could be also user's fixed buffer */
+  batch = lluv_test_fbuf(L, -1) ? NULL : (lluv_udp_batch_t *)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  return batch;
+}
+
+static void lluv_udp_batch_alloc_cb(uv_handle_t* arg, size_t suggested_size, uv_buf_t *buf){
+  lluv_handle_t    *handle = lluv_handle_byptr(arg);
+  lua_State        *L      = LLUV_HCALLBACK_L(handle);
+  lluv_udp_batch_t *batch  = lluv_udp_get_batch(L, handle);
+
+  if(batch && batch->gro){
+    /* read datagrams by itself in recv callback with UV_ENOBUFS */
+    *buf = uv_buf_init(NULL, 0);
+    return;
+  }
+
+  if(batch && batch->buffer_size){
+    *buf = uv_buf_init(batch->buffer, batch->buffer_size);
+    return;
+  }
+
+  lluv_alloc_buffer_cb(arg, suggested_size, buf);
+}
+
+static void lluv_udp_batch_free(uv_handle_t* arg, lluv_udp_batch_t *batch, const uv_buf_t* buf){
+  if(batch && (buf->base == batch->buffer)) return;
+  lluv_free_buffer(arg, buf);
+}
+
+static void lluv_udp_batch_push(lua_State *L, lluv_handle_t *handle, lluv_udp_batch_t *batch, const char *data, size_t len, const struct sockaddr* addr){
+  int top = lua_gettop(L);
+  lua_Integer i;
+
+  if(batch->items == LUA_NOREF){
+    lua_createtable(L, 3 * (int)batch->size, 0);
+    batch->items = luaL_ref(L, LLUV_LUA_REGISTRY);
+    batch->count = 0;
+  }
+
+  i = 3 * (lua_Integer)batch->count;
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, batch->items);
+  lua_pushlstring(L, data, len);
+  lua_rawseti(L, -2, ++i);
+  /* host, port or address, false */
+  if(lluv_push_handle_addr(L, handle->flags, (const struct sockaddr_storage*)addr) == 1)
+    lua_pushboolean(L, 0);
+  lua_settop(L, top + 3);
+  lua_rawseti(L, top + 1, i + 2);
+  lua_rawseti(L, top + 1, i + 1);
+  lua_settop(L, top);
+
+  batch->count++;
+}
+
+static void lluv_udp_batch_flush(lua_State *L, lluv_handle_t *handle, lluv_udp_batch_t *batch){
+  if((batch->items == LUA_NOREF) || (LLUV_READ_CB(handle) == LUA_NOREF)) return;
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+  lluv_handle_pushself(L, handle);
+  lua_pushnil(L);
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, batch->items);
+  lutil_pushint64(L, batch->count);
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, batch->items);
+  batch->items = LUA_NOREF;
+  batch->count = 0;
+
+  LLUV_HANDLE_CALL_CB(L, handle, 4);
+}
+
+#if LLUV_UDP_USE_GRO
+
+/* Read up to `batch->size` coalesced datagrams and split them to segments.
+** libuv does not pass control messages so socket read directly.
+*/
+static int lluv_udp_gro_recv(lua_State *L, lluv_handle_t *handle, lluv_udp_batch_t *batch){
+  size_t i;
+  uv_os_fd_t fd;
+
+  if(uv_fileno((uv_handle_t*)LLUV_H(handle, uv_udp_t), &fd) < 0) return 0;
+
+  for(i = 0; i < batch->size; ++i){
+    char control[CMSG_SPACE(sizeof(int))];
+    struct sockaddr_storage sa;
+    struct msghdr msg; struct cmsghdr *cm; struct iovec iov;
+    size_t off, seg_size = 0;
+    ssize_t ret;
+
+    iov.iov_base = batch->buffer;
+    iov.iov_len  = batch->buffer_size;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name       = &sa;
+    msg.msg_namelen    = sizeof(sa);
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    do ret = recvmsg(fd, &msg, 0);
+    while((ret == -1) && (errno == EINTR));
+
+    if(ret < 0){
+      if((errno == EAGAIN) || (errno == EWOULDBLOCK)) break;
+      return -errno;
+    }
+
+    for(cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)){
+      if((cm->cmsg_level == IPPROTO_UDP) && (cm->cmsg_type == UDP_GRO)){
+        int v; memcpy(&v, CMSG_DATA(cm), sizeof(v));
+        if(v > 0) seg_size = (size_t)v;
+      }
+    }
+
+    if(seg_size == 0) seg_size = (size_t)ret;
+
+    off = 0;
+    do{
+      size_t n = ((size_t)ret - off > seg_size) ? seg_size : ((size_t)ret - off);
+      lluv_udp_batch_push(L, handle, batch, batch->buffer + off, n, (struct sockaddr*)&sa);
+      off += n;
+    }while(off < (size_t)ret);
+  }
+
+  return 0;
+}
+
+static int lluv_udp_gro_enable(lluv_handle_t *handle){
+  uv_os_fd_t fd; int on = 1;
+
+  if(uv_fileno((uv_handle_t*)LLUV_H(handle, uv_udp_t), &fd) < 0) return 0;
+
+  return setsockopt(fd, IPPROTO_UDP, UDP_GRO, &on, sizeof(on)) == 0;
+}
+
+static void lluv_udp_gro_disable(lluv_handle_t *handle){
+  uv_os_fd_t fd; int off = 0;
+
+  if(uv_fileno((uv_handle_t*)LLUV_H(handle, uv_udp_t), &fd) < 0) return;
+
+  setsockopt(fd, IPPROTO_UDP, UDP_GRO, &off, sizeof(off));
+}
+
+#endif
+
+static void lluv_on_udp_recv_batch_cb(uv_udp_t *arg, ssize_t nread, const uv_buf_t* buf, const struct sockaddr* addr, unsigned flags){
+  lluv_handle_t    *handle = lluv_handle_byptr((uv_handle_t*)arg);
+  lua_State        *L      = LLUV_HCALLBACK_L(handle);
+  lluv_udp_batch_t *batch  = lluv_udp_get_batch(L, handle);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+  if(!batch || !IS_(handle, OPEN)){
+    lluv_udp_batch_free((uv_handle_t*)arg, batch, buf);
+    return;
+  }
+
+#if LLUV_UDP_USE_GRO
+  if(batch->gro && (nread == UV_ENOBUFS)){
+    nread = lluv_udp_gro_recv(L, handle, batch);
+    addr  = NULL;
+  }
+#endif
+
+  if(nread >= 0 && addr){
+    lluv_udp_batch_push(L, handle, batch, buf->base, nread, addr);
+
+#if LLUV_UDP_USE_MMSG
+    /* wait until UV_UDP_MMSG_FREE */
+    if(flags & UV_UDP_MMSG_CHUNK) return;
+#endif
+
+    /* no recvmmsg so deliver each datagram */
+    lluv_udp_batch_free((uv_handle_t*)arg, batch, buf);
+    lluv_udp_batch_flush(L, handle, batch);
+
+    LLUV_CHECK_LOOP_CB_INVARIANT(L);
+    return;
+  }
+
+  lluv_udp_batch_free((uv_handle_t*)arg, batch, buf);
+
+  /* all datagrams for this call are received */
+  lluv_udp_batch_flush(L, handle, batch);
+
+  if((nread < 0) && (LLUV_READ_CB(handle) != LUA_NOREF)){
+    uv_udp_recv_stop(arg);
+
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+    luaL_unref(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+    LLUV_READ_CB(handle) = LUA_NOREF;
+
+    lluv_handle_pushself(L, handle);
+    lluv_error_create(L, LLUV_ERR_UV, (uv_errno_t)nread, NULL);
+    lua_pushnil(L);
+    lua_pushinteger(L, 0);
+
+    lluv_handle_unlock(L, handle, LLUV_LOCK_READ);
+
+    LLUV_HANDLE_CALL_CB(L, handle, 4);
+  }
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+}
+
+/* drop batch state. Coalesced datagrams can not be passed to regular recv callback */
+static void lluv_udp_release_batch(lua_State *L, lluv_handle_t *handle){
+#if LLUV_UDP_USE_GRO
+  lluv_udp_batch_t *batch = lluv_udp_get_batch(L, handle);
+  if(batch && batch->gro){
+    lluv_udp_gro_disable(handle);
+    batch->gro = 0;
+  }
+#endif
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, LLUV_READ_BUF(handle));
+  LLUV_READ_BUF(handle) = LUA_NOREF;
+}
+
+static int lluv_udp_start_recv_batch(lua_State *L, lluv_handle_t *handle){
+  lluv_udp_batch_t *batch;
+  size_t size, buffer_size = 0;
+  int err, gro;
+
+  lua_getfield(L, 2, "batch");
+  size = (size_t)luaL_optinteger(L, -1, LLUV_UDP_MMSG_MAXWIDTH);
+  luaL_argcheck(L, size > 0, 2, "batch size should be positive number");
+  lua_pop(L, 1);
+
+  lua_getfield(L, 2, "gro");
+  gro = lua_toboolean(L, -1);
+  lua_pop(L, 1);
+
+#if LLUV_UDP_USE_MMSG
+  if(uv_udp_using_recvmmsg(LLUV_H(handle, uv_udp_t))){
+    buffer_size = (size > LLUV_UDP_MMSG_MAXWIDTH) ? LLUV_UDP_MMSG_MAXWIDTH : size;
+    buffer_size *= LLUV_UDP_DGRAM_MAXSIZE;
+  }
+#endif
+
+  /* coalesced datagram could be up to 64KB */
+  if(gro && (buffer_size < LLUV_UDP_DGRAM_MAXSIZE)) buffer_size = LLUV_UDP_DGRAM_MAXSIZE;
+
+  lluv_udp_release_batch(L, handle);
+
+  batch = (lluv_udp_batch_t *)lua_newuserdata(L, sizeof(lluv_udp_batch_t) + buffer_size);
+  batch->size        = size;
+  batch->count       = 0;
+  batch->items       = LUA_NOREF;
+  batch->gro         = 0;
+  batch->buffer_size = buffer_size;
+
+  LLUV_READ_BUF(handle) = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+  err = uv_udp_recv_start(LLUV_H(handle, uv_udp_t), lluv_udp_batch_alloc_cb, lluv_on_udp_recv_batch_cb);
+
+  if(err >= 0){
+    lluv_handle_lock(L, handle, LLUV_LOCK_READ);
+
+#if LLUV_UDP_USE_GRO
+    /* socket exists only after recv_start. Without GRO works as regular batch */
+    if(gro) batch->gro = lluv_udp_gro_enable(handle);
+#endif
+  }
+
+  return lluv_return(L, handle, LLUV_READ_CB(handle), err);
+}
+
+/* Read datagrams directly into user's fixed buffer.
+** Callback gets offset and size of datagram in the buffer.
+** Data valid only until callback returns.
+*/
+static void lluv_udp_fbuf_alloc_cb(uv_handle_t* arg, size_t suggested_size, uv_buf_t *buf){
+  lluv_handle_t *handle = lluv_handle_byptr(arg);
+  lua_State *L = LLUV_HCALLBACK_L(handle);
+  lluv_fixed_buffer_t *fb;
+
+  UNUSED_ARG(suggested_size);
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, LLUV_READ_BUF(handle));
+  fb = lluv_test_fbuf(L, -1);
+  lua_pop(L, 1);
+
+  /* freed buffer produce UV_ENOBUFS */
+  if(fb && fb->data) *buf = uv_buf_init(fb->data, fb->capacity);
+  else *buf = uv_buf_init(NULL, 0);
+}
+
+static void lluv_on_udp_recv_fbuf_cb(uv_udp_t *arg, ssize_t nread, const uv_buf_t* buf, const struct sockaddr* addr, unsigned flags){
+  lluv_handle_t *handle = lluv_handle_byptr((uv_handle_t*)arg);
+  lua_State *L = LLUV_HCALLBACK_L(handle);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+  /* nothing to read or end of recvmmsg call */
+  if(((nread == 0) && (addr == NULL)) || !IS_(handle, OPEN)) return;
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+  assert(!lua_isnil(L, -1));
+
+  lluv_handle_pushself(L, handle);
+
+  if(nread >= 0){
+    lluv_fixed_buffer_t *fb;
+
+    lua_pushnil(L);
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, LLUV_READ_BUF(handle));
+    fb = lluv_test_fbuf(L, -1);
+    assert(fb && fb->data);
+    lutil_pushint64(L, buf->base - fb->data);
+    lutil_pushint64(L, nread);
+  }
+  else{
+    uv_udp_recv_stop(arg);
+
+    luaL_unref(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+    LLUV_READ_CB(handle) = LUA_NOREF;
+
+    lluv_error_create(L, LLUV_ERR_UV, (uv_errno_t)nread, NULL);
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, LLUV_READ_BUF(handle));
+    lua_pushinteger(L, 0);
+    lua_pushinteger(L, 0);
+
+    luaL_unref(L, LLUV_LUA_REGISTRY, LLUV_READ_BUF(handle));
+    LLUV_READ_BUF(handle) = LUA_NOREF;
+
+    lluv_handle_unlock(L, handle, LLUV_LOCK_READ);
+  }
+  lua_pushinteger(L, flags);
+
+  LLUV_HANDLE_CALL_CB(L, handle, 6 + (addr ? lluv_push_handle_addr(L, handle->flags, (const struct sockaddr_storage*)addr) : 0));
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+}
+
+static int lluv_udp_start_recv_fbuf(lua_State *L, lluv_handle_t *handle, lluv_fixed_buffer_t *fb){
+  int err;
+
+  luaL_argcheck(L, fb->data != NULL, 2, LLUV_PREFIX" buffer closed");
+
+#if LLUV_UDP_USE_MMSG
+  /* recvmmsg splits buffer to 64KB chunks */
+  luaL_argcheck(L, !uv_udp_using_recvmmsg(LLUV_H(handle, uv_udp_t)) || (fb->capacity >= LLUV_UDP_DGRAM_MAXSIZE),
+    2, "buffer should be at least 64KB for recvmmsg handle"
+  );
+#endif
+
+  lluv_udp_release_batch(L, handle);
+
+  lua_pushvalue(L, 2);
+  LLUV_READ_BUF(handle) = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+  err = uv_udp_recv_start(LLUV_H(handle, uv_udp_t), lluv_udp_fbuf_alloc_cb, lluv_on_udp_recv_fbuf_cb);
+
+  if(err >= 0) lluv_handle_lock(L, handle, LLUV_LOCK_READ);
+
+  return lluv_return(L, handle, LLUV_READ_CB(handle), err);
+}
+
 static int lluv_udp_start_recv(lua_State *L){
   lluv_handle_t *handle = lluv_check_udp(L, 1, LLUV_FLAG_OPEN);
   int err;
 
+  if(lua_istable(L, 2)){
+    lluv_check_args_with_cb(L, 3);
+    LLUV_READ_CB(handle) = luaL_ref(L, LLUV_LUA_REGISTRY);
+    return lluv_udp_start_recv_batch(L, handle);
+  }
+
+  if(lluv_test_fbuf(L, 2)){
+    lluv_check_args_with_cb(L, 3);
+    LLUV_READ_CB(handle) = luaL_ref(L, LLUV_LUA_REGISTRY);
+    return lluv_udp_start_recv_fbuf(L, handle, lluv_test_fbuf(L, 2));
+  }
+
   lluv_check_args_with_cb(L, 2);
   LLUV_READ_CB(handle) = luaL_ref(L, LLUV_LUA_REGISTRY);
 
+  lluv_udp_release_batch(L, handle);
+
   err = uv_udp_recv_start(LLUV_H(handle, uv_udp_t), lluv_alloc_buffer_cb, lluv_on_udp_recv_cb);
 
   if(err >= 0) lluv_handle_lock(L, handle, LLUV_LOCK_READ);
@@ -278,6 +1336,8 @@ static int lluv_udp_stop_recv(lua_State *L){
     lluv_handle_unlock(L, handle, LLUV_LOCK_READ);
   }
 
+  lluv_udp_release_batch(L, handle);
+
   lua_settop(L, 1);
   return 1;
 }
@@ -293,7 +1353,7 @@ static int lluv_udp_getsockname(lua_State *L){
   if(err < 0){
     return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, NULL);
   }
-  return lluv_push_addr(L, &sa);
+  return lluv_push_handle_addr(L, handle->flags, &sa);
 }
 
 static int lluv_udp_set_membership(lua_State *L){
@@ -388,7 +1448,16 @@ static const struct luaL_Reg lluv_udp_methods[] = {
   { "bind",                     lluv_udp_bind                    },
   { "try_send",                 lluv_udp_try_send                },
   { "send",                     lluv_udp_send                    },
+  { "send_batch",               lluv_udp_send_batch              },
+  { "queue_send",               lluv_udp_queue_send              },
+  { "flush_send",               lluv_udp_flush_send              },
+  { "send_segments",            lluv_udp_send_segments           },
   { "getsockname",              lluv_udp_getsockname             },
+  { "compact_address",          lluv_handle_compact_address      },
+#if LLUV_UDP_USE_CONNECT
+  { "connect",                  lluv_udp_connect                 },
+  { "getpeername",              lluv_udp_getpeername             },
+#endif
   { "start_recv",               lluv_udp_start_recv              },
   { "stop_recv",                lluv_udp_stop_recv               },
   { "set_membership",           lluv_udp_set_membership          },
@@ -407,6 +1476,9 @@ static const lluv_uv_const_t lluv_udp_constants[] = {
   { UV_UDP_REUSEADDR,  "UDP_REUSEADDR"  },
   { UV_LEAVE_GROUP ,   "LEAVE_GROUP "   },
   { UV_JOIN_GROUP,     "JOIN_GROUP"     },
+#if LLUV_UDP_USE_MMSG
+  { UV_UDP_RECVMMSG,   "UDP_RECVMMSG"   },
+#endif
 
   { 0, NULL }
 };
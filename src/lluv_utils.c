@@ -14,6 +14,7 @@
 #include "lluv_handle.h"
 #include "lluv_loop.h"
 #include "lluv_req.h"
+#include "lluv_addr.h"
 #include <memory.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -54,9 +55,57 @@ LLUV_INTERNAL void lluv_free(lua_State* L, void *ptr){
   free(ptr);
 }
 
+LLUV_INTERNAL int lluv_lua_resume(lua_State* L, int narg){
+  lua_State *co = lua_tothread(L, -narg-1);
+  int ret;
+
+  assert(co);
+
+  if(lua_status(co) != LUA_YIELD){
+    lua_pop(L, narg + 1);
+    lua_pushliteral(L, "cannot resume non-suspended coroutine");
+    return LUA_ERRRUN;
+  }
+
+  if(!lua_checkstack(co, narg)){
+    lua_pop(L, narg + 1);
+    lua_pushliteral(L, "too many arguments to resume");
+    return LUA_ERRRUN;
+  }
+
+  lua_xmove(L, co, narg);
+  lua_pop(L, 1);
+
+  ret = lutil_resume(co, L, narg);
+  if((ret == 0) || (ret == LUA_YIELD)){
+    /* we do not use values returned/yielded by coroutine */
+    lua_settop(co, 0);
+    return 0;
+  }
+
+  lua_xmove(co, L, 1);
+  return ret;
+}
+
 LLUV_INTERNAL int lluv_lua_call(lua_State* L, int narg, int nret){
   int error_handler = lua_isnil(L, LLUV_ERROR_HANDLER_INDEX) ? 0 : LLUV_ERROR_HANDLER_INDEX;
-  int ret = lua_pcall(L, narg, nret, error_handler);
+  int ret;
+
+  if(lua_type(L, -narg-1) == LUA_TTHREAD){
+    ret = lluv_lua_resume(L, narg);
+    if(!ret){
+      for(;nret > 0; --nret) lua_pushnil(L);
+      return 0;
+    }
+
+    if(error_handler && (ret != LUA_ERRMEM)){
+      lua_pushvalue(L, error_handler);
+      lua_pushvalue(L, -2);
+      if(lua_pcall(L, 1, 1, 0)) lua_pop(L, 1);
+      else lua_replace(L, -2);
+    }
+  }
+  else ret = lua_pcall(L, narg, nret, error_handler);
  
   if(!ret) return 0;
 
@@ -82,9 +131,25 @@ LLUV_INTERNAL int lluv__index(lua_State *L, const char *meta, lua_CFunction inhe
 
 LLUV_INTERNAL void lluv_check_callable(lua_State *L, int idx){
   idx = lua_absindex(L, idx);
+  if(lua_type(L, idx) == LUA_TTHREAD){
+    lua_State *co = lua_tothread(L, idx);
+    if(co == L){
+      int is_main = lua_pushthread(L);
+      lua_pop(L, 1);
+      luaL_argcheck(L, !is_main, idx, "attempt to yield from outside a coroutine");
+    }
+    else{
+      luaL_argcheck(L, lua_status(co) == LUA_YIELD, idx, "suspended coroutine expected");
+    }
+    return;
+  }
   luaL_checktype(L, idx, LUA_TFUNCTION);
 }
 
+LLUV_INTERNAL int lluv_is_yield_cb(lua_State *L, int idx){
+  return lua_tothread(L, idx) == L;
+}
+
 LLUV_INTERNAL void lluv_check_none(lua_State *L, int idx){
   idx = lua_absindex(L, idx);
   luaL_argcheck (L, lua_isnone(L, idx), idx, "too many parameters");
@@ -102,6 +167,20 @@ LLUV_INTERNAL void lluv_push_status(lua_State *L, int status){
     lluv_error_create(L, LLUV_ERR_UV, (uv_errno_t)status, NULL);
 }
 
+LLUV_INTERNAL const char *lluv_memfind(const char *s, size_t len, const char *p, size_t plen){
+  if(plen == 0) return s;
+  if(plen == 1) return (const char*)memchr(s, p[0], len);
+
+  while(len >= plen){
+    const char *c = (const char*)memchr(s, p[0], len - plen + 1);
+    if(!c) return NULL;
+    if(0 == memcmp(c + 1, p + 1, plen - 1)) return c;
+    len -= c - s + 1; s = c + 1;
+  }
+
+  return NULL;
+}
+
 LLUV_INTERNAL void lluv_alloc_buffer_cb(uv_handle_t* h, size_t suggested_size, uv_buf_t *buf){
 //  *buf = uv_buf_init(malloc(suggested_size), suggested_size);
   lluv_handle_t *handle = lluv_handle_byptr(h);
@@ -151,11 +230,30 @@ LLUV_INTERNAL int lluv_to_addr(lua_State *L, const char *addr, int port, struct
 }
 
 LLUV_INTERNAL int lluv_check_addr(lua_State *L, int i, struct sockaddr_storage *sa){
-  const char *addr  = luaL_checkstring(L, i);
-  lua_Integer port  = luaL_checkint(L, i + 1);
+  lluv_address_t *obj = lluv_test_address(L, i);
+  const char *addr; lua_Integer port;
+
+  if(obj){ /* port ignored */
+    memcpy(sa, &obj->addr, sizeof(*sa));
+    return 0;
+  }
+
+  addr  = luaL_checkstring(L, i);
+  port  = luaL_checkint(L, i + 1);
   return lluv_to_addr(L, addr, port, sa);
 }
 
+/* push `host:port` for error message. Address object converted with `__tostring` */
+LLUV_INTERNAL const char *lluv_push_addr_text(lua_State *L, int i){
+  lua_checkstack(L, 3);
+
+  if(lluv_test_address(L, i) && luaL_callmeta(L, i, "__tostring"))
+    return lua_tostring(L, -1);
+
+  lua_pushvalue(L, i); lua_pushliteral(L, ":"); lua_pushvalue(L, i + 1); lua_concat(L, 3);
+  return lua_tostring(L, -1);
+}
+
 LLUV_INTERNAL int lluv_push_addr(lua_State *L, const struct sockaddr_storage *addr){
   char buf[INET6_ADDRSTRLEN + 1];
 
@@ -355,8 +453,12 @@ LLUV_INTERNAL void lluv_push_timespec(lua_State *L, const uv_timespec_t *ts){
 }
 
 LLUV_INTERNAL int lluv_return_req(lua_State *L, lluv_handle_t *handle, lluv_req_t *req, int err){
+  int co;
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, req->cb);
+  co = lluv_is_yield_cb(L, -1);
+
   if(err < 0){
-    lua_rawgeti(L, LLUV_LUA_REGISTRY, req->cb);
     lluv_req_free(L, req);
     if(lua_isnil(L, -1)){
       lua_pop(L, 1);
@@ -368,13 +470,20 @@ LLUV_INTERNAL int lluv_return_req(lua_State *L, lluv_handle_t *handle, lluv_req_
     lluv_loop_defer_call(L, lluv_loop_by_handle(&handle->handle), 2);
   }
 
+  /* coroutine waits result of request. It will be resumed from callback */
+  if(co) return lua_yield(L, 0);
+
   lua_settop(L, 1);
   return 1;
 }
 
 LLUV_INTERNAL int lluv_return_loop_req(lua_State *L, lluv_loop_t *loop, lluv_req_t *req, int err){
+  int co;
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, req->cb);
+  co = lluv_is_yield_cb(L, -1);
+
   if(err < 0){
-    lua_rawgeti(L, LLUV_LUA_REGISTRY, req->cb);
     lluv_req_free(L, req);
     if(lua_isnil(L, -1)){
       lua_pop(L, 1);
@@ -386,6 +495,9 @@ LLUV_INTERNAL int lluv_return_loop_req(lua_State *L, lluv_loop_t *loop, lluv_req
     lluv_loop_defer_call(L, loop, 2);
   }
 
+  /* coroutine waits result of request. It will be resumed from callback */
+  if(co) return lua_yield(L, 0);
+
   lua_settop(L, 1);
   return 1;
 }
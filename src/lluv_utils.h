@@ -64,10 +64,23 @@ LLUV_INTERNAL void lluv_free(lua_State* L, void *ptr);
 
 LLUV_INTERNAL int lluv_lua_call(lua_State* L, int narg, int nret);
 
+/*
+ Resume suspended coroutine with `narg` values.
+ Coroutine itself expected just below arguments.
+*/
+LLUV_INTERNAL int lluv_lua_resume(lua_State* L, int narg);
+
 LLUV_INTERNAL int lluv__index(lua_State *L, const char *meta, lua_CFunction inherit);
 
 LLUV_INTERNAL void lluv_check_callable(lua_State *L, int idx);
 
+/*
+ Check if callback is the coroutine which calls function.
+ In this case function have to yield and coroutine
+ will be resumed with callback arguments.
+*/
+LLUV_INTERNAL int lluv_is_yield_cb(lua_State *L, int idx);
+
 LLUV_INTERNAL void lluv_check_none(lua_State *L, int idx);
 
 /*
@@ -76,6 +89,9 @@ LLUV_INTERNAL void lluv_check_none(lua_State *L, int idx);
 */
 LLUV_INTERNAL void lluv_check_args_with_cb(lua_State *L, int n);
 
+/* find first occurrence of `p` in `s` (like memmem) */
+LLUV_INTERNAL const char *lluv_memfind(const char *s, size_t len, const char *p, size_t plen);
+
 LLUV_INTERNAL void lluv_alloc_buffer_cb(uv_handle_t* handle, size_t suggested_size, uv_buf_t *buf);
 
 LLUV_INTERNAL void lluv_free_buffer(uv_handle_t* handle, const uv_buf_t *buf);
@@ -84,6 +100,8 @@ LLUV_INTERNAL int lluv_to_addr(lua_State *L, const char *addr, int port, struct
 
 LLUV_INTERNAL int lluv_check_addr(lua_State *L, int i, struct sockaddr_storage *sa);
 
+LLUV_INTERNAL const char *lluv_push_addr_text(lua_State *L, int i);
+
 LLUV_INTERNAL int lluv_push_addr(lua_State *L, const struct sockaddr_storage *addr);
 
 LLUV_INTERNAL void lluv_push_stat(lua_State* L, const uv_stat_t* s);
@@ -0,0 +1,893 @@
+------------------------------------------------------------------
+--
+--  Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+--
+--  Copyright (C) 2014 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+--
+--  Licensed according to the included 'LICENSE' document
+--
+--  This file is part of lua-lluv library.
+--
+------------------------------------------------------------------
+
+-- Asynchronous DNS stub resolver.
+--
+-- Unlike `uv.getaddrinfo` it does not use threadpool. Queries are sent
+-- over few UDP sockets and many queries can be in flight on each socket.
+-- Query ids are random and sockets are replaced after `socket_queries`
+-- queries so source port also changes (RFC 5452).
+-- Truncated responses are repeated over TCP. Each query tried
+-- `attempts` times on every server with `timeout` per try.
+--
+-- Configuration read from `/etc/resolv.conf` (`nameserver`, `search`,
+-- `domain`, `options timeout: attempts: ndots: rotate`) and `/etc/hosts`.
+--
+-- Errors are `uv.error` objects with same codes as `getaddrinfo`:
+-- `EAI_NONAME` (NXDOMAIN), `EAI_NODATA` (no records), `EAI_AGAIN` (SERVFAIL),
+-- `EAI_FAIL` (other server errors), `ETIMEDOUT` and `ECANCELED` (resolver closed).
+--
+-- @usage
+-- local dns = require "lluv.dns"
+-- local resolver = dns.new()
+-- resolver:resolve("example.com", function(self, err, addresses)
+--   for i = 1, #addresses do print(addresses[i].family, addresses[i].address) end
+-- end)
+-- resolver:query("_sip._udp.example.com", "SRV", function(self, err, records)
+--   for i = 1, #records do print(records[i].target, records[i].port) end
+-- end)
+
+local uv = require "lluv"
+local ut = require "lluv.utils"
+
+-- works with both safe and unsafe lluv
+local function try(f, ...)
+  local ok, res, err = pcall(f, ...)
+  if not ok then return nil, res end
+  return res, err
+end
+
+local function Error(no, ext)
+  return uv.error(uv.ERROR_UV, no, ext)
+end
+
+local TYPES = { A = 1, CNAME = 5, PTR = 12, AAAA = 28, SRV = 33 }
+
+local TYPE_NAMES = {}
+for name, code in pairs(TYPES) do TYPE_NAMES[code] = name end
+
+local RCODE_NOERROR, RCODE_FORMERR, RCODE_SERVFAIL, RCODE_NXDOMAIN = 0, 1, 2, 3
+
+-------------------------------------------------------------------
+-- Wire format
+-------------------------------------------------------------------
+
+local function u16(s, i)
+  local a, b = string.byte(s, i, i + 1)
+  return a * 256 + b
+end
+
+local function u32(s, i)
+  local a, b, c, d = string.byte(s, i, i + 3)
+  return ((a * 256 + b) * 256 + c) * 256 + d
+end
+
+local function p16(n)
+  return string.char(math.floor(n / 256) % 256, n % 256)
+end
+
+local function encode_name(name)
+  local t, n = {}, 0
+  for label in string.gmatch(name, "[^.]+") do
+    if #label > 63 then return end
+    n = n + 1
+    t[n] = string.char(#label) .. label
+  end
+  t[n + 1] = "\0"
+  local s = table.concat(t)
+  if #s > 255 then return end
+  return s
+end
+
+-- returns name and position after it
+local function decode_name(msg, pos)
+  local labels, after, jumps = {}, nil, 0
+
+  while true do
+    local len = string.byte(msg, pos)
+    if not len then return end
+
+    if len >= 0xC0 then
+      local lo = string.byte(msg, pos + 1)
+      if not lo then return end
+      after = after or (pos + 2)
+      jumps = jumps + 1
+      if jumps > 64 then return end
+      pos = (len - 0xC0) * 256 + lo + 1
+    elseif len >= 0x40 then
+      return
+    elseif len == 0 then
+      pos = pos + 1
+      break
+    else
+      if pos + len > #msg then return end
+      labels[#labels + 1] = string.sub(msg, pos + 1, pos + len)
+      pos = pos + len + 1
+    end
+  end
+
+  return table.concat(labels, "."), after or pos
+end
+
+local function ip6_name(s)
+  local g = {}
+  for i = 1, 16, 2 do g[#g + 1] = u16(s, i) end
+
+  -- longest run of zero groups replaced by `::`
+  local best, best_len, cur, cur_len = 0, 0, 0, 0
+  for i = 1, 8 do
+    if g[i] == 0 then
+      if cur_len == 0 then cur = i end
+      cur_len = cur_len + 1
+      if cur_len > best_len then best, best_len = cur, cur_len end
+    else
+      cur_len = 0
+    end
+  end
+
+  local function hex(a, b)
+    local t = {}
+    for i = a, b do t[#t + 1] = string.format("%x", g[i]) end
+    return table.concat(t, ":")
+  end
+
+  if best_len < 2 then return hex(1, 8) end
+  return hex(1, best - 1) .. "::" .. hex(best + best_len, 8)
+end
+
+local function encode_query(id, name, qtype)
+  local qname = encode_name(name)
+  if not qname then return end
+  return p16(id) .. "\1\0" .. "\0\1\0\0\0\0\0\0" .. qname .. p16(qtype) .. "\0\1"
+end
+
+local function decode_rdata(msg, pos, rtype, rdlen, rr)
+  if rtype == TYPES.A then
+    if rdlen ~= 4 then return end
+    rr.address = string.format("%d.%d.%d.%d", string.byte(msg, pos, pos + 3))
+  elseif rtype == TYPES.AAAA then
+    if rdlen ~= 16 then return end
+    rr.address = ip6_name(string.sub(msg, pos, pos + 15))
+  elseif rtype == TYPES.CNAME then
+    rr.cname = decode_name(msg, pos)
+    if not rr.cname then return end
+  elseif rtype == TYPES.PTR then
+    rr.ptrdname = decode_name(msg, pos)
+    if not rr.ptrdname then return end
+  elseif rtype == TYPES.SRV then
+    if rdlen < 7 then return end
+    rr.priority = u16(msg, pos)
+    rr.weight   = u16(msg, pos + 2)
+    rr.port     = u16(msg, pos + 4)
+    rr.target   = decode_name(msg, pos + 6)
+    if not rr.target then return end
+  end
+  return rr
+end
+
+local function decode_response(msg)
+  if #msg < 12 then return end
+
+  local flags = u16(msg, 3)
+  local res = {
+    id      = u16(msg, 1);
+    qr      = flags >= 0x8000;
+    tc      = math.floor(flags / 0x200) % 2 == 1;
+    rcode   = flags % 16;
+    answers = {};
+  }
+
+  local qdcount, ancount = u16(msg, 5), u16(msg, 7)
+  if qdcount ~= 1 then return end
+
+  local pos
+  res.qname, pos = decode_name(msg, 13)
+  if not res.qname or pos + 3 > #msg then return end
+  res.qtype = u16(msg, pos)
+  pos = pos + 4
+
+  for i = 1, ancount do
+    local name
+    name, pos = decode_name(msg, pos)
+    if not name or pos + 9 > #msg then return end
+
+    local rtype, ttl, rdlen = u16(msg, pos), u32(msg, pos + 4), u16(msg, pos + 8)
+    pos = pos + 10
+    if pos + rdlen - 1 > #msg then return end
+
+    local rr = {name = name, type = TYPE_NAMES[rtype] or rtype, ttl = ttl}
+    if not decode_rdata(msg, pos, rtype, rdlen, rr) then return end
+    res.answers[#res.answers + 1] = rr
+
+    pos = pos + rdlen
+  end
+
+  return res
+end
+
+-------------------------------------------------------------------
+-- Addresses
+-------------------------------------------------------------------
+
+local function ip4_parts(ip)
+  local a, b, c, d = string.match(ip, "^(%d+)%.(%d+)%.(%d+)%.(%d+)$")
+  if not a then return end
+  a, b, c, d = tonumber(a), tonumber(b), tonumber(c), tonumber(d)
+  if a > 255 or b > 255 or c > 255 or d > 255 then return end
+  return a, b, c, d
+end
+
+local function ip6_groups(ip)
+  ip = string.gsub(ip, "%%.*$", "")
+  if not string.find(ip, "^[%x:]+$") then return end
+
+  local function split(s)
+    local t = {}
+    for x in string.gmatch(s, "[^:]+") do
+      if #x > 4 then return end
+      t[#t + 1] = tonumber(x, 16)
+    end
+    return t
+  end
+
+  local g
+  local head, tail = string.match(ip, "^(.-)::(.*)$")
+  if head then
+    local h, t = split(head), split(tail)
+    if not (h and t) or #h + #t > 7 then return end
+    g = h
+    for i = 1, 8 - #h - #t do g[#g + 1] = 0 end
+    for i = 1, #t do g[#g + 1] = t[i] end
+  else
+    g = split(ip)
+    if not g or #g ~= 8 then return end
+  end
+
+  return g
+end
+
+local function address_family(host)
+  if ip4_parts(host) then return 'inet' end
+  if ip6_groups(host) then return 'inet6' end
+end
+
+local function reverse_name(ip)
+  local a, b, c, d = ip4_parts(ip)
+  if a then return string.format("%d.%d.%d.%d.in-addr.arpa", d, c, b, a) end
+
+  local g = ip6_groups(ip)
+  if not g then return end
+
+  local t = {}
+  for i = 8, 1, -1 do
+    local s = string.format("%04x", g[i])
+    for j = 4, 1, -1 do t[#t + 1] = string.sub(s, j, j) end
+  end
+  t[#t + 1] = "ip6.arpa"
+  return table.concat(t, ".")
+end
+
+-- `host`, `host:port`, `[host]:port` or `{host, port}`
+local function parse_server(s)
+  if type(s) == 'table' then return {host = s[1] or s.host, port = s[2] or s.port or 53} end
+
+  local host, port = string.match(s, "^%[(.-)%]:?(%d*)$")
+  if not host then
+    host, port = string.match(s, "^([^:]+):(%d+)$")
+  end
+  host, port = host or s, tonumber(port) or 53
+
+  return {host = host, port = port}
+end
+
+-------------------------------------------------------------------
+-- Configuration files
+-------------------------------------------------------------------
+
+local function parse_resolv_conf(data, conf)
+  for line in string.gmatch(data, "[^\r\n]+") do
+    line = string.gsub(line, "[#;].*$", "")
+    local key, rest = string.match(line, "^%s*(%S+)%s*(.-)%s*$")
+    if key == 'nameserver' then
+      if #conf.servers < 3 and rest ~= '' then
+        conf.servers[#conf.servers + 1] = {host = rest, port = 53}
+      end
+    elseif key == 'search' or key == 'domain' then
+      conf.search = {}
+      for domain in string.gmatch(rest, "%S+") do
+        conf.search[#conf.search + 1] = string.gsub(domain, "%.$", "")
+      end
+    elseif key == 'options' then
+      for opt in string.gmatch(rest, "%S+") do
+        local name, value = string.match(opt, "^([^:]+):?(%d*)$")
+        value = tonumber(value)
+        if name == 'timeout' and value then
+          conf.timeout = value * 1000
+        elseif name == 'attempts' and value then
+          conf.attempts = value
+        elseif name == 'ndots' and value then
+          conf.ndots = value
+        elseif name == 'rotate' then
+          conf.rotate = true
+        end
+      end
+    end
+  end
+end
+
+local function parse_hosts(data, hosts, addrs)
+  for line in string.gmatch(data, "[^\r\n]+") do
+    line = string.gsub(line, "#.*$", "")
+    local ip, names = string.match(line, "^%s*(%S+)%s+(.-)%s*$")
+    local family = ip and address_family(ip)
+    if family then
+      for name in string.gmatch(names, "%S+") do
+        name = string.lower(name)
+        local e = hosts[name]
+        if not e then
+          e = {inet = {}, inet6 = {}}
+          hosts[name] = e
+        end
+        e[family][#e[family] + 1] = ip
+
+        local ptr = reverse_name(ip)
+        local a = addrs[ptr]
+        if not a then
+          a = {}
+          addrs[ptr] = a
+        end
+        a[#a + 1] = name
+      end
+    end
+  end
+end
+
+-- random 16 bit ids. Use OS source if lluv has it
+local random16 do
+  local pool, pos = '', 1
+
+  if uv.random then
+    random16 = function()
+      if pos > #pool then pool, pos = uv.random(128), 1 end
+      pos = pos + 2
+      return u16(pool, pos - 2)
+    end
+  else
+    local addr = tonumber(string.match(tostring({}), '%x+$'), 16) or 0
+    math.randomseed((os.time() + uv.hrtime() + addr) % 0x7FFFFFFF)
+    random16 = function()
+      return math.random(0, 0xFFFF)
+    end
+  end
+end
+
+-------------------------------------------------------------------
+local Resolver = ut.class() do
+
+-- options:
+--  loop        - uv_loop (default loop)
+--  resolv_conf - path to resolv.conf or false (default `/etc/resolv.conf`)
+--  hosts       - path to hosts file or false (default `/etc/hosts`)
+--  servers     - array of servers (`ip`, `ip:port`, `[ipv6]:port` or `{ip, port}`)
+--  search      - array of search domains
+--  timeout     - timeout of one try in ms (default 5000)
+--  attempts    - number of tries on each server (default 2)
+--  ndots       - names with fewer dots tried with search domains first (default 1)
+--  sockets     - max number of UDP sockets per address family (default 2)
+--  socket_queries - number of queries sent over UDP socket before it replaced
+--                with new one bound to new port (default 64)
+function Resolver:__init(opt)
+  opt = opt or {}
+
+  self._loop     = opt.loop or uv.default_loop()
+  self._nsockets = opt.sockets or 2
+  self._nqueries = opt.socket_queries or 64
+  self._queries  = {}  -- id => query waiting for UDP response
+  self._active   = {}  -- query => true
+  self._udp      = {inet = {}, inet6 = {}}
+  self._next_udp = 0
+  self._next_srv = 0
+  self._hosts    = {}  -- name => {inet = {...}, inet6 = {...}}
+  self._addrs    = {}  -- reverse name => {names}
+  self._waiting  = {}  -- queries before configuration loaded
+  self._conf     = {servers = {}, search = {}, timeout = 5000, attempts = 2, ndots = 1}
+
+  local loading = 0
+
+  local function done()
+    loading = loading - 1
+    if loading > 0 then return end
+    self:_configure(opt)
+  end
+
+  local function load(path, parse)
+    loading = loading + 1
+    uv.fs_readfile(self._loop, path, function(loop, err, data)
+      if not err then parse(data) end
+      done()
+    end)
+  end
+
+  local resolv_conf = opt.resolv_conf
+  if resolv_conf == nil then resolv_conf = '/etc/resolv.conf' end
+  if resolv_conf then
+    load(resolv_conf, function(data) parse_resolv_conf(data, self._conf) end)
+  end
+
+  local hosts = opt.hosts
+  if hosts == nil then hosts = '/etc/hosts' end
+  if hosts then
+    load(hosts, function(data) parse_hosts(data, self._hosts, self._addrs) end)
+  end
+
+  if loading == 0 then
+    loading = 1
+    done()
+  end
+
+  return self
+end
+
+function Resolver:_configure(opt)
+  local conf = self._conf
+
+  if opt.servers then
+    conf.servers = {}
+    for i = 1, #opt.servers do conf.servers[i] = parse_server(opt.servers[i]) end
+  end
+  if #conf.servers == 0 then conf.servers[1] = {host = '127.0.0.1', port = 53} end
+
+  conf.search   = opt.search   or conf.search
+  conf.timeout  = opt.timeout  or conf.timeout
+  conf.attempts = opt.attempts or conf.attempts
+  conf.ndots    = opt.ndots    or conf.ndots
+
+  for i = 1, #conf.servers do
+    local server = conf.servers[i]
+    server.family = string.find(server.host, ':', 1, true) and 'inet6' or 'inet'
+  end
+
+  self._ready = true
+
+  local waiting = self._waiting
+  self._waiting = nil
+  for i = 1, #waiting do waiting[i]() end
+end
+
+function Resolver:_defer(...)
+  self._loop:defer(...)
+end
+
+-- names to try in order
+function Resolver:_candidates(name)
+  if string.sub(name, -1) == '.' then return {string.sub(name, 1, -2)} end
+
+  local search = self._conf.search
+  if #search == 0 then return {name} end
+
+  local list = {}
+  local _, dots = string.gsub(name, '%.', '')
+  if dots >= self._conf.ndots then list[1] = name end
+  for i = 1, #search do list[#list + 1] = name .. '.' .. search[i] end
+  if dots < self._conf.ndots then list[#list + 1] = name end
+
+  return list
+end
+
+-- returns {udp = sock, sent = n, pending = n}
+-- socket retired after `socket_queries` queries and closed when
+-- there no more responses to wait on it.
+function Resolver:_socket(family)
+  local list = self._udp[family]
+  local s
+
+  if #list < self._nsockets then
+    local sock = uv.udp(self._loop)
+    local ok, err = try(sock.bind, sock, family == 'inet6' and '::' or '0.0.0.0', 0)
+    if not ok then
+      sock:close()
+      return nil, err
+    end
+
+    s = {udp = sock, sent = 0, pending = 0}
+
+    sock:start_recv(function(_, err, data, flags, host, port)
+      if err or not data then return end
+      self:_on_udp(s, data, host, port)
+    end)
+
+    -- idle resolver should not keep loop alive
+    sock:unref()
+
+    list[#list + 1] = s
+    self._next_udp = #list
+  else
+    self._next_udp = self._next_udp % #list + 1
+    s = list[self._next_udp]
+  end
+
+  s.sent = s.sent + 1
+  if s.sent >= self._nqueries then
+    table.remove(list, self._next_udp)
+    s.retired = true
+  end
+
+  return s
+end
+
+-- query no longer waits for UDP response
+function Resolver:_unwait(q)
+  if self._queries[q.id] == q then self._queries[q.id] = nil end
+
+  local s = q.sock
+  if not s then return end
+
+  q.sock = nil
+  s.pending = s.pending - 1
+  if s.retired and s.pending == 0 then s.udp:close() end
+end
+
+function Resolver:_new_id()
+  while true do
+    local id = random16()
+    if not self._queries[id] then return id end
+  end
+end
+
+function Resolver:_finish(q, err, records)
+  if q.done then return end
+  q.done = true
+
+  self:_unwait(q)
+  self._active[q] = nil
+  q.timer:close()
+  if q.tcp then q.tcp:close() q.tcp = nil end
+
+  q.cb(err, records)
+end
+
+-- send next try
+function Resolver:_send(q, err)
+  if q.done then return end
+
+  self:_unwait(q)
+  if q.tcp then q.tcp:close() q.tcp = nil end
+
+  local servers = self._conf.servers
+  if q.try >= self._conf.attempts * #servers then
+    return self:_finish(q, err or Error(uv.ETIMEDOUT, q.name))
+  end
+
+  local server = servers[(q.try + q.offset) % #servers + 1]
+  q.try = q.try + 1
+
+  q.id     = self:_new_id()
+  q.server = server
+  q.packet = encode_query(q.id, q.name, q.qtype)
+
+  local sock, serr = self:_socket(server.family)
+  if not sock then
+    -- e.g. IPv6 is not available. Try next server
+    return self:_send(q, serr)
+  end
+
+  self._queries[q.id] = q
+  q.sock = sock
+  sock.pending = sock.pending + 1
+
+  q.timer:stop()
+  q.timer:start(self._conf.timeout, function() self:_send(q) end)
+
+  sock.udp:send(server.host, server.port, q.packet, function(_, err)
+    if err and self._queries[q.id] == q then self:_send(q, err) end
+  end)
+end
+
+-- truncated response. Repeat query over TCP with same id
+function Resolver:_send_tcp(q)
+  local server = q.server
+  local buf = ''
+
+  self:_unwait(q)
+
+  q.timer:stop()
+  q.timer:start(self._conf.timeout, function() self:_send(q) end)
+
+  q.tcp = uv.tcp(self._loop)
+  q.tcp:connect(server.host, server.port, function(cli, err)
+    if err then return self:_send(q, err) end
+
+    cli:write(p16(#q.packet) .. q.packet)
+
+    cli:start_read(function(cli, err, data)
+      if err then return self:_send(q, err) end
+
+      buf = buf .. data
+      if #buf < 2 then return end
+
+      local len = u16(buf, 1)
+      if #buf < len + 2 then return end
+
+      cli:close()
+      q.tcp = nil
+
+      local res = decode_response(string.sub(buf, 3, len + 2))
+      if not (res and res.id == q.id and self:_match(q, res)) then
+        return self:_send(q, Error(uv.EPROTO, q.name))
+      end
+
+      self:_response(q, res)
+    end)
+  end)
+end
+
+function Resolver:_match(q, res)
+  return res.qr and res.qtype == q.qtype and string.lower(res.qname) == string.lower(q.name)
+end
+
+function Resolver:_on_udp(sock, data, host, port)
+  local res = decode_response(data)
+  if not res then return end
+
+  local q = self._queries[res.id]
+  if not q or q.sock ~= sock or q.server.port ~= port or q.server.host ~= host then return end
+  if not self:_match(q, res) then return end
+
+  if res.tc then return self:_send_tcp(q) end
+
+  self:_response(q, res)
+end
+
+function Resolver:_response(q, res)
+  if res.rcode == RCODE_NXDOMAIN then
+    return self:_finish(q, Error(uv.EAI_NONAME, q.name))
+  end
+
+  if res.rcode == RCODE_FORMERR then
+    return self:_finish(q, Error(uv.EAI_FAIL, q.name))
+  end
+
+  if res.rcode ~= RCODE_NOERROR then
+    -- SERVFAIL, REFUSED ... try other server
+    local no = (res.rcode == RCODE_SERVFAIL) and uv.EAI_AGAIN or uv.EAI_FAIL
+    return self:_send(q, Error(no, q.name))
+  end
+
+  local records, qtype = {}, TYPE_NAMES[q.qtype]
+  for i = 1, #res.answers do
+    local rr = res.answers[i]
+    if rr.type == qtype then records[#records + 1] = rr end
+  end
+
+  if #records == 0 then
+    return self:_finish(q, Error(uv.EAI_NODATA, q.name))
+  end
+
+  self:_finish(q, nil, records)
+end
+
+function Resolver:_hosts_lookup(name, qtype)
+  name = string.lower(string.gsub(name, '%.$', ''))
+
+  if qtype == TYPES.PTR then
+    local names = self._addrs[name]
+    if not names then return end
+
+    local records = {}
+    for i = 1, #names do
+      records[i] = {name = name, type = 'PTR', ttl = 0, ptrdname = names[i]}
+    end
+    return records
+  end
+
+  local e = self._hosts[name]
+  if not e then return end
+
+  local list = e[(qtype == TYPES.AAAA) and 'inet6' or 'inet']
+  if #list == 0 then return end
+
+  local records = {}
+  for i = 1, #list do
+    records[i] = {name = name, type = TYPE_NAMES[qtype], ttl = 0, address = list[i]}
+  end
+  return records
+end
+
+-- query records of one type: `A`, `AAAA`, `SRV`, `PTR` or `CNAME`.
+-- callback(resolver, err, records)
+function Resolver:query(name, qtype, cb)
+  if self._closed then
+    self:_defer(cb, self, Error(uv.ECANCELED, name))
+    return self
+  end
+
+  if not self._ready then
+    local waiting = self._waiting
+    waiting[#waiting + 1] = function() self:query(name, qtype, cb) end
+    return self
+  end
+
+  local code = TYPES[string.upper(qtype)]
+  if not code then
+    self:_defer(cb, self, Error(uv.EINVAL, tostring(qtype)))
+    return self
+  end
+
+  if code == TYPES.A or code == TYPES.AAAA or code == TYPES.PTR then
+    local records = self:_hosts_lookup(name, code)
+    if records then
+      self:_defer(cb, self, nil, records)
+      return self
+    end
+  end
+
+  local candidates = self:_candidates(name)
+  if not encode_name(candidates[1]) then
+    self:_defer(cb, self, Error(uv.EAI_NONAME, name))
+    return self
+  end
+
+  local i = 1
+
+  local function lookup()
+    local q = {
+      name   = candidates[i];
+      qtype  = code;
+      try    = 0;
+      offset = 0;
+      timer  = uv.timer(self._loop);
+    }
+
+    if self._conf.rotate then
+      self._next_srv = self._next_srv + 1
+      q.offset = self._next_srv
+    end
+
+    q.cb = function(err, records)
+      if err and i < #candidates then
+        local name = err:name()
+        if name == 'EAI_NONAME' or name == 'EAI_NODATA' then
+          i = i + 1
+          return lookup()
+        end
+      end
+      cb(self, err, records)
+    end
+
+    self._active[q] = true
+    self:_send(q)
+  end
+
+  lookup()
+
+  return self
+end
+
+-- resolve host name with `A` and `AAAA` queries. IPv6 addresses come first.
+-- options: family - `inet` or `inet6` (default both)
+-- callback(resolver, err, addresses) where address is
+-- `{address = ip, family = 'inet'|'inet6', ttl = sec}`
+function Resolver:resolve(name, opt, cb)
+  if type(opt) == 'function' then opt, cb = nil, opt end
+  local family = opt and opt.family
+
+  local literal = address_family(name)
+  if literal then
+    if family and family ~= literal then
+      self:_defer(cb, self, Error(uv.EAI_NODATA, name))
+    else
+      self:_defer(cb, self, nil, {{address = name, family = literal, ttl = 0}})
+    end
+    return self
+  end
+
+  local types = {}
+  if family ~= 'inet'  then types[#types + 1] = 'AAAA' end
+  if family ~= 'inet6' then types[#types + 1] = 'A'    end
+
+  local results, errors, n = {}, {}, #types
+
+  local function done()
+    n = n - 1
+    if n > 0 then return end
+
+    local addresses = {}
+    for i = 1, #types do
+      local records = results[i]
+      if records then
+        for j = 1, #records do
+          local rr = records[j]
+          addresses[#addresses + 1] = {
+            address = rr.address;
+            family  = (rr.type == 'AAAA') and 'inet6' or 'inet';
+            ttl     = rr.ttl;
+          }
+        end
+      end
+    end
+
+    if #addresses > 0 then return cb(self, nil, addresses) end
+
+    -- report most specific error
+    local err = errors[#types]
+    for i = 1, #types do
+      if errors[i] and errors[i]:name() ~= 'EAI_NODATA' then err = errors[i] end
+    end
+    cb(self, err)
+  end
+
+  for i = 1, #types do
+    self:query(name, types[i], function(_, err, records)
+      results[i], errors[i] = records, err
+      done()
+    end)
+  end
+
+  return self
+end
+
+-- find host names for address with `PTR` query.
+-- callback(resolver, err, names)
+function Resolver:reverse(ip, cb)
+  local name = reverse_name(ip)
+  if not name then
+    self:_defer(cb, self, Error(uv.EINVAL, ip))
+    return self
+  end
+
+  return self:query(name .. '.', 'PTR', function(_, err, records)
+    if err then return cb(self, err) end
+    local names = {}
+    for i = 1, #records do names[i] = records[i].ptrdname end
+    cb(self, nil, names)
+  end)
+end
+
+function Resolver:servers()
+  return self._conf.servers
+end
+
+-- number of queries in flight
+function Resolver:pending()
+  local n = 0
+  for _ in pairs(self._active) do n = n + 1 end
+  return n
+end
+
+function Resolver:close()
+  if self._closed then return end
+  self._closed = true
+
+  local active = self._active
+  self._active = {}
+  for q in pairs(active) do
+    self:_finish(q, Error(uv.ECANCELED, q.name))
+  end
+
+  for _, list in pairs(self._udp) do
+    for i = 1, #list do list[i].udp:close() end
+  end
+  self._udp = {inet = {}, inet6 = {}}
+
+  local waiting = self._waiting
+  self._waiting = {}
+  if waiting then
+    for i = 1, #waiting do waiting[i]() end
+  end
+end
+
+end
+-------------------------------------------------------------------
+
+return setmetatable({
+  new = Resolver.new;
+}, {__call = function(_, ...) return Resolver.new(...) end})
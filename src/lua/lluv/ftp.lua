@@ -284,7 +284,7 @@ function Connection:__init(server, opt)
   self._cnn   = TcpConnection.new(self._host, self._port)
   self._auth  = false
 
-  self._buff         = ut.Buffer.new(EOL) -- pending data
+  self._buff         = uv.bqueue(EOL)    -- pending data
   self._queue        = ut.Queue.new()     -- pending requests
   self._pasv_pending = ut.Queue.new()     -- passive requests
 
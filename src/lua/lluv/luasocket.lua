@@ -174,7 +174,7 @@ local MAX_ACCEPT_COUNT = 10
 function TcpSock:__init(s)
   assert(TcpSock.__base.__init(self))
 
-  self._buf   = assert(ut.Buffer.new("\r*\n", true))
+  self._buf   = assert(uv.bqueue("\r*\n", true))
 
   self._wait.conn   = false
   self._wait.accept = false
@@ -295,7 +295,36 @@ function TcpSock:_reset()
   self._sock = uv.tcp()
 end
 
+function TcpSock:_connect_any(host, port)
+  local terminated
+
+  self:_start("conn")
+
+  uv.tcp_connect_any(host, port, function(cli, err)
+    if terminated then
+      if cli then cli:close() end
+      return
+    end
+    return self:_resume(cli, err)
+  end)
+
+  local cli, err = self:_yield()
+  terminated = true
+
+  self:_stop("conn")
+
+  if not cli then return nil, err end
+
+  self._sock:close()
+  self._sock = cli
+
+  return self
+end
+
 function TcpSock:_connect(host, port)
+  -- bound socket can not be replaced so try addresses one by one
+  if not self._bound then return self:_connect_any(host, port) end
+
   self:_start("conn")
   local res, err = CoGetAddrInfo(self._co, host, port)
   self:_stop("conn")
@@ -341,6 +370,7 @@ function TcpSock:bind(host, port)
     self._sock = uv.tcp()
     return nil, err
   end
+  self._bound = true
   return self
 end
 
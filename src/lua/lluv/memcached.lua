@@ -132,7 +132,7 @@ function Connection:__init(server)
   local host, port = split_first(server, ":")
   self._host  = host
   self._port  = port or "11211"
-  self._buff  = ut.Buffer.new(EOL) -- pending data
+  self._buff  = uv.bqueue(EOL)    -- pending data
   self._queue = ut.Queue.new()     -- pending requests
 
   return self
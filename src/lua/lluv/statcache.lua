@@ -0,0 +1,295 @@
+------------------------------------------------------------------
+--
+--  Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+--
+--  Copyright (C) 2014 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+--
+--  Licensed according to the included 'LICENSE' document
+--
+--  This file is part of lua-lluv library.
+--
+------------------------------------------------------------------
+
+-- File metadata (and small content) cache.
+--
+-- Entries expire after `ttl` and are invalidated by `fs_event`
+-- watchers on containing directories. Watchers are unref'ed so they
+-- do not keep loop alive and closed when directory has no cached entries.
+--
+-- @usage
+-- local cache = require "lluv.statcache".loop()
+-- cache:read("./www/index.html", function(err, data, stat) end)
+
+local uv = require "lluv"
+local ut = require "lluv.utils"
+
+local function dirname(path)
+  local dir, name = path:match("^(.*)[/\\]([^/\\]*)$")
+  if not dir then return ".", path end
+  if dir == "" then dir = "/" end
+  return dir, name
+end
+
+local function call_all(cbs, ...)
+  for i = 1, #cbs do cbs[i](...) end
+end
+
+-------------------------------------------------------------------
+local StatCache = ut.class() do
+
+-- options:
+--  loop        - uv_loop (default loop)
+--  ttl         - entry life time in ms (default 5000)
+--  max_entries - max number of cached paths (default 10000)
+--  max_content - max size of file content to cache (default 64KB, 0 - disable)
+--  max_memory  - max total size of cached content (default 16MB)
+--  watch       - use fs_event to invalidate entries (default true)
+function StatCache:__init(opt)
+  opt = opt or {}
+
+  self._loop        = opt.loop or uv.default_loop()
+  self._ttl         = opt.ttl or 5000
+  self._max_entries = opt.max_entries or 10000
+  self._max_content = opt.max_content or 64 * 1024
+  self._max_memory  = opt.max_memory or 16 * 1024 * 1024
+  self._watch       = (opt.watch ~= false)
+
+  self._entries  = {}  -- path => entry
+  self._count    = 0
+  self._memory   = 0
+  self._pending  = {}  -- path => {callbacks} for stat in progress
+  self._watchers = {}  -- dir  => {handle = fs_event, count = N}
+
+  -- LRU list. Head is most recently used
+  self._head = {}
+  self._head.next, self._head.prev = self._head, self._head
+
+  return self
+end
+
+function StatCache:_unlink(e)
+  e.prev.next, e.next.prev = e.next, e.prev
+end
+
+function StatCache:_touch(e)
+  self:_unlink(e)
+  local head = self._head
+  e.next, e.prev = head.next, head
+  head.next.prev, head.next = e, e
+end
+
+function StatCache:_watch_dir(dir)
+  if not self._watch then return end
+
+  local w = self._watchers[dir]
+  if w then
+    w.count = w.count + 1
+    return
+  end
+
+  local handle = uv.fs_event(self._loop)
+  local ok, res = pcall(handle.start, handle, dir, function(_, err, name)
+    if err or not name then return self:_invalidate_dir(dir) end
+    local path = (dir == "/" and "/" or dir .. "/") .. name
+    self:invalidate(path)
+  end)
+  ok = ok and res
+
+  -- too many watchers or not supported. Rely on ttl
+  if not ok then
+    handle:close()
+    w = {count = 1}
+  else
+    handle:unref()
+    w = {handle = handle, count = 1}
+  end
+
+  self._watchers[dir] = w
+end
+
+function StatCache:_unwatch_dir(dir)
+  local w = self._watchers[dir]
+  if not w then return end
+
+  w.count = w.count - 1
+  if w.count == 0 then
+    if w.handle then w.handle:close() end
+    self._watchers[dir] = nil
+  end
+end
+
+function StatCache:_remove(e)
+  self:_unlink(e)
+  self._entries[e.path] = nil
+  self._count  = self._count - 1
+  if e.data then self._memory = self._memory - #e.data end
+  self:_unwatch_dir(e.dir)
+end
+
+function StatCache:_set_data(e, data)
+  if e.data then self._memory = self._memory - #e.data end
+  e.data = data
+  if data then self._memory = self._memory + #data end
+
+  -- evict content of least recently used entries
+  local node = self._head.prev
+  while self._memory > self._max_memory and node ~= self._head do
+    if node.data and node ~= e then
+      self._memory = self._memory - #node.data
+      node.data = nil
+    end
+    node = node.prev
+  end
+end
+
+function StatCache:_put(path, err, stat)
+  local e = self._entries[path]
+  if not e then
+    local dir = dirname(path)
+    e = {path = path, dir = dir}
+    e.next, e.prev = e, e
+    self._entries[path] = e
+    self._count = self._count + 1
+    self:_watch_dir(dir)
+
+    while self._count > self._max_entries do
+      self:_remove(self._head.prev)
+    end
+  end
+
+  self:_touch(e)
+  e.err, e.stat, e.expire = err, stat, self._loop:now() + self._ttl
+  self:_set_data(e, nil)
+
+  return e
+end
+
+function StatCache:_get(path)
+  local e = self._entries[path]
+  if not e then return end
+
+  if e.expire <= self._loop:now() then
+    self:_remove(e)
+    return
+  end
+
+  self:_touch(e)
+  return e
+end
+
+-- return cached stat without IO. Returns nil if there no valid entry.
+function StatCache:get(path)
+  local e = self:_get(path)
+  if e then return e.stat or false, e.err end
+end
+
+-- callback(err, stat). Called synchronously if entry is cached.
+function StatCache:stat(path, cb)
+  local e = self:_get(path)
+  if e then
+    cb(e.err, e.stat)
+    return self
+  end
+
+  local pending = self._pending[path]
+  if pending then
+    pending[#pending + 1] = cb
+    return self
+  end
+
+  pending = {cb}
+  self._pending[path] = pending
+
+  uv.fs_stat(self._loop, path, function(loop, err, stat)
+    -- entry could be invalidated while request was in flight
+    if self._pending[path] == pending then
+      self._pending[path] = nil
+      self:_put(path, err, stat)
+    end
+    call_all(pending, err, stat)
+  end)
+
+  return self
+end
+
+-- callback(err, data, stat). Content cached only for small regular files.
+function StatCache:read(path, cb)
+  self:stat(path, function(err, stat)
+    if err then return cb(err) end
+
+    local e = self._entries[path]
+    if e and e.data and e.stat == stat then return cb(nil, e.data, stat) end
+
+    uv.fs_readfile(self._loop, path, function(loop, err, data)
+      if err then return cb(err) end
+
+      e = self._entries[path]
+      if e and e.stat == stat and stat.is_file and #data <= self._max_content and #data == stat.size then
+        self:_set_data(e, data)
+      end
+
+      cb(nil, data, stat)
+    end)
+  end)
+
+  return self
+end
+
+function StatCache:invalidate(path)
+  self._pending[path] = nil
+  local e = self._entries[path]
+  if e then self:_remove(e) end
+
+  -- changes in directory content also change directory itself
+  local dir = dirname(path)
+  e = self._entries[dir]
+  if e then self:_remove(e) end
+
+  return self
+end
+
+function StatCache:_invalidate_dir(dir)
+  for path, e in pairs(self._entries) do
+    if e.dir == dir then self:_remove(e) end
+  end
+  for path in pairs(self._pending) do
+    if dirname(path) == dir then self._pending[path] = nil end
+  end
+end
+
+function StatCache:clear()
+  for _, e in pairs(self._entries) do self:_remove(e) end
+  self._pending = {}
+  return self
+end
+
+function StatCache:size()
+  return self._count, self._memory
+end
+
+function StatCache:close()
+  self:clear()
+end
+
+end
+-------------------------------------------------------------------
+
+local loop_caches = setmetatable({}, {__mode = "k"})
+
+-- shared cache for loop
+local function loop_cache(loop, opt)
+  loop = loop or uv.default_loop()
+  local cache = loop_caches[loop]
+  if not cache then
+    opt = opt or {}
+    opt.loop = loop
+    cache = StatCache.new(opt)
+    loop_caches[loop] = cache
+  end
+  return cache
+end
+
+return {
+  new  = StatCache.new;
+  loop = loop_cache;
+}
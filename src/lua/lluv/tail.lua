@@ -0,0 +1,291 @@
+------------------------------------------------------------------
+--
+--  Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+--
+--  Copyright (C) 2014 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+--
+--  Licensed according to the included 'LICENSE' document
+--
+--  This file is part of lua-lluv library.
+--
+------------------------------------------------------------------
+
+-- Follow growing file (like `tail -F`).
+--
+-- Changes detected by `fs_event` on parent directory (libuv shares one
+-- inotify watch for all handles on same directory). Idle tail has no
+-- timers, no pending requests and no read buffer.
+-- On change file read from last position until EOF with one
+-- outstanding positional read. Next read issued before data delivered.
+-- Rotation (new inode at path) and truncation detected with `fs_stat`.
+-- Rest of rotated file read before switching to new one.
+--
+-- @usage
+-- local tail = require "lluv.tail"
+-- tail("/var/log/app.log", {position = "end"}, function(self, err, lines)
+--   for i = 1, #lines do ship(lines[i]) end
+-- end)
+
+local uv = require "lluv"
+local ut = require "lluv.utils"
+
+local function split_path(path)
+  local dir, name = path:match("^(.*)[/\\]([^/\\]*)$")
+  if not dir then return ".", path end
+  if dir == "" then dir = "/" end
+  return dir, name
+end
+
+local function is_enoent(err)
+  return err and err:name() == 'ENOENT'
+end
+
+-------------------------------------------------------------------
+local Tail = ut.class() do
+
+-- options:
+--  loop     - uv_loop (default loop)
+--  position - `end` (default), `start` or offset where start read first file
+--  lines    - deliver array of lines without `\n` (default true).
+--             Otherwise deliver raw chunks as strings
+--  chunk    - read size (default 64KB)
+--  max_line - longer lines delivered in parts (default 64KB)
+function Tail:__init(path, opt, cb)
+  if type(opt) == 'function' then opt, cb = nil, opt end
+  opt = opt or {}
+
+  self._path     = path
+  self._loop     = opt.loop or uv.default_loop()
+  self._lines    = (opt.lines ~= false)
+  self._chunk    = opt.chunk or 65536
+  self._max_line = opt.max_line or 65536
+  self._cb       = cb
+  self._partial  = ''
+  self._busy     = false -- check cycle in progress
+  self._dirty    = false -- change notification during cycle
+
+  local position = opt.position or 'end'
+  if position == 'start' then position = 0 end
+
+  local dir, name = split_path(path)
+  self._event = uv.fs_event(self._loop)
+  local ok, res, err = pcall(self._event.start, self._event, dir, function(_, err, fname)
+    if err then return self:_error(err) end
+    if fname == nil or fname == name then self:_kick() end
+  end)
+  if not ok then err = res end
+
+  if not (ok and res) then
+    self._event:close()
+    self._event = nil
+    return nil, err
+  end
+
+  self._busy = true
+  self:_open(position, function() self:_done() end)
+
+  return self
+end
+
+function Tail:path()
+  return self._path
+end
+
+-- current read position
+function Tail:position()
+  return self._pos
+end
+
+function Tail:_error(err)
+  if self._cb then self._cb(self, err) end
+end
+
+function Tail:_deliver(data)
+  if not self._lines then
+    return self._cb(self, nil, data)
+  end
+
+  local lines, n, pos = {}, 0, 1
+  local partial = self._partial
+
+  while true do
+    local e = string.find(data, '\n', pos, true)
+    if not e then break end
+    n = n + 1
+    if partial ~= '' then
+      lines[n], partial = partial .. string.sub(data, pos, e - 1), ''
+    else
+      lines[n] = string.sub(data, pos, e - 1)
+    end
+    pos = e + 1
+  end
+
+  if pos <= #data then partial = partial .. string.sub(data, pos) end
+
+  while #partial >= self._max_line do
+    n = n + 1
+    lines[n], partial = string.sub(partial, 1, self._max_line), string.sub(partial, self._max_line + 1)
+  end
+
+  self._partial = partial
+
+  if n > 0 then self._cb(self, nil, lines) end
+end
+
+-- deliver incomplete last line of rotated or truncated file
+function Tail:_flush_partial()
+  local partial = self._partial
+  if partial == '' then return end
+  self._partial = ''
+  if self._lines then self._cb(self, nil, {partial}) end
+end
+
+function Tail:_open(position, done)
+  uv.fs_open(self._loop, self._path, 'r', function(file, err)
+    if not self._event then
+      if file then file:close() end
+      return done()
+    end
+
+    -- file not created yet. wait for notification
+    if is_enoent(err) then return done() end
+    if err then
+      self:_error(err)
+      return done()
+    end
+
+    file:stat(function(file, err, stat)
+      if not self._event then
+        file:close()
+        return done()
+      end
+
+      if err then
+        file:close()
+        self:_error(err)
+        return done()
+      end
+
+      self._file, self._ino = file, stat.ino
+      self._pos = (position == 'end') and stat.size or position
+      self:_read(done)
+    end)
+  end)
+end
+
+-- read until EOF. Only one request in flight.
+function Tail:_read(done)
+  local buf = self._buf
+  if not buf then
+    buf = uv.buffer(self._chunk)
+    self._buf = buf
+  end
+
+  self._file:read(buf, self._pos, function(file, err, buf, size)
+    if not self._event then return done() end
+
+    if err then
+      self:_error(err)
+      return done()
+    end
+
+    if size == 0 then return done() end
+
+    local data = buf:to_s(size)
+    self._pos = self._pos + size
+
+    if size == self._chunk then
+      -- more data likely. Start next read before deliver
+      self:_read(done)
+      return self:_deliver(data)
+    end
+
+    self:_deliver(data)
+    if not self._event then return done() end
+    self:_read(done)
+  end)
+end
+
+function Tail:_kick()
+  if self._busy then
+    self._dirty = true
+    return
+  end
+
+  self:_check()
+end
+
+function Tail:_done()
+  self._busy = false
+
+  if not self._event then
+    -- closed while request was in flight
+    if self._file then
+      self._file:close()
+      self._file = nil
+    end
+    return
+  end
+
+  if self._dirty then return self:_check() end
+
+  -- release read buffer while idle
+  self._buf = nil
+end
+
+function Tail:_check()
+  self._busy, self._dirty = true, false
+
+  local done = function() self:_done() end
+
+  uv.fs_stat(self._loop, self._path, function(loop, err, stat)
+    if not self._event then return done() end
+
+    if not self._file then
+      if err then return done() end
+      return self:_open(0, done)
+    end
+
+    if err or stat.ino ~= self._ino then
+      -- rotated. Read rest of old file and switch to new one
+      return self:_read(function()
+        if not self._event then return done() end
+        self:_flush_partial()
+        self._file:close()
+        self._file, self._ino = nil
+
+        if err then return done() end
+        self:_open(0, done)
+      end)
+    end
+
+    if stat.size < self._pos then
+      self:_flush_partial()
+      self._pos = 0
+    end
+
+    self:_read(done)
+  end)
+end
+
+function Tail:close()
+  if self._event then
+    self._event:close()
+    self._event = nil
+  end
+
+  -- file closed when pending request done
+  if self._file and not self._busy then
+    self._file:close()
+    self._file = nil
+  end
+
+  self._buf, self._partial = nil, ''
+end
+
+end
+-------------------------------------------------------------------
+
+return setmetatable({
+  new = Tail.new;
+}, {__call = function(_, ...) return Tail.new(...) end})
@@ -0,0 +1,299 @@
+------------------------------------------------------------------
+--
+--  Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+--
+--  Copyright (C) 2014 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+--
+--  Licensed according to the included 'LICENSE' document
+--
+--  This file is part of lua-lluv library.
+--
+------------------------------------------------------------------
+
+-- Watch whole directory tree.
+--
+-- On Linux uses one `uv.fs_notify` (inotify) descriptor for all
+-- directories in tree. New subdirectories are watched automatically.
+-- On other platforms uses one recursive `fs_event` handle.
+--
+-- Events are coalesced per path within `debounce` window and
+-- delivered as one batch `cb(watcher, nil, paths, events)`.
+-- Paths are relative to root. Events are
+--  * `create` - new file or directory (also moved into tree)
+--  * `modify` - content or attributes changed
+--  * `delete` - removed (also moved out of tree)
+--  * `rename` - one of above (only on platforms without inotify)
+--  * `rescan` - event queue overflow. Path is `.`
+--
+-- @usage
+-- local watch_tree = require "lluv.watch_tree"
+-- watch_tree("./src", {debounce = 100}, function(watcher, err, paths, events)
+--   for i = 1, #paths do print(events[i], paths[i]) end
+-- end)
+
+local uv = require "lluv"
+local ut = require "lluv.utils"
+
+-- works with both safe and unsafe lluv
+local function try(f, ...)
+  local ok, res, err = pcall(f, ...)
+  if not ok then return nil, res end
+  return res, err
+end
+
+local function join(dir, name)
+  if dir == '' then return name end
+  return dir .. '/' .. name
+end
+
+-- merge new event with pending one. `false` - no net change
+local MERGE = {
+  create = { modify = 'create', delete = false,    create = 'create' },
+  modify = { create = 'modify', delete = 'delete' },
+  delete = { create = 'modify', modify = 'modify' },
+}
+
+local function merge(old, new)
+  if not old or new == 'rescan' or old == 'rescan' then return new end
+  local m = MERGE[old]
+  local r = m and m[new]
+  if r == nil then return new end
+  return r
+end
+
+-------------------------------------------------------------------
+local Watcher = ut.class() do
+
+-- options:
+--  loop     - uv_loop (default loop)
+--  debounce - coalesce window in ms (default 50)
+--  ready    - called as `ready(watcher, err)` when initial tree scan done
+function Watcher:__init(root, opt, cb)
+  if type(opt) == 'function' then opt, cb = nil, opt end
+  opt = opt or {}
+
+  self._root     = (root:gsub('[/\\]+$', ''))
+  if self._root == '' then self._root = root:sub(1, 1) end
+  self._loop     = opt.loop or uv.default_loop()
+  self._debounce = opt.debounce or 50
+  self._cb       = cb
+  self._ready    = opt.ready
+  self._pending  = {} -- path => event
+  self._order    = {} -- paths in order of first event
+  self._dirs     = {} -- wd   => relative path
+  self._wds      = {} -- path => wd
+  self._timer    = uv.timer(self._loop)
+
+  local notify = try(uv.fs_notify)
+  if notify then
+    local ok, err = self:_start_notify(notify)
+    if not ok then
+      self:close()
+      return nil, err
+    end
+  else
+    local ok, err = self:_start_fs_event()
+    if not ok then
+      self:close()
+      return nil, err
+    end
+  end
+
+  return self
+end
+
+function Watcher:root()
+  return self._root
+end
+
+function Watcher:_full(rel)
+  if rel == '' then return self._root end
+  if self._root == '/' then return '/' .. rel end
+  return self._root .. '/' .. rel
+end
+
+function Watcher:_start_notify(notify)
+  self._notify = notify
+
+  local ok, err = self:_add_dir('')
+  if not ok then return nil, err end
+
+  self._poll = uv.poll(self._loop, notify:fileno()):start(function(_, err)
+    if err then return self:_error(err) end
+    self:_read()
+  end)
+
+  self:_add_tree('', false, function(err)
+    if self._ready then self._ready(self, err) end
+  end)
+
+  return true
+end
+
+function Watcher:_start_fs_event()
+  local handle = uv.fs_event(self._loop)
+  local ok, err = try(handle.start, handle, self._root, uv.FS_EVENT_RECURSIVE,
+    function(_, err, name, events)
+      if err then return self:_error(err) end
+      if not name then return self:_queue('.', 'rescan') end
+      name = name:gsub('\\', '/')
+      self:_queue(name, events == uv.CHANGE and 'modify' or 'rename')
+    end
+  )
+
+  if not ok then
+    handle:close()
+    return nil, err
+  end
+
+  self._fs_event = handle
+  if self._ready then uv.defer(self._ready, self) end
+
+  return true
+end
+
+function Watcher:_error(err)
+  if self._cb then self._cb(self, err) end
+end
+
+-- returns true if directory is watched or no longer exists
+function Watcher:_add_dir(rel)
+  local wd, err = try(self._notify.add, self._notify, self:_full(rel))
+  if not wd then
+    local name = type(err) ~= 'string' and err:name()
+    if rel ~= '' and (name == 'ENOENT' or name == 'ENOTDIR') then return true end
+    return nil, err
+  end
+
+  self._dirs[wd], self._wds[rel] = rel, wd
+  return true
+end
+
+-- watch all subdirectories. `report` - queue `create` for all found entries
+function Watcher:_add_tree(rel, report, done)
+  local base = self:_full(rel)
+  local skip = #base + ((base:sub(-1) == '/') and 1 or 2)
+
+  uv.fs_walk(self._loop, base, function(loop, paths, types)
+    if not self._notify then return end
+    for i = 1, #paths do
+      local path = join(rel, paths[i]:sub(skip))
+      if types[i] == 'dir' then
+        local ok, err = self:_add_dir(path)
+        if not ok then self:_error(err) end
+      end
+      if report then self:_queue(path, 'create') end
+    end
+  end, function(loop, err)
+    if err and err:name() == 'ENOENT' then err = nil end
+    if done then done(err) end
+  end)
+end
+
+-- stop watching directory moved out of tree
+function Watcher:_remove_tree(rel)
+  local prefix = rel .. '/'
+  for path, wd in pairs(self._wds) do
+    if path == rel or path:sub(1, #prefix) == prefix then
+      self._wds[path], self._dirs[wd] = nil
+      try(self._notify.remove, self._notify, wd)
+    end
+  end
+end
+
+function Watcher:_read()
+  local ok, wds, names, events, dirs = pcall(self._notify.read, self._notify)
+  if not ok then return self:_error(wds) end
+  if not wds then return self:_error(names) end
+
+  for i = 1, #wds do
+    local wd, name, event, is_dir = wds[i], names[i], events[i], dirs[i]
+    local dir = self._dirs[wd]
+
+    if event == 'overflow' then
+      self:_queue('.', 'rescan')
+    elseif dir then
+      local path = name and join(dir, name)
+
+      if event == 'ignored' then
+        if self._wds[dir] == wd then self._wds[dir] = nil end
+        self._dirs[wd] = nil
+      elseif event == 'delete_self' or event == 'move_self' then
+        -- parent directory reports entry itself
+        if dir == '' then self:_queue('.', 'delete') end
+      elseif not path then
+        -- attributes of watched directory itself
+        if dir ~= '' then self:_queue(dir, 'modify') end
+      elseif event == 'create' or event == 'moved_to' then
+        self:_queue(path, 'create')
+        if is_dir then
+          local ok, err = self:_add_dir(path)
+          if not ok then self:_error(err) end
+          -- entries could be created before watch added
+          self:_add_tree(path, true)
+        end
+      elseif event == 'delete' then
+        self:_queue(path, 'delete')
+      elseif event == 'moved_from' then
+        self:_queue(path, 'delete')
+        if is_dir then self:_remove_tree(path) end
+      else
+        self:_queue(path, 'modify')
+      end
+    end
+  end
+end
+
+function Watcher:_queue(path, event)
+  if not self._timer then return end
+
+  local old = self._pending[path]
+  if old == nil then self._order[#self._order + 1] = path end
+  self._pending[path] = merge(old, event)
+
+  if not self._timer:active() then
+    self._timer:start(self._debounce, function() self:_flush() end)
+  end
+end
+
+function Watcher:_flush()
+  self._timer:stop()
+
+  local pending, order = self._pending, self._order
+  self._pending, self._order = {}, {}
+
+  local paths, events = {}, {}
+  for i = 1, #order do
+    local path = order[i]
+    local event = pending[path]
+    if event then
+      paths[#paths + 1], events[#events + 1] = path, event
+      pending[path] = nil
+    end
+  end
+
+  if #paths > 0 and self._cb then self._cb(self, nil, paths, events) end
+end
+
+-- number of watched directories
+function Watcher:size()
+  local n = 0
+  for _ in pairs(self._dirs) do n = n + 1 end
+  return n
+end
+
+function Watcher:close()
+  if self._timer    then self._timer:close()    self._timer    = nil end
+  if self._poll     then self._poll:close()     self._poll     = nil end
+  if self._notify   then self._notify:close()   self._notify   = nil end
+  if self._fs_event then self._fs_event:close() self._fs_event = nil end
+  self._dirs, self._wds = {}, {}
+  self._pending, self._order = {}, {}
+end
+
+end
+-------------------------------------------------------------------
+
+return setmetatable({
+  new = Watcher.new;
+}, {__call = function(_, ...) return Watcher.new(...) end})
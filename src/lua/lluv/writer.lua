@@ -0,0 +1,254 @@
+------------------------------------------------------------------
+--
+--  Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+--
+--  Copyright (C) 2014 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+--
+--  Licensed according to the included 'LICENSE' document
+--
+--  This file is part of lua-lluv library.
+--
+------------------------------------------------------------------
+
+-- Buffered append writer for uv_file.
+--
+-- Small appends are collected in memory and written with one
+-- `file:writev` when threshold reached or on timer tick.
+-- Optional `SyncGroup` batches `fdatasync` calls across many
+-- writers (group commit).
+--
+-- @usage
+-- local writer = require "lluv.writer"
+-- local group  = writer.group{interval = 5}
+-- local log    = writer.new(file, {threshold = 65536, interval = 10, sync = group})
+-- log:append("record\n", function(log, err) --[[ record is on disk ]] end)
+
+local uv = require "lluv"
+local ut = require "lluv.utils"
+
+-- max number of buffers passed to one writev call
+local MAX_IOV = 1024
+
+local function call_all(cbs, ...)
+  for i = 1, #cbs do cbs[i](...) end
+end
+
+-------------------------------------------------------------------
+local SyncGroup = ut.class() do
+
+function SyncGroup:__init(opt)
+  opt = opt or {}
+
+  self._interval = opt.interval or 0
+  self._pending  = {} -- file => {callbacks}
+  self._count    = 0
+  self._timer    = uv.timer():start(self._interval, function()
+    self:_flush()
+  end):stop()
+
+  return self
+end
+
+-- call `cb(err)` after all data written to file before this call is synced
+function SyncGroup:sync(file, cb)
+  local cbs = self._pending[file]
+  if not cbs then
+    cbs = {}
+    self._pending[file] = cbs
+    self._count = self._count + 1
+    if self._count == 1 then
+      self._timer:start(self._interval, function() self:_flush() end)
+    end
+  end
+  cbs[#cbs + 1] = cb
+  return self
+end
+
+function SyncGroup:_flush()
+  self._timer:stop()
+
+  local pending = self._pending
+  self._pending, self._count = {}, 0
+
+  -- one fdatasync per file for all waiters
+  for file, cbs in pairs(pending) do
+    file:datasync(function(file, err)
+      call_all(cbs, err)
+    end)
+  end
+end
+
+function SyncGroup:close()
+  if self._timer then
+    if self._count > 0 then self:_flush() end
+    self._timer:close()
+    self._timer = nil
+  end
+end
+
+end
+-------------------------------------------------------------------
+
+-------------------------------------------------------------------
+local Writer = ut.class() do
+
+-- options:
+--  threshold - flush when this number of bytes buffered (default 64KB)
+--  interval  - max delay in ms before buffered data written (default 0 - next loop iteration)
+--  position  - file position for first write (default -1 - current file position)
+--  sync      - `true` for fdatasync after each write or SyncGroup object
+function Writer:__init(file, opt)
+  opt = opt or {}
+
+  self._file      = file
+  self._threshold = opt.threshold or 65536
+  self._interval  = opt.interval or 0
+  self._position  = opt.position or -1
+  self._sync      = opt.sync
+  self._bufs      = {}
+  self._cbs       = {}
+  self._size      = 0
+  self._busy      = false
+  self._timer     = uv.timer():start(self._interval, function()
+    self:_flush()
+  end):stop()
+
+  return self
+end
+
+function Writer:file()
+  return self._file
+end
+
+function Writer:size()
+  return self._size
+end
+
+-- data is string or fixed buffer. Buffer should not be modified until callback
+function Writer:append(data, cb)
+  assert(self._timer, 'writer closed')
+
+  local n = #self._bufs + 1
+  self._bufs[n] = data
+  self._size = self._size + (type(data) == 'string' and #data or data:size())
+  if cb then self._cbs[#self._cbs + 1] = cb end
+
+  if self._busy then return self end
+
+  if self._size >= self._threshold or n >= MAX_IOV then
+    self:_flush()
+  elseif n == 1 then
+    self._timer:start(self._interval, function() self:_flush() end)
+  end
+
+  return self
+end
+
+-- write buffered data now
+function Writer:flush(cb)
+  if cb then
+    if #self._bufs == 0 and not self._busy then
+      uv.defer(cb, self)
+      return self
+    end
+    self._cbs[#self._cbs + 1] = cb
+  end
+
+  if not self._busy then self:_flush() end
+
+  return self
+end
+
+function Writer:_done(cbs, err)
+  self._busy = false
+
+  call_all(cbs, self, err)
+
+  if not self._timer then return end
+  if #self._bufs == 0 and #self._cbs == 0 then return end
+
+  if self._flush_requested or self._size >= self._threshold then
+    self:_flush()
+  else
+    self._timer:start(self._interval, function() self:_flush() end)
+  end
+end
+
+local function bufs_size(bufs)
+  local size = 0
+  for i = 1, #bufs do
+    local b = bufs[i]
+    size = size + (type(b) == 'string' and #b or b:size())
+  end
+  return size
+end
+
+function Writer:_flush()
+  if self._timer then self._timer:stop() end
+  self._flush_requested = nil
+
+  if self._busy then
+    self._flush_requested = true
+    return
+  end
+
+  local bufs, cbs, size = self._bufs, self._cbs, self._size
+
+  if #bufs == 0 then
+    self._cbs = {}
+    return call_all(cbs, self)
+  end
+
+  if #bufs > MAX_IOV then
+    local rest = {}
+    for i = MAX_IOV + 1, #bufs do
+      rest[#rest + 1] = bufs[i]
+      bufs[i] = nil
+    end
+    size = bufs_size(bufs)
+    -- callbacks wait for rest of data
+    self._bufs, self._size, cbs = rest, self._size - size, {}
+    self._flush_requested = true
+  else
+    self._bufs, self._cbs, self._size = {}, {}, 0
+  end
+
+  local position = self._position
+  if position >= 0 then self._position = position + size end
+
+  self._busy = true
+
+  self._file:writev(bufs, position, function(file, err)
+    if err or not self._sync then return self:_done(cbs, err) end
+
+    if self._sync == true then
+      return file:datasync(function(file, err) self:_done(cbs, err) end)
+    end
+
+    self._sync:sync(file, function(err) self:_done(cbs, err) end)
+  end)
+end
+
+-- flush buffered data and release timer. File stays open.
+function Writer:close(cb)
+  if not self._timer then
+    if cb then uv.defer(cb, self) end
+    return
+  end
+
+  self:flush(function(self, err)
+    if self._timer then
+      self._timer:close()
+      self._timer = nil
+    end
+    if cb then cb(self, err) end
+  end)
+end
+
+end
+-------------------------------------------------------------------
+
+return {
+  new   = Writer.new;
+  group = SyncGroup.new;
+}
@@ -0,0 +1,141 @@
+local uv = require "lluv"
+
+local function test_1() -- same behavior as lluv.utils.Buffer
+  local b = uv.bqueue("\r\n")
+
+  b:append("a\r")
+  b:append("\nb")
+  b:append("\r\n")
+  b:append("c\r\nd\r\n")
+
+  assert("a" == b:read_line())
+  assert("b" == b:read_line())
+  assert("c" == b:read_line())
+  assert("d" == b:read_line())
+
+  local b = uv.bqueue()
+  local eol = b:eol()
+  assert(eol == "\n")
+
+  assert("aaa" == b:next_line("aaa" .. eol .. "bbb"))
+
+  assert("bbbccc" == b:next_line("ccc" .. eol .. "ddd" .. eol))
+
+  assert("ddd" == b:next_line(eol))
+
+  assert("" == b:next_line(""))
+
+  assert(nil == b:next_line(""))
+
+  assert(nil == b:next_line("aaa"))
+
+  assert("aaa" == b:next_n("123456", 3))
+
+  assert(nil == b:next_n("", 8))
+
+  assert("123"== b:next_n("", 3))
+
+  assert("456" == b:next_n(nil, 3))
+
+  b:reset()
+
+  assert(nil == b:next_line("aaa|bbb"))
+
+  assert("aaa" == b:next_line(nil, "|"))
+
+  b:reset()
+
+  b:set_eol("\r*\n", true)
+   :append("aaa\r\r\n\r\nbbb\nccc")
+  assert("aaa" == b:read_line())
+  assert("" == b:read_line())
+  assert("bbb" == b:read_line())
+  assert(nil == b:read_line())
+
+  b:reset()
+  b:append("aaa\r\r")
+  b:append("\r\r")
+  assert(nil == b:read_line())
+  b:append("\nbbb\n")
+  assert("aaa" == b:read_line())
+  assert("bbb" == b:read_line())
+
+  b:reset()
+  b:set_eol("\n\0")
+
+  b:append("aaa")
+  assert(nil == b:read_line())
+  b:append("\n")
+  assert(nil == b:read_line())
+  b:append("\0")
+  assert("aaa" == b:read_line())
+end
+
+local function test_2() -- read_until/peek/skip/find
+  local b = uv.bqueue()
+
+  b:append("key: value\r\n\r\nbody")
+  assert(b:size() == 18)
+
+  assert(b:find("\r\n\r\n") == 11)
+  assert(b:find("\r\n", 12) == 13)
+  assert(b:find("xx") == nil)
+
+  assert(b:peek(3) == "key")
+  assert(b:peek(100) == nil)
+  assert(b:size() == 18)
+
+  assert(b:read_until(": ") == "key")
+  assert(b:read_until("\r\n\r\n", true) == "value\r\n\r\n")
+  assert(b:read_until("\r\n") == nil)
+
+  assert(b:skip(2) == 2)
+  assert(b:skip(10) == 2)
+  assert(b:empty())
+  assert(b:read_some() == nil)
+  assert(b:read_all() == "")
+end
+
+local function test_3() -- prepend and grow
+  local b = uv.bqueue()
+  local t = {}
+
+  for i = 1, 1000 do
+    local s = ("%d"):format(i)
+    b:append(s .. "\n")
+    t[#t + 1] = s
+  end
+
+  for i = 1, 500 do
+    assert(b:read_line() == t[i])
+  end
+
+  b:prepend("hello\n")
+  assert(b:read_line() == "hello")
+
+  b:prepend(("x"):rep(10000))
+  assert(b:read_n(10000) == ("x"):rep(10000))
+
+  for i = 501, 1000 do
+    assert(b:read_line() == t[i])
+  end
+
+  assert(b:read_line() == nil)
+  assert(b:empty())
+end
+
+local function test_4() -- unsupported patterns
+  assert(not pcall(uv.bqueue, "%s+", true))
+  assert(pcall(uv.bqueue, "%s+"))
+  assert(pcall(uv.bqueue, "\n", true))
+end
+
+test_1()
+
+test_2()
+
+test_3()
+
+test_4()
+
+print("Done!")
@@ -0,0 +1,134 @@
+local uv = require "lluv"
+
+local host = "127.0.0.1"
+
+local function server()
+  local srv = uv.tcp():bind(host, 0)
+  local _, port = srv:getsockname()
+  local accepted = 0
+  srv:listen(function(self, err)
+    assert(not err, tostring(err))
+    accepted = accepted + 1
+    self:accept():close()
+  end)
+  return srv, port, function() return accepted end
+end
+
+-- port without listener
+local function closed_port()
+  local srv = uv.tcp():bind(host, 0)
+  local _, port = srv:getsockname()
+  srv:close()
+  return port
+end
+
+local function test_1() -- host name
+  local srv, port = server()
+  local cli, err1
+
+  uv.tcp_connect_any("localhost", port, function(tcp, err)
+    cli, err1 = tcp, err
+    srv:close()
+  end)
+
+  uv.run()
+
+  assert(not err1, tostring(err1))
+  assert(cli and cli:getpeername() == host)
+  cli:close()
+  uv.run()
+end
+
+local function test_2() -- failed attempt starts next one without delay
+  local srv, port = server()
+  local cli, err1
+
+  -- server listens only on 127.0.0.1 so first attempt refused
+  local t = uv.hrtime()
+  uv.tcp_connect_any({"127.0.0.2", host}, port, {delay = 5000}, function(tcp, err)
+    cli, err1 = tcp, err
+    srv:close()
+  end)
+
+  uv.run()
+
+  assert(not err1, tostring(err1))
+  assert(cli:getpeername() == host)
+  cli:close()
+  uv.run()
+
+  -- not waited for 5 sec
+  assert((uv.hrtime() - t) / 1e6 < 4000)
+end
+
+local function test_3() -- all attempts failed
+  local port = closed_port()
+  local err1, called = nil, 0
+
+  uv.tcp_connect_any({host, "127.0.0.3"}, port, {delay = 10}, function(tcp, err)
+    called = called + 1
+    assert(tcp == nil)
+    err1 = err
+  end)
+
+  uv.run()
+
+  assert(called == 1)
+  assert(err1 and err1:name() == 'ECONNREFUSED', tostring(err1))
+
+  uv.tcp_connect_any("lluv-no-such-host.invalid", port, function(tcp, err)
+    called = called + 1
+    assert(tcp == nil)
+    err1 = err
+  end)
+
+  uv.run()
+
+  assert(called == 2 and err1)
+end
+
+local function test_4() -- stalled attempt does not block next one
+  local srv, port, accepted = server()
+  local cli
+
+  -- non routable address. Attempt hangs or fails
+  uv.tcp_connect_any({"10.255.255.1", host}, port, {delay = 50}, function(tcp, err)
+    assert(not err, tostring(err))
+    cli = tcp
+    srv:close()
+  end)
+
+  uv.run()
+
+  assert(cli and cli:getpeername() == host)
+  assert(accepted() == 1)
+  cli:close()
+  uv.run()
+
+  -- loser attempt and delay timer closed
+  assert(#uv.handles() == 0)
+end
+
+local function test_5() -- coroutine
+  local srv, port = server()
+  local ok
+
+  coroutine.wrap(function()
+    local tcp, err = uv.tcp_connect_any({host}, port, (coroutine.running()))
+    assert(not err, tostring(err))
+    tcp:close()
+    srv:close()
+    ok = true
+  end)()
+
+  uv.run()
+  assert(ok)
+end
+
+test_1()
+test_2()
+test_3()
+test_4()
+test_5()
+
+print("Done!")
@@ -0,0 +1,96 @@
+local uv = require "lluv"
+
+local function test_1() -- tcp echo via coroutine
+  local host, port = "127.0.0.1", 5555
+
+  local srv = uv.tcp():bind(host, port):listen(function(srv, err)
+    assert(not err, tostring(err))
+    local cli = srv:accept()
+    cli:start_read(function(cli, err, data)
+      if err then return cli:close() end
+      cli:write(data)
+    end)
+  end)
+
+  local result
+  coroutine.wrap(function()
+    local cli, err = uv.tcp():connect(host, port, (coroutine.running()))
+    assert(not err, tostring(err))
+
+    local _, err = cli:write("hello", (coroutine.running()))
+    assert(_ == cli)
+    assert(not err, tostring(err))
+
+    local _, err, data = cli:read((coroutine.running()))
+    assert(_ == cli)
+    assert(not err, tostring(err))
+
+    result = data
+
+    cli:close()
+    srv:close()
+  end)()
+
+  assert(result == nil)
+
+  uv.run()
+
+  assert(result == "hello", result)
+end
+
+local function test_2() -- fs via coroutine
+  local fname = "./test-coroutine.txt"
+  local result
+  coroutine.wrap(function()
+    local co = coroutine.running()
+
+    local f, err = uv.fs_open(fname, "w+", co)
+    assert(f, tostring(err))
+
+    local _, err = f:write("hello", co)
+    assert(_ == f)
+    assert(not err, tostring(err))
+
+    local _, err, buf, size = f:read(5, 0, co)
+    assert(not err, tostring(err))
+    result = buf:to_s(0, size)
+
+    f:close(co)
+
+    local _, err = uv.fs_unlink(fname, co)
+    assert(not err, tostring(err))
+  end)()
+
+  uv.run()
+
+  assert(result == "hello", result)
+end
+
+local function test_3() -- error delivered to coroutine
+  local flag
+  coroutine.wrap(function()
+    local cli, err = uv.tcp():connect("127.0.0.1", 5556, (coroutine.running()))
+    assert(err)
+    cli:close()
+    flag = true
+  end)()
+
+  uv.run()
+
+  assert(flag)
+end
+
+local function test_4() -- only suspended coroutine accepted
+  local co = coroutine.create(function() end)
+  assert(not pcall(uv.fs_stat, "./", co))
+end
+
+test_1()
+
+test_2()
+
+test_3()
+
+test_4()
+
+print("Done!")
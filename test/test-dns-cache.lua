@@ -0,0 +1,184 @@
+local uv = require "lluv"
+
+local function test_1() -- cache hit and coalesced requests
+  uv.dns_cache{flush = true}
+  local s0 = uv.dns_cache()
+  assert(s0.enabled == true and s0.size == 0)
+
+  local results = {}
+  for i = 1, 3 do
+    uv.getaddrinfo("localhost", function(loop, err, res)
+      assert(not err, tostring(err))
+      results[#results + 1] = res
+    end)
+  end
+
+  uv.run()
+
+  assert(#results == 3)
+  assert(results[1] ~= results[2] and results[2] ~= results[3])
+  assert(results[1][1].address == results[2][1].address)
+
+  -- modify own copy
+  local address = results[1][1].address
+  table.remove(results[1], 1)
+  results[2][1].address = "0.0.0.0"
+
+  local s = uv.dns_cache()
+  assert(s.size == 1)
+  assert(s.misses - s0.misses == 1)
+  assert(s.coalesced - s0.coalesced == 2)
+
+  local hit
+  uv.getaddrinfo("localhost", function(loop, err, res)
+    assert(not err)
+    hit = res
+  end)
+
+  uv.run()
+
+  assert(hit ~= results[1] and hit ~= results[3])
+  assert(#hit == #results[3] and hit[1].address == address)
+  assert(uv.dns_cache().hits - s.hits == 1)
+end
+
+local function test_2() -- negative entries
+  uv.dns_cache{flush = true}
+
+  local e1, e2
+  uv.getaddrinfo("lluv-no-such-host.invalid", function(loop, err, res)
+    assert(err and not res)
+    e1 = err
+  end)
+
+  uv.run()
+
+  local s = uv.dns_cache()
+
+  uv.getaddrinfo("lluv-no-such-host.invalid", function(loop, err, res)
+    assert(err and not res)
+    e2 = err
+  end)
+
+  uv.run()
+
+  assert(e1 and e2)
+  if e1:name() == 'EAI_NONAME' or e1:name() == 'EAI_NODATA' then
+    assert(uv.dns_cache().hits - s.hits == 1)
+    assert(e1 == e2)
+  end
+end
+
+local function test_3() -- ttl, size limit and disable
+  local s = uv.dns_cache{ttl = 20, max_entries = 1, flush = true}
+  assert(s.ttl == 20 and s.max_entries == 1 and s.size == 0)
+
+  uv.getaddrinfo("localhost", function() end)
+  uv.getaddrinfo("127.0.0.1", function() end)
+  uv.run()
+  assert(uv.dns_cache().size == 1)
+
+  local misses = uv.dns_cache().misses
+  uv.timer():start(50, function()
+    uv.getaddrinfo("127.0.0.1", function() end)
+  end)
+  uv.run()
+  assert(uv.dns_cache().misses - misses == 1)
+
+  s = uv.dns_cache(false)
+  assert(s.enabled == false and s.size == 0)
+  uv.getaddrinfo("127.0.0.1", function() end)
+  uv.run()
+  assert(uv.dns_cache().size == 0)
+
+  uv.dns_cache(true)
+  uv.dns_cache{ttl = 60000, max_entries = 1024}
+end
+
+local function test_4() -- tcp connect with host name
+  local addresses
+  uv.getaddrinfo("localhost", {family = "unspec", socktype = "stream"}, function(loop, err, res)
+    assert(not err, tostring(err))
+    addresses = res
+  end)
+  uv.run()
+
+  -- only first resolved address used, bound handle keeps its socket
+  local server = uv.tcp():bind(addresses[1].address, 0)
+  local _, port = server:getsockname()
+
+  local accepted
+  server:listen(function(server, err)
+    assert(not err)
+    accepted = server:accept()
+    accepted:close()
+    server:close()
+  end)
+
+  local connected
+  local cli = uv.tcp():bind(addresses[1].address, 0)
+  local _, cli_port = cli:getsockname()
+  cli:connect("localhost", port, function(cli, err)
+    connected = err or true
+    local _, p = cli:getsockname()
+    assert(p == cli_port)
+    cli:close()
+  end)
+
+  uv.run()
+
+  assert(connected == true, tostring(connected))
+  assert(accepted)
+
+  local err1
+  uv.tcp():connect("lluv-no-such-host.invalid", 1, function(cli, err)
+    err1 = err
+    cli:close()
+  end)
+
+  uv.run()
+
+  assert(err1)
+
+  -- closed while resolving
+  local err2
+  cli = uv.tcp()
+  cli:connect("localhost", 1, function(cli, err)
+    err2 = err
+  end)
+  cli:close()
+
+  uv.run()
+
+  assert(err2 and err2:name() == 'ECANCELED', tostring(err2))
+end
+
+local function test_5() -- coroutine
+  local done
+  local co = coroutine.wrap(function()
+    local loop, err, res = uv.getaddrinfo("localhost", (coroutine.running()))
+    assert(not err and res[1].address)
+    done = true
+  end)
+  co()
+  uv.run()
+  assert(done)
+
+  -- handle closed while resolving resumes coroutine
+  local cli, err1 = uv.tcp()
+  coroutine.wrap(function()
+    local _, err = cli:connect("localhost", 1, (coroutine.running()))
+    err1 = err
+  end)()
+  cli:close()
+  uv.run()
+  assert(err1 and err1:name() == 'ECANCELED', tostring(err1))
+end
+
+test_1()
+test_2()
+test_3()
+test_4()
+test_5()
+
+print("Done!")
@@ -0,0 +1,394 @@
+local uv  = require "lluv"
+local dns = require "lluv.dns"
+
+local host = "127.0.0.1"
+
+local function u16(s, i)
+  local a, b = s:byte(i, i + 1)
+  return a * 256 + b
+end
+
+local function p16(n)
+  return string.char(math.floor(n / 256) % 256, n % 256)
+end
+
+local function p32(n)
+  return p16(math.floor(n / 65536)) .. p16(n % 65536)
+end
+
+local function encode_name(name)
+  local t = {}
+  for label in name:gmatch("[^.]+") do t[#t + 1] = string.char(#label) .. label end
+  return table.concat(t) .. "\0"
+end
+
+local function parse_query(msg)
+  local labels, pos = {}, 13
+  while msg:byte(pos) ~= 0 do
+    local len = msg:byte(pos)
+    labels[#labels + 1] = msg:sub(pos + 1, pos + len)
+    pos = pos + len + 1
+  end
+  local qtype = u16(msg, pos + 1)
+  return u16(msg, 1), table.concat(labels, "."), qtype, msg:sub(13, pos + 4)
+end
+
+local RDATA = {
+  [1]  = function(v) return string.char(v:match("(%d+)%.(%d+)%.(%d+)%.(%d+)")) end;
+  [28] = function(v)
+    local t = {}
+    for x in v:gmatch("[^:]+") do t[#t + 1] = tonumber(x, 16) end
+    local s = ""
+    for i = 1, 8 do s = s .. p16(t[i] or 0) end
+    return s
+  end;
+  [12] = encode_name;
+  [33] = function(v) return p16(v[1]) .. p16(v[2]) .. p16(v[3]) .. encode_name(v[4]) end;
+}
+
+-- zone: name => {[qtype] = {values}} or false for NXDOMAIN
+local function build_response(msg, zone, tc)
+  local id, name, qtype, question = parse_query(msg)
+  local e = zone[name:lower()]
+  local answers = {}
+
+  local rcode = 0
+  if e == false then rcode = 3
+  elseif e == 'servfail' then rcode = 2
+  elseif e then
+    local values = e[qtype] or {}
+    for i = 1, #values do
+      local rdata = RDATA[qtype](values[i])
+      answers[#answers + 1] = "\192\12" .. p16(qtype) .. "\0\1" .. p32(300) .. p16(#rdata) .. rdata
+    end
+  else rcode = 3 end
+
+  if tc then answers = {} end
+  local flags = 0x8180 + rcode + (tc and 0x200 or 0)
+  return p16(id) .. p16(flags) .. "\0\1" .. p16(#answers) .. "\0\0\0\0" .. question .. table.concat(answers)
+end
+
+-- stand in DNS server. opt.drop(n) - ignore n-th query, opt.tc - truncate all UDP responses
+local function server(zone, opt)
+  opt = opt or {}
+  local srv = uv.udp():bind(host, 0)
+  local _, port = srv:getsockname()
+  local stat = {udp = 0, tcp = 0, ports = {}, port = port}
+
+  local queue = {}
+  srv:start_recv(function(self, err, data, flags, h, p)
+    assert(not err, tostring(err))
+    stat.udp = stat.udp + 1
+    stat.ports[p] = true
+    if opt.drop and opt.drop(stat.udp) then return end
+    local res = build_response(data, zone, opt.tc)
+    if opt.reverse then
+      queue[#queue + 1] = {h, p, res}
+      if #queue == opt.reverse then
+        for i = #queue, 1, -1 do self:send(queue[i][1], queue[i][2], queue[i][3]) end
+        queue = {}
+      end
+      return
+    end
+    self:send(h, p, res)
+  end)
+
+  local tcp = uv.tcp()
+  local ok = pcall(tcp.bind, tcp, host, port)
+  if ok then
+    tcp:listen(function(self, err)
+      assert(not err, tostring(err))
+      local cli, buf = self:accept(), ""
+      cli:start_read(function(cli, err, data)
+        if err then return cli:close() end
+        buf = buf .. data
+        if #buf >= 2 and #buf >= u16(buf, 1) + 2 then
+          stat.tcp = stat.tcp + 1
+          local res = build_response(buf:sub(3), zone)
+          cli:write(p16(#res) .. res, function(cli) cli:close() end)
+        end
+      end)
+    end)
+  end
+
+  -- server should not keep loop alive
+  srv:unref() tcp:unref()
+
+  stat.close = function() srv:close() tcp:close() end
+  return stat
+end
+
+local ZONE = {
+  ["example.test"]         = {[1] = {"10.0.0.1", "10.0.0.2"}, [28] = {"fd00:0:0:0:0:0:0:1"}};
+  ["v4only.example.test"]  = {[1] = {"10.0.0.3"}};
+  ["_sip._udp.example.test"] = {[33] = {{10, 60, 5060, "sip.example.test"}}};
+  ["1.0.0.10.in-addr.arpa"] = {[12] = {"example.test"}};
+  ["www.corp.test"]        = {[1] = {"10.1.1.1"}};
+  ["missing.test"]         = false;
+  ["broken.test"]          = 'servfail';
+}
+
+local function resolver(srv, opt)
+  opt = opt or {}
+  opt.servers     = opt.servers or {host .. ":" .. srv.port}
+  opt.resolv_conf = opt.resolv_conf or false
+  opt.hosts       = opt.hosts or false
+  opt.timeout     = opt.timeout or 200
+  return dns.new(opt)
+end
+
+local function test_1() -- A, AAAA, SRV, PTR
+  local srv = server(ZONE)
+  local r = resolver(srv)
+  local results = {}
+
+  r:query("example.test", "A", function(self, err, records)
+    assert(not err, tostring(err))
+    results.a = records
+  end)
+
+  r:resolve("example.test", function(self, err, addresses)
+    assert(not err, tostring(err))
+    results.addr = addresses
+  end)
+
+  r:query("_sip._udp.example.test", "SRV", function(self, err, records)
+    assert(not err, tostring(err))
+    results.srv = records
+  end)
+
+  r:reverse("10.0.0.1", function(self, err, names)
+    assert(not err, tostring(err))
+    results.ptr = names
+  end)
+
+  r:query("missing.test", "A", function(self, err, records)
+    assert(err and err:name() == 'EAI_NONAME', tostring(err))
+    results.nx = true
+  end)
+
+  r:query("v4only.example.test", "AAAA", function(self, err, records)
+    assert(err and err:name() == 'EAI_NODATA', tostring(err))
+    results.nodata = true
+  end)
+
+  r:resolve("v4only.example.test", function(self, err, addresses)
+    assert(not err, tostring(err))
+    results.v4only = addresses
+  end)
+
+  uv.run()
+
+  assert(#results.a == 2 and results.a[1].address == "10.0.0.1" and results.a[2].address == "10.0.0.2")
+  assert(results.a[1].ttl == 300 and results.a[1].type == 'A')
+
+  assert(#results.addr == 3)
+  assert(results.addr[1].family == 'inet6' and results.addr[1].address == "fd00::1")
+  assert(results.addr[2].family == 'inet'  and results.addr[2].address == "10.0.0.1")
+
+  assert(results.srv[1].target == "sip.example.test" and results.srv[1].port == 5060)
+  assert(results.srv[1].priority == 10 and results.srv[1].weight == 60)
+
+  assert(results.ptr[1] == "example.test")
+  assert(results.nx and results.nodata)
+  assert(#results.v4only == 1 and results.v4only[1].address == "10.0.0.3")
+
+  r:close()
+  srv.close()
+  uv.run()
+end
+
+local function test_2() -- pipelining over few sockets
+  local N = 50
+  local srv = server(ZONE, {reverse = N})
+  local r = resolver(srv, {sockets = 2})
+  local done = 0
+
+  for i = 1, N do
+    r:query("example.test", i % 2 == 0 and "A" or "AAAA", function(self, err, records)
+      assert(not err, tostring(err))
+      assert(records[1].type == (i % 2 == 0 and "A" or "AAAA"))
+      done = done + 1
+      if done == N then srv.close() end
+    end)
+  end
+
+  uv.run()
+
+  assert(done == N)
+  assert(srv.udp == N)
+  local ports = 0
+  for _ in pairs(srv.ports) do ports = ports + 1 end
+  assert(ports <= 2, ports)
+
+  r:close()
+  uv.run()
+end
+
+local function test_3() -- retry after timeout, SERVFAIL
+  local srv = server(ZONE, {drop = function(n) return n == 1 end})
+  local r = resolver(srv, {timeout = 100, attempts = 2})
+  local res, err2
+
+  r:query("example.test", "A", function(self, err, records)
+    assert(not err, tostring(err))
+    res = records
+  end)
+
+  uv.run()
+  assert(res and srv.udp == 2)
+
+  r:query("broken.test", "A", function(self, err, records)
+    err2 = err
+  end)
+
+  uv.run()
+  assert(err2 and err2:name() == 'EAI_AGAIN', tostring(err2))
+  assert(srv.udp == 4)
+
+  local err3
+  srv.close()
+  r:query("example.test", "A", function(self, err, records)
+    err3 = err
+  end)
+
+  uv.run()
+  assert(err3, 'timeout expected')
+
+  r:close()
+  uv.run()
+end
+
+local function test_4() -- truncated response repeated over TCP
+  local srv = server(ZONE, {tc = true})
+  local r = resolver(srv)
+  local res
+
+  r:query("example.test", "A", function(self, err, records)
+    assert(not err, tostring(err))
+    res = records
+  end)
+
+  uv.run()
+
+  assert(res and #res == 2)
+  assert(srv.udp == 1 and srv.tcp == 1)
+
+  r:close()
+  srv.close()
+  uv.run()
+end
+
+local function test_5() -- resolv.conf, hosts file and search domains
+  local srv = server(ZONE)
+  local resolv_conf, hosts = "./dns.resolv.conf", "./dns.hosts"
+
+  local f = assert(io.open(resolv_conf, "w"))
+  f:write("# test\nnameserver " .. host .. "\nsearch corp.test\noptions timeout:1 attempts:3 ndots:1\n")
+  f:close()
+
+  f = assert(io.open(hosts, "w"))
+  f:write("127.0.0.1 localhost\n10.9.9.9   myhost.local myhost # comment\n::1 localhost ip6-localhost\n")
+  f:close()
+
+  -- server port is not 53 so override nameserver
+  local r = dns.new{resolv_conf = resolv_conf, hosts = hosts, servers = {{host, srv.port}}}
+  local results = {}
+
+  r:resolve("myhost", function(self, err, addresses)
+    assert(not err, tostring(err))
+    results.hosts = addresses
+  end)
+
+  r:resolve("localhost", function(self, err, addresses)
+    assert(not err, tostring(err))
+    results.localhost = addresses
+  end)
+
+  r:reverse("10.9.9.9", function(self, err, names)
+    assert(not err, tostring(err))
+    results.ptr = names
+  end)
+
+  r:query("www", "A", function(self, err, records)
+    assert(not err, tostring(err))
+    results.search = records
+  end)
+
+  uv.run()
+
+  assert(#results.hosts == 1 and results.hosts[1].address == "10.9.9.9")
+  assert(#results.localhost == 2 and results.localhost[1].address == "::1")
+  assert(results.ptr[1] == "myhost.local" and results.ptr[2] == "myhost")
+  assert(results.search[1].address == "10.1.1.1" and results.search[1].name == "www.corp.test")
+
+  assert(r._conf.attempts == 3 and r._conf.timeout == 1000)
+
+  r:close()
+  srv.close()
+  uv.run()
+
+  os.remove(resolv_conf)
+  os.remove(hosts)
+end
+
+local function test_6() -- close cancels pending queries
+  local srv = server(ZONE, {drop = function() return true end})
+  local r = resolver(srv)
+  local err1
+
+  r:query("example.test", "A", function(self, err)
+    err1 = err
+  end)
+
+  uv.timer():start(50, function() r:close() end)
+
+  uv.run()
+
+  assert(err1 and err1:name() == 'ECANCELED', tostring(err1))
+  srv.close()
+  uv.run()
+end
+
+local function test_7() -- random ids, sockets replaced to change source port
+  local N = 40
+  local srv = server(ZONE, {reverse = N})
+  local r = resolver(srv, {sockets = 2, socket_queries = 5})
+  local done = 0
+
+  if uv.random then
+    local a, b = uv.random(16), uv.random(16)
+    assert(#a == 16 and #b == 16 and a ~= b)
+  end
+
+  for i = 1, N do
+    r:query("example.test", "A", function(self, err, records)
+      assert(not err, tostring(err))
+      assert(records[1].type == "A")
+      done = done + 1
+      if done == N then srv.close() end
+    end)
+  end
+
+  -- responses held by server until all queries received,
+  -- so retired sockets have to wait for them
+  uv.run()
+
+  assert(done == N)
+  local ports = 0
+  for _ in pairs(srv.ports) do ports = ports + 1 end
+  assert(ports >= N / 5, ports)
+
+  r:close()
+  uv.run()
+end
+
+test_1()
+test_2()
+test_3()
+test_4()
+test_5()
+test_6()
+test_7()
+
+print("Done!")
@@ -0,0 +1,171 @@
+local uv = require "lluv"
+
+local function test_1() -- typed accessors
+  local buf = uv.buffer(32)
+
+  assert(buf:set_u8(0, 0xFF) == 1)
+  assert(buf:get_u8(0) == 0xFF)
+  assert(buf:get_i8(0) == -1)
+
+  assert(buf:set_u16be(0, 0x0102) == 2)
+  assert(buf:to_s(0, 2) == "\1\2")
+  assert(buf:get_u16le(0) == 0x0201)
+  assert(buf:get_u16be(0) == 0x0102)
+
+  assert(buf:set_i32le(4, -2) == 8)
+  assert(buf:to_s(4, 4) == "\254\255\255\255")
+  assert(buf:get_i32le(4) == -2)
+  assert(buf:get_u32le(4) == 0xFFFFFFFE)
+
+  assert(buf:set_u32be(4, 0xDEADBEEF) == 8)
+  assert(buf:get_u32be(4) == 0xDEADBEEF)
+
+  assert(buf:set_i64be(8, -3) == 16)
+  assert(buf:get_i64be(8) == -3)
+  assert(buf:set_i64le(8, 0x0102030405) == 16)
+  assert(buf:to_s(8, 8) == "\5\4\3\2\1\0\0\0")
+
+  assert(buf:set_f64be(16, 1.5) == 24)
+  assert(buf:get_f64be(16) == 1.5)
+  assert(buf:set_f32le(24, -0.25) == 28)
+  assert(buf:get_f32le(24) == -0.25)
+
+  assert(not pcall(buf.set_u32le, buf, 30, 1))
+  assert(not pcall(buf.get_u8, buf, 32))
+end
+
+local function test_2() -- varint
+  local buf = uv.buffer(16)
+
+  assert(buf:set_varint(0, 300) == 2)
+  assert(buf:to_s(0, 2) == "\172\2")
+  local v, off = buf:get_varint(0)
+  assert(v == 300 and off == 2)
+
+  assert(buf:set_svarint(0, -123456) == 3)
+  v, off = buf:get_svarint(0)
+  assert(v == -123456 and off == 3)
+
+  assert(buf:set_varint(14, 0x80) == 16)
+  assert(buf:get_varint(14) == 0x80)
+
+  -- not enough data
+  assert(buf:set_u8(15, 0x80))
+  assert(buf:get_varint(15) == nil)
+end
+
+local function test_3() -- pack/unpack
+  local buf = uv.buffer(64)
+
+  local off = buf:pack(0, ">I2 B i4 <d s1 z c3 v V",
+    0x1234, 7, -5, 2.5, "abc", "zero", "xy", 1000, -1000
+  )
+
+  local a, b, c, d, e, f, g, h, i, n = buf:unpack(0, ">I2 B i4 <d s1 z c3 v V")
+  assert(a == 0x1234)
+  assert(b == 7)
+  assert(c == -5)
+  assert(d == 2.5)
+  assert(e == "abc")
+  assert(f == "zero")
+  assert(g == "xy\0")
+  assert(h == 1000)
+  assert(i == -1000)
+  assert(n == off)
+
+  assert(buf:to_s(0, 3) == "\18\52\7")
+
+  assert(not pcall(buf.pack, buf, 60, "I8", 1))
+  assert(not pcall(buf.unpack, buf, 0, "y"))
+end
+
+local function test_4() -- slices
+  local buf = uv.buffer(16)
+  buf:pack(0, "c16", "0123456789abcdef")
+
+  local s1 = buf:slice(4, 8)
+  assert(s1:size() == 8)
+  assert(s1:to_s() == "456789ab")
+  assert(s1:parent() == buf)
+  assert(buf:parent() == nil)
+
+  local s2 = s1:slice(2)
+  assert(s2:to_s() == "6789ab")
+  assert(s2:parent() == buf)
+
+  -- slices share memory with parent
+  s2:set_u8(0, 0x41)
+  assert(buf:to_s(6, 1) == "A")
+
+  assert(buf:slice(16):size() == 0)
+  assert(not pcall(buf.slice, buf, 17))
+  assert(not pcall(buf.slice, buf, 8, 9))
+
+  -- slice keeps memory alive
+  s1 = uv.buffer(8):slice(2, 4)
+  collectgarbage("collect")
+  assert(s1:set_u32le(0, 1) == 4)
+
+  s1:free()
+  assert(s1:size() == 0)
+end
+
+local function test_5() -- write slices
+  local fname = "./test-fbuf.txt"
+  local buf = uv.buffer(16)
+  buf:pack(0, "c16", "0123456789abcdef")
+
+  local result
+  uv.fs_open(fname, "w+", function(f, err)
+    assert(not err, tostring(err))
+    f:write(buf:slice(10), function(f, err)
+      assert(not err, tostring(err))
+      local dst = uv.buffer(16)
+      f:read(dst:slice(4, 6), 0, function(f, err, b, size)
+        assert(not err, tostring(err))
+        assert(size == 6)
+        result = dst:to_s(4, size)
+        f:close(function() uv.fs_unlink(fname) end)
+      end)
+    end)
+  end)
+
+  uv.run()
+  assert(result == "abcdef", result)
+
+  local host, port = "127.0.0.1", 5555
+  local srv = uv.tcp():bind(host, port):listen(function(srv, err)
+    assert(not err, tostring(err))
+    local cli, data = srv:accept(), ""
+    cli:start_read(function(cli, err, chunk)
+      if err then
+        result = data
+        cli:close()
+        return srv:close()
+      end
+      data = data .. chunk
+    end)
+  end)
+
+  uv.tcp():connect(host, port, function(cli, err)
+    assert(not err, tostring(err))
+    cli:write(buf:slice(0, 2))
+    cli:write({buf:slice(2, 2), "--", buf:slice(14)})
+    cli:write(buf:slice(4, 2), function(cli) cli:close() end)
+  end)
+
+  uv.run()
+  assert(result == "0123--ef45", result)
+end
+
+test_1()
+
+test_2()
+
+test_3()
+
+test_4()
+
+test_5()
+
+print("Done!")
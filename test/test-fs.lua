@@ -137,6 +137,593 @@ it("unlink async bad file", function()
   assert_true(run_flag)
 end)
 
+
+it("readfile sync", function()
+  local data, path = assert_string(uv.fs_readfile(TEST_FILE))
+  assert_equal(TEST_DATA, data)
+  assert_equal(TEST_FILE, path)
+end)
+
+it("readfile async", function()
+  local run_flag = false
+
+  assert_true(uv.fs_readfile(TEST_FILE, function(...)
+    run_flag = true
+    assert_equal(4, select("#", ...))
+    local loop, err, data, path = ...
+    assert_userdata(loop)
+    assert_nil(err)
+    assert_equal(TEST_DATA, data)
+    assert_equal(TEST_FILE, path)
+  end))
+
+  assert_equal(0, uv.run())
+
+  assert_true(run_flag)
+end)
+
+it("readfile async as buffer", function()
+  local run_flag = false
+
+  assert_true(uv.fs_readfile(TEST_FILE, {buffer = true}, function(loop, err, buf)
+    run_flag = true
+    assert_nil(err)
+    assert_userdata(buf)
+    assert_equal(#TEST_DATA, buf:size())
+    assert_equal(TEST_DATA, buf:to_s())
+    buf:free()
+    assert_equal(0, buf:size())
+  end))
+
+  assert_equal(0, uv.run())
+
+  assert_true(run_flag)
+end)
+
+it("readfile buffer free with slice", function()
+  local run_flag = false
+
+  assert_true(uv.fs_readfile(TEST_FILE, {buffer = true}, function(loop, err, buf)
+    assert_nil(err)
+    local s = buf:slice(2, 3)
+    buf:free()
+    assert_equal(0, buf:size())
+    buf = nil
+    collectgarbage() collectgarbage()
+
+    -- slice keeps memory alive
+    assert_equal("234", s:to_s())
+    run_flag = true
+  end))
+
+  assert_equal(0, uv.run())
+
+  assert_true(run_flag)
+end)
+
+it("readfile async bad file", function()
+  local run_flag = false
+
+  assert_true(uv.fs_readfile(BAD_FILE, function(...)
+    run_flag = true
+    assert_equal(2, select("#", ...))
+    local loop, err = ...
+    assert_userdata(loop)
+    assert_not_nil(err)
+  end))
+
+  assert_equal(0, uv.run())
+
+  assert_true(run_flag)
+end)
+
+it("writefile async", function()
+  local run_flag = false
+  local data = ("x"):rep(100000)
+
+  assert_true(uv.fs_writefile(TEST_FILE, data, function(loop, err, path)
+    assert_nil(err)
+    assert_equal(TEST_FILE, path)
+    uv.fs_writefile(TEST_FILE, "tail", "a", function(loop, err)
+      assert_nil(err)
+      run_flag = true
+    end)
+  end))
+
+  assert_equal(0, uv.run())
+
+  assert_true(run_flag)
+  assert_equal(data .. "tail", uv.fs_readfile(TEST_FILE))
+end)
+
+it("writefile sync buffer", function()
+  local buf = uv.buffer(4)
+  buf:pack(0, "c4", "abcd")
+  assert_equal(TEST_FILE, uv.fs_writefile(TEST_FILE, buf:slice(1, 2)))
+  assert_equal("bc", uv.fs_readfile(TEST_FILE))
+  assert_nil(uv.fs_writefile(BAD_FILE .. "/x", buf))
+end)
+
+
+it("mmap read", function()
+  local buf = assert_userdata(uv.fs_mmap(TEST_FILE))
+  assert_equal(#TEST_DATA, buf:size())
+  assert_equal(TEST_DATA, buf:to_s())
+  assert_equal("345", buf:to_s(3, 3))
+  assert_equal(buf, buf:madvise("sequential"))
+
+  local s = buf:slice(2, 4)
+  assert_equal("2345", s:to_s())
+  assert_equal(s, s:madvise("willneed"))
+
+  buf:free()
+  assert_equal(0, buf:size())
+end)
+
+it("mmap free with slice", function()
+  local buf = assert_userdata(uv.fs_mmap(TEST_FILE))
+  local s = buf:slice(0, 4)
+  buf:free()
+  buf = nil
+  collectgarbage() collectgarbage()
+
+  -- slice keeps mapping alive
+  assert_equal("0123", s:to_s())
+  assert_equal(s, s:msync())
+end)
+
+-- number of mappings of test file (nil if not supported)
+local function mapped()
+  local f = io.open("/proc/self/maps")
+  if not f then return end
+  local n = 0
+  for line in f:lines() do
+    if string.find(line, "/test.txt", 1, true) then n = n + 1 end
+  end
+  f:close()
+  return n
+end
+
+it("mmap free unmaps", function()
+  local base = mapped()
+  if not base then return end
+
+  local buf = assert_userdata(uv.fs_mmap(TEST_FILE))
+  assert_equal(base + 1, mapped())
+  buf:free()
+  assert_equal(base, mapped())
+  assert_equal(0, buf:size())
+
+  -- released when last slice freed
+  buf = assert_userdata(uv.fs_mmap(TEST_FILE))
+  local s1, s2 = buf:slice(0, 4), buf:slice(4)
+  local s3 = s1:slice(1, 2)
+  buf:free()
+  assert_equal(base + 1, mapped())
+  s1:free() s2:free()
+  assert_equal(base + 1, mapped())
+  assert_equal("12", s3:to_s())
+  s3:free()
+  assert_equal(base, mapped())
+
+  -- released when pending write done
+  buf = assert_userdata(uv.fs_mmap(TEST_FILE))
+  local run_flag = false
+  assert_true(uv.fs_writefile(BAD_FILE, buf, function(loop, err)
+    assert_nil(err)
+    run_flag = true
+  end))
+  buf:free()
+  assert_equal(base + 1, mapped())
+  assert_equal(0, uv.run())
+  assert_true(run_flag)
+  assert_equal(base, mapped())
+  assert_equal(TEST_DATA, uv.fs_readfile(BAD_FILE))
+  rmfile(BAD_FILE)
+
+  -- released when pending send done
+  buf = assert_userdata(uv.fs_mmap(TEST_FILE))
+  local srv = uv.udp():bind("127.0.0.1", 0)
+  local cli, received = uv.udp()
+  srv:start_recv(function(self, err, data)
+    received = data
+    self:close()
+  end)
+  cli:send("127.0.0.1", select(2, srv:getsockname()), buf:slice(2), function(self, err)
+    assert_nil(err)
+    self:close()
+  end)
+  buf:free()
+  assert_equal(base + 1, mapped())
+  assert_equal(0, uv.run())
+  -- temporary slice pins memory until collected
+  collectgarbage() collectgarbage()
+  assert_equal(base, mapped())
+  assert_equal("23456789", received)
+end)
+
+it("mmap region", function()
+  local buf = assert_userdata(uv.fs_mmap(TEST_FILE, "r", 4, 3))
+  assert_equal("456", buf:to_s())
+  buf:free()
+
+  assert_nil(uv.fs_mmap(TEST_FILE, "r", 4, 100))
+  assert_nil(uv.fs_mmap(TEST_FILE, "r", 100))
+  assert_nil(uv.fs_mmap(BAD_FILE))
+  assert_error(function() uv.fs_mmap(TEST_FILE, "x") end)
+  assert_error(function() uv.buffer(4):msync() end)
+end)
+
+it("mmap write", function()
+  local buf = assert_userdata(uv.fs_mmap(TEST_FILE, "w"))
+  buf:pack(0, "c3", "abc")
+  assert_equal(buf, buf:msync())
+  buf:free()
+  assert_equal("abc3456789", uv.fs_readfile(TEST_FILE))
+
+  buf = assert_userdata(uv.fs_mmap(TEST_FILE, "p"))
+  buf:pack(0, "c3", "xyz")
+  assert_equal("xyz3456789", buf:to_s())
+  buf:free()
+  assert_equal("abc3456789", uv.fs_readfile(TEST_FILE))
+end)
+
+it("mmap file write", function()
+  local run_flag = false
+  local src = assert_userdata(uv.fs_open(TEST_FILE, "r"))
+  local buf = assert_userdata(uv.fs_mmap(src, "r", 2))
+  src:close()
+
+  assert_true(uv.fs_open(BAD_FILE, "w", function(f, err)
+    assert_nil(err)
+    f:write(buf, function(f, err)
+      assert_nil(err)
+      f:close()
+      run_flag = true
+    end)
+  end))
+
+  assert_equal(0, uv.run())
+
+  assert_true(run_flag)
+  assert_equal("23456789", uv.fs_readfile(BAD_FILE))
+  buf:free()
+  rmfile(BAD_FILE)
+end)
+
+
+it("stream_read in order", function()
+  local data = {}
+  for i = 1, 1000 do data[#data + 1] = ("%.4d;"):format(i) end
+  data = table.concat(data)
+  assert_equal(TEST_FILE, uv.fs_writefile(TEST_FILE, data))
+
+  local f = assert_userdata(uv.fs_open(TEST_FILE, "r"))
+  local chunks, position, result = {}, 0
+
+  assert_true(f:stream_read({chunk = 100, depth = 8}, function(self, err, chunk, pos)
+    assert_equal(f, self)
+    if err then
+      result = err
+      return
+    end
+    assert_equal(position, pos)
+    position = position + #chunk
+    chunks[#chunks + 1] = chunk
+  end))
+
+  assert_equal(0, uv.run())
+  f:close()
+
+  assert_not_nil(result)
+  assert_equal("EOF", result:name())
+  assert_equal(50, #chunks)
+  assert_equal(data, table.concat(chunks))
+end)
+
+it("stream_read region", function()
+  local f = assert_userdata(uv.fs_open(TEST_FILE, "r"))
+  local chunks, result = {}
+
+  assert_true(f:stream_read({chunk = 2, depth = 3, position = 3, length = 5}, function(self, err, chunk)
+    if err then result = err return end
+    chunks[#chunks + 1] = chunk
+  end))
+
+  assert_equal(0, uv.run())
+  f:close()
+
+  assert_equal("EOF", result:name())
+  assert_equal("34567", table.concat(chunks))
+end)
+
+it("stream_read short read is EOF", function()
+  local data = ("0123456789"):rep(25)
+  assert_equal(TEST_FILE, uv.fs_writefile(TEST_FILE, data))
+
+  local f = assert_userdata(uv.fs_open(TEST_FILE, "r"))
+  local chunks, result = {}
+
+  assert_true(f:stream_read({chunk = 100, depth = 1}, function(self, err, chunk)
+    if err then result = err return end
+    chunks[#chunks + 1] = chunk
+    if #chunk < 100 then
+      -- file grows after short read. This data should not be read
+      local h = assert(io.open(TEST_FILE, "ab"))
+      h:write(data) h:close()
+    end
+  end))
+
+  assert_equal(0, uv.run())
+  f:close()
+
+  assert_equal("EOF", result:name())
+  assert_equal(3, #chunks)
+  assert_equal(data, table.concat(chunks))
+end)
+
+it("stream_read callback error", function()
+  local data = ("0123456789"):rep(100)
+  assert_equal(TEST_FILE, uv.fs_writefile(TEST_FILE, data))
+
+  local f = assert_userdata(uv.fs_open(TEST_FILE, "r"))
+  local calls = 0
+
+  assert_true(f:stream_read({chunk = 100, depth = 4}, function(self, err, chunk)
+    calls = calls + 1
+    error("stop read")
+  end))
+
+  assert_error(function() uv.run() end)
+  uv.run()
+  f:close()
+
+  -- rest of chunks and EOF are not delivered
+  assert_equal(1, calls)
+end)
+
+it("stream_read to stream", function()
+  local data = ("0123456789"):rep(10000)
+  assert_equal(TEST_FILE, uv.fs_writefile(TEST_FILE, data))
+
+  local host, port = "127.0.0.1", 5555
+  local received, total = {}
+
+  local srv = uv.tcp():bind(host, port):listen(function(srv, err)
+    assert_nil(err)
+    local cli = srv:accept()
+    cli:start_read(function(cli, err, chunk)
+      if err then
+        cli:close()
+        return srv:close()
+      end
+      received[#received + 1] = chunk
+    end)
+  end)
+
+  uv.tcp():connect(host, port, function(cli, err)
+    assert_nil(err)
+    local f = assert_userdata(uv.fs_open(TEST_FILE, "r"))
+    f:stream_read({chunk = 4096, depth = 4, stream = cli}, function(self, err, n)
+      assert_nil(err)
+      total = n
+      f:close()
+      cli:close()
+    end)
+  end)
+
+  assert_equal(0, uv.run())
+
+  assert_equal(#data, total)
+  assert_equal(data, table.concat(received))
+end)
+
+
+it("writev", function()
+  local run_flag = false
+  local buf = uv.buffer(4)
+  buf:pack(0, "c4", "abcd")
+
+  local f = assert_userdata(uv.fs_open(TEST_FILE, "w+"))
+  local t, n = f:writev({"01", buf:slice(1, 2), "23"})
+  assert_table(t)
+  assert_equal(6, n)
+
+  assert_true(f:writev({"45", buf}, 6, function(self, err, t, n)
+    assert_equal(f, self)
+    assert_nil(err)
+    assert_equal(6, n)
+    run_flag = true
+  end))
+
+  assert_equal(0, uv.run())
+  f:close()
+
+  assert_true(run_flag)
+  assert_equal("01bc2345abcd", uv.fs_readfile(TEST_FILE))
+  assert_error(function() f:writev({}) end)
+end)
+
+
+local WALK_ROOT = "./test-walk"
+
+local WALK_FILES = {
+  "a.txt", "b.lua", "d1/c.txt", "d1/d2/e.txt", "d1/d2/f.lua", "skip/g.txt"
+}
+
+local function walk_setup()
+  uv.fs_mkdir(WALK_ROOT)
+  uv.fs_mkdir(WALK_ROOT .. "/d1")
+  uv.fs_mkdir(WALK_ROOT .. "/d1/d2")
+  uv.fs_mkdir(WALK_ROOT .. "/skip")
+  for _, name in ipairs(WALK_FILES) do
+    uv.fs_writefile(WALK_ROOT .. "/" .. name, name)
+  end
+end
+
+local function walk_teardown()
+  for _, name in ipairs(WALK_FILES) do
+    uv.fs_unlink(WALK_ROOT .. "/" .. name)
+  end
+  uv.fs_rmdir(WALK_ROOT .. "/d1/d2")
+  uv.fs_rmdir(WALK_ROOT .. "/d1")
+  uv.fs_rmdir(WALK_ROOT .. "/skip")
+  uv.fs_rmdir(WALK_ROOT)
+end
+
+local function walk(opt)
+  local result, batches, done = {}, 0
+
+  assert_true(uv.fs_walk(WALK_ROOT, opt, function(loop, paths, types, sizes, mtimes)
+    batches = batches + 1
+    assert_equal(#paths, #types)
+    for i = 1, #paths do
+      local name = paths[i]:sub(#WALK_ROOT + 2)
+      result[name] = types[i]
+      if opt.stat then
+        assert_number(sizes[i])
+        assert_number(mtimes[i])
+        if types[i] == "file" then assert_equal(#name, sizes[i]) end
+      end
+    end
+  end, function(loop, err, total)
+    assert_nil(err)
+    done = total
+  end))
+
+  assert_equal(0, uv.run())
+
+  local n = 0
+  for _ in pairs(result) do n = n + 1 end
+  assert_equal(n, done)
+
+  return result, batches
+end
+
+it("walk", function()
+  walk_setup()
+  local ok, err = pcall(function()
+    local t, batches = walk{batch = 2, jobs = 2}
+    assert_equal("file", t["a.txt"])
+    assert_equal("dir",  t["d1"])
+    assert_equal("file", t["d1/d2/f.lua"])
+    assert_equal("file", t["skip/g.txt"])
+    assert_true(batches >= 5)
+
+    t = walk{include = "*.txt", exclude = "skip", stat = true}
+    assert_equal("file", t["a.txt"])
+    assert_equal("file", t["d1/d2/e.txt"])
+    assert_nil(t["b.lua"])
+    assert_nil(t["d1"])
+    assert_nil(t["skip/g.txt"])
+
+    t = walk{include = {"d1/**/*.lua", "b.*"}, depth = 2}
+    assert_equal("file", t["b.lua"])
+    assert_nil(t["d1/d2/f.lua"])
+
+    t = walk{include = {"d1/**/*.lua"}}
+    assert_equal("file", t["d1/d2/f.lua"])
+    assert_nil(t["b.lua"])
+  end)
+  walk_teardown()
+  assert(ok, err)
+end)
+
+it("walk callback error", function()
+  walk_setup()
+  local ok, err = pcall(function()
+    local calls, done_err = 0
+    assert_true(uv.fs_walk(WALK_ROOT, {batch = 1}, function()
+      calls = calls + 1
+      error("stop walk")
+    end, function(loop, err)
+      done_err = err
+    end))
+
+    assert_error(function() uv.run() end)
+    uv.run()
+
+    -- rest of entries are not delivered
+    assert_equal(1, calls)
+    assert_equal("ECANCELED", done_err:name())
+
+    assert_error(function() uv.fs_walk(WALK_ROOT, {include = {"*.txt", 1}}, print, print) end)
+    assert_error(function() uv.fs_walk(WALK_ROOT, {depth = "x"}, print, print) end)
+  end)
+  walk_teardown()
+  assert(ok, err)
+end)
+
+it("walk bad root", function()
+  local run_flag = false
+  assert_true(uv.fs_walk(BAD_FILE, {}, function() assert(false) end, function(loop, err, total)
+    assert_not_nil(err)
+    assert_equal(0, total)
+    run_flag = true
+  end))
+  assert_equal(0, uv.run())
+  assert_true(run_flag)
+end)
+
+
+it("work functions check callback before start", function()
+  assert_error(function() uv.fs_readfile(TEST_FILE, 123) end)
+  assert_error(function() uv.fs_writefile(BAD_FILE, "data", 123) end)
+  assert_error(function() uv.fs_stat_many({TEST_FILE}, 123) end)
+
+  -- data of failed call does not stay pinned
+  local base = mapped()
+  if base then
+    local buf = assert_userdata(uv.fs_mmap(TEST_FILE))
+    assert_error(function() uv.fs_writefile(BAD_FILE, buf, 123) end)
+    buf:free()
+    assert_equal(base, mapped())
+  end
+
+  assert_equal(0, uv.run())
+end)
+
+it("stat_many sync", function()
+  local stats, errors = uv.fs_stat_many({TEST_FILE, BAD_FILE})
+  assert_table(stats)
+  assert_equal(2, #stats)
+  assert_table(stats[1])
+  assert_equal(#TEST_DATA, stats[1].size)
+  assert_false(stats[2])
+
+  assert_table(errors)
+  assert_false(errors[1])
+  assert_equal("ENOENT", errors[2]:name())
+end)
+
+it("stat_many fields async", function()
+  local run_flag = false
+
+  assert_true(uv.fs_stat_many({TEST_FILE, BAD_FILE, "."}, {fields = {"size", "mtime", "type", "error"}}, function(...)
+    run_flag = true
+    assert_equal(6, select("#", ...))
+    local loop, err, sizes, mtimes, types, errors = ...
+    assert_userdata(loop)
+    assert_nil(err)
+    assert_equal(#TEST_DATA, sizes[1])
+    assert_number(mtimes[1])
+    assert_equal("file", types[1])
+    assert_false(errors[1])
+
+    assert_false(sizes[2])
+    assert_false(types[2])
+    assert_not_nil(errors[2])
+    assert_equal("ENOENT", errors[2]:name())
+
+    assert_equal("dir", types[3])
+  end))
+
+  assert_equal(0, uv.run())
+
+  assert_true(run_flag)
+  assert_error(function() uv.fs_stat_many({TEST_FILE}, {fields = {"bad"}}) end)
+end)
+
 end
 
 RUN()
@@ -0,0 +1,29 @@
+local uv = require "lluv"
+
+local function test_1() -- known options return loop
+  local loop = assert(uv.loop())
+
+  assert(loop:configure("metrics_idle_time") == loop)
+
+  -- libuv without io_uring SQPOLL support returns ENOSYS
+  local ok, err = loop:configure("io_uring_sqpoll")
+  if ok then assert(ok == loop)
+  else assert(err:name() == "ENOSYS", tostring(err)) end
+
+  assert(loop:run() == 0)
+  loop:close()
+end
+
+local function test_2() -- unknown option raises
+  local loop = assert(uv.loop())
+
+  assert(not pcall(loop.configure, loop, "no_such_option"))
+  assert(not pcall(loop.configure, loop))
+
+  loop:close()
+end
+
+test_1()
+test_2()
+
+print("Done!")
@@ -0,0 +1,124 @@
+local uv = require "lluv"
+
+local function test_1(mirror) -- basic operations
+  local rb = uv.ringbuf(16, mirror)
+  local cap = rb:capacity()
+  assert(cap >= 16)
+  assert(rb:empty())
+  assert(rb:space() == cap)
+
+  assert(rb:write("hello\r\nworld") == 12)
+  assert(rb:size() == 12)
+  assert(#rb == 12)
+
+  assert(rb:find("\r\n") == 6)
+  assert(rb:find("xx") == nil)
+  assert(rb:peek(5) == "hello")
+  assert(rb:peek(100) == nil)
+
+  assert(rb:read_until("\r\n") == "hello")
+  assert(rb:read_until("\r\n") == nil)
+  assert(rb:read(3) == "wor")
+  assert(rb:read() == "ld")
+  assert(rb:read() == nil)
+  assert(rb:empty())
+
+  -- wrap around end of buffer
+  local s = ("x"):rep(cap - 4)
+  assert(rb:write(s) == cap - 4)
+  assert(rb:consume(cap - 6) == cap - 6)
+  assert(rb:write("0123456789") == 10)
+  assert(rb:read() == "xx0123456789")
+
+  -- full buffer
+  assert(rb:write(("y"):rep(cap + 10)) == cap)
+  assert(rb:full())
+  assert(rb:write("z") == 0)
+  assert(rb:consume(cap + 1) == cap)
+
+  -- fixed buffer as source
+  local buf = uv.buffer(4)
+  buf:pack(0, "c4", "abcd")
+  assert(rb:write(buf:slice(1)) == 3)
+  assert(rb:read() == "bcd")
+
+  local _, n = rb:write_view()
+  assert(n > 0)
+  assert(not pcall(rb.commit, rb, n + 1))
+
+  rb:free()
+  assert(rb:capacity() == 0)
+end
+
+local function test_2() -- stream reads into ring buffer
+  local host, port = "127.0.0.1", 5555
+  local rb = uv.ringbuf(64)
+  local lines = {}
+
+  local srv = uv.tcp():bind(host, port):listen(function(srv, err)
+    assert(not err, tostring(err))
+    srv:accept():start_read(rb, function(cli, err, buf, n)
+      if err then
+        cli:close()
+        return srv:close()
+      end
+      assert(buf == rb)
+      assert(n > 0)
+      while true do
+        local line = buf:read_until("\n")
+        if not line then break end
+        lines[#lines + 1] = line
+      end
+    end)
+  end)
+
+  uv.tcp():connect(host, port, function(cli, err)
+    assert(not err, tostring(err))
+    for i = 1, 100 do
+      cli:write(("line %d\n"):format(i))
+    end
+    cli:close()
+  end)
+
+  uv.run()
+
+  assert(#lines == 100, #lines)
+  for i = 1, 100 do assert(lines[i] == ("line %d"):format(i)) end
+end
+
+local function test_3() -- full buffer stop reading
+  local host, port = "127.0.0.1", 5555
+  local rb = uv.ringbuf(16, false)
+  local result
+
+  local srv = uv.tcp():bind(host, port):listen(function(srv, err)
+    assert(not err, tostring(err))
+    srv:accept():start_read(rb, function(cli, err, buf)
+      if err then
+        result = err
+        cli:close()
+        return srv:close()
+      end
+    end)
+  end)
+
+  uv.tcp():connect(host, port, function(cli, err)
+    assert(not err, tostring(err))
+    cli:write(("x"):rep(1024), function(cli) cli:close() end)
+  end)
+
+  uv.run()
+
+  assert(result and result:name() == "ENOBUFS", tostring(result))
+  assert(rb:full())
+end
+
+test_1()
+
+test_1(false)
+
+test_2()
+
+test_3()
+
+print("Done!")
@@ -0,0 +1,106 @@
+local uv        = require "lluv"
+local statcache = require "lluv.statcache"
+
+local fname = "./test-statcache.txt"
+
+local function test_1() -- cache hit and coalescing
+  assert(uv.fs_writefile(fname, "hello"))
+
+  local cache = statcache.new{ttl = 10000}
+  local n = 0
+
+  local function cb(err, stat)
+    assert(not err, tostring(err))
+    assert(stat.size == 5)
+    n = n + 1
+  end
+
+  cache:stat(fname, cb):stat(fname, cb)
+  assert(n == 0)
+  assert(cache:get(fname) == nil)
+
+  uv.run()
+  assert(n == 2)
+
+  -- from memory
+  assert(cache:get(fname).size == 5)
+  cache:stat(fname, cb)
+  assert(n == 3)
+
+  local missing = "./test-statcache.bad"
+  cache:stat(missing, function(err, stat)
+    assert(err and not stat)
+  end)
+  uv.run()
+  local stat, err = cache:get(missing)
+  assert(stat == false and err)
+
+  cache:close()
+end
+
+local function test_2() -- content and fs_event invalidation
+  assert(uv.fs_writefile(fname, "hello"))
+
+  local cache = statcache.new{ttl = 10000}
+  local result
+
+  cache:read(fname, function(err, data)
+    assert(not err, tostring(err))
+    assert(data == "hello")
+    local _, memory = cache:size()
+    assert(memory == 5)
+
+    cache:read(fname, function(err, data)
+      assert(data == "hello")
+      uv.fs_writefile(fname, "world!", function()
+        -- give watcher time to fire
+        uv.timer():start(200, function(self)
+          self:close()
+          assert(cache:get(fname) == nil, "entry not invalidated")
+          cache:read(fname, function(err, data)
+            result = data
+          end)
+        end)
+      end)
+    end)
+  end)
+
+  uv.run()
+  assert(result == "world!", result)
+
+  cache:close()
+  assert(cache:size() == 0)
+end
+
+local function test_3() -- ttl and limits
+  local cache = statcache.new{ttl = 20, max_entries = 2, watch = false}
+  local done = false
+
+  cache:stat(".", function()
+    cache:stat(fname, function()
+      cache:stat("..", function()
+        assert(cache:size() == 2)
+        -- least recently used evicted
+        assert(cache:get(".") == nil)
+        uv.timer():start(50, function(self)
+          self:close()
+          assert(cache:get(fname) == nil)
+          done = true
+        end)
+      end)
+    end)
+  end)
+
+  uv.run()
+  assert(done)
+end
+
+test_1()
+
+test_2()
+
+test_3()
+
+uv.fs_unlink(fname)
+
+print("Done!")
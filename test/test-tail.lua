@@ -0,0 +1,118 @@
+local uv   = require "lluv"
+local tail = require "lluv.tail"
+
+local fname = "./test-tail.log"
+
+local function append(data)
+  local f = assert(uv.fs_open(fname, "a"))
+  assert(f:write(data))
+  f:close()
+end
+
+local function steps(list)
+  local i = 0
+  local function next_step()
+    i = i + 1
+    if list[i] then
+      list[i]()
+      uv.timer():start(100, function(self) self:close() next_step() end)
+    end
+  end
+  next_step()
+end
+
+local function test_1() -- lines, truncation and rotation
+  uv.fs_unlink(fname)
+  uv.fs_unlink(fname .. ".1")
+  assert(uv.fs_writefile(fname, "old\n"))
+
+  local lines = {}
+  local t = assert(tail(fname, {position = "end"}, function(self, err, chunk)
+    assert(not err, tostring(err))
+    for i = 1, #chunk do lines[#lines + 1] = chunk[i] end
+  end))
+
+  steps{
+    function() end, -- wait until file opened
+    function() append("line 1\nline ") end,
+    function() append("2\n") end,
+    function()
+      assert(#lines == 2, #lines)
+      assert(lines[1] == "line 1")
+      assert(lines[2] == "line 2")
+      -- truncate
+      assert(uv.fs_writefile(fname, "line 3\n"))
+    end,
+    function()
+      assert(lines[3] == "line 3", lines[3])
+      -- rotate. Tail reads rest of old file first
+      append("line 4\n")
+      assert(uv.fs_rename(fname, fname .. ".1"))
+      assert(uv.fs_writefile(fname, "line 5\n"))
+    end,
+    function()
+      assert(lines[4] == "line 4", lines[4])
+      assert(lines[5] == "line 5", lines[5])
+      assert(#lines == 5)
+      t:close()
+    end,
+  }
+
+  uv.run()
+
+  uv.fs_unlink(fname)
+  uv.fs_unlink(fname .. ".1")
+end
+
+local function test_2() -- raw chunks from start, file created later
+  uv.fs_unlink(fname)
+
+  local data = {}
+  local t = assert(tail(fname, {position = "start", lines = false, chunk = 4}, function(self, err, chunk)
+    assert(not err, tostring(err))
+    data[#data + 1] = chunk
+  end))
+
+  steps{
+    function() assert(uv.fs_writefile(fname, "hello world")) end,
+    function()
+      assert(table.concat(data) == "hello world")
+      assert(t:position() == 11)
+      t:close()
+    end,
+  }
+
+  uv.run()
+
+  uv.fs_unlink(fname)
+end
+
+local function test_3() -- alias in core module
+  uv.fs_unlink(fname)
+  assert(uv.fs_writefile(fname, "a\nb"))
+
+  local lines = {}
+  local t = assert(uv.fs_tail(fname, {position = "start"}, function(self, err, chunk)
+    assert(not err, tostring(err))
+    for i = 1, #chunk do lines[#lines + 1] = chunk[i] end
+  end))
+
+  steps{
+    function() end,
+    function()
+      assert(#lines == 1 and lines[1] == "a")
+      assert(t:path() == fname)
+      t:close()
+    end,
+  }
+
+  uv.run()
+
+  uv.fs_unlink(fname)
+end
+
+test_1()
+test_2()
+test_3()
+
+print("Done!")
@@ -0,0 +1,107 @@
+local uv = require "lluv"
+
+local function test_1() -- size can be set only before first use
+  assert(uv.threadpool_size(6) == 6)
+  assert(uv.threadpool_size() == 6)
+
+  uv.fs_stat(".", function() end)
+
+  local ok, err = uv.threadpool_size(8)
+  assert(not ok and err:name() == "EBUSY")
+  assert(uv.threadpool_size() == 6)
+
+  uv.run()
+end
+
+local function test_2() -- per class stats
+  uv.threadpool_stats(true)
+
+  for i = 1, 10 do uv.fs_stat(".", function() end) end
+  uv.fs_readfile("./test-threadpool.lua", function() end)
+  uv.getaddrinfo("127.0.0.1", function() end)
+
+  -- one thread left for dns
+  local s = uv.threadpool_stats()
+  assert(s.fs.limit == 5)
+  assert(s.fs.active == 5 and s.fs.queued == 6)
+  assert(s.dns.active == 1)
+
+  uv.run()
+
+  s = uv.threadpool_stats()
+  assert(s.size == 6)
+  assert(s.fs.submitted == 11 and s.fs.completed == 11)
+  assert(s.fs.active == 0 and s.fs.max_active == 5)
+  assert(s.fs.queued == 0 and s.fs.max_queued == 6)
+  assert(s.fs.time_max >= s.fs.time_avg)
+  assert(s.fs.wait_max >= s.fs.wait_avg)
+  assert(s.fs.queue_wait_max >= s.fs.queue_wait_avg)
+  assert(s.dns.completed == 1)
+  assert(s.dns.limit == nil)
+  assert(s.cpu == nil)
+end
+
+local function test_3() -- queued requests keep order
+  assert(uv.threadpool_limit("fs") == 5)
+  assert(uv.threadpool_limit("fs", 1) == 1)
+  assert(not pcall(uv.threadpool_limit, "dns", 1))
+  uv.threadpool_stats(true)
+
+  local events = {}
+  local f = assert(uv.fs_open("./test-threadpool.lua", "r"))
+  local size = assert(f:stat()).size
+
+  uv.fs_stat(".", function(loop, err) assert(not err) events[#events + 1] = "stat" end)
+  f:read(16, 0, function(self, err, buf, n)
+    assert(not err and n == 16)
+    events[#events + 1] = "read"
+  end)
+  uv.fs_readfile("./test-threadpool.lua", function(loop, err, data)
+    assert(not err and #data == size)
+    events[#events + 1] = "readfile"
+  end)
+  f:close(function(self, err) assert(not err) events[#events + 1] = "close" end)
+
+  local s = uv.threadpool_stats()
+  assert(s.fs.active == 1 and s.fs.queued == 3)
+
+  uv.run()
+
+  assert(table.concat(events, ",") == "stat,read,readfile,close")
+
+  s = uv.threadpool_stats()
+  assert(s.fs.max_active == 1 and s.fs.completed == 4)
+end
+
+local function test_4() -- stream reader waits in queue too
+  local f = assert(uv.fs_open("./test-threadpool.lua", "r"))
+  local size = assert(f:stat()).size
+  local total, done = 0
+
+  uv.threadpool_stats(true)
+
+  f:stream_read({chunk = 64, depth = 4}, function(self, err, chunk)
+    if err then
+      assert(err:name() == "EOF")
+      done = true
+      return
+    end
+    total = total + #chunk
+  end)
+
+  uv.run()
+  f:close()
+
+  assert(done and total == size)
+  local s = uv.threadpool_stats()
+  assert(s.fs.max_active == 1 and s.fs.max_queued == 3)
+
+  assert(uv.threadpool_limit("fs", 0) == 5)
+end
+
+test_1()
+test_2()
+test_3()
+test_4()
+
+print("Done!")
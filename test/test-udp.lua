@@ -0,0 +1,423 @@
+local uv = require "lluv"
+
+local host = "127.0.0.1"
+
+local function bind_any(...)
+  local srv = uv.udp(...):bind(host, 0)
+  local _, port = srv:getsockname()
+  return srv, port
+end
+
+local function test_1(flags) -- batch receive
+  local srv, port = bind_any(flags)
+  local N, received, calls = 100, {}, 0
+
+  srv:start_recv({batch = 16}, function(self, err, items, n)
+    assert(not err, tostring(err))
+    assert(#items == 3 * n)
+    calls = calls + 1
+    for i = 1, #items, 3 do
+      assert(items[i + 1] == host)
+      assert(type(items[i + 2]) == "number")
+      received[#received + 1] = items[i]
+    end
+    if #received == N then self:close() end
+  end)
+
+  local cli = uv.udp()
+  for i = 1, N do cli:try_send(host, port, "message #" .. i) end
+  cli:close()
+
+  uv.run()
+
+  assert(#received == N, #received)
+  assert(calls <= N)
+  for i = 1, N do assert(received[i] == "message #" .. i) end
+end
+
+local function test_2() -- regular receive on recvmmsg handle
+  local srv, port = bind_any{"recvmmsg"}
+  local received = {}
+
+  srv:start_recv(function(self, err, data, flags, h, p)
+    assert(not err, tostring(err))
+    assert(h == host)
+    received[#received + 1] = data
+    if #received == 10 then self:close() end
+  end)
+
+  local cli = uv.udp()
+  for i = 1, 10 do cli:try_send(host, port, "message #" .. i) end
+  cli:close()
+
+  uv.run()
+
+  assert(#received == 10, #received)
+  for i = 1, 10 do assert(received[i] == "message #" .. i) end
+end
+
+local function recv_n(srv, N, received)
+  srv:start_recv(function(self, err, data)
+    assert(not err, tostring(err))
+    received[#received + 1] = data
+    if #received == N then self:close() end
+  end)
+end
+
+local function test_3() -- send batch
+  local srv, port = bind_any()
+  local N, received = 100, {}
+  recv_n(srv, N, received)
+
+  local items = {}
+  for i = 1, N do items[i] = {host, port, "message #" .. i} end
+
+  local sent
+  local cli = uv.udp()
+  cli:send_batch(items, function(self, err)
+    assert(self == cli)
+    assert(not err, tostring(err))
+    sent = true
+    self:close()
+  end)
+
+  uv.run()
+
+  assert(sent)
+  assert(#received == N, #received)
+  for i = 1, N do assert(received[i] == "message #" .. i) end
+end
+
+local function test_4() -- send queue
+  local srv, port = bind_any()
+  local N, received = 50, {}
+  recv_n(srv, N, received)
+
+  local buf = uv.buffer(4)
+  buf:pack(0, "c4", "buff")
+
+  local cli = uv.udp()
+  uv.timer():start(10, function(self)
+    self:close()
+    for i = 1, N - 1 do cli:queue_send(host, port, "message #" .. i) end
+    cli:queue_send(host, port, buf)
+  end)
+
+  local flushed
+  uv.timer():start(100, function(self)
+    self:close()
+    assert(#received == N, #received) -- flushed after first timer callback
+    cli:flush_send(function(self, err)
+      assert(not err, tostring(err))
+      flushed = true
+      self:close()
+    end)
+  end)
+
+  uv.run()
+
+  assert(flushed)
+  assert(#received == N, #received)
+  for i = 1, N - 1 do assert(received[i] == "message #" .. i) end
+  assert(received[N] == "buff")
+end
+
+local function test_5() -- invalid address
+  local cli = uv.udp()
+  local ok
+  cli:send_batch({{"not-an-address", 1, "x"}}, function(self, err)
+    assert(err)
+    ok = true
+    self:close()
+  end)
+  uv.run()
+  assert(ok)
+
+  -- invalid data reported same way as invalid address
+  cli = uv.udp()
+  local res, err = cli:send_batch({{host, 1, true}})
+  assert(res == nil and err and err:name() == "EINVAL", tostring(err))
+
+  ok = false
+  cli:send_batch({{host, 1, true}}, function(self, err)
+    assert(err and err:name() == "EINVAL", tostring(err))
+    ok = true
+  end)
+  uv.run()
+  assert(ok)
+
+  -- error of deferred flush raised from loop
+  cli:queue_send("not-an-address", 1, "x")
+  ok, err = pcall(uv.run)
+  assert(not ok and err, tostring(err))
+  cli:close()
+  uv.run()
+end
+
+local function test_6() -- connected socket
+  local srv, port = bind_any()
+  local other = uv.udp():bind(host, 0)
+  local N, received = 4, {}
+  recv_n(srv, N, received)
+
+  local cli = uv.udp():bind(host, 0):connect(host, port)
+  local h, p = cli:getpeername()
+  assert(h == host and p == port)
+
+  -- only datagrams from peer are received
+  local _, cli_port = cli:getsockname()
+  local got
+  cli:start_recv(function(self, err, data)
+    assert(not err, tostring(err))
+    got = data
+    self:close()
+  end)
+  other:try_send(host, cli_port, "ignored")
+  srv:try_send(host, cli_port, "from peer")
+  other:close()
+
+  assert(cli:try_send("message #1") == 10)
+  cli:send("message #2")
+  cli:send_batch({"message #3"})
+  cli:queue_send("message #4")
+
+  uv.run()
+
+  assert(got == "from peer", got)
+  assert(#received == N, #received)
+  for i = 1, N do assert(received[i] == "message #" .. i) end
+
+  -- disconnect
+  cli = uv.udp():connect(host, port):connect()
+  assert(cli:getpeername() == nil)
+  cli:close()
+  uv.run()
+end
+
+local function test_7(opt) -- segmented send
+  local srv, port = bind_any()
+  local parts = {}
+  for i = 1, 10 do parts[i] = ("%04d"):format(i):rep(250) end
+  parts[11] = ("tail"):rep(125)
+  local data, received = table.concat(parts), {}
+
+  if opt then
+    srv:start_recv(opt, function(self, err, items, n)
+      assert(not err, tostring(err))
+      for i = 1, #items, 3 do received[#received + 1] = items[i] end
+      if #received >= #parts then self:close() end
+    end)
+  else
+    recv_n(srv, #parts, received)
+  end
+
+  local sent
+  local cli = uv.udp()
+  cli:send_segments(host, port, data, 1000, function(self, err)
+    assert(not err, tostring(err))
+    sent = true
+    self:close()
+  end)
+
+  uv.run()
+
+  assert(sent)
+  assert(#received == #parts, #received)
+  for i = 1, #parts do assert(received[i] == parts[i]) end
+
+  -- connected socket and buffer
+  srv, port = bind_any()
+  received = {}
+  recv_n(srv, 3, received)
+
+  local buf = uv.buffer(5)
+  buf:pack(0, "c5", "abcde")
+  cli = uv.udp():connect(host, port)
+  cli:send_segments(buf, 2)
+
+  uv.run()
+  cli:close()
+  uv.run()
+
+  assert(received[1] == "ab" and received[2] == "cd" and received[3] == "e")
+end
+
+local function test_8(flags) -- receive into buffer
+  local srv, port = bind_any(flags)
+  local buf = uv.buffer(flags and 4 * 65536 or 16)
+  local N, received, offsets = 10, {}, {}
+
+  srv:start_recv(buf, function(self, err, b, offset, len, flags, h, p)
+    assert(not err, tostring(err))
+    assert(b == buf)
+    assert(h == host and type(p) == "number")
+    assert(offset % 65536 == 0)
+    offsets[offset] = true
+    received[#received + 1] = buf:to_s(offset, len)
+    if #received == N then self:close() end
+  end)
+
+  local cli = uv.udp()
+  for i = 1, N do cli:try_send(host, port, "message #" .. i) end
+  cli:close()
+
+  uv.run()
+
+  assert(#received == N, #received)
+  for i = 1, N do assert(received[i] == "message #" .. i) end
+
+  -- datagram truncated
+  if not flags then
+    srv, port = bind_any()
+    local got
+    srv:start_recv(uv.buffer(4), function(self, err, b, offset, len, flags)
+      assert(not err, tostring(err))
+      assert(offset == 0 and len == 4)
+      assert(flags == uv.UDP_PARTIAL)
+      got = b:to_s(offset, len)
+      self:close()
+    end)
+    local cli = uv.udp()
+    cli:try_send(host, port, "123456")
+    cli:close()
+    uv.run()
+    assert(got == "1234")
+  end
+end
+
+local function test_9() -- compact address
+  local a = uv.address(host, 5555)
+  assert(a == uv.address(host, 5555))
+  assert(a ~= uv.address(host, 5556))
+  assert(tostring(a) == "127.0.0.1:5555")
+  assert(a:host() == host and a:port() == 5555)
+  assert(a:family() == "inet")
+  local h, p = a:unpack()
+  assert(h == host and p == 5555)
+  assert(tostring(uv.address("::1", 80)) == "[::1]:80")
+  assert(uv.address("not-an-address", 1) == nil)
+
+  local srv, port = bind_any()
+  srv:compact_address()
+  local addr = uv.address(host, port)
+
+  local cli = uv.udp():bind(host, 0)
+  local peer = cli:compact_address():getsockname()
+  assert(peer == uv.address(cli:compact_address(false):getsockname()))
+
+  local N, received, peers = 5, {}, {}
+  srv:start_recv(function(self, err, data, flags, from, p)
+    assert(not err, tostring(err))
+    assert(from == peer and p == nil)
+    peers[from] = (peers[from] or 0) + 1
+    received[#received + 1] = data
+    if #received == N then self:close() end
+  end)
+
+  assert(cli:try_send(addr, "message #1") == 10)
+  cli:send(addr, "message #2")
+  cli:send_batch({{addr, "message #3"}, {host, port, "message #4"}})
+  cli:queue_send(addr, "message #5")
+
+  uv.run()
+  cli:close()
+  uv.run()
+
+  assert(peers[peer] == N)
+  for i = 1, N do assert(received[i] == "message #" .. i) end
+
+  -- batch receive
+  srv, port = bind_any()
+  local items
+  srv:compact_address():start_recv({batch = 4}, function(self, err, t, n)
+    assert(not err, tostring(err))
+    items = t
+    self:close()
+  end)
+  cli = uv.udp()
+  cli:try_send(uv.address(host, port), "hello")
+  cli:close()
+  uv.run()
+  assert(#items == 3)
+  assert(items[1] == "hello")
+  assert(items[2]:host() == host)
+  assert(items[3] == false)
+
+  -- accepted tcp connection inherits address mode
+  local remote
+  local server = uv.tcp():bind(host, 0):compact_address():listen(function(self, err)
+    assert(not err, tostring(err))
+    remote = self:accept():getpeername()
+    self:close()
+  end)
+  local client = uv.tcp():connect(server:compact_address():getsockname(), function(self, err)
+    assert(not err, tostring(err))
+    self:close()
+  end)
+  uv.run()
+  assert(getmetatable(remote) == getmetatable(peer))
+end
+
+local function test_10() -- address objects in bind and connect errors
+  local srv, port = bind_any()
+  local addr = uv.address(host, port)
+
+  -- port in use
+  local u = uv.udp()
+  local ok, err = u:bind(addr)
+  assert(ok == nil and err and err:name() == "EADDRINUSE", tostring(err))
+  assert(string.find(tostring(err), tostring(addr), 1, true), tostring(err))
+
+  local got
+  u:bind(addr, function(self, err) got = err end)
+  uv.run()
+  assert(got and got:name() == "EADDRINUSE", tostring(got))
+  u:close()
+
+  -- flags after address
+  local a = uv.udp():bind(host, 0, {"reuseaddr"})
+  local b = uv.udp()
+  assert(b:bind(uv.address(a:getsockname()), {"reuseaddr"}) == b)
+  a:close() b:close()
+
+  -- already connected
+  u = uv.udp():connect(addr)
+  ok, err = u:connect(addr)
+  assert(ok == nil and err and err:name() == "EISCONN", tostring(err))
+  assert(string.find(tostring(err), tostring(addr), 1, true), tostring(err))
+
+  -- tcp bind with address
+  local t = uv.tcp():bind(uv.address(host, 0))
+  assert(t:getsockname() == host)
+
+  u:close() srv:close() t:close()
+  uv.run()
+end
+
+if uv.UDP_RECVMMSG then
+  test_1{"recvmmsg"}
+  test_2()
+  test_8{"recvmmsg"}
+end
+
+test_1()
+
+test_3()
+
+test_4()
+
+test_5()
+
+test_6()
+
+test_10()
+
+test_7()
+
+test_7{batch = 4, gro = true}
+
+test_8()
+
+test_9()
+
+print("Done!")
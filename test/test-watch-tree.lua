@@ -0,0 +1,105 @@
+local uv         = require "lluv"
+local watch_tree = require "lluv.watch_tree"
+
+local root = "./test-watch-tree"
+
+local function rmtree(path)
+  local list = uv.fs_scandir(path)
+  if list then
+    for _, name in ipairs(list) do
+      local p = path .. "/" .. name
+      if not uv.fs_unlink(p) then rmtree(p) end
+    end
+    uv.fs_rmdir(path)
+  end
+end
+
+local function collect(paths, events)
+  local t = {}
+  for i = 1, #paths do t[paths[i]] = events[i] end
+  return t
+end
+
+local function test_1() -- new files and subdirectories
+  rmtree(root)
+  assert(uv.fs_mkdir(root))
+  assert(uv.fs_mkdir(root .. "/a"))
+
+  local batches, result = 0
+
+  local watcher = assert(watch_tree(root, {debounce = 100,
+    ready = function(self, err)
+      assert(not err, tostring(err))
+      assert(uv.fs_writefile(root .. "/a/1.txt", "1"))
+      assert(uv.fs_writefile(root .. "/a/1.txt", "11"))
+      assert(uv.fs_mkdir(root .. "/b"))
+      assert(uv.fs_writefile(root .. "/b/2.txt", "2"))
+    end
+  }, function(self, err, paths, events)
+    assert(not err, tostring(err))
+    batches = batches + 1
+    result = collect(paths, events)
+    self:close()
+  end))
+
+  uv.run()
+
+  assert(batches == 1)
+  assert(result["a/1.txt"] == "create", result["a/1.txt"])
+  assert(result["b"] == "create")
+  assert(result["b/2.txt"] == "create")
+end
+
+local function test_2() -- modify, delete and coalescing
+  local n, result = 0
+
+  local watcher = assert(watch_tree(root, {debounce = 100,
+    ready = function(self, err)
+      assert(not err, tostring(err))
+      assert(uv.fs_writefile(root .. "/a/1.txt", "111"))
+      assert(uv.fs_unlink(root .. "/b/2.txt"))
+      assert(uv.fs_writefile(root .. "/b/3.txt", "3"))
+      assert(uv.fs_unlink(root .. "/b/3.txt"))
+    end
+  }, function(self, err, paths, events)
+    assert(not err, tostring(err))
+    result = collect(paths, events)
+    self:close()
+  end))
+
+  assert(watcher:size() >= 1)
+
+  uv.run()
+
+  assert(result["a/1.txt"] == "modify")
+  assert(result["b/2.txt"] == "delete")
+  -- created and removed in same window
+  assert(result["b/3.txt"] == nil)
+end
+
+local function test_3() -- missing root
+  local watcher, err = watch_tree(root .. "/missing", function() end)
+  assert(not watcher and err)
+end
+
+local function test_4() -- alias in core module
+  rmtree(root)
+  assert(uv.fs_mkdir(root))
+
+  local watcher = assert(uv.watch_tree(root, function() end))
+  assert(watcher:root() == root)
+  watcher:close()
+  uv.run()
+
+  local watcher, err = uv.watch_tree(root .. "/missing", function() end)
+  assert(not watcher and err)
+end
+
+test_1()
+test_2()
+test_3()
+test_4()
+
+rmtree(root)
+
+print("Done!")
@@ -0,0 +1,117 @@
+local uv     = require "lluv"
+local writer = require "lluv.writer"
+
+local fname = "./test-writer.txt"
+
+local function read_file()
+  return assert(uv.fs_readfile(fname))
+end
+
+local function test_1() -- coalesce small appends
+  local f = assert(uv.fs_open(fname, "w+"))
+  local w = writer.new(f, {threshold = 1024, interval = 10})
+  local writes, called = 0, 0
+
+  local writev = f.writev
+  getmetatable(f).__index.writev = function(...)
+    writes = writes + 1
+    return writev(...)
+  end
+
+  for i = 1, 100 do
+    w:append(("%.3d;"):format(i), function(self, err)
+      assert(self == w)
+      assert(not err, tostring(err))
+      called = called + 1
+    end)
+  end
+  assert(w:size() == 400)
+
+  w:close(function() f:close() end)
+  uv.run()
+
+  getmetatable(f).__index.writev = writev
+
+  assert(called == 100)
+  assert(writes == 1, writes)
+  local data = read_file()
+  assert(#data == 400)
+  assert(data:sub(1, 8) == "001;002;")
+  assert(data:sub(-4) == "100;")
+end
+
+local function test_2() -- threshold and order
+  local f = assert(uv.fs_open(fname, "w+"))
+  local w = writer.new(f, {threshold = 64, position = 0, sync = true})
+  local t, done = {}
+
+  for i = 1, 3000 do
+    local s = ("%d\n"):format(i)
+    t[#t + 1] = s
+    w:append(s)
+  end
+
+  w:flush(function(self, err)
+    assert(not err, tostring(err))
+    done = true
+    w:close()
+    f:close()
+  end)
+
+  uv.run()
+
+  assert(done)
+  assert(read_file() == table.concat(t))
+end
+
+local function test_3() -- group commit
+  local group = writer.group{interval = 5}
+  local f1 = assert(uv.fs_open(fname, "w+"))
+  local f2 = assert(uv.fs_open(fname .. "2", "w+"))
+  local syncs, called = 0, 0
+
+  local datasync = f1.datasync
+  getmetatable(f1).__index.datasync = function(...)
+    syncs = syncs + 1
+    return datasync(...)
+  end
+
+  local w1 = writer.new(f1, {sync = group})
+  local w2 = writer.new(f2, {sync = group})
+  local w3 = writer.new(f1, {sync = group, position = 100})
+
+  local function cb(self, err)
+    assert(not err, tostring(err))
+    called = called + 1
+  end
+
+  w1:append("hello", cb)
+  w2:append("world", cb)
+  w3:append("!", cb)
+
+  uv.timer():start(50, function(self)
+    self:close()
+    w1:close() w2:close() w3:close()
+    f1:close() f2:close()
+    group:close()
+  end)
+
+  uv.run()
+
+  getmetatable(f1).__index.datasync = datasync
+
+  assert(called == 3)
+  -- one fdatasync per file
+  assert(syncs == 2, syncs)
+  uv.fs_unlink(fname .. "2")
+end
+
+test_1()
+
+test_2()
+
+test_3()
+
+uv.fs_unlink(fname)
+
+print("Done!")